@@ -0,0 +1,132 @@
+#include <burst_capture.hpp>
+
+#include <wall_clock.hpp>
+
+#include <hardware/watchdog.h>
+#include <pico/stdlib.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+constexpr const size_t HEADER_SIZE = 20;
+constexpr const uint64_t WATCHDOG_STEP_US = 1000000;
+
+/* Static so the capture neither uses the heap nor the small main stack */
+std::array<uint8_t, burst_capture::BLOB_CAPACITY> blob_buffer;
+
+template<typename T>
+void put(size_t offset, T value)
+{
+    // the RP2040 is little endian, as the blob
+    std::memcpy(blob_buffer.data() + offset, &value, sizeof(T));
+}
+
+/* Maximum conversion time: 750 ms at 12 bit, halved per bit less */
+constexpr uint64_t conversion_time_us(uint8_t resolution)
+{
+    return (750000 >> (12 - resolution)) + 1000;
+}
+
+struct selected_device
+{
+    uint8_t bus;
+    size_t index;
+};
+}
+
+burst_capture::result burst_capture::run(std::span<ds18b20_host> hosts, const parameters &params)
+{
+    result res{};
+    std::array<selected_device, MAX_DEVICES> selected;
+    size_t device_count = 0;
+    for (size_t bus = 0; bus < std::min(hosts.size(), MAX_BUSES); bus++)
+    {
+        if (!(params.bus_mask & (1u << bus)))
+        {
+            continue;
+        }
+        if (!hosts[bus].set_resolution(params.resolution))
+        {
+            printf("could not set burst resolution on bus %zu\n", bus);
+        }
+        for (size_t i = 0; i < hosts[bus].device_count() && device_count < MAX_DEVICES; i++)
+        {
+            selected[device_count++] = {uint8_t(bus), i};
+        }
+    }
+
+    const size_t record_size = sizeof(uint32_t) + device_count * sizeof(int16_t);
+    const size_t data_offset = HEADER_SIZE + device_count * sizeof(uint64_t);
+    const size_t max_conversions = std::min<size_t>((BLOB_CAPACITY - data_offset) / record_size, UINT16_MAX);
+
+    blob_length = data_offset;
+    std::memcpy(blob_buffer.data(), "OWB1", 4);
+    put<uint8_t>(4, params.resolution);
+    put<uint8_t>(5, uint8_t(device_count));
+    put<uint16_t>(8, params.period_ms);
+    put<uint16_t>(10, 0);
+    for (size_t d = 0; d < device_count; d++)
+    {
+        put<uint64_t>(HEADER_SIZE + d * sizeof(uint64_t), hosts[selected[d].bus].identifier(selected[d].index));
+    }
+    if (device_count == 0)
+    {
+        put<uint16_t>(6, 0);
+        put<uint64_t>(12, 0);
+        return res;
+    }
+
+    const uint64_t period_us = uint64_t(params.period_ms) * 1000;
+    const uint64_t start_us = time_us_64();
+    const uint64_t end_us = start_us + uint64_t(params.duration_s) * 1000000;
+    put<uint64_t>(12, wall_clock::to_unix_us(start_us) / 1000);
+
+    /* Conversions start every period, back to back if a cycle takes
+       longer than the period */
+    uint64_t deadline_us = start_us;
+    while (deadline_us < end_us && res.conversions < max_conversions)
+    {
+        /* A capture and a period may take longer than the watchdog
+           timeout, the steps of a cycle do not */
+        while (time_us_64() < deadline_us)
+        {
+            watchdog_update();
+            sleep_until(from_us_since_boot(std::min(deadline_us, time_us_64() + WATCHDOG_STEP_US)));
+        }
+        const uint64_t conversion_start_us = time_us_64();
+        for (size_t bus = 0; bus < std::min(hosts.size(), MAX_BUSES); bus++)
+        {
+            if (params.bus_mask & (1u << bus))
+            {
+                hosts[bus].convert_all();
+            }
+        }
+        sleep_until(from_us_since_boot(conversion_start_us + conversion_time_us(params.resolution)));
+
+        put<uint32_t>(blob_length, (conversion_start_us - start_us) / 1000);
+        blob_length += sizeof(uint32_t);
+        for (size_t d = 0; d < device_count; d++)
+        {
+            auto raw = hosts[selected[d].bus].read_temperature(selected[d].index);
+            if (raw)
+            {
+                res.samples[selected[d].bus]++;
+            }
+            put<int16_t>(blob_length, raw.value_or(MISSING));
+            blob_length += sizeof(int16_t);
+        }
+        res.conversions++;
+
+        deadline_us = std::max(deadline_us + period_us, time_us_64());
+    }
+    res.duration_us = time_us_64() - start_us;
+    put<uint16_t>(6, uint16_t(res.conversions));
+    return res;
+}
+
+std::span<const uint8_t> burst_capture::blob() const
+{
+    return {blob_buffer.data(), blob_length};
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <ds18b20_host.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+/* High-rate acquisition for short capture windows: the devices on the
+   selected buses convert back to back at a reduced resolution, the raw
+   readings are streamed into a preallocated buffer and uploaded as one
+   binary blob after the capture.
+
+   Blob layout, little endian:
+     0  char[4]   magic "OWB1"
+     4  uint8     resolution
+     5  uint8     device count n
+     6  uint16    conversion count
+     8  uint16    period in ms
+     10 uint16    reserved, 0
+     12 uint64    start of the capture, UNIX ms (0 if not synchronized)
+     20 uint64[n] device identifiers
+     then per conversion:
+        uint32    ms since the start of the capture
+        int16[n]  raw readings in 1/16 degC, INT16_MIN if not read */
+class burst_capture
+{
+  public:
+    static constexpr const size_t MAX_BUSES = 8;
+    static constexpr const size_t MAX_DEVICES = 32;
+    static constexpr const size_t BLOB_CAPACITY = 32 * 1024;
+    static constexpr const int16_t MISSING = INT16_MIN;
+
+    struct parameters
+    {
+        uint8_t resolution;
+        uint16_t period_ms;   // conversions start back to back if shorter than a cycle
+        uint16_t duration_s;
+        uint8_t bus_mask;     // bit i selects hosts[i]
+    };
+
+    struct result
+    {
+        uint32_t conversions;
+        uint64_t duration_us;
+        std::array<uint32_t, MAX_BUSES> samples; // readings per bus
+    };
+
+    /* Capture until the duration has passed or the buffer is full.
+       The resolution of the selected hosts is left at
+       parameters::resolution, the caller restores it. */
+    result run(std::span<ds18b20_host> hosts, const parameters &params);
+
+    /* The blob of the last capture */
+    std::span<const uint8_t> blob() const;
+
+  private:
+    size_t blob_length = 0;
+};
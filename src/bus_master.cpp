@@ -0,0 +1,188 @@
+#include <bus_master.hpp>
+
+#include <onewire_defs.hpp>
+#include <trace.hpp>
+
+#include <cstdio>
+#include <stdexcept>
+
+namespace
+{
+constexpr const int CHECKSUM_RETRIES = 10;
+
+/* Directions to take at discrepancies when continuing the search
+   after last_device_id: follow last_device_id before the most
+   significant discrepancy, go down the 1-direction at it and down
+   the 0-direction after it. */
+uint64_t discrepancy_directions(uint64_t last_device_id, int8_t most_significant_discrepancy)
+{
+    if (most_significant_discrepancy < 0)
+    {
+        return 0;
+    }
+    uint64_t below_discrepancy = (uint64_t(1) << most_significant_discrepancy) - 1;
+    return (last_device_id & below_discrepancy) | (uint64_t(1) << most_significant_discrepancy);
+}
+}// namespace
+
+uint8_t calc_crc8(const uint8_t* data, const size_t size)
+{
+    // See Application Note 27
+    uint8_t crc8 = 0;
+    for (size_t j = 0; j < size; j++)
+    {
+        crc8 = crc8 ^ data[j];
+        for (int i = 0; i < 8; ++i)
+        {
+            if (crc8 & 1)
+                crc8 = (crc8 >> 1) ^ 0x8c;
+            else
+                crc8 = (crc8 >> 1);
+        }
+    }
+
+    return crc8;
+}
+
+bool bus_master::select(uint64_t device_id, speed device_speed) const
+{
+    /* A reset at standard speed returns all devices to standard speed */
+    set_speed(speed::standard);
+    if (!reset())
+    {
+        return false;
+    }
+
+    if (device_speed == speed::overdrive)
+    {
+        /* The command is sent at standard speed, the ROM id already
+           at overdrive speed */
+        transmit(ONEWIRE_OVERDRIVE_MATCH_ROM_COMMAND);
+        set_speed(speed::overdrive);
+    }
+    else
+    {
+        transmit(ONEWIRE_MATCH_ROM_COMMAND);
+    }
+    for (int i = 0; i < 8; i++)
+    {
+        transmit(reinterpret_cast<const uint8_t*>(&device_id)[i]);
+    }
+    return true;
+}
+
+bool bus_master::skip_rom(speed bus_speed) const
+{
+    set_speed(speed::standard);
+    if (!reset())
+    {
+        return false;
+    }
+
+    if (bus_speed == speed::overdrive)
+    {
+        transmit(ONEWIRE_OVERDRIVE_SKIP_ROM_COMMAND);
+        set_speed(speed::overdrive);
+    }
+    else
+    {
+        transmit(ONEWIRE_SKIP_ROM_COMMAND);
+    }
+    return true;
+}
+
+bus_master::search_bits bus_master::run_search(uint64_t directions) const
+{
+    search_bits bits{0, 0};
+    for (unsigned bit_id = 0; bit_id < 64; bit_id++)
+    {
+        auto [id_bit, complement_bit, direction] = triplet((directions >> bit_id) & 0b1);
+        bits.id |= uint64_t(id_bit) << bit_id;
+        bits.complement |= uint64_t(complement_bit) << bit_id;
+    }
+    return bits;
+}
+
+std::optional<bus_master::search_state> bus_master::incremental_search(const search_state& state, uint8_t search_command) const
+{
+    const auto [last_device_id, most_significant_discrepancy] = state;
+
+    if(!reset())
+    {
+        return {};
+    }
+
+    transmit(search_command);
+
+    const uint64_t directions = discrepancy_directions(last_device_id, most_significant_discrepancy);
+    const auto [id_bits, complement_bits] = run_search(directions);
+
+    uint64_t device_id = 0;
+    int8_t discrepancy = 64;
+    for (int8_t bit_id = 0; bit_id < 64; bit_id++)
+    {
+        bool id_bit = (id_bits >> bit_id) & 0b1;
+        bool complement_bit = (complement_bits >> bit_id) & 0b1;
+        if (id_bit && complement_bit) // no devices left
+        {
+            return {};
+        }
+        // all remaining devices agree on the current bit, or at a discrepancy, the supplied direction was taken
+        bool search_direction = (id_bit != complement_bit) ? id_bit : ((directions >> bit_id) & 0b1);
+        if (!id_bit && !complement_bit && !search_direction)
+        {
+            discrepancy = bit_id; // we hit a discrepancy and are going down the 0-direction, *insert NOTED-meme*
+        }
+
+        device_id += uint64_t(search_direction) << bit_id;
+    }
+    return {search_state{device_id, discrepancy}};
+}
+
+std::vector<uint64_t> bus_master::search() const
+{
+    return search(ONEWIRE_SEARCH_COMMAND);
+}
+
+std::vector<uint64_t> bus_master::alarm_search() const
+{
+    return search(ONEWIRE_ALARM_SEARCH_COMMAND);
+}
+
+std::vector<uint64_t> bus_master::search(uint8_t search_command) const
+{
+    TRACE_SCOPE(onewire_search, trace_id());
+    std::vector<uint64_t> device_ids;
+
+    /* The search always runs at standard speed */
+    set_speed(speed::standard);
+
+    int8_t most_significant_discrepancy = -1;
+    uint64_t last_device_id = 0;
+    int checksum_fails = 0;
+    while (most_significant_discrepancy != 64)
+    {
+        auto search_result = incremental_search({last_device_id, most_significant_discrepancy}, search_command);
+        if(!search_result.has_value())
+        {
+            return device_ids;
+        }
+        auto [device_id, discrepancy] = search_result.value();
+        if(calc_crc8((uint8_t*)&device_id, sizeof(decltype(device_id))))
+        {
+            // checksum is invalid, something went wrong, try again
+            printf("checksum of device %llu invalid\n", device_id);
+            checksum_fails++;
+            if(checksum_fails > CHECKSUM_RETRIES)
+            {
+                throw std::runtime_error("Max checksum fails exceeded.");
+            }
+            continue;
+        }
+        last_device_id = device_id;
+        most_significant_discrepancy = discrepancy;
+        device_ids.push_back(device_id);
+    }
+
+    return device_ids;
+}
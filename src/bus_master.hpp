@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <tuple>
+#include <vector>
+
+uint8_t calc_crc8(const uint8_t* data, const size_t size);
+
+/* A 1-Wire bus master: the primitives a backend implements (reset,
+   bytes, triplets, strong pullup) and the ROM functions built on them.
+   Backends are the PIO master (onewire) and the channels of a DS2482
+   I2C bridge (ds2482_channel). A backend that gets stuck throws
+   std::runtime_error after recovering to the idle state. */
+class bus_master
+{
+  public:
+    enum class speed
+    {
+        standard,
+        overdrive
+    };
+
+    struct triplet_result
+    {
+        bool id_bit;
+        bool complement_bit;
+        bool direction; // the direction that was written
+    };
+
+    using search_state = std::tuple<uint64_t, int8_t>;
+
+    virtual ~bus_master() = default;
+
+    /* Reset at the current speed. Only overdrive capable devices
+       which have been switched to overdrive respond to a reset
+       at overdrive speed. Returns 1 if a presence pulse was detected. */
+    virtual int reset() const = 0;
+
+    /* Switch the timing of the master, devices are switched by
+       select and skip_rom */
+    virtual void set_speed(speed bus_speed) const = 0;
+    virtual speed get_speed() const = 0;
+
+    /* Recompute clock dependent settings after clk_sys has changed.
+       Call while no transfer is in progress. Throws std::runtime_error
+       if the master was stuck, it is usable again with the new clock. */
+    virtual void clock_changed() const {}
+
+    virtual void transmit(uint8_t byte) const = 0;
+    virtual uint8_t receive() const = 0;
+
+    /* Transmit a byte and activate the strong pullup after the last
+       bit, until disable_pull_up */
+    virtual void transmit_then_pull_up(uint8_t byte) const = 0;
+    virtual void disable_pull_up() const = 0;
+
+    /**
+     * @brief Execute one step of the ROM search: read the id bit and its
+     * complement, then write the direction. If the devices agree on the
+     * id bit, it is taken as direction, otherwise direction_on_discrepancy.
+     */
+    virtual triplet_result triplet(bool direction_on_discrepancy) const = 0;
+
+    /* How the ROM search runs, for diagnostics */
+    virtual const char* search_method() const { return "triplets"; }
+
+    /* Distinguishes the buses in traces */
+    virtual uint16_t trace_id() const = 0;
+
+    /* Reset at standard speed and address a single device (MATCH ROM).
+       With overdrive, OVERDRIVE MATCH ROM switches the device and the
+       master to overdrive until the next select.
+       Returns false if no device was present. */
+    bool select(uint64_t device_id, speed device_speed = speed::standard) const;
+
+    /* Reset at standard speed and address all devices (SKIP ROM).
+       With overdrive, OVERDRIVE SKIP ROM switches all overdrive
+       capable devices and the master to overdrive.
+       Returns false if no device was present. */
+    bool skip_rom(speed bus_speed = speed::standard) const;
+
+    /**
+     * @brief Incrementally search new devices by passing the last discrepancy
+     * point to the next iteration. This does not work with hot-swapping devices.
+     * When a new device is connected, a new search has to be started, i.e.,
+     * last_discrepancy has to be 0. When this function returns no values, the
+     * search has to be started from scratch, too.
+     *
+     * @param last_discrepancy The last discrepancy of the previous iteration.
+     *     Initialize with 0.
+     * @param search_command SEARCH ROM or ALARM SEARCH
+     * @return new device id, new last discrepancy
+     */
+    std::optional<search_state> incremental_search(const search_state& state, uint8_t search_command) const;
+
+    /* Search all devices (SEARCH ROM) */
+    std::vector<uint64_t> search() const;
+
+    /* Search the devices whose alarm flag is set (ALARM SEARCH) */
+    std::vector<uint64_t> alarm_search() const;
+
+  protected:
+    struct search_bits
+    {
+        uint64_t id;
+        uint64_t complement;
+    };
+
+    /* Run the 64 triplets of one search pass after the search command,
+       taking the given directions at discrepancies. Backends with a
+       faster way than single triplets override it. */
+    virtual search_bits run_search(uint64_t directions) const;
+
+  private:
+    std::vector<uint64_t> search(uint8_t search_command) const;
+};
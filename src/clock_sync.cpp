@@ -0,0 +1,27 @@
+#include <clock_sync.hpp>
+
+uint64_t clock_sync::extrapolate(const synchronization& sync, uint64_t local_us)
+{
+    int64_t elapsed = int64_t(local_us - sync.local_us);
+    int64_t correction = elapsed / 1000 * sync.drift_ppb / 1000000;
+    return sync.unix_us + elapsed - correction;
+}
+
+void clock_sync::update(synchronization& sync, uint64_t local_us, uint64_t unix_us)
+{
+    if (sync.valid && local_us - sync.local_us >= MIN_DRIFT_INTERVAL_US)
+    {
+        /* Remaining error of the extrapolation over the last interval,
+           relative to the interval */
+        int64_t local_elapsed = int64_t(local_us - sync.local_us);
+        int64_t error_us = int64_t(extrapolate(sync, local_us) - unix_us);
+        int64_t error_ppb = error_us * 1000000 / (local_elapsed / 1000);
+        if (error_ppb < MAX_DRIFT_PPB && error_ppb > -MAX_DRIFT_PPB)
+        {
+            sync.drift_ppb += int32_t(error_ppb);
+        }
+    }
+    sync.local_us = local_us;
+    sync.unix_us = unix_us;
+    sync.valid = true;
+}
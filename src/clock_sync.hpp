@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+
+/* Drift-corrected extrapolation of the wall clock between two time
+   server updates, for wall_clock. The drift of the local clock is
+   corrected by the remaining error of the extrapolation at each update.
+
+   Does not depend on the SDK and is checked on the host by
+   tools/clock_check. */
+namespace clock_sync
+{
+/* Updates closer together than this are too short to measure drift */
+constexpr const uint64_t MIN_DRIFT_INTERVAL_US = 60 * 1000 * 1000;
+/* Drift beyond this is a time step on the server, not drift */
+constexpr const int64_t MAX_DRIFT_PPB = 500 * 1000;
+
+struct synchronization
+{
+    bool valid = false;
+    uint64_t local_us = 0;
+    uint64_t unix_us = 0;
+    int32_t drift_ppb = 0; // local clock runs fast by this
+};
+
+/* UNIX time in us of a local time in us */
+uint64_t extrapolate(const synchronization& sync, uint64_t local_us);
+
+/* Takes the UNIX time from the server at a local time in us as the new
+   synchronization point, correcting the drift by the error of the
+   extrapolation since the last one */
+void update(synchronization& sync, uint64_t local_us, uint64_t unix_us);
+}
@@ -0,0 +1,32 @@
+#include <command_handler.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+command_handler::command_handler(mqtt_client& client_in, const char* result_topic_in, apply_function apply_in):
+    client(client_in), result_topic(result_topic_in), apply(std::move(apply_in))
+{}
+
+bool command_handler::handle_received()
+{
+    bool handled = false;
+    while (client.poll(message))
+    {
+        auto cmd = parse_command(message.payload.data(), message.payload_length);
+        const char* result = "error malformed command";
+        try
+        {
+            result = cmd ? apply(*cmd) : result;
+        } catch (std::runtime_error& err)
+        {
+            printf("command failed: %s\n", err.what());
+            result = "error bus failed";
+        }
+        printf("command %.*s: %s\n", int(message.payload_length), message.payload.data(), result);
+        client.publish(result_topic, result, strlen(result));
+        handled = true;
+    }
+    return handled;
+}
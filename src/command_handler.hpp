@@ -0,0 +1,30 @@
+#pragma once
+
+#include <commands.hpp>
+#include <mqtt_client.hpp>
+
+#include <functional>
+
+/* Answers the commands received on the subscription of a client: each
+   message is parsed, applied and answered on the result topic, in the
+   order received. The apply function returns the answer, a command it
+   fails with std::runtime_error (a stuck bus) is answered with an
+   error. */
+class command_handler
+{
+  public:
+    using apply_function = std::function<const char*(const command&)>;
+
+    /* The result topic has to outlive the handler */
+    command_handler(mqtt_client& client, const char* result_topic, apply_function apply);
+
+    /* Handles the messages in the inbox of the client. Returns whether
+       there were any. */
+    bool handle_received();
+
+  private:
+    mqtt_client& client;
+    const char* result_topic;
+    apply_function apply;
+    mqtt_message message;
+};
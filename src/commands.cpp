@@ -0,0 +1,110 @@
+#include <commands.hpp>
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <string_view>
+
+namespace
+{
+constexpr const size_t MAX_ARGUMENTS = 5;
+
+/* Splits at spaces, returns the number of tokens or MAX_ARGUMENTS + 1
+   if there are too many */
+size_t tokenize(std::string_view text, std::array<std::string_view, MAX_ARGUMENTS>& tokens)
+{
+    size_t count = 0;
+    while (!text.empty())
+    {
+        auto start = text.find_first_not_of(" \t\r\n");
+        if (start == std::string_view::npos)
+        {
+            break;
+        }
+        text.remove_prefix(start);
+        auto end = std::min(text.find_first_of(" \t\r\n"), text.size());
+        if (count == MAX_ARGUMENTS)
+        {
+            return MAX_ARGUMENTS + 1;
+        }
+        tokens[count++] = text.substr(0, end);
+        text.remove_prefix(end);
+    }
+    return count;
+}
+
+template<typename T>
+std::optional<T> parse_number(std::string_view token)
+{
+    T value;
+    auto [end, error] = std::from_chars(token.data(), token.data() + token.size(), value);
+    if (error != std::errc() || end != token.data() + token.size())
+    {
+        return {};
+    }
+    return value;
+}
+}
+
+std::optional<command> parse_command(const char* payload, size_t length)
+{
+    std::array<std::string_view, MAX_ARGUMENTS> tokens;
+    auto count = tokenize(std::string_view(payload, length), tokens);
+    if (count == 0 || count > MAX_ARGUMENTS)
+    {
+        return {};
+    }
+
+    const auto name = tokens[0];
+    if (name == "interval" && count == 3)
+    {
+        auto group = parse_number<uint8_t>(tokens[1]);
+        auto interval_ms = parse_number<uint32_t>(tokens[2]);
+        if (!group || !interval_ms || *interval_ms == 0)
+        {
+            return {};
+        }
+        return command{command::type::set_interval, *group, *interval_ms};
+    }
+    if (name == "resolution" && count == 2)
+    {
+        auto bits = parse_number<uint32_t>(tokens[1]);
+        if (!bits || *bits < 9 || *bits > 12)
+        {
+            return {};
+        }
+        return command{command::type::set_resolution, 0, *bits};
+    }
+    if (name == "rescan" && count == 1)
+    {
+        return command{command::type::rescan};
+    }
+    if (name == "stats" && count == 1)
+    {
+        return command{command::type::fetch_stats};
+    }
+    if (name == "sample" && count == 1)
+    {
+        return command{command::type::sample_now};
+    }
+    if (name == "trace" && count == 1)
+    {
+        return command{command::type::dump_trace};
+    }
+    if (name == "burst" && count == 5)
+    {
+        auto bits = parse_number<uint8_t>(tokens[1]);
+        auto period_ms = parse_number<uint16_t>(tokens[2]);
+        auto duration_s = parse_number<uint16_t>(tokens[3]);
+        auto bus_mask = parse_number<uint8_t>(tokens[4]);
+        if (!bits || *bits < 9 || *bits > 12 || !period_ms || !duration_s || *duration_s == 0
+            || *duration_s > command::burst_parameters::MAX_DURATION_S || !bus_mask)
+        {
+            return {};
+        }
+        command cmd{command::type::burst};
+        cmd.burst = {*bits, *period_ms, *duration_s, *bus_mask};
+        return cmd;
+    }
+    return {};
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+/* Compact text commands received over MQTT, one per message:
+
+     interval <group> <ms>   set the sampling interval of a group
+     resolution <9..12>      set the resolution of all devices
+     rescan                  search the buses for devices again
+     stats                   publish the statistics
+     sample                  sample all groups now
+     burst <9..12> <period ms> <1..600 s> <bus mask>
+                             capture back-to-back conversions
+     trace                   dump the trace ring
+
+   Parsing does not allocate. */
+struct command
+{
+    enum class type
+    {
+        set_interval,
+        set_resolution,
+        rescan,
+        fetch_stats,
+        sample_now,
+        burst,
+        dump_trace
+    };
+
+    struct burst_parameters
+    {
+        /* The capture blocks the main loop, commands and sweeps wait */
+        static constexpr const uint16_t MAX_DURATION_S = 600;
+
+        uint8_t resolution;
+        uint16_t period_ms;
+        uint16_t duration_s;
+        uint8_t bus_mask;
+    };
+
+    type command_type;
+    uint8_t group = 0;
+    uint32_t value = 0;
+    burst_parameters burst{};
+};
+
+/* Returns no value for malformed commands */
+std::optional<command> parse_command(const char* payload, size_t length);
@@ -1,6 +1,10 @@
 #include <ds18b20_host.hpp>
 
 #include <onewire_defs.hpp>
+#include <trace.hpp>
+
+#include <hardware/watchdog.h>
+#include <pico/stdlib.h>
 
 #include <algorithm>
 #include <cstddef>
@@ -11,6 +15,8 @@ namespace
 {
 constexpr const uint DS18B20_FAMILY_CODE = 0x28;
 
+constexpr const uint8_t MAX_OVERDRIVE_CRC_FAILS = 3;
+
 constexpr const uint DS18B20_CONVERT_T_COMMAND = 0x44;
 constexpr const uint DS18B20_READ_SCRATCHPAD_COMMAND = 0xbe;
 constexpr const uint DS18B20_WRITE_SCRATCHPAD_COMMAND = 0x4e;
@@ -19,57 +25,295 @@ constexpr const uint DS18B20_RECALL_E2_COMMAND = 0xB8;
 constexpr const uint DS18B20_READ_POWER_SUPPLY_COMMAND = 0xB4;
 }
 
-ds18b20_host::ds18b20_host(const onewire &wire_in):
-    wire(wire_in)
+ds18b20_host::ds18b20_host(const bus_master &wire_in, const sample_processor::config &processing):
+    wire(wire_in), default_processing(processing)
+{
+    rescan();
+}
+
+ds18b20_host::ds18b20_host(const bus_master &wire_in, const sample_processor::config &processing, std::span<const table_entry> table):
+    wire(wire_in), default_processing(processing)
+{
+    for (const auto& entry: table)
+    {
+        devices.push_back({entry.identifier, 0, entry.speed, 0, sample_processor(default_processing), entry.alarm_low, entry.alarm_high});
+    }
+    wire.set_speed(bus_master::speed::standard);
+}
+
+void ds18b20_host::rescan()
 {
+    auto search_start = time_us_64();
     auto device_ids = wire.search();
+    auto search_duration = time_us_64() - search_start;
+    if (!device_ids.empty())
+    {
+        printf("Search took %llu us (%llu us per device, %s)\n",
+            search_duration,
+            search_duration / device_ids.size(),
+            wire.search_method());
+    }
 
+    /* Probing takes a scratchpad read per device: a long bus must not
+       starve the watchdog */
+    std::vector<device> found;
     for(auto identifier: device_ids)
     {
+        watchdog_update();
         if(!(identifier & DS18B20_FAMILY_CODE))
         {
             continue;
         }
-        devices.push_back({identifier, 0});
-        printf("device found: %llx\n", identifier);
+        auto known = std::find_if(devices.begin(), devices.end(), [identifier](const device &dev) {
+            return dev.identifier == identifier;
+        });
+        if (known != devices.end())
+        {
+            found.push_back(std::move(*known));
+            continue;
+        }
+
+        found.push_back({identifier, 0, bus_master::speed::overdrive, 0, sample_processor(default_processing)});
+        auto& dev = found.back();
+
+        // Probe overdrive support: devices without it ignore OVERDRIVE MATCH ROM
+        // and the scratchpad read fails its CRC. The DS18B20 has none, so the
+        // probe does not count as a read or a CRC error of the bus.
+        uint8_t buf[9];
+        if (transfer_scratchpad(dev, buf) != transfer_status::ok)
+        {
+            dev.speed = bus_master::speed::standard;
+        }
+        printf("device found: %llx%s\n", identifier, dev.speed == bus_master::speed::overdrive ? " (overdrive)" : "");
     }
+    devices = std::move(found);
+    wire.set_speed(bus_master::speed::standard);
     printf("Found %zu devices\n", devices.size());
 }
 
-void ds18b20_host::request_readings() const
+std::vector<ds18b20_host::table_entry> ds18b20_host::device_table() const
+{
+    std::vector<table_entry> table;
+    for (const auto& dev: devices)
+    {
+        table.push_back({dev.identifier, dev.speed, dev.alarm_low, dev.alarm_high});
+    }
+    return table;
+}
+
+void ds18b20_host::assign_group(uint64_t identifier, uint8_t group, const sample_processor::config &processing)
+{
+    for (auto& dev: devices)
+    {
+        if (dev.identifier == identifier)
+        {
+            dev.group = group;
+            dev.processor.configure(processing);
+        }
+    }
+}
+
+bool ds18b20_host::is_due(const device &dev, sweep_scheduler::group_mask due) const
+{
+    return due.test(dev.group);
+}
+
+bool ds18b20_host::request_readings(sweep_scheduler::group_mask due)
 {
-    if (!wire.reset())
+    /* One conversion on the whole bus serves all due groups */
+    if (std::none_of(devices.begin(), devices.end(), [&](const device &dev) { return is_due(dev, due); }))
+    {
+        return false;
+    }
+    return convert_all();
+}
+
+bool ds18b20_host::convert_all()
+{
+    TRACE_SCOPE(ds18b20_convert);
+    if (!wire.skip_rom())
     {
         printf("wire reset failed\n");
-        return;
+        health_counters.reset_failures++;
+        return false;
     }
-    wire.transmit(ONEWIRE_SKIP_ROM_COMMAND);
+    /* The conversion starts with the last bit of the command */
     wire.transmit(DS18B20_CONVERT_T_COMMAND);
+    conversion_start_us = time_us_64();
+    health_counters.conversions++;
+    return true;
 }
 
-std::vector<ds18b20_host::reading> ds18b20_host::retrieve_readings()
+std::optional<int16_t> ds18b20_host::read_temperature(size_t index)
 {
-    std::vector<reading> readings;
-    for(const auto& dev: devices)
+    uint8_t buf[9];
+    if (read_scratchpad(devices[index], buf) != transfer_status::ok)
+    {
+        return {};
+    }
+    int16_t raw;
+    std::memcpy(&raw, buf, sizeof(int16_t));
+    return raw;
+}
+
+ds18b20_host::transfer_status ds18b20_host::read_scratchpad(device &dev, uint8_t (&buf)[9])
+{
+    TRACE_SCOPE(ds18b20_read_scratchpad);
+    health_counters.reads++;
+    const auto status = transfer_scratchpad(dev, buf);
+    if (status == transfer_status::no_presence)
+    {
+        health_counters.reset_failures++;
+        return status;
+    }
+    if (status == transfer_status::crc_failed)
+    {
+        dev.crc_fails++;
+        health_counters.crc_errors++;
+        return status;
+    }
+    dev.crc_fails = 0;
+    return status;
+}
+
+ds18b20_host::transfer_status ds18b20_host::transfer_scratchpad(const device &dev, uint8_t (&buf)[9]) const
+{
+    if (!wire.select(dev.identifier, dev.speed))
+    {
+        return transfer_status::no_presence;
+    }
+
+    wire.transmit(DS18B20_READ_SCRATCHPAD_COMMAND);
+    for(int i = 0; i < 9; i++)
     {
-        if (!wire.reset())
+        buf[i] = wire.receive();
+    }
+    if (calc_crc8(buf, 8) != buf[8])
+    {
+        return transfer_status::crc_failed;
+    }
+    return transfer_status::ok;
+}
+
+bool ds18b20_host::write_scratchpad(device &dev, int8_t high, int8_t low, uint8_t configuration)
+{
+    TRACE_SCOPE(ds18b20_write_scratchpad);
+    if (!wire.select(dev.identifier, dev.speed))
+    {
+        return false;
+    }
+    wire.transmit(DS18B20_WRITE_SCRATCHPAD_COMMAND);
+    wire.transmit(high);
+    wire.transmit(low);
+    wire.transmit(configuration);
+
+    uint8_t buf[9];
+    return read_scratchpad(dev, buf) == transfer_status::ok
+        && int8_t(buf[2]) == high && int8_t(buf[3]) == low && buf[4] == configuration;
+}
+
+bool ds18b20_host::write_alarm_limits(device &dev, int8_t low, int8_t high)
+{
+    uint8_t buf[9];
+    // keeps the configuration, i.e. the resolution
+    if (read_scratchpad(dev, buf) != transfer_status::ok || !write_scratchpad(dev, high, low, buf[4]))
+    {
+        return false;
+    }
+    dev.alarm_low = low;
+    dev.alarm_high = high;
+    return true;
+}
+
+bool ds18b20_host::set_resolution(uint8_t bits)
+{
+    const uint8_t configuration = ((bits - 9) << 5) | 0x1f;
+    bool written = true;
+    for (auto& dev: devices)
+    {
+        watchdog_update();
+        uint8_t buf[9];
+        // keeps the alarm limits
+        written = read_scratchpad(dev, buf) == transfer_status::ok
+            && write_scratchpad(dev, int8_t(buf[2]), int8_t(buf[3]), configuration)
+            && written;
+    }
+    return written;
+}
+
+bool ds18b20_host::set_alarm_limits(int8_t low, int8_t high)
+{
+    bool written = true;
+    for (auto& dev: devices)
+    {
+        watchdog_update();
+        written = write_alarm_limits(dev, low, high) && written;
+    }
+    return written;
+}
+
+bool ds18b20_host::set_alarm_limits(uint64_t identifier, int8_t low, int8_t high)
+{
+    bool written = true;
+    for (auto& dev: devices)
+    {
+        if (dev.identifier == identifier)
+        {
+            written = write_alarm_limits(dev, low, high) && written;
+        }
+    }
+    return written;
+}
+
+std::vector<ds18b20_host::alarm_event> ds18b20_host::check_alarms()
+{
+    TRACE_SCOPE(ds18b20_check_alarms);
+    std::vector<alarm_event> events;
+    const auto alarmed = wire.alarm_search();
+    for (auto& dev: devices)
+    {
+        bool in_alarm = std::find(alarmed.begin(), alarmed.end(), dev.identifier) != alarmed.end();
+        if (in_alarm == dev.in_alarm)
         {
-            printf("wire reset failed\n");
             continue;
         }
-        wire.transmit(ONEWIRE_MATCH_ROM_COMMAND);
-        for (int i = 0; i < 8; i++)
+
+        uint8_t buf[9];
+        if (read_scratchpad(dev, buf) != transfer_status::ok)
+        {
+            continue; // retried after the next conversion
+        }
+        int16_t raw;
+        std::memcpy(&raw, buf, sizeof(int16_t));
+        dev.in_alarm = in_alarm;
+
+        auto type = alarm_event::kind::cleared;
+        if (in_alarm)
         {
-            wire.transmit(reinterpret_cast<const uint8_t*>(&dev.identifier)[i]);
+            type = raw >= dev.alarm_high * 16 ? alarm_event::kind::high : alarm_event::kind::low;
         }
+        events.push_back({dev.identifier, raw, type});
+    }
+    return events;
+}
 
-        wire.transmit(DS18B20_READ_SCRATCHPAD_COMMAND);
+std::vector<ds18b20_host::reading> ds18b20_host::retrieve_readings(sweep_scheduler::group_mask due)
+{
+    std::vector<reading> readings;
+    for(auto& dev: devices)
+    {
+        if (!is_due(dev, due))
+        {
+            continue;
+        }
         uint8_t buf[9];
-        for(int i = 0; i < 9; i++)
+        auto status = read_scratchpad(dev, buf);
+        if (status == transfer_status::no_presence)
         {
-            buf[i] = wire.receive();
+            printf("wire reset failed\n");
+            continue;
         }
-        if (calc_crc8(buf, 8) != buf[8])
+        if (status == transfer_status::crc_failed)
         {
             printf("crc failed ");
             for (int i = 0; i < 9; i++)
@@ -77,11 +321,20 @@ std::vector<ds18b20_host::reading> ds18b20_host::retrieve_readings()
                 printf("%hhu ", buf[i]);
             }
             printf("\n");
+            if (dev.speed == bus_master::speed::overdrive && dev.crc_fails >= MAX_OVERDRIVE_CRC_FAILS)
+            {
+                // fall back to standard speed for devices unreliable at overdrive
+                printf("device %llx falls back to standard speed\n", dev.identifier);
+                dev.speed = bus_master::speed::standard;
+            }
             continue;
         }
-        reading read{dev.identifier, 0};
-        std::memcpy(&read.temperature, buf, sizeof(uint16_t));
-        readings.push_back(read);
+        int16_t raw;
+        std::memcpy(&raw, buf, sizeof(int16_t));
+        if (auto rep = dev.processor.add(raw))
+        {
+            readings.push_back({dev.identifier, rep->value, rep->min, rep->max, rep->mean});
+        }
     }
     return readings;
 }
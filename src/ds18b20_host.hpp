@@ -1,30 +1,137 @@
 #pragma once
 
-#include <onewire.hpp>
+#include <bus_master.hpp>
+#include <sample_processor.hpp>
+#include <sweep_scheduler.hpp>
 
 #include <cstdint>
+#include <optional>
+#include <span>
 #include <vector>
 
 class ds18b20_host
 {
   public:
+    /* Temperatures in 1/16 degC */
     struct reading
     {
         uint64_t identifier;
-        uint16_t temperature;
+        int16_t temperature; // filtered
+        int16_t min;
+        int16_t max;
+        int16_t mean;
     };
 
-    ds18b20_host(const onewire &wire);
+    struct alarm_event
+    {
+        enum class kind
+        {
+            high,
+            low,
+            cleared
+        };
+
+        uint64_t identifier;
+        int16_t temperature; // 1/16 degC
+        kind type;
+    };
+
+    /* Counters since start */
+    struct bus_health
+    {
+        uint32_t conversions;
+        uint32_t reads;
+        uint32_t reset_failures; // no presence pulse
+        uint32_t crc_errors;
+    };
+
+    /* What the host knows about a device beyond its readings */
+    struct table_entry
+    {
+        uint64_t identifier;
+        bus_master::speed speed;
+        int8_t alarm_low;
+        int8_t alarm_high;
+    };
 
-    void request_readings() const;
-    std::vector<reading> retrieve_readings();
+    /* Searches the bus, new devices use the processing of group 0 */
+    ds18b20_host(const bus_master &wire, const sample_processor::config &processing);
+    /* Takes over the devices of an earlier search without accessing
+       the bus, e.g. after a warm restart. The devices have to be the
+       same and still hold the configuration written to them. */
+    ds18b20_host(const bus_master &wire, const sample_processor::config &processing, std::span<const table_entry> table);
+
+    /* Search the bus again. Known devices keep their state, devices
+       no longer found are removed. */
+    void rescan();
+    size_t device_count() const { return devices.size(); }
+    uint64_t identifier(size_t index) const { return devices[index].identifier; }
+    std::vector<table_entry> device_table() const;
+    const bus_health &health() const { return health_counters; }
+
+    /* Set the resolution (9 to 12 bits) of all devices.
+       Returns false if a device could not be written. */
+    bool set_resolution(uint8_t bits);
+
+    /* Program the alarm limits (TH/TL, whole degC) into the scratchpad
+       of all devices or of one device. The DS18B20 flags an alarm after
+       a conversion if the temperature is >= high or <= low.
+       Returns false if a device could not be written. */
+    bool set_alarm_limits(int8_t low, int8_t high);
+    bool set_alarm_limits(uint64_t identifier, int8_t low, int8_t high);
+
+    /* Devices are in sampling group 0 with the processing passed to
+       the constructor unless assigned otherwise */
+    void assign_group(uint64_t identifier, uint8_t group, const sample_processor::config &processing);
+
+    /* Start a conversion on the whole bus (SKIP ROM) if any device
+       is in a due group. Returns whether a conversion was started. */
+    bool request_readings(sweep_scheduler::group_mask due);
+    /* Start a conversion on the whole bus (SKIP ROM) */
+    bool convert_all();
+    /* Read the raw temperature of a device, without sample processing */
+    std::optional<int16_t> read_temperature(size_t index);
+    /* time_us_64 when the last conversion was started */
+    uint64_t conversion_start() const { return conversion_start_us; }
+    /* Read the devices of the due groups. Returns the readings
+       their sample processing reports. */
+    std::vector<reading> retrieve_readings(sweep_scheduler::group_mask due);
+
+    /* After a conversion: find the devices in alarm (ALARM SEARCH) and
+       read only those entering or leaving alarm */
+    std::vector<alarm_event> check_alarms();
 
   private:
     struct device
     {
         uint64_t identifier;
         uint8_t crc_fails;
+        bus_master::speed speed;
+        uint8_t group = 0;
+        sample_processor processor;
+        int8_t alarm_low = -55;
+        int8_t alarm_high = 125;
+        bool in_alarm = false;
     };
-    const onewire &wire;
+
+    bool is_due(const device &dev, sweep_scheduler::group_mask due) const;
+
+    enum class transfer_status
+    {
+        ok,
+        no_presence,
+        crc_failed
+    };
+
+    // Addresses the device at its speed and reads its scratchpad.
+    transfer_status read_scratchpad(device &dev, uint8_t (&buf)[9]);
+    // The same without counting, for probing a speed the device may not support.
+    transfer_status transfer_scratchpad(const device &dev, uint8_t (&buf)[9]) const;
+    bool write_scratchpad(device &dev, int8_t high, int8_t low, uint8_t configuration);
+    bool write_alarm_limits(device &dev, int8_t low, int8_t high);
+    const bus_master &wire;
+    sample_processor::config default_processing;
     std::vector<device> devices;
+    uint64_t conversion_start_us = 0;
+    bus_health health_counters{};
 };
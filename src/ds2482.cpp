@@ -0,0 +1,213 @@
+#include <ds2482.hpp>
+
+#include <trace.hpp>
+
+#include <array>
+#include <cstdio>
+#include <stdexcept>
+
+namespace
+{
+constexpr const uint8_t DEVICE_RESET_COMMAND = 0xf0;
+constexpr const uint8_t SET_READ_POINTER_COMMAND = 0xe1;
+constexpr const uint8_t WRITE_CONFIGURATION_COMMAND = 0xd2;
+constexpr const uint8_t CHANNEL_SELECT_COMMAND = 0xc3;
+constexpr const uint8_t ONEWIRE_RESET_COMMAND = 0xb4;
+constexpr const uint8_t ONEWIRE_WRITE_BYTE_COMMAND = 0xa5;
+constexpr const uint8_t ONEWIRE_READ_BYTE_COMMAND = 0x96;
+constexpr const uint8_t ONEWIRE_TRIPLET_COMMAND = 0x78;
+
+constexpr const uint8_t READ_DATA_REGISTER = 0xe1;
+
+constexpr const uint8_t STATUS_1WB = 0x01;
+constexpr const uint8_t STATUS_PPD = 0x02;
+constexpr const uint8_t STATUS_SD = 0x04;
+constexpr const uint8_t STATUS_RST = 0x10;
+constexpr const uint8_t STATUS_SBR = 0x20;
+constexpr const uint8_t STATUS_TSB = 0x40;
+constexpr const uint8_t STATUS_DIR = 0x80;
+
+constexpr const uint8_t CONFIGURATION_APU = 0x01;
+constexpr const uint8_t CONFIGURATION_SPU = 0x04;
+constexpr const uint8_t CONFIGURATION_1WS = 0x08;
+
+/* Channel select codes and the values the channel register reads back */
+constexpr const std::array<uint8_t, 8> CHANNEL_CODES{0xf0, 0xe1, 0xd2, 0xc3, 0xb4, 0xa5, 0x96, 0x87};
+constexpr const std::array<uint8_t, 8> CHANNEL_READBACK{0xb8, 0xb1, 0xaa, 0xa3, 0x9c, 0x95, 0x8e, 0x87};
+
+/* A 1-Wire reset at standard speed, the longest command, takes about
+   1.2 ms: 12 status reads at 100 kHz, 50 at 400 kHz */
+constexpr const int BUSY_POLL_LIMIT = 200;
+}// namespace
+
+ds2482_bridge::ds2482_bridge(i2c_transport &i2c_in, uint8_t address_in, model type_in):
+    i2c(i2c_in), i2c_address(address_in), type(type_in)
+{
+    write(std::array<uint8_t, 1>{DEVICE_RESET_COMMAND});
+    if (!(read_register() & STATUS_RST))
+    {
+        throw std::runtime_error("DS2482 did not reset");
+    }
+    /* The active pullup shortens the rising edges on longer buses */
+    write_configuration(CONFIGURATION_APU);
+}
+
+void ds2482_bridge::write(std::span<const uint8_t> data)
+{
+    if (!i2c.write(i2c_address, data))
+    {
+        throw std::runtime_error("DS2482 did not acknowledge");
+    }
+}
+
+uint8_t ds2482_bridge::read_register()
+{
+    uint8_t value;
+    if (!i2c.read(i2c_address, {&value, 1}))
+    {
+        throw std::runtime_error("DS2482 did not acknowledge");
+    }
+    return value;
+}
+
+/* 1-Wire commands leave the read pointer at the status register */
+uint8_t ds2482_bridge::wait_until_idle()
+{
+    for (int poll = 0; poll < BUSY_POLL_LIMIT; poll++)
+    {
+        uint8_t status = read_register();
+        if (!(status & STATUS_1WB))
+        {
+            return status;
+        }
+    }
+    throw std::runtime_error("DS2482 1-Wire busy timeout");
+}
+
+void ds2482_bridge::select_channel(uint8_t channel)
+{
+    if (channel >= channel_count())
+    {
+        throw std::invalid_argument("DS2482 channel out of range");
+    }
+    if (type == model::ds2482_100 || channel == current_channel)
+    {
+        return;
+    }
+    write(std::array<uint8_t, 2>{CHANNEL_SELECT_COMMAND, CHANNEL_CODES[channel]});
+    if (read_register() != CHANNEL_READBACK[channel])
+    {
+        throw std::runtime_error("DS2482 channel select failed");
+    }
+    current_channel = channel;
+}
+
+void ds2482_bridge::write_configuration(uint8_t configuration)
+{
+    /* The upper nibble is the complement of the lower nibble */
+    write(std::array<uint8_t, 2>{WRITE_CONFIGURATION_COMMAND, uint8_t(configuration | (~configuration << 4))});
+    if (read_register() != configuration)
+    {
+        throw std::runtime_error("DS2482 configuration write failed");
+    }
+    current_configuration = configuration;
+}
+
+uint8_t ds2482_bridge::execute(uint8_t channel, bool overdrive, bool strong_pullup, std::span<const uint8_t> command)
+{
+    select_channel(channel);
+    uint8_t configuration = CONFIGURATION_APU
+        | (overdrive ? CONFIGURATION_1WS : 0)
+        | (strong_pullup ? CONFIGURATION_SPU : 0);
+    if (configuration != current_configuration)
+    {
+        write_configuration(configuration);
+    }
+    write(command);
+    uint8_t status = wait_until_idle();
+    /* The bridge clears SPU itself when the pullup ends, the next
+       command with strong pullup has to set it again */
+    current_configuration &= ~CONFIGURATION_SPU;
+    return status;
+}
+
+uint8_t ds2482_bridge::read_data()
+{
+    write(std::array<uint8_t, 2>{SET_READ_POINTER_COMMAND, READ_DATA_REGISTER});
+    return read_register();
+}
+
+void ds2482_bridge::end_strong_pullup()
+{
+    write_configuration(current_configuration);
+}
+
+void ds2482_bridge::clock_changed()
+{
+    i2c.clock_changed();
+}
+
+ds2482_channel::ds2482_channel(ds2482_bridge &bridge_in, uint8_t channel_in):
+    bridge(bridge_in), channel(channel_in)
+{
+    if (channel >= bridge.channel_count())
+    {
+        throw std::invalid_argument("DS2482 channel out of range");
+    }
+}
+
+uint8_t ds2482_channel::execute(std::span<const uint8_t> command, bool strong_pullup) const
+{
+    return bridge.execute(channel, current_speed == speed::overdrive, strong_pullup, command);
+}
+
+int ds2482_channel::reset() const
+{
+    TRACE_SCOPE(onewire_reset, trace_id());
+    uint8_t status = execute(std::array<uint8_t, 1>{ONEWIRE_RESET_COMMAND});
+    if (status & STATUS_SD)
+    {
+        printf("1-Wire short on DS2482 0x%02x channel %u\n", bridge.address(), channel);
+        return 0;
+    }
+    return (status & STATUS_PPD) ? 1 : 0;
+}
+
+void ds2482_channel::clock_changed() const
+{
+    bridge.clock_changed();
+}
+
+void ds2482_channel::transmit(uint8_t byte) const
+{
+    TRACE_SCOPE(onewire_transmit, trace_id());
+    execute(std::array<uint8_t, 2>{ONEWIRE_WRITE_BYTE_COMMAND, byte});
+}
+
+uint8_t ds2482_channel::receive() const
+{
+    TRACE_SCOPE(onewire_receive, trace_id());
+    execute(std::array<uint8_t, 1>{ONEWIRE_READ_BYTE_COMMAND});
+    return bridge.read_data();
+}
+
+void ds2482_channel::transmit_then_pull_up(uint8_t byte) const
+{
+    execute(std::array<uint8_t, 2>{ONEWIRE_WRITE_BYTE_COMMAND, byte}, true);
+}
+
+void ds2482_channel::disable_pull_up() const
+{
+    bridge.end_strong_pullup();
+}
+
+ds2482_channel::triplet_result ds2482_channel::triplet(bool direction_on_discrepancy) const
+{
+    uint8_t status = execute(std::array<uint8_t, 2>{ONEWIRE_TRIPLET_COMMAND, uint8_t(direction_on_discrepancy ? 0x80 : 0x00)});
+    return {bool(status & STATUS_SBR), bool(status & STATUS_TSB), bool(status & STATUS_DIR)};
+}
+
+uint16_t ds2482_channel::trace_id() const
+{
+    return 0x100 | ((bridge.address() & 0x7) << 3) | channel;
+}
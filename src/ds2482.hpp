@@ -0,0 +1,96 @@
+#pragma once
+
+#include <bus_master.hpp>
+#include <i2c_transport.hpp>
+
+#include <cstdint>
+#include <span>
+
+/* DS2482-100 (one 1-Wire channel) and DS2482-800 (eight channels)
+   I2C to 1-Wire bridges. The bridge generates the 1-Wire timing, the
+   host starts a command and polls the status register until the
+   1-Wire busy bit clears.
+
+   The configuration (speed, strong pullup) is shared by the channels
+   of a DS2482-800 and rewritten when a channel with other settings
+   is used. Throws std::runtime_error if the bridge does not respond. */
+class ds2482_bridge
+{
+  public:
+    enum class model
+    {
+        ds2482_100,
+        ds2482_800
+    };
+
+    /* Resets the bridge and enables the active pullup */
+    ds2482_bridge(i2c_transport &i2c, uint8_t address, model type);
+
+    uint8_t address() const { return i2c_address; }
+    uint8_t channel_count() const { return type == model::ds2482_800 ? 8 : 1; }
+
+    /* Select the channel, apply the speed and strong pullup setting
+       and run a 1-Wire command (1-Wire Reset, Single Bit, Write Byte,
+       Read Byte or Triplet with its parameter byte). Returns the
+       status register once the command has finished. */
+    uint8_t execute(uint8_t channel, bool overdrive, bool strong_pullup, std::span<const uint8_t> command);
+
+    /* The byte received by the last Read Byte command */
+    uint8_t read_data();
+
+    /* Switch off the strong pullup of the last command */
+    void end_strong_pullup();
+
+    void clock_changed();
+
+  private:
+    void write(std::span<const uint8_t> data);
+    uint8_t read_register();
+    uint8_t wait_until_idle();
+    void select_channel(uint8_t channel);
+    void write_configuration(uint8_t configuration);
+
+    i2c_transport &i2c;
+    uint8_t i2c_address;
+    model type;
+    uint8_t current_channel = 0;
+    uint8_t current_configuration = 0;
+};
+
+/* One 1-Wire channel of a DS2482 as a bus master. The bridge runs the
+   triplets of the ROM search in hardware. */
+class ds2482_channel : public bus_master
+{
+  public:
+    ds2482_channel(ds2482_bridge &bridge, uint8_t channel);
+
+    int reset() const override;
+
+    /* Applied to the bridge with the next command */
+    void set_speed(speed bus_speed) const override { current_speed = bus_speed; }
+    speed get_speed() const override { return current_speed; }
+
+    void clock_changed() const override;
+
+    void transmit(uint8_t byte) const override;
+    uint8_t receive() const override;
+
+    /* The bridge switches the strong pullup on right after the last
+       bit, until disable_pull_up or the next command */
+    void transmit_then_pull_up(uint8_t byte) const override;
+    void disable_pull_up() const override;
+
+    triplet_result triplet(bool direction_on_discrepancy) const override;
+
+    const char* search_method() const override { return "DS2482 triplets"; }
+
+    /* 0x100 | I2C address bits | channel */
+    uint16_t trace_id() const override;
+
+  private:
+    uint8_t execute(std::span<const uint8_t> command, bool strong_pullup = false) const;
+
+    ds2482_bridge &bridge;
+    uint8_t channel;
+    mutable speed current_speed = speed::standard;
+};
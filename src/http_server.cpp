@@ -0,0 +1,285 @@
+#include <http_server.hpp>
+
+#include <pico/cyw43_arch.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+/* tcp_poll interval in units of the coarse TCP timer (500 ms) */
+constexpr const u8_t POLL_INTERVAL = 2;
+/* Connections idle for 5 s are aborted */
+constexpr const uint8_t MAX_IDLE_POLLS = 5;
+
+constexpr const std::string_view PROMETHEUS_PATH = "/metrics";
+constexpr const std::string_view JSON_PATH = "/metrics.json";
+constexpr const char* PROMETHEUS_CONTENT_TYPE = "text/plain; version=0.0.4; charset=utf-8";
+constexpr const char* JSON_CONTENT_TYPE = "application/json";
+constexpr const char* TEXT_CONTENT_TYPE = "text/plain";
+}
+
+http_server::http_server(metrics_cache &cache_in, uint16_t port_in):
+    cache(cache_in), port(port_in)
+{}
+
+void http_server::start()
+{
+    cyw43_arch_lwip_begin();
+    tcp_pcb* pcb = tcp_new_ip_type(IPADDR_TYPE_ANY);
+    if (!pcb || tcp_bind(pcb, IP_ANY_TYPE, port) != ERR_OK)
+    {
+        if (pcb)
+        {
+            tcp_close(pcb);
+        }
+        cyw43_arch_lwip_end();
+        throw std::runtime_error("Could not bind the HTTP port");
+    }
+    listener = tcp_listen_with_backlog(pcb, MAX_CONNECTIONS);
+    if (!listener)
+    {
+        tcp_close(pcb);
+        cyw43_arch_lwip_end();
+        throw std::runtime_error("Could not listen on the HTTP port");
+    }
+    tcp_arg(listener, this);
+    tcp_accept(listener, accept);
+    cyw43_arch_lwip_end();
+}
+
+void http_server::publish(uint32_t sequence, uint64_t uptime_ms)
+{
+    cyw43_arch_lwip_begin();
+    const int slot = cache.begin_render();
+    cyw43_arch_lwip_end();
+    if (slot < 0)
+    {
+        printf("metrics snapshot skipped, a scrape still sends the other slot\n");
+        return;
+    }
+
+    /* No scrape reads this slot, rendering runs without the lock */
+    cache.render(slot, sequence, uptime_ms);
+
+    cyw43_arch_lwip_begin();
+    cache.commit(slot);
+    cyw43_arch_lwip_end();
+}
+
+err_t http_server::accept(void* arg, tcp_pcb* pcb, err_t err)
+{
+    auto* server = static_cast<http_server*>(arg);
+    if (err != ERR_OK || !pcb)
+    {
+        return ERR_VAL;
+    }
+    auto free_connection = std::find_if(server->connections.begin(), server->connections.end(), [](const connection& conn) {
+        return conn.pcb == nullptr;
+    });
+    if (free_connection == server->connections.end())
+    {
+        server->refused++;
+        tcp_abort(pcb);
+        return ERR_ABRT;
+    }
+
+    auto& conn = *free_connection;
+    conn = connection{};
+    conn.server = server;
+    conn.pcb = pcb;
+    tcp_arg(pcb, &conn);
+    tcp_recv(pcb, receive);
+    tcp_sent(pcb, sent);
+    tcp_err(pcb, error);
+    tcp_poll(pcb, poll, POLL_INTERVAL);
+    return ERR_OK;
+}
+
+err_t http_server::receive(void* arg, tcp_pcb* pcb, pbuf* p, err_t err)
+{
+    auto& conn = *static_cast<connection*>(arg);
+    if (!p)
+    {
+        /* The client closed its side, the response may still be sent */
+        if (!conn.responding || conn.acked == conn.queued)
+        {
+            conn.server->close(conn);
+        }
+        return ERR_OK;
+    }
+    if (err != ERR_OK)
+    {
+        pbuf_free(p);
+        return err;
+    }
+
+    conn.idle_polls = 0;
+    if (!conn.responding)
+    {
+        const size_t space = conn.request.size() - 1 - conn.request_length;
+        conn.request_length += pbuf_copy_partial(p, conn.request.data() + conn.request_length, std::min<size_t>(space, p->tot_len), 0);
+        conn.request[conn.request_length] = '\0';
+    }
+    tcp_recved(pcb, p->tot_len);
+    pbuf_free(p);
+
+    /* Only the request line is needed, the remaining headers are ignored */
+    if (!conn.responding && (std::strstr(conn.request.data(), "\r\n") || conn.request_length == conn.request.size() - 1))
+    {
+        conn.server->respond(conn);
+    }
+    return ERR_OK;
+}
+
+void http_server::respond(connection& conn)
+{
+    conn.responding = true;
+    const std::string_view request(conn.request.data(), conn.request_length);
+    const auto line_end = request.find("\r\n");
+    const auto line = request.substr(0, line_end);
+
+    int status = 200;
+    const char* reason = "OK";
+    const char* content_type = TEXT_CONTENT_TYPE;
+    if (line_end == std::string_view::npos)
+    {
+        status = 414;
+        reason = "URI Too Long";
+        conn.body = "request line too long\n";
+    }
+    else if (!line.starts_with("GET "))
+    {
+        status = 405;
+        reason = "Method Not Allowed";
+        conn.body = "only GET is supported\n";
+    }
+    else
+    {
+        auto path = line.substr(4);
+        path = path.substr(0, path.find(' '));
+        const bool is_prometheus = path == PROMETHEUS_PATH;
+        const bool is_json = path == JSON_PATH;
+        if (!is_prometheus && !is_json)
+        {
+            status = 404;
+            reason = "Not Found";
+            conn.body = "not found, try /metrics or /metrics.json\n";
+        }
+        else if ((conn.slot = cache.acquire()) < 0)
+        {
+            status = 503;
+            reason = "Service Unavailable";
+            conn.body = "no sweep yet\n";
+        }
+        else
+        {
+            conn.body = is_prometheus ? cache.prometheus(conn.slot) : cache.json(conn.slot);
+            content_type = is_prometheus ? PROMETHEUS_CONTENT_TYPE : JSON_CONTENT_TYPE;
+        }
+    }
+
+    conn.header_length = snprintf(conn.header.data(), conn.header.size(),
+        "HTTP/1.0 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+        status,
+        reason,
+        content_type,
+        conn.body.size());
+    served++;
+    send_pending(conn);
+}
+
+void http_server::send_pending(connection& conn)
+{
+    const size_t total = conn.header_length + conn.body.size();
+    while (conn.queued < total)
+    {
+        const bool in_header = conn.queued < conn.header_length;
+        const char* data = in_header ? conn.header.data() + conn.queued : conn.body.data() + (conn.queued - conn.header_length);
+        const size_t remaining = in_header ? conn.header_length - conn.queued : total - conn.queued;
+        const u16_t length = std::min<size_t>({remaining, tcp_sndbuf(conn.pcb), 0xffff});
+        if (length == 0)
+        {
+            break; // continued from the sent callback
+        }
+        /* Header and snapshot stay valid until acknowledged, no copy needed */
+        const u8_t flags = conn.queued + length < total ? TCP_WRITE_FLAG_MORE : 0;
+        if (tcp_write(conn.pcb, data, length, flags) != ERR_OK)
+        {
+            break; // out of segments, retried from the sent callback
+        }
+        conn.queued += length;
+    }
+    tcp_output(conn.pcb);
+}
+
+err_t http_server::sent(void* arg, tcp_pcb*, u16_t length)
+{
+    auto& conn = *static_cast<connection*>(arg);
+    conn.acked += length;
+    conn.idle_polls = 0;
+    if (conn.acked == conn.header_length + conn.body.size())
+    {
+        conn.server->close(conn);
+        return ERR_OK;
+    }
+    conn.server->send_pending(conn);
+    return ERR_OK;
+}
+
+err_t http_server::poll(void* arg, tcp_pcb*)
+{
+    auto& conn = *static_cast<connection*>(arg);
+    if (++conn.idle_polls >= MAX_IDLE_POLLS)
+    {
+        return conn.server->abort(conn);
+    }
+    if (conn.responding)
+    {
+        conn.server->send_pending(conn);
+    }
+    return ERR_OK;
+}
+
+void http_server::error(void* arg, err_t)
+{
+    /* lwIP already freed the pcb */
+    auto& conn = *static_cast<connection*>(arg);
+    conn.server->release(conn);
+}
+
+void http_server::close(connection& conn)
+{
+    tcp_pcb* pcb = conn.pcb;
+    tcp_arg(pcb, nullptr);
+    tcp_recv(pcb, nullptr);
+    tcp_sent(pcb, nullptr);
+    tcp_err(pcb, nullptr);
+    tcp_poll(pcb, nullptr, 0);
+    if (tcp_close(pcb) != ERR_OK)
+    {
+        tcp_abort(pcb);
+    }
+    release(conn);
+}
+
+err_t http_server::abort(connection& conn)
+{
+    tcp_pcb* pcb = conn.pcb;
+    tcp_arg(pcb, nullptr);
+    tcp_err(pcb, nullptr);
+    tcp_abort(pcb);
+    release(conn);
+    return ERR_ABRT;
+}
+
+void http_server::release(connection& conn)
+{
+    if (conn.slot >= 0)
+    {
+        cache.release(conn.slot);
+    }
+    conn = connection{};
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <metrics_cache.hpp>
+
+#include <lwip/tcp.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/* Minimal HTTP/1.0 server on the lwIP raw API serving the snapshots of
+   a metrics_cache:
+     GET /metrics       Prometheus text format
+     GET /metrics.json  JSON
+
+   Responses are sent straight from the snapshot without copying
+   (tcp_write without TCP_WRITE_FLAG_COPY), the snapshot is held until
+   the client acknowledged all of it. Connections come from a fixed
+   pool, excess connections are refused. */
+class http_server
+{
+  public:
+    static constexpr const size_t MAX_CONNECTIONS = 4;
+
+    http_server(metrics_cache &cache, uint16_t port = 80);
+    /* The lwIP callbacks refer to the server */
+    http_server(const http_server&) = delete;
+    http_server& operator=(const http_server&) = delete;
+
+    /* Listen on the port, throws std::runtime_error on failure */
+    void start();
+
+    /* Render the cache into a snapshot and make it current. Called
+       once per sweep from the main loop. */
+    void publish(uint32_t sequence, uint64_t uptime_ms);
+
+    uint32_t served_requests() const { return served; }
+    uint32_t refused_connections() const { return refused; }
+
+  private:
+    struct connection
+    {
+        http_server* server = nullptr;
+        tcp_pcb* pcb = nullptr;
+        std::array<char, 128> request;
+        size_t request_length = 0;
+        std::array<char, 160> header;
+        size_t header_length = 0;
+        std::string_view body;
+        int slot = -1;
+        size_t queued = 0; // bytes of header and body passed to tcp_write
+        size_t acked = 0;
+        uint8_t idle_polls = 0;
+        bool responding = false;
+    };
+
+    /* lwIP callbacks, run in the lwIP context */
+    static err_t accept(void* arg, tcp_pcb* pcb, err_t err);
+    static err_t receive(void* arg, tcp_pcb* pcb, pbuf* p, err_t err);
+    static err_t sent(void* arg, tcp_pcb* pcb, u16_t length);
+    static err_t poll(void* arg, tcp_pcb* pcb);
+    static void error(void* arg, err_t err);
+
+    void respond(connection& conn);
+    void send_pending(connection& conn);
+    /* Close after the response was acknowledged */
+    void close(connection& conn);
+    /* Abort drops the data still queued, so the snapshot can be released */
+    err_t abort(connection& conn);
+    void release(connection& conn);
+
+    metrics_cache& cache;
+    uint16_t port;
+    tcp_pcb* listener = nullptr;
+    std::array<connection, MAX_CONNECTIONS> connections{};
+    uint32_t served = 0;
+    uint32_t refused = 0;
+};
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+/* Transfers to the targets of an I2C bus. Implemented by the RP2040
+   I2C block (pico_i2c) and by the DS2482 model of tools/ds2482_sim. */
+class i2c_transport
+{
+  public:
+    virtual ~i2c_transport() = default;
+
+    /* Each transfer is framed by a START and a STOP condition.
+       Return false if the target did not acknowledge. */
+    virtual bool write(uint8_t address, std::span<const uint8_t> data) = 0;
+    virtual bool read(uint8_t address, std::span<uint8_t> data) = 0;
+
+    /* Recompute the baud rate divider after clk_sys has changed.
+       Call while no transfer is in progress. */
+    virtual void clock_changed() {}
+};
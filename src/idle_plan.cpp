@@ -0,0 +1,32 @@
+#include <idle_plan.hpp>
+
+idle_plan::action idle_plan::plan(uint64_t now_us, uint64_t deadline_us) const
+{
+    if (deadline_us <= now_us)
+    {
+        return action::none;
+    }
+    if (reduced || deadline_us - now_us < switch_cost_us())
+    {
+        return action::sleep;
+    }
+    return action::reduce_clock;
+}
+
+void idle_plan::clock_reduced_at(uint64_t now_us, uint32_t cost_us)
+{
+    reduced = true;
+    reduced_since_us = now_us;
+    reduce_cost_us = cost_us;
+}
+
+void idle_plan::clock_restored_at(uint64_t now_us, uint32_t cost_us)
+{
+    if (!reduced)
+    {
+        return;
+    }
+    reduced = false;
+    reduced_total_us += now_us - cost_us - reduced_since_us;
+    restore_cost_us = cost_us;
+}
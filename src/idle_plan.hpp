@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+
+/* The clock decisions of power_scheduler, free of the SDK and checked
+   on the host by tools/power_check.
+
+   The reduced clock is kept across idle steps, e.g. the command polls
+   between sweeps, and only left when work starts. An idle step shorter
+   than a round trip through the reduced clock (switching down, then up
+   and recomputing the clock dividers of all wires) stays at full
+   clock. The round trip is the last one measured. */
+class idle_plan
+{
+  public:
+    enum class action
+    {
+        none,         // the deadline has passed
+        sleep,        // sleep at the current clock
+        reduce_clock, // switch to the reduced clock, then sleep
+    };
+
+    /* Until a round trip has been measured */
+    static constexpr const uint32_t INITIAL_SWITCH_COST_US = 2000;
+
+    action plan(uint64_t now_us, uint64_t deadline_us) const;
+
+    bool clock_reduced() const { return reduced; }
+
+    /* Report a switch that ended at now_us and took cost_us */
+    void clock_reduced_at(uint64_t now_us, uint32_t cost_us);
+    void clock_restored_at(uint64_t now_us, uint32_t cost_us);
+
+    uint32_t switch_cost_us() const { return reduce_cost_us + restore_cost_us; }
+
+    /* Time at reduced clock, up to the last restore */
+    uint64_t reduced_clock_us() const { return reduced_total_us; }
+
+  private:
+    bool reduced = false;
+    uint64_t reduced_since_us = 0;
+    uint64_t reduced_total_us = 0;
+    uint32_t reduce_cost_us = INITIAL_SWITCH_COST_US / 2;
+    uint32_t restore_cost_us = INITIAL_SWITCH_COST_US / 2;
+};
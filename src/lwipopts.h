@@ -20,6 +20,8 @@
 #define MEM_ALIGNMENT               4
 #define MEM_SIZE                    4000
 #define MEMP_NUM_TCP_SEG            32
+// MQTT, the HTTP connections (http_server::MAX_CONNECTIONS) and TIME_WAIT
+#define MEMP_NUM_TCP_PCB            8
 #define MEMP_NUM_ARP_QUEUE          10
 #define PBUF_POOL_SIZE              24
 #define LWIP_ARP                    1
@@ -86,3 +88,28 @@
 #define DHCP_DEBUG                  LWIP_DBG_OFF
 
 #define PPP_NUM_TIMEOUTS 1
+
+// Room for the statistics and command results next to queued publishes
+#define MQTT_OUTPUT_RINGBUF_SIZE    1024
+
+// MQTT over TLS (CMake option ENABLE_MQTT_TLS), see mbedtls_config.h
+#if MQTT_TLS_ENABLED
+#define LWIP_ALTCP                  1
+#define LWIP_ALTCP_TLS              1
+#define LWIP_ALTCP_TLS_MBEDTLS      1
+#define ALTCP_MBEDTLS_AUTHMODE      MBEDTLS_SSL_VERIFY_REQUIRED
+#endif
+
+// SNTP, see wall_clock.hpp
+#define MEMP_NUM_SYS_TIMEOUT        (LWIP_NUM_SYS_TIMEOUT_INTERNAL + 1)
+#define SNTP_SERVER_DNS             1
+#define SNTP_UPDATE_DELAY           (15 * 60 * 1000)
+#include <stdint.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+void wall_clock_set_time_us(uint32_t sec, uint32_t us);
+#ifdef __cplusplus
+}
+#endif
+#define SNTP_SET_SYSTEM_TIME_US(sec, us) wall_clock_set_time_us(sec, us)
@@ -1,16 +1,35 @@
 #include <onewire.hpp>
+#include <burst_capture.hpp>
+#include <command_handler.hpp>
+#include <commands.hpp>
 #include <ds18b20_host.hpp>
+#include <ds2482.hpp>
+#include <http_server.hpp>
+#include <metrics_cache.hpp>
 #include <mqtt_client.hpp>
+#include <pico_i2c.hpp>
+#include <power_scheduler.hpp>
+#include <sweep_encoder.hpp>
+#include <sweep_scheduler.hpp>
+#include <trace.hpp>
+#include <wall_clock.hpp>
+#include <warm_state.hpp>
 
+#include <hardware/watchdog.h>
 #include <pico/binary_info.h>
 #include <pico/cyw43_arch.h>
 #include <pico/stdlib.h>
 
+#include <algorithm>
 #include <array>
 #include <bitset>
+#include <cstring>
+#include <deque>
+#include <optional>
 #include <stdio.h>
 #include <stdexcept>
 #include <string_view>
+#include <vector>
 
 constexpr const char* wifi_ssid = "";
 constexpr const char* wifi_password = "";
@@ -18,8 +37,104 @@ constexpr const char* mqtt_hostname = "";
 constexpr const uint32_t mqtt_port = 1883;
 constexpr const char* mqtt_user = "";
 constexpr const char* mqtt_pass = "";
+/* PEM CA certificate of the broker: MQTT over TLS (usually port 8883)
+   in a build with ENABLE_MQTT_TLS, plain TCP if nullptr */
+constexpr const char* mqtt_ca_certificate = nullptr;
+constexpr const uint32_t mqtt_reconnect_interval_ms = 10000;
 constexpr const char* mqtt_client_id = "picoW";
+constexpr const char* sntp_server = "pool.ntp.org";
 constexpr const std::string_view topic_prefix = "picoW/temperature/";
+constexpr const std::string_view alarm_topic_prefix = "picoW/alarm/";
+constexpr const char* command_topic = "picoW/command";
+constexpr const char* command_result_topic = "picoW/command/result";
+constexpr const char* stats_topic = "picoW/stats";
+/* Readings of a sweep in the binary sweep format (sweep_format.hpp)
+   on one topic instead of a text message per device */
+constexpr const bool binary_sweeps = true;
+constexpr const char* sweep_topic = "picoW/sweep";
+/* Prometheus text on /metrics, JSON on /metrics.json */
+constexpr const uint16_t http_port = 80;
+/* Trace dumps, consecutive messages form the dump */
+constexpr const char* trace_topic = "picoW/trace";
+constexpr const std::string_view burst_topic_prefix = "picoW/burst/";
+/* A publish has to fit into MQTT_OUTPUT_RINGBUF_SIZE with its topic */
+constexpr const size_t burst_chunk_size = 768;
+constexpr const uint32_t command_poll_interval_ms = 1000;
+/* The chip resets if the main loop stalls this long, at most 8388 ms */
+constexpr const uint32_t watchdog_timeout_ms = 8000;
+/* Warm restarts in a row without a published sweep before a cold start */
+constexpr const uint32_t max_warm_restarts = 3;
+/* Sweep messages kept while the broker cannot be reached, oldest
+   dropped first */
+constexpr const size_t unsent_sweep_bytes = 8 * 1024;
+
+/* DS2482 I2C to 1-Wire bridges on I2C0. Each channel is a bus,
+   numbered after the PIO buses; a DS2482-800 adds eight. */
+struct bridge_config
+{
+    uint8_t address;
+    ds2482_bridge::model type;
+};
+constexpr const std::array<bridge_config, 0> ds2482_bridges{};
+constexpr const uint8_t i2c_sda_pin = 4;
+constexpr const uint8_t i2c_scl_pin = 5;
+constexpr const uint32_t i2c_baudrate = 400000;
+
+/* 12bit: max. 750 ms, halved per bit less */
+constexpr uint32_t conversion_time_ms(uint8_t resolution)
+{
+    return (750 >> (12 - resolution)) + 10;
+}
+
+struct sampling_group
+{
+    const char* name;
+    uint32_t interval_ms;
+    sample_processor::config processing;
+};
+/* Group 0 is the default for all devices.
+   ambient: report changes of 0.125 degC, at least every 15 minutes.
+   process: median of 3, report min/max/mean of 10 s windows on
+   changes of 0.25 degC, at least every 10 minutes. */
+constexpr const std::array<sampling_group, 2> sampling_groups
+{{
+    {"ambient", 60000, {sample_processor::filter::none, 3, 2, 1, 2, 15}},
+    {"process", 1000, {sample_processor::filter::median, 3, 2, 10, 4, 60}}
+}};
+
+struct device_group
+{
+    uint64_t identifier;
+    uint8_t group;
+};
+constexpr const std::array<device_group, 0> device_groups{};
+
+/* TH/TL in whole degC, the defaults effectively disable alarms */
+struct alarm_limits
+{
+    uint64_t identifier;
+    int8_t low;
+    int8_t high;
+};
+constexpr const int8_t default_alarm_low = -55;
+constexpr const int8_t default_alarm_high = 125;
+constexpr const std::array<alarm_limits, 0> device_alarm_limits{};
+
+/* Kept across a watchdog reset, see warm_state.hpp. Holds the device
+   tables and as many unsent sweep messages as fit. */
+constexpr const size_t warm_state_size = 16 * 1024;
+static uint8_t __uninitialized_ram(warm_state_region)[warm_state_size];
+
+/* Sleeps without starving the watchdog */
+void supervised_sleep_ms(uint32_t ms)
+{
+    const auto deadline = make_timeout_time_ms(ms);
+    while(!time_reached(deadline))
+    {
+        watchdog_update();
+        sleep_until(absolute_time_min(deadline, make_timeout_time_ms(1000)));
+    }
+}
 
 int main()
 {
@@ -28,6 +143,30 @@ int main()
     stdio_init_all();
     printf("Start multi-point temperature probe %s\n", mqtt_client_id);
 
+    /* After a watchdog reset the device tables, the broker address and
+       the unsent sweeps are taken over instead of searching, resolving
+       and dropping them */
+    warm_state::state retained;
+    bool warm_start = false;
+    if(watchdog_caused_reboot())
+    {
+        auto kept = warm_state::load(warm_state_region);
+        if(kept && kept->restarts >= max_warm_restarts)
+        {
+            printf("Cold start after %lu warm restarts without a published sweep\n", kept->restarts);
+            kept.reset();
+        }
+        if(kept)
+        {
+            retained = std::move(*kept);
+            retained.restarts++;
+            warm_start = true;
+        }
+        printf(warm_start ? "Warm restart after watchdog reset\n" : "Watchdog reset, no state kept\n");
+    }
+    warm_state::save(retained, warm_state_region);
+    watchdog_enable(watchdog_timeout_ms, true);
+
     init_wifi(CYW43_COUNTRY_GERMANY);
     while(true)
     {
@@ -39,65 +178,627 @@ int main()
         {
             printf("WIFI connection could not be established: %s \n", err.what());
             printf("Retrying in 10 seconds\n");
-            sleep_ms(10000);
+            supervised_sleep_ms(10000);
         }
     }
 
-    auto try_creating_client = []()
+    ip_addr_t broker_address;
+    const ip_addr_t* known_address = nullptr;
+    if(retained.broker_address)
+    {
+        ip_addr_set_ip4_u32(&broker_address, retained.broker_address);
+        known_address = &broker_address;
+    }
+    auto try_creating_client = [&known_address]()
     {
         while (true)
         {
             try
             {
-                return mqtt_client(mqtt_hostname, mqtt_port, mqtt_client_id, mqtt_user, mqtt_pass);
+                return mqtt_client(mqtt_hostname, mqtt_port, mqtt_client_id, mqtt_user, mqtt_pass, mqtt_ca_certificate, known_address);
             } catch (std::runtime_error& err)
             {
                 printf("MQTT connection could not be established %s \n", err.what());
+                if(known_address)
+                {
+                    /* The broker may have moved */
+                    known_address = nullptr;
+                    continue;
+                }
                 printf("Retrying in 10 seconds\n");
-                sleep_ms(10000);
+                supervised_sleep_ms(10000);
             }
         }
     };
 
     auto client = try_creating_client();
+    wall_clock::start(sntp_server);
+
+    /* static: the snapshots are too large for the main stack */
+    static metrics_cache metrics;
+    http_server http(metrics, http_port);
+    try
+    {
+        http.start();
+    } catch (std::runtime_error& err)
+    {
+        printf("HTTP server not started: %s\n", err.what());
+    }
 
-    std::array<onewire, 2> wires
+    std::array<onewire, 2> pio_wires
     {
         onewire(15, 14),
         onewire(17, 16)
     };
+    pico::print_pio_budget();
+
+    std::vector<const bus_master*> wires;
+    for(const auto& wire: pio_wires)
+    {
+        wires.push_back(&wire);
+    }
+    /* deque: the channels refer to their bridge, the buses to the channels */
+    std::optional<pico_i2c> i2c;
+    std::deque<ds2482_bridge> bridges;
+    std::deque<ds2482_channel> bridge_channels;
+    if(!ds2482_bridges.empty())
+    {
+        i2c.emplace(i2c0, i2c_sda_pin, i2c_scl_pin, i2c_baudrate);
+    }
+    for(const auto& config: ds2482_bridges)
+    {
+        try
+        {
+            auto& bridge = bridges.emplace_back(*i2c, config.address, config.type);
+            printf("DS2482-%s at 0x%02x\n", config.type == ds2482_bridge::model::ds2482_800 ? "800" : "100", config.address);
+            for(uint8_t channel = 0; channel < bridge.channel_count(); channel++)
+            {
+                wires.push_back(&bridge_channels.emplace_back(bridge, channel));
+            }
+        } catch (std::runtime_error& err)
+        {
+            printf("DS2482 at 0x%02x not used: %s\n", config.address, err.what());
+        }
+    }
+
+    uint8_t resolution = retained.resolution;
+    std::vector<ds18b20_host> hosts;
+    hosts.reserve(wires.size());
+    auto assign_groups = [&]()
+    {
+        for(auto& host: hosts)
+        {
+            for(const auto& assignment: device_groups)
+            {
+                host.assign_group(assignment.identifier, assignment.group, sampling_groups[assignment.group].processing);
+            }
+        }
+    };
+    /* Applied after a bus is searched, which may find new devices.
+       Kept tables skip it: the devices were not reset with the chip. */
+    auto configure_devices = [&](ds18b20_host& host)
+    {
+        if(!host.set_alarm_limits(default_alarm_low, default_alarm_high))
+        {
+            printf("could not set alarm limits\n");
+        }
+        for(const auto& limits: device_alarm_limits)
+        {
+            if(!host.set_alarm_limits(limits.identifier, limits.low, limits.high))
+            {
+                printf("could not set alarm limits of %llx\n", limits.identifier);
+            }
+        }
+        if(!host.set_resolution(resolution))
+        {
+            printf("could not set resolution\n");
+        }
+    };
+    auto keep_device_table = [&](const ds18b20_host& host)
+    {
+        auto& bus = retained.buses.emplace_back();
+        for(const auto& entry: host.device_table())
+        {
+            bus.push_back({entry.identifier, entry.speed == bus_master::speed::overdrive, entry.alarm_low, entry.alarm_high});
+        }
+    };
+
+    /* The kept tables apply if the buses are the same. Each bus is kept
+       once it is searched and configured: a reset while enumerating a
+       long bus does not search the previous buses again. */
+    if(!warm_start || retained.buses.size() > wires.size())
+    {
+        retained.buses.clear();
+    }
+    const size_t kept_buses = retained.buses.size();
+    for(size_t bus = 0; bus < wires.size(); bus++)
+    {
+        if(bus < kept_buses)
+        {
+            std::vector<ds18b20_host::table_entry> table;
+            for(const auto& dev: retained.buses[bus])
+            {
+                table.push_back({dev.identifier, dev.overdrive ? bus_master::speed::overdrive : bus_master::speed::standard, dev.alarm_low, dev.alarm_high});
+            }
+            hosts.emplace_back(*wires[bus], sampling_groups[0].processing, table);
+            continue;
+        }
+        auto& host = hosts.emplace_back(*wires[bus], sampling_groups[0].processing);
+        configure_devices(host);
+        keep_device_table(host);
+        if(!warm_state::save(retained, warm_state_region))
+        {
+            printf("device tables too large to keep across a reset\n");
+        }
+    }
+    assign_groups();
 
-    std::array<ds18b20_host, 2> hosts
+    sweep_scheduler scheduler;
+    for(const auto& group: sampling_groups)
+    {
+        scheduler.add_group(uint64_t(group.interval_ms) * 1000, time_us_64());
+    }
+
+    /* Sweep messages are published in order once the broker has the
+       previous ones */
+    auto publish_unsent = [&]()
+    {
+        while(!retained.unsent.empty() && client.is_connected())
+        {
+            const auto& message = retained.unsent.front();
+            if(!client.publish(sweep_topic, message.data(), message.size()))
+            {
+                break;
+            }
+            retained.unsent.pop_front();
+        }
+    };
+    sweep_encoder encoder([&](std::span<const uint8_t> message) {
+        retained.unsent.emplace_back(message.begin(), message.end());
+        size_t unsent_bytes = 0;
+        for(const auto& unsent: retained.unsent)
+        {
+            unsent_bytes += unsent.size();
+        }
+        while(unsent_bytes > unsent_sweep_bytes)
+        {
+            unsent_bytes -= retained.unsent.front().size();
+            retained.unsent.pop_front();
+        }
+        publish_unsent();
+    });
+    auto update_device_table = [&]()
     {
-        ds18b20_host(wires[0]),
-        ds18b20_host(wires[1])
+        std::vector<uint64_t> identifiers;
+        for(const auto& host: hosts)
+        {
+            for(size_t i = 0; i < host.device_count(); i++)
+            {
+                identifiers.push_back(host.identifier(i));
+            }
+        }
+        encoder.set_devices(std::move(identifiers));
     };
+    update_device_table();
+
+    power_scheduler power(wires);
 
     std::array<char, topic_prefix.size() + 17> topic_str_buf;
     std::copy(topic_prefix.begin(), topic_prefix.end(), topic_str_buf.data());
-    std::array<char, 9> temp_str_buf;
-    while(true)
+    std::array<char, 80> temp_str_buf;
+    std::array<char, alarm_topic_prefix.size() + 17> alarm_topic_str_buf;
+    std::copy(alarm_topic_prefix.begin(), alarm_topic_prefix.end(), alarm_topic_str_buf.data());
+    uint32_t sequence = retained.sequence;
+    bool sample_now = false;
+    bool dump_trace = false;
+    std::optional<burst_capture::parameters> pending_burst;
+    burst_capture burst;
+    uint32_t burst_count = 0;
+
+    /* After every sweep and command, a reset can come at any time */
+    auto save_warm_state = [&]()
     {
+        retained.sequence = sequence;
+        retained.resolution = resolution;
+        retained.broker_address = ip_addr_get_ip4_u32(&client.address());
+        retained.buses.clear();
         for(const auto& host: hosts)
         {
-            host.request_readings();
+            keep_device_table(host);
         }
+        if(!warm_state::save(retained, warm_state_region))
+        {
+            printf("device tables too large to keep across a reset\n");
+        }
+    };
+    save_warm_state();
 
-        sleep_ms(760); /* 12bit: max. 750 ms */
+    /* A bus master that got stuck throws once it has recovered, the
+       sweep goes on without the bus */
+    auto on_bus = [](size_t bus, auto&& operation)
+    {
+        try
+        {
+            operation();
+        } catch (std::runtime_error& err)
+        {
+            printf("bus %zu failed: %s\n", bus, err.what());
+        }
+    };
 
-        for(auto& host: hosts)
+    /* static: the main stack is small */
+    static std::array<char, 512> stats_str_buf;
+    auto publish_stats = [&]()
+    {
+        size_t device_count = 0;
+        for(const auto& host: hosts)
+        {
+            device_count += host.device_count();
+        }
+        const auto connection = client.statistics();
+        int length = snprintf(stats_str_buf.data(), stats_str_buf.size(),
+            "sweeps %lu devices %zu drift_ppb %ld dropped_commands %lu connects %lu tls_resumptions %lu connect_ms %lu unsent_sweep_messages %zu warm_restarts %lu",
+            sequence,
+            device_count,
+            wall_clock::drift_ppb(),
+            client.dropped_messages(),
+            connection.connects,
+            connection.tls_resumptions,
+            connection.last_connect_ms,
+            retained.unsent.size(),
+            retained.restarts);
+        for(uint8_t group = 0; group < scheduler.group_count(); group++)
+        {
+            const auto& stats = scheduler.statistics(group);
+            length += snprintf(stats_str_buf.data() + length, stats_str_buf.size() - length,
+                "; %s interval_ms %llu runs %lu missed %lu lateness_max_us %llu jitter_max_us %llu",
+                sampling_groups[group].name,
+                scheduler.interval(group) / 1000,
+                stats.runs,
+                stats.missed_deadlines,
+                stats.max_lateness_us,
+                stats.max_jitter_us);
+            if(length >= int(stats_str_buf.size()))
+            {
+                length = stats_str_buf.size() - 1;
+                break;
+            }
+        }
+        client.publish(stats_topic, stats_str_buf.data(), length);
+    };
+
+    /* Commands are handled between sweeps */
+    auto apply_command = [&](const command& cmd) -> const char*
+    {
+        switch(cmd.command_type)
+        {
+        case command::type::set_interval:
+            if(cmd.group >= scheduler.group_count())
+            {
+                return "error no such group";
+            }
+            scheduler.set_interval(cmd.group, uint64_t(cmd.value) * 1000);
+            return "ok interval";
+        case command::type::set_resolution:
+        {
+            resolution = cmd.value;
+            bool written = true;
+            for(auto& host: hosts)
+            {
+                written = host.set_resolution(resolution) && written;
+            }
+            return written ? "ok resolution" : "error resolution not set on all devices";
+        }
+        case command::type::rescan:
+            /* Kept bus by bus like the enumeration at start */
+            for(auto& host: hosts)
+            {
+                host.rescan();
+                configure_devices(host);
+                save_warm_state();
+            }
+            assign_groups();
+            update_device_table();
+            metrics.clear_readings();
+            return "ok rescan";
+        case command::type::fetch_stats:
+            publish_stats();
+            return "ok stats";
+        case command::type::sample_now:
+            sample_now = true;
+            return "ok sample";
+        case command::type::burst:
+            pending_burst = burst_capture::parameters{
+                cmd.burst.resolution, cmd.burst.period_ms, cmd.burst.duration_s, cmd.burst.bus_mask};
+            return "ok burst";
+        case command::type::dump_trace:
+            if(!trace::enabled)
+            {
+                return "error trace disabled in this build";
+            }
+            dump_trace = true;
+            return "ok trace";
+        default:
+            return "error unknown command";
+        }
+    };
+
+    /* Blocks for the capture, the sweeps due meanwhile count as missed */
+    auto run_burst = [&](const burst_capture::parameters& params)
+    {
+        const auto res = burst.run(hosts, params);
+        for(size_t bus = 0; bus < hosts.size(); bus++)
+        {
+            if((params.bus_mask & (1u << bus)) && !hosts[bus].set_resolution(resolution))
+            {
+                printf("could not restore resolution on bus %zu\n", bus);
+            }
+        }
+
+        const auto blob = burst.blob();
+        const size_t chunk_count = (blob.size() + burst_chunk_size - 1) / burst_chunk_size;
+        std::array<char, burst_topic_prefix.size() + 24> burst_topic_str_buf;
+        std::copy(burst_topic_prefix.begin(), burst_topic_prefix.end(), burst_topic_str_buf.data());
+        burst_count++;
+        /* picoW/burst/<capture>/<chunk>/<chunk count> */
+        for(size_t chunk = 0; chunk < chunk_count; chunk++)
+        {
+            snprintf(burst_topic_str_buf.data() + burst_topic_prefix.size(), burst_topic_str_buf.size() - burst_topic_prefix.size(),
+                "%lu/%zu/%zu", burst_count, chunk, chunk_count);
+            const auto part = blob.subspan(chunk * burst_chunk_size, std::min(burst_chunk_size, blob.size() - chunk * burst_chunk_size));
+            client.publish(burst_topic_str_buf.data(), part.data(), part.size());
+        }
+
+        int length = snprintf(stats_str_buf.data(), stats_str_buf.size(), "ok burst %lu conversions %lu bytes %zu",
+            burst_count,
+            res.conversions,
+            blob.size());
+        const double duration_s = res.duration_us / 1e6;
+        for(size_t bus = 0; bus < hosts.size() && length < int(stats_str_buf.size()); bus++)
+        {
+            if(params.bus_mask & (1u << bus))
+            {
+                length += snprintf(stats_str_buf.data() + length, stats_str_buf.size() - length, " bus%zu %.2f samples/s",
+                    bus,
+                    duration_s > 0 ? res.samples[bus] / duration_s : 0.0);
+            }
+        }
+        length = std::min(length, int(stats_str_buf.size()) - 1);
+        printf("%s\n", stats_str_buf.data());
+        client.publish(command_result_topic, stats_str_buf.data(), length);
+    };
+
+    /* Over USB/UART stdio and MQTT, recording pauses meanwhile */
+    auto run_trace_dump = [&]()
+    {
+        static std::array<char, burst_chunk_size> trace_str_buf;
+        trace::set_recording(false);
+        size_t cursor = 0;
+        while(size_t length = trace::format(cursor, trace_str_buf.data(), trace_str_buf.size()))
+        {
+            fwrite(trace_str_buf.data(), 1, length, stdout);
+            client.publish(trace_topic, trace_str_buf.data(), length);
+        }
+        trace::set_recording(true);
+    };
+
+    command_handler commands(client, command_result_topic, apply_command);
+    try
+    {
+        client.subscribe(command_topic);
+    } catch (std::runtime_error& err)
+    {
+        printf("MQTT subscribe failed: %s\n", err.what());
+    }
+    publish_unsent();
+
+    absolute_time_t next_reconnect = nil_time;
+    while(true)
+    {
+        const auto deadline = from_us_since_boot(scheduler.next_deadline());
+        while(!time_reached(deadline) && !client.has_messages())
+        {
+            /* An idle step is at most command_poll_interval_ms */
+            watchdog_update();
+            power.idle_until(absolute_time_min(deadline, make_timeout_time_ms(command_poll_interval_ms)));
+        }
+        power.restore_clock();
+        watchdog_update();
+
+        /* Sweeps go on while disconnected, their publishes fail */
+        if(!client.is_connected() && time_reached(next_reconnect))
+        {
+            try
+            {
+                client.reconnect();
+                publish_unsent();
+            } catch (std::runtime_error& err)
+            {
+                printf("MQTT reconnect failed: %s\n", err.what());
+                next_reconnect = make_timeout_time_ms(mqtt_reconnect_interval_ms);
+            }
+        }
+
+        if(commands.handle_received())
+        {
+            save_warm_state();
+        }
+        if(dump_trace)
+        {
+            run_trace_dump();
+            dump_trace = false;
+        }
+        if(pending_burst)
+        {
+            try
+            {
+                run_burst(*pending_burst);
+            } catch (std::runtime_error& err)
+            {
+                printf("burst failed: %s\n", err.what());
+            }
+            pending_burst.reset();
+        }
+
+        auto due = scheduler.collect_due(time_us_64());
+        if(sample_now)
+        {
+            for(uint8_t group = 0; group < scheduler.group_count(); group++)
+            {
+                due.set(group);
+            }
+            sample_now = false;
+        }
+        if(due.none())
+        {
+            continue;
+        }
+
+        power.start_sweep();
+        TRACE_SCOPE(sweep, uint16_t(due.to_ulong()));
+        /* A single conversion per bus serves all due groups */
+        std::vector<bool> converting(hosts.size());
+        for(size_t i = 0; i < hosts.size(); i++)
+        {
+            on_bus(i, [&]() { converting[i] = hosts[i].request_readings(due); });
+        }
+        if(std::none_of(converting.begin(), converting.end(), [](bool c) { return c; }))
+        {
+            continue;
+        }
+        /* Sequence number and conversion start (UNIX ms, 0 until the
+           wall clock is synchronized) lead every payload */
+        sequence++;
+
+        power.idle_until(make_timeout_time_ms(conversion_time_ms(resolution)));
+        power.restore_clock();
+
+        /* Fast path: the devices in alarm are found and published
+           before all other devices are read */
+        power.wake_radio();
+        for(size_t i = 0; i < hosts.size(); i++)
         {
-            const auto readings = host.retrieve_readings();
-            for(const auto reading: readings)
+            if(!converting[i])
             {
-                sprintf(topic_str_buf.data() + topic_prefix.size(), "%llx", reading.identifier);
-                auto temp = reading.temperature * 0.0625f;
-                auto temp_str_char_count = sprintf(temp_str_buf.data(), "%6.2f", temp);
-                client.publish(topic_str_buf.data(), temp_str_buf.data(), temp_str_char_count);
-                printf("%s : %s\n", topic_str_buf.data(), temp_str_buf.data());
+                continue;
+            }
+            watchdog_update();
+            const uint64_t timestamp_ms = wall_clock::to_unix_us(hosts[i].conversion_start()) / 1000;
+            std::vector<ds18b20_host::alarm_event> alarms;
+            on_bus(i, [&]() { alarms = hosts[i].check_alarms(); });
+            for(const auto& alarm: alarms)
+            {
+                sprintf(alarm_topic_str_buf.data() + alarm_topic_prefix.size(), "%llx", alarm.identifier);
+                const char* type = alarm.type == ds18b20_host::alarm_event::kind::high ? "high"
+                    : alarm.type == ds18b20_host::alarm_event::kind::low               ? "low"
+                                                                                       : "cleared";
+                auto alarm_str_char_count = sprintf(temp_str_buf.data(), "%lu,%llu,%s,%.2f",
+                    sequence,
+                    timestamp_ms,
+                    type,
+                    alarm.temperature * 0.0625);
+                client.publish(alarm_topic_str_buf.data(), temp_str_buf.data(), alarm_str_char_count);
+                printf("%s : %s\n", alarm_topic_str_buf.data(), temp_str_buf.data());
+            }
+        }
+
+        /* Readings of all buses, in bus order */
+        std::vector<ds18b20_host::reading> readings;
+        std::vector<size_t> bus_begin(hosts.size() + 1);
+        std::vector<uint64_t> bus_timestamp_ms(hosts.size());
+        for(size_t i = 0; i < hosts.size(); i++)
+        {
+            watchdog_update();
+            bus_timestamp_ms[i] = wall_clock::to_unix_us(hosts[i].conversion_start()) / 1000;
+            std::vector<ds18b20_host::reading> host_readings;
+            on_bus(i, [&]() { host_readings = hosts[i].retrieve_readings(due); });
+            readings.insert(readings.end(), host_readings.begin(), host_readings.end());
+            bus_begin[i + 1] = readings.size();
+        }
+
+        for(size_t i = 0; i < hosts.size(); i++)
+        {
+            for(size_t r = bus_begin[i]; r < bus_begin[i + 1]; r++)
+            {
+                const auto& reading = readings[r];
+                metrics.set_reading({reading.identifier, uint8_t(i), reading.temperature, reading.min, reading.max, reading.mean, bus_timestamp_ms[i]});
+            }
+            const auto& health = hosts[i].health();
+            metrics.set_bus(i, {uint32_t(hosts[i].device_count()), health.conversions, health.reads, health.reset_failures, health.crc_errors});
+        }
+        http.publish(sequence, time_us_64() / 1000);
+
+        if(binary_sweeps)
+        {
+            std::vector<sweep_encoder::sample> samples;
+            uint64_t timestamp_ms = 0;
+            for(size_t i = 0; i < hosts.size(); i++)
+            {
+                if(converting[i] && timestamp_ms == 0)
+                {
+                    timestamp_ms = bus_timestamp_ms[i];
+                }
+            }
+            /* The entries of the other buses carry their own start */
+            for(size_t i = 0; i < hosts.size(); i++)
+            {
+                for(size_t r = bus_begin[i]; r < bus_begin[i + 1]; r++)
+                {
+                    const auto& reading = readings[r];
+                    samples.push_back({reading.identifier, reading.temperature, reading.min, reading.max, reading.mean, bus_timestamp_ms[i]});
+                }
+            }
+            encoder.encode(sequence, timestamp_ms, samples);
+            printf("sweep %lu: %zu readings published in binary\n", sequence, samples.size());
+        }
+        else
+        {
+            for(size_t i = 0; i < hosts.size(); i++)
+            {
+                for(size_t r = bus_begin[i]; r < bus_begin[i + 1]; r++)
+                {
+                    const auto& reading = readings[r];
+                    sprintf(topic_str_buf.data() + topic_prefix.size(), "%llx", reading.identifier);
+                    /* sequence,timestamp,value,min,max,mean */
+                    auto temp_str_char_count = sprintf(temp_str_buf.data(), "%lu,%llu,%.2f,%.2f,%.2f,%.2f",
+                        sequence,
+                        bus_timestamp_ms[i],
+                        reading.temperature * 0.0625,
+                        reading.min * 0.0625,
+                        reading.max * 0.0625,
+                        reading.mean * 0.0625);
+                    client.publish(topic_str_buf.data(), temp_str_buf.data(), temp_str_char_count);
+                    printf("%s : %s\n", topic_str_buf.data(), temp_str_buf.data());
+                }
             }
         }
 
-        sleep_ms(58000);
+        if(client.is_connected())
+        {
+            retained.restarts = 0;
+        }
+        save_warm_state();
+
+        const auto activity = power.end_sweep();
+        printf("sweep %lu took %llu us, active %llu us, clock drift %ld ppb\n",
+            sequence,
+            activity.sweep_us,
+            activity.active_us,
+            wall_clock::drift_ppb());
+        for(uint8_t group = 0; group < scheduler.group_count(); group++)
+        {
+            if(!due.test(group))
+            {
+                continue;
+            }
+            const auto& stats = scheduler.statistics(group);
+            printf("group %s: %lu runs, %lu missed deadlines, lateness max %llu us mean %llu us, jitter max %llu us\n",
+                sampling_groups[group].name,
+                stats.runs,
+                stats.missed_deadlines,
+                stats.max_lateness_us,
+                stats.total_lateness_us / stats.runs,
+                stats.max_jitter_us);
+        }
     }
 }
@@ -0,0 +1,53 @@
+#include <message_inbox.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+void message_inbox::begin(const char* topic, uint32_t total_length)
+{
+    size_t topic_length = strlen(topic);
+    incoming_fits = topic_length <= mqtt_message::MAX_TOPIC_LENGTH && total_length <= mqtt_message::MAX_PAYLOAD_LENGTH;
+    if (incoming_fits)
+    {
+        std::memcpy(incoming.topic.data(), topic, topic_length + 1);
+        incoming.payload_length = 0;
+    }
+}
+
+void message_inbox::append(const uint8_t* data, uint16_t length, bool last)
+{
+    if (!incoming_fits)
+    {
+        if (last)
+        {
+            dropped_count++;
+        }
+        return;
+    }
+    length = std::min<uint16_t>(length, mqtt_message::MAX_PAYLOAD_LENGTH - incoming.payload_length);
+    std::memcpy(incoming.payload.data() + incoming.payload_length, data, length);
+    incoming.payload_length += length;
+    if (!last)
+    {
+        return;
+    }
+    if (count == SIZE)
+    {
+        dropped_count++;
+        return;
+    }
+    messages[(first + count) % SIZE] = incoming;
+    count++;
+}
+
+bool message_inbox::pop(mqtt_message& message)
+{
+    if (count == 0)
+    {
+        return false;
+    }
+    message = messages[first];
+    first = (first + 1) % SIZE;
+    count--;
+    return true;
+}
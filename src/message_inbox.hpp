@@ -0,0 +1,43 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+struct mqtt_message
+{
+    static constexpr const size_t MAX_TOPIC_LENGTH = 64;
+    static constexpr const size_t MAX_PAYLOAD_LENGTH = 64;
+
+    std::array<char, MAX_TOPIC_LENGTH + 1> topic; // null-terminated
+    std::array<char, MAX_PAYLOAD_LENGTH> payload;
+    uint32_t payload_length;
+};
+
+/* Fixed-size queue of incoming MQTT messages, assembled from the
+   fragments lwIP delivers. Messages too long or arriving at a full
+   inbox are dropped and counted. Does not lock, mqtt_client holds the
+   lwIP lock around it. */
+class message_inbox
+{
+  public:
+    static constexpr const size_t SIZE = 4;
+
+    /* A message of total_length bytes starts */
+    void begin(const char* topic, uint32_t total_length);
+    /* A fragment of the message begun last, the last one queues it */
+    void append(const uint8_t* data, uint16_t length, bool last);
+
+    /* Returns false if the inbox is empty */
+    bool pop(mqtt_message& message);
+    bool empty() const { return count == 0; }
+    uint32_t dropped() const { return dropped_count; }
+
+  private:
+    std::array<mqtt_message, SIZE> messages;
+    size_t first = 0;
+    size_t count = 0;
+    mqtt_message incoming;
+    bool incoming_fits = false;
+    uint32_t dropped_count = 0;
+};
@@ -0,0 +1,220 @@
+#include <metrics_cache.hpp>
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+
+namespace
+{
+/* Appends to a fixed buffer, remembers whether it ran out of space */
+class appender
+{
+  public:
+    appender(char* buf_in, size_t capacity_in):
+        buf(buf_in), capacity(capacity_in)
+    {}
+
+    __attribute__((format(printf, 2, 3))) void add(const char* format, ...)
+    {
+        if (overflow)
+        {
+            return;
+        }
+        va_list args;
+        va_start(args, format);
+        int written = vsnprintf(buf + length, capacity - length, format, args);
+        va_end(args);
+        if (written < 0 || size_t(written) >= capacity - length)
+        {
+            overflow = true;
+            return;
+        }
+        length += written;
+    }
+
+    /* Text up to the last complete line or element */
+    void mark() { complete = length; }
+    size_t size() const { return overflow ? complete : length; }
+    bool overflowed() const { return overflow; }
+
+  private:
+    char* buf;
+    size_t capacity;
+    size_t length = 0;
+    size_t complete = 0;
+    bool overflow = false;
+};
+
+double celsius(int16_t raw)
+{
+    return raw * 0.0625;
+}
+}
+
+void metrics_cache::set_reading(const device_metrics &reading)
+{
+    auto end = devices.begin() + device_count;
+    auto found = std::find_if(devices.begin(), end, [&](const device_metrics &dev) {
+        return dev.identifier == reading.identifier;
+    });
+    if (found != end)
+    {
+        *found = reading;
+    }
+    else if (device_count < MAX_DEVICES)
+    {
+        devices[device_count++] = reading;
+    }
+}
+
+void metrics_cache::set_bus(uint8_t bus, const bus_metrics &metrics)
+{
+    if (bus < MAX_BUSES)
+    {
+        buses[bus] = metrics;
+        bus_count = std::max(bus_count, size_t(bus) + 1);
+    }
+}
+
+void metrics_cache::clear_readings()
+{
+    device_count = 0;
+}
+
+int metrics_cache::begin_render()
+{
+    for (int slot = 0; slot < int(SLOT_COUNT); slot++)
+    {
+        if (slot != current && slots[slot].readers == 0)
+        {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+void metrics_cache::render(int slot, uint32_t sequence, uint64_t uptime_ms)
+{
+    auto& target = slots[slot];
+
+    appender prom(target.prometheus.data(), target.prometheus.size());
+    prom.add("# TYPE probe_sweeps_total counter\nprobe_sweeps_total %lu\n", (unsigned long)sequence);
+    prom.add("# TYPE probe_uptime_seconds gauge\nprobe_uptime_seconds %.3f\n", uptime_ms / 1000.0);
+    static constexpr const std::array<std::pair<const char*, uint32_t bus_metrics::*>, 5> bus_counters
+    {{
+        {"onewire_devices", &bus_metrics::devices},
+        {"onewire_conversions_total", &bus_metrics::conversions},
+        {"onewire_reads_total", &bus_metrics::reads},
+        {"onewire_reset_failures_total", &bus_metrics::reset_failures},
+        {"onewire_crc_errors_total", &bus_metrics::crc_errors}
+    }};
+    for (const auto& [name, member] : bus_counters)
+    {
+        prom.add("# TYPE %s %s\n", name, member == &bus_metrics::devices ? "gauge" : "counter");
+        for (size_t bus = 0; bus < bus_count; bus++)
+        {
+            prom.add("%s{bus=\"%zu\"} %lu\n", name, bus, (unsigned long)(buses[bus].*member));
+        }
+    }
+    prom.mark();
+    static constexpr const std::array<std::pair<const char*, int16_t device_metrics::*>, 4> device_values
+    {{
+        {"temperature_celsius", &device_metrics::value},
+        {"temperature_min_celsius", &device_metrics::min},
+        {"temperature_max_celsius", &device_metrics::max},
+        {"temperature_mean_celsius", &device_metrics::mean}
+    }};
+    for (const auto& [name, member] : device_values)
+    {
+        prom.add("# TYPE %s gauge\n", name);
+        for (size_t i = 0; i < device_count; i++)
+        {
+            const auto& dev = devices[i];
+            prom.add("%s{bus=\"%u\",id=\"%016llx\"} %.4f\n", name, dev.bus, (unsigned long long)dev.identifier, celsius(dev.*member));
+            prom.mark();
+        }
+    }
+    prom.add("# TYPE temperature_timestamp_seconds gauge\n");
+    for (size_t i = 0; i < device_count; i++)
+    {
+        const auto& dev = devices[i];
+        prom.add("temperature_timestamp_seconds{bus=\"%u\",id=\"%016llx\"} %.3f\n", dev.bus, (unsigned long long)dev.identifier, dev.timestamp_ms / 1000.0);
+        prom.mark();
+    }
+    target.prometheus_length = prom.size();
+
+    /* leaves room to close the arrays after truncation */
+    appender json(target.json.data(), target.json.size() - 2);
+    json.add("{\"sequence\":%lu,\"uptime_ms\":%llu,\"buses\":[", (unsigned long)sequence, (unsigned long long)uptime_ms);
+    for (size_t bus = 0; bus < bus_count; bus++)
+    {
+        const auto& b = buses[bus];
+        json.add("%s{\"bus\":%zu,\"devices\":%lu,\"conversions\":%lu,\"reads\":%lu,\"reset_failures\":%lu,\"crc_errors\":%lu}",
+            bus == 0 ? "" : ",",
+            bus,
+            (unsigned long)b.devices,
+            (unsigned long)b.conversions,
+            (unsigned long)b.reads,
+            (unsigned long)b.reset_failures,
+            (unsigned long)b.crc_errors);
+    }
+    json.add("],\"devices\":[");
+    json.mark();
+    for (size_t i = 0; i < device_count; i++)
+    {
+        const auto& dev = devices[i];
+        json.add("%s{\"id\":\"%016llx\",\"bus\":%u,\"value\":%.4f,\"min\":%.4f,\"max\":%.4f,\"mean\":%.4f,\"timestamp_ms\":%llu}",
+            i == 0 ? "" : ",",
+            (unsigned long long)dev.identifier,
+            dev.bus,
+            celsius(dev.value),
+            celsius(dev.min),
+            celsius(dev.max),
+            celsius(dev.mean),
+            (unsigned long long)dev.timestamp_ms);
+        if (!json.overflowed())
+        {
+            json.mark();
+        }
+    }
+    /* Closed after the last device that fit */
+    const bool json_truncated = json.overflowed();
+    const size_t json_length = json.size();
+    target.json[json_length] = ']';
+    target.json[json_length + 1] = '}';
+    target.json_length = json_length + 2;
+
+    if (prom.overflowed() || json_truncated)
+    {
+        truncated++;
+    }
+}
+
+void metrics_cache::commit(int slot)
+{
+    current = slot;
+}
+
+int metrics_cache::acquire()
+{
+    if (current >= 0)
+    {
+        slots[current].readers++;
+    }
+    return current;
+}
+
+void metrics_cache::release(int slot)
+{
+    slots[slot].readers--;
+}
+
+std::string_view metrics_cache::prometheus(int slot) const
+{
+    return {slots[slot].prometheus.data(), slots[slot].prometheus_length};
+}
+
+std::string_view metrics_cache::json(int slot) const
+{
+    return {slots[slot].json.data(), slots[slot].json_length};
+}
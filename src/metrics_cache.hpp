@@ -0,0 +1,91 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/* Latest readings and bus health, rendered once per sweep as
+   Prometheus text and as JSON into static buffers. Scrapes only send
+   a rendered snapshot: they neither touch the 1-Wire bus nor allocate.
+
+   Two snapshot slots: a sweep renders into the slot that is not
+   current while scrapes keep sending the current one. If a slow scrape
+   still sends the other slot, the sweep skips rendering and scrapes
+   see the previous sweep.
+
+   The values are set from the main loop only. begin_render, commit,
+   acquire and release have to be serialized with the network stack
+   by the caller. */
+class metrics_cache
+{
+  public:
+    static constexpr const size_t MAX_DEVICES = 32;
+    static constexpr const size_t MAX_BUSES = 8;
+    static constexpr const size_t PROMETHEUS_CAPACITY = 12 * 1024;
+    static constexpr const size_t JSON_CAPACITY = 6 * 1024;
+    static constexpr const size_t SLOT_COUNT = 2;
+
+    /* Temperatures in 1/16 degC */
+    struct device_metrics
+    {
+        uint64_t identifier;
+        uint8_t bus;
+        int16_t value;
+        int16_t min;
+        int16_t max;
+        int16_t mean;
+        uint64_t timestamp_ms; // UNIX ms of the conversion, 0 if not synchronized
+    };
+
+    struct bus_metrics
+    {
+        uint32_t devices;
+        uint32_t conversions;
+        uint32_t reads;
+        uint32_t reset_failures;
+        uint32_t crc_errors;
+    };
+
+    /* Devices beyond MAX_DEVICES are not cached */
+    void set_reading(const device_metrics &reading);
+    void set_bus(uint8_t bus, const bus_metrics &metrics);
+    /* Drop the devices not reported since, e.g. after a rescan */
+    void clear_readings();
+
+    /* Returns the slot to render into, or -1 if all are read */
+    int begin_render();
+    /* Renders the snapshot of a sweep, needs no serialization */
+    void render(int slot, uint32_t sequence, uint64_t uptime_ms);
+    /* Make the rendered slot current */
+    void commit(int slot);
+
+    /* Returns the current slot, -1 before the first sweep. The slot
+       stays unchanged until released. */
+    int acquire();
+    void release(int slot);
+    std::string_view prometheus(int slot) const;
+    std::string_view json(int slot) const;
+
+    /* Renders truncated because a buffer was full */
+    uint32_t truncated_renders() const { return truncated; }
+
+  private:
+    struct slot_buffers
+    {
+        std::array<char, PROMETHEUS_CAPACITY> prometheus;
+        size_t prometheus_length = 0;
+        std::array<char, JSON_CAPACITY> json;
+        size_t json_length = 0;
+        uint32_t readers = 0;
+    };
+
+    std::array<device_metrics, MAX_DEVICES> devices{};
+    size_t device_count = 0;
+    std::array<bus_metrics, MAX_BUSES> buses{};
+    size_t bus_count = 0;
+
+    std::array<slot_buffers, SLOT_COUNT> slots{};
+    int current = -1;
+    uint32_t truncated = 0;
+};
@@ -1,12 +1,30 @@
 #include <mqtt_client.hpp>
 
+#include <trace.hpp>
+
+#include <hardware/watchdog.h>
 #include <lwip/dns.h>
 #include <lwip/apps/mqtt.h>
+#if MQTT_TLS_ENABLED
+#include <lwip/altcp_tls.h>
+#include <lwip/apps/mqtt_priv.h>
+#include <mbedtls/ssl.h>
+#endif
 
+#include <algorithm>
+#include <cstring>
 #include <stdexcept>
 
 namespace
 {
+constexpr const uint32_t POLL_INTERVAL_MS = 5;
+/* lwIP gives up on a query after about 10 s itself */
+constexpr const uint32_t DNS_TIMEOUT_MS = 15000;
+/* Long enough for a full TLS handshake on the M0+ */
+constexpr const uint32_t CONNECT_TIMEOUT_MS = 20000;
+/* A QoS 2 publish or a subscribe takes a few round trips */
+constexpr const uint32_t REQUEST_TIMEOUT_MS = 5000;
+
 struct MQTT_Connection_Status
 {
     int status = -1;
@@ -31,6 +49,8 @@ struct MQTT_Connection_Status
             return "Disconnected";
         case MQTT_CONNECT_TIMEOUT:
             return "Timeout";
+        default:
+            return "Not connected";
         }
     }
 };
@@ -41,12 +61,104 @@ struct MQTT_Publish_Status
     bool published = false;
 };
 
+struct MQTT_Subscribe_Status
+{
+    err_t error = 0;
+    bool subscribed = false;
+};
+
+/* Static: the callback of a query that timed out may still come. The
+   query number passed to it tells a late answer from the current one. */
 struct DNS_Query_Status
 {
     ip_addr_t ip;
+    uintptr_t query = 0;
     bool resolved = false;
     bool failed = false;
 };
+
+DNS_Query_Status& dns_query_status()
+{
+    static DNS_Query_Status status;
+    return status;
+}
+
+/* Polls until done() returns true or the timeout has passed. The waits
+   are bounded, so they feed the watchdog, which is left to catch the
+   waits that are not. */
+template<typename Predicate>
+bool wait_until(Predicate done, uint32_t timeout_ms)
+{
+    const auto deadline = make_timeout_time_ms(timeout_ms);
+    while (!done())
+    {
+        if (time_reached(deadline))
+        {
+            return false;
+        }
+        watchdog_update();
+        sleep_ms(POLL_INTERVAL_MS);
+    }
+    return true;
+}
+
+#if MQTT_TLS_ENABLED
+#ifndef MBEDTLS_PRIVATE
+#define MBEDTLS_PRIVATE(member) member
+#endif
+
+/* Session of the last TLS connection. Offered on the next connect, the
+   broker may resume it (session ID or ticket) and skip the key exchange
+   and the certificate verification, which take seconds on the M0+.
+   Kept in RAM only: it serves reconnects, a reset starts over. */
+struct TLS_Session_Cache
+{
+    mbedtls_ssl_session session;
+    bool valid = false;
+
+    TLS_Session_Cache() { mbedtls_ssl_session_init(&session); }
+};
+
+TLS_Session_Cache& tls_session_cache()
+{
+    static TLS_Session_Cache cache;
+    return cache;
+}
+
+mbedtls_ssl_context* tls_context(mqtt_client_t* client)
+{
+    return static_cast<mbedtls_ssl_context*>(altcp_tls_context(client->conn));
+}
+
+/* Call with the lwIP lock held before the TCP connection is established */
+void prepare_tls_handshake(mqtt_client_t* client, const char* hostname)
+{
+    auto ssl = tls_context(client);
+    mbedtls_ssl_set_hostname(ssl, hostname);
+    auto& cache = tls_session_cache();
+    if (cache.valid)
+    {
+        mbedtls_ssl_set_session(ssl, &cache.session);
+    }
+}
+
+/* Call with the lwIP lock held after the handshake. Keeps the new
+   session and returns whether the offered one was resumed: a resumed
+   session has the master secret of the offered one. */
+bool keep_tls_session(mqtt_client_t* client)
+{
+    auto& cache = tls_session_cache();
+    const bool offered = cache.valid;
+    std::array<unsigned char, sizeof(cache.session.MBEDTLS_PRIVATE(master))> offered_master;
+    std::memcpy(offered_master.data(), cache.session.MBEDTLS_PRIVATE(master), offered_master.size());
+
+    mbedtls_ssl_session_free(&cache.session);
+    mbedtls_ssl_session_init(&cache.session);
+    cache.valid = mbedtls_ssl_get_session(tls_context(client), &cache.session) == 0;
+    return offered && cache.valid
+        && std::memcmp(offered_master.data(), cache.session.MBEDTLS_PRIVATE(master), offered_master.size()) == 0;
+}
+#endif
 }
 
 template<>
@@ -66,10 +178,40 @@ void init_wifi(uint32_t country)
 
 void connect_wifi(const char *ssid, const char *pass, uint32_t auth, const uint32_t timeout)
 {
-    if (cyw43_arch_wifi_connect_timeout_ms(ssid, pass, auth, timeout))
+    cyw43_arch_lwip_begin();
+    int err = cyw43_arch_wifi_connect_async(ssid, pass, auth);
+    cyw43_arch_lwip_end();
+    if (err)
+    {
+        throw std::runtime_error("Wifi connection could not be started");
+    }
+    int status = CYW43_LINK_DOWN;
+    auto joined = [&status]()
+    {
+        cyw43_arch_lwip_begin();
+        status = cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA);
+        cyw43_arch_lwip_end();
+        return status == CYW43_LINK_UP || status < 0;
+    };
+    if (!wait_until(joined, timeout))
     {
         throw std::runtime_error("Wifi connection timed out");
     }
+    if (status < 0)
+    {
+        throw std::runtime_error(status == CYW43_LINK_BADAUTH ? "Wifi authentication failed" : "Wifi connection failed");
+    }
+}
+
+void set_wifi_power_save(bool enabled)
+{
+    cyw43_arch_lwip_begin();
+    int err = cyw43_wifi_pm(&cyw43_state, enabled ? CYW43_AGGRESSIVE_PM : CYW43_PERFORMANCE_PM);
+    cyw43_arch_lwip_end();
+    if (err)
+    {
+        printf("Wifi power management returned error: %d\n", err);
+    }
 }
 
 ip_addr_t run_dns_lookup(const char* hostname)
@@ -78,7 +220,11 @@ ip_addr_t run_dns_lookup(const char* hostname)
 
     auto dns_gethostbyname_cb = [](const char* /*name*/, const ip_addr_t *ipaddr, void *callback_arg)
     {
-        auto& query_status = *static_cast<DNS_Query_Status*>(callback_arg);
+        auto& query_status = dns_query_status();
+        if (reinterpret_cast<uintptr_t>(callback_arg) != query_status.query)
+        {
+            return;
+        }
         query_status.resolved = true;
         if(ipaddr)
         {
@@ -90,16 +236,24 @@ ip_addr_t run_dns_lookup(const char* hostname)
         }
     };
 
-    DNS_Query_Status query_status;
+    TRACE_SCOPE(mqtt_dns);
+    auto& query_status = dns_query_status();
     cyw43_arch_lwip_begin();
-    err_t err = dns_gethostbyname(hostname, &query_status.ip, dns_gethostbyname_cb, &query_status);
+    const uintptr_t query = query_status.query + 1;
+    query_status = {{}, query, false, false};
+    err_t err = dns_gethostbyname(hostname, &query_status.ip, dns_gethostbyname_cb, reinterpret_cast<void*>(query));
     cyw43_arch_lwip_end();
 
     if (err == ERR_INPROGRESS)
     {
-        while (!query_status.resolved) // wait until the callback was called
+        bool resolved = wait_until([&query_status]() { return query_status.resolved; }, DNS_TIMEOUT_MS);
+        cyw43_arch_lwip_begin();
+        /* A later answer is ignored */
+        query_status.query++;
+        cyw43_arch_lwip_end();
+        if (!resolved)
         {
-            sleep_ms(5);
+            throw std::runtime_error("DNS lookup timed out.");
         }
     }
 
@@ -112,11 +266,32 @@ ip_addr_t run_dns_lookup(const char* hostname)
     return query_status.ip;
 }
 
-mqtt_client::mqtt_client(const char* hostname, const uint32_t port, const char* client_id, const char* user, const char* pass)
+mqtt_client::mqtt_client(const char* hostname_in, const uint32_t port_in, const char* client_id_in, const char* user_in, const char* pass_in,
+    const char* ca_certificate, const ip_addr_t* known_address):
+    hostname(hostname_in), port(port_in), client_id(client_id_in), user(user_in), pass(pass_in)
 {
-    remote_addr = run_dns_lookup(hostname);
+    if (ca_certificate)
+    {
+#if MQTT_TLS_ENABLED
+        /* mbedTLS expects the length of a PEM certificate with the terminator */
+        tls_config = altcp_tls_create_config_client(reinterpret_cast<const u8_t*>(ca_certificate), strlen(ca_certificate) + 1);
+        if (!tls_config)
+        {
+            throw std::runtime_error("TLS configuration failed");
+        }
+#else
+        throw std::runtime_error("MQTT over TLS needs a build with ENABLE_MQTT_TLS");
+#endif
+    }
+
+    remote_addr = known_address ? *known_address : run_dns_lookup(hostname);
 
     lwip_mqtt_client = mqtt_client_new();
+    connect();
+}
+
+void mqtt_client::connect()
+{
     struct mqtt_connect_client_info_t ci;
     err_t err;
 
@@ -125,37 +300,166 @@ mqtt_client::mqtt_client(const char* hostname, const uint32_t port, const char*
     ci.client_id = client_id;
     ci.client_user = user;
     ci.client_pass = pass;
-    ci.keep_alive = 0;
+    ci.keep_alive = KEEP_ALIVE_S;
     ci.will_topic = NULL;
+#if MQTT_TLS_ENABLED
+    ci.tls_config = tls_config;
+#endif
 
+    /* Also called when an established connection is lost */
     auto connection_cb = [](mqtt_client_t* /*client*/, void* arg, mqtt_connection_status_t status)
     {
-        MQTT_Connection_Status* connection_status = reinterpret_cast<MQTT_Connection_Status*>(arg);
-        connection_status->status = status;
+        auto& client = *static_cast<mqtt_client*>(arg);
+        client.connection_status = status;
     };
 
-    MQTT_Connection_Status connection_status;
-    err = mqtt_client_connect(lwip_mqtt_client, &remote_addr, port, connection_cb, &connection_status, &ci);
+    TRACE_SCOPE(mqtt_connect);
+    const auto connect_start = time_us_64();
+    cyw43_arch_lwip_begin();
+    connection_status = -1;
+    err = mqtt_client_connect(lwip_mqtt_client, &remote_addr, port, connection_cb, this, &ci);
+#if MQTT_TLS_ENABLED
+    /* The handshake starts once TCP is connected, which the lwIP lock holds off */
+    if (err == ERR_OK && tls_config)
+    {
+        prepare_tls_handshake(lwip_mqtt_client, hostname);
+    }
+#endif
+    cyw43_arch_lwip_end();
 
     if (err != ERR_OK)
     {
         throw std::runtime_error(std::string("mqtt_connect returned ") + std::to_string(err));
     }
 
-    while(!mqtt_client_is_connected(lwip_mqtt_client))
+    if (!wait_until([this]() { return is_connected() || connection_status > 0; }, CONNECT_TIMEOUT_MS))
     {
-        if(connection_status.status > 0)
-        {
-            throw std::runtime_error(std::string("MQTT connection failed: ") + std::string(std::string_view(connection_status)));
-        }
-        sleep_ms(5);
+        abort_connection();
+        throw std::runtime_error("MQTT connection timed out");
+    }
+    if(connection_status > 0)
+    {
+        throw std::runtime_error(std::string("MQTT connection failed: ") + std::string(std::string_view(MQTT_Connection_Status{connection_status})));
+    }
+
+    stats.connects++;
+    stats.last_connect_ms = uint32_t((time_us_64() - connect_start) / 1000);
+    const char* transport = "TCP";
+#if MQTT_TLS_ENABLED
+    if (tls_config)
+    {
+        cyw43_arch_lwip_begin();
+        bool resumed = keep_tls_session(lwip_mqtt_client);
+        cyw43_arch_lwip_end();
+        stats.tls_resumptions += resumed ? 1 : 0;
+        transport = resumed ? "TLS, session resumed" : "TLS, full handshake";
     }
+#endif
+    printf("MQTT connected in %lu ms (%s).\n", stats.last_connect_ms, transport);
+
+    auto incoming_publish_cb = [](void *arg, const char *topic, u32_t tot_len)
+    {
+        static_cast<mqtt_client*>(arg)->inbox.begin(topic, tot_len);
+    };
+    auto incoming_data_cb = [](void *arg, const u8_t *data, u16_t len, u8_t flags)
+    {
+        static_cast<mqtt_client*>(arg)->inbox.append(data, len, flags & MQTT_DATA_FLAG_LAST);
+    };
+    /* mqtt_client_connect clears the callbacks */
+    cyw43_arch_lwip_begin();
+    mqtt_set_inpub_callback(lwip_mqtt_client, incoming_publish_cb, incoming_data_cb, this);
+    cyw43_arch_lwip_end();
+}
 
+/* Closing the connection drops the pending requests without calling
+   their callbacks, which refer to the stack of the waiting call */
+void mqtt_client::abort_connection()
+{
+    cyw43_arch_lwip_begin();
+    mqtt_disconnect(lwip_mqtt_client);
+    connection_status = MQTT_CONNECT_TIMEOUT;
+    cyw43_arch_lwip_end();
+}
+
+bool mqtt_client::is_connected() const
+{
+    cyw43_arch_lwip_begin();
+    bool connected = mqtt_client_is_connected(lwip_mqtt_client);
+    cyw43_arch_lwip_end();
+    return connected;
+}
+
+void mqtt_client::reconnect()
+{
+    printf("MQTT connection lost: %s\n", std::string(std::string_view(MQTT_Connection_Status{connection_status})).c_str());
+    connect();
+    for (const auto& [topic, qos]: subscriptions)
+    {
+        request_subscription(topic.c_str(), qos);
+    }
+}
 
-    printf("MQTT connected.\n");
+void mqtt_client::subscribe(const char* topic, uint8_t qos)
+{
+    request_subscription(topic, qos);
+    subscriptions.emplace_back(topic, qos);
+}
+
+void mqtt_client::request_subscription(const char* topic, uint8_t qos)
+{
+    auto sub_request_cb = [](void *callback_arg, err_t err)
+    {
+        auto& status = *static_cast<MQTT_Subscribe_Status*>(callback_arg);
+        status.subscribed = true;
+        status.error = err;
+    };
+    TRACE_SCOPE(mqtt_subscribe);
+    MQTT_Subscribe_Status status;
+    cyw43_arch_lwip_begin();
+    auto err = mqtt_subscribe(lwip_mqtt_client, topic, qos, sub_request_cb, &status);
+    cyw43_arch_lwip_end();
+    if (err != ERR_OK)
+    {
+        throw std::runtime_error(std::string("mqtt_subscribe returned ") + std::to_string(err));
+    }
+
+    if (!wait_until([&status]() { return status.subscribed; }, REQUEST_TIMEOUT_MS))
+    {
+        abort_connection();
+        throw std::runtime_error("MQTT subscribe timed out");
+    }
+    if(status.error != ERR_OK)
+    {
+        throw std::runtime_error(std::string("MQTT subscribe failed: ") + std::to_string(status.error));
+    }
+    printf("MQTT subscribed to %s.\n", topic);
+}
+
+bool mqtt_client::poll(mqtt_message& message)
+{
+    cyw43_arch_lwip_begin();
+    bool available = inbox.pop(message);
+    cyw43_arch_lwip_end();
+    return available;
+}
+
+bool mqtt_client::has_messages() const
+{
+    cyw43_arch_lwip_begin();
+    bool available = !inbox.empty();
+    cyw43_arch_lwip_end();
+    return available;
+}
+
+uint32_t mqtt_client::dropped_messages() const
+{
+    cyw43_arch_lwip_begin();
+    uint32_t count = inbox.dropped();
+    cyw43_arch_lwip_end();
+    return count;
 }
 
-void mqtt_client::publish(const char* topic, const void *data, uint32_t data_len)
+bool mqtt_client::publish(const char* topic, const void *data, uint32_t data_len)
 {
     auto pub_request_cb = [](void *callback_arg, err_t err)
     {
@@ -165,21 +469,28 @@ void mqtt_client::publish(const char* topic, const void *data, uint32_t data_len
     };
     constexpr const u8_t qos = 2; /* 0 1 or 2, see MQTT specification */
     constexpr const u8_t retain = 0;
+    TRACE_SCOPE(mqtt_publish, uint16_t(std::min<uint32_t>(data_len, UINT16_MAX)));
     cyw43_arch_lwip_begin();
     MQTT_Publish_Status status;
     auto err = mqtt_publish(lwip_mqtt_client, topic, data, data_len, qos, retain, pub_request_cb, &status);
     cyw43_arch_lwip_end();
     if (err != ERR_OK)
     {
+        /* The callback is not called, e.g. while disconnected */
         printf("MQTT calling publish returned error: %d\n", err);
+        return false;
     }
 
-    while(!status.published)
+    if (!wait_until([&status]() { return status.published; }, REQUEST_TIMEOUT_MS))
     {
-        sleep_ms(5);
+        printf("MQTT publish timed out\n");
+        abort_connection();
+        return false;
     }
     if(status.error != ERR_OK)
     {
         printf("MQTT publish failed: %d\n", status.error);
+        return false;
     }
+    return true;
 }
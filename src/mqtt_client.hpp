@@ -1,12 +1,19 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
 #include <tuple>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <pico/cyw43_arch.h>
 #include <pico/stdlib.h>
 
+#include <message_inbox.hpp>
+
 typedef struct mqtt_client_s mqtt_client_t;
+struct altcp_tls_config;
 
 template<typename T>
 std::tuple<const void*, uint32_t> get_data_view(const T& data)
@@ -21,19 +28,83 @@ void init_wifi(uint32_t country);
 
 void connect_wifi(const char *ssid, const char *pass, uint32_t auth = CYW43_AUTH_WPA2_AES_PSK, const uint32_t timeout = 10000);
 
+/* Power-save lets the radio sleep between beacons, at the cost of latency */
+void set_wifi_power_save(bool enabled);
+
 struct mqtt_client
 {
-    mqtt_client(const char* hostname, const uint32_t port, const char* client_id, const char* user = nullptr, const char* pass = nullptr);
+    /* Broker pings detect a lost connection within 1.5 times this */
+    static constexpr const uint16_t KEEP_ALIVE_S = 60;
+
+    struct connection_statistics
+    {
+        uint32_t connects;
+        uint32_t tls_resumptions; // connects that resumed the cached TLS session
+        uint32_t last_connect_ms; // TCP, TLS handshake and MQTT CONNECT
+    };
+
+    /* With a CA certificate (PEM) the client connects over TLS and
+       verifies the broker certificate against it and hostname. This
+       needs a build with ENABLE_MQTT_TLS.
+       The strings have to outlive the client, reconnect uses them.
+       A known address of the broker skips the DNS lookup.
+       The waits for the broker are bounded, a broker that does not
+       answer in time is disconnected. */
+    mqtt_client(const char* hostname, const uint32_t port, const char* client_id, const char* user = nullptr, const char* pass = nullptr,
+        const char* ca_certificate = nullptr, const ip_addr_t* known_address = nullptr);
+    /* The lwIP callbacks refer to the client */
+    mqtt_client(const mqtt_client&) = delete;
+    mqtt_client& operator=(const mqtt_client&) = delete;
+
+    /* Subscriptions are restored by reconnect */
+    void subscribe(const char* topic, uint8_t qos = 1);
 
-    void publish(const char* topic, const void* data, uint32_t data_len);
+    bool is_connected() const;
+    const ip_addr_t& address() const { return remote_addr; }
+
+    /* Connect to the address resolved at construction and subscribe
+       again: lwIP's MQTT client always requests a clean session, so
+       the broker does not keep subscriptions. Offers the session of
+       the last TLS connection for an abbreviated handshake.
+       Throws std::runtime_error. */
+    void reconnect();
+
+    connection_statistics statistics() const { return stats; }
+
+    /* Incoming messages are queued in a fixed-size inbox by the lwIP
+       callbacks. Messages too long or arriving at a full inbox are
+       dropped. Returns false if the inbox is empty. */
+    bool poll(mqtt_message& message);
+    bool has_messages() const;
+    uint32_t dropped_messages() const;
+
+    /* Returns whether the broker received the message */
+    bool publish(const char* topic, const void* data, uint32_t data_len);
 
     template<typename T>
-    void publish(const char* topic, const T& data)
+    bool publish(const char* topic, const T& data)
     {
         auto [ptr, len] = get_data_view(data);
-        publish(topic, ptr, len);
+        return publish(topic, ptr, len);
     }
 
+    void connect();
+    void abort_connection();
+    void request_subscription(const char* topic, uint8_t qos);
+
+    const char* hostname;
+    uint32_t port;
+    const char* client_id;
+    const char* user;
+    const char* pass;
     ip_addr_t remote_addr;
     mqtt_client_t* lwip_mqtt_client;
+    altcp_tls_config* tls_config = nullptr;
+    /* mqtt_connection_status_t, -1 while connecting */
+    int connection_status = -1;
+    connection_statistics stats{};
+    std::vector<std::pair<std::string, uint8_t>> subscriptions;
+
+    /* Written in the lwIP context, read with the lwIP lock held */
+    message_inbox inbox;
 };
@@ -2,62 +2,76 @@
 
 #include <onewire_pio/onewirepio.hpp>
 #include <onewire_defs.hpp>
+#include <onewire_timing.hpp>
 #include <picopp.hpp>
+#include <trace.hpp>
 
 #include <hardware/clocks.h>
 #include <hardware/pio.h>
 #include <hardware/structs/pio.h>
 #include <pico/types.h>
 
+#include <cstdio>
 #include <stdexcept>
 
 namespace
 {
 constexpr const int TIMEOUT_RETRIES = 2000;
-constexpr const int CHECKSUM_RETRIES = 10;
+/* A word of the search program takes 16 triplets, 3.4 ms at
+   standard speed */
+constexpr const uint32_t RX_TIMEOUT_US = 10000;
 
-const pico::ProgramInstructions &get_onewire_instructions()
+const onewire_timing::profile &get_timing_profile(onewire::speed bus_speed)
 {
-    static const pico::ProgramInstructions onewire_instructions(&onewire_program);
-    return onewire_instructions;
+    return bus_speed == onewire::speed::overdrive ? onewire_timing::OVERDRIVE : onewire_timing::STANDARD;
 }
-}// namespace
 
-uint8_t calc_crc8(const uint8_t* data, const size_t size)
+pico::ProgramInstructions &get_onewire_instructions()
 {
-    // See Application Note 27
-    uint8_t crc8 = 0;
-    for (size_t j = 0; j < size; j++)
-    {
-        crc8 = crc8 ^ data[j];
-        for (int i = 0; i < 8; ++i)
-        {
-            if (crc8 & 1)
-                crc8 = (crc8 >> 1) ^ 0x8c;
-            else
-                crc8 = (crc8 >> 1);
-        }
-    }
+    static pico::ProgramInstructions onewire_instructions(&onewire_program);
+    return onewire_instructions;
+}
 
-    return crc8;
+pico::ProgramInstructions &get_onewire_search_instructions()
+{
+    static pico::ProgramInstructions onewire_search_instructions(&onewire_search_program);
+    return onewire_search_instructions;
 }
 
+}// namespace
+
 onewire::onewire(uint8_t pin_in, uint8_t pinctlz_in)
     : program(get_onewire_instructions()), pin(pin_in), pinctlz(pinctlz_in)
 {
-    auto pio = program.instructions.pio;
+    auto pio = program.pio;
     auto state_machine = program.state_machine_id;
-    auto memory_offset = program.instructions.pio_memory_offset;
-    pio_sm_config config = onewire_program_get_default_config(memory_offset);
+    auto memory_offset = program.pio_memory_offset;
+    config = onewire_program_get_default_config(memory_offset);
     sm_config_set_out_pins(&config, pinctlz, 1);
     sm_config_set_set_pins(&config, pinctlz, 1);
     sm_config_set_in_pins(&config, pin);
     sm_config_set_sideset_pins(&config, pin);
-    uint div = clock_get_hz(clk_sys) / 1e6 * 3;
-    sm_config_set_clkdiv_int_frac(&config, div, 0);
+    const float mhz = float(clock_get_hz(clk_sys) / 1e6);
+    sm_config_set_clkdiv(&config, mhz * onewire_timing::STANDARD.slot_tick_us);
     sm_config_set_out_shift(&config, true, true, 8);
     sm_config_set_in_shift(&config, true, true, 8);
 
+    /* The search program has to live in the same PIO as the
+       state machine. If it does not fit, the search falls back
+       to triplets driven by the ARM. */
+    search_program_loaded = get_onewire_search_instructions().acquire(program.pio_index);
+    if (search_program_loaded)
+    {
+        search_config = onewire_search_program_get_default_config(
+            get_onewire_search_instructions().offset(program.pio_index));
+        sm_config_set_in_pins(&search_config, pin);
+        sm_config_set_sideset_pins(&search_config, pin);
+        sm_config_set_jmp_pin(&search_config, pin);
+        sm_config_set_clkdiv(&search_config, mhz * onewire_timing::SEARCH_TICK_US);
+        sm_config_set_out_shift(&search_config, true, false, 32);
+        sm_config_set_in_shift(&search_config, true, true, 32);
+    }
+
     gpio_init(pin);
     gpio_set_dir(pin, 0);
     gpio_pull_up(pin);
@@ -77,17 +91,26 @@ onewire::onewire(uint8_t pin_in, uint8_t pinctlz_in)
     pio_sm_set_pins_with_mask(pio, state_machine, 1 << pinctlz, 1 << pinctlz);
     pio_sm_set_pindirs_with_mask(pio, state_machine, 1 << pinctlz, 1 << pinctlz);
 
-    /* Preload register y with 1 to keep pinctlz = high when
-       state machine starts running */
-    pio_sm_exec(pio, state_machine, pio_encode_set(pio_y, 1));
+    /* Preload register y with the sample delay and the strong
+       pullup off to keep pinctlz = high when state machine starts
+       running */
+    set_y_register(false);
 
     pio_sm_init(pio, state_machine, memory_offset + onewire_offset_start, &config);
     pio_sm_set_enabled(pio, state_machine, true);
 }
 
+onewire::~onewire()
+{
+    if (search_program_loaded)
+    {
+        get_onewire_search_instructions().release(program.pio_index);
+    }
+}
+
 void onewire::set_fifo_thresh(uint thresh) const
 {
-    auto pio = program.instructions.pio;
+    auto pio = program.pio;
     auto state_machine = program.state_machine_id;
 
     if (thresh >= 32) { thresh = 0; }
@@ -133,197 +156,253 @@ void onewire::set_fifo_thresh(uint thresh) const
 
 int onewire::reset() const
 {
-    auto pio = program.instructions.pio;
+    TRACE_SCOPE(onewire_reset, pin);
+    auto pio = program.pio;
     auto state_machine = program.state_machine_id;
-    auto memory_offset = program.instructions.pio_memory_offset;
+    auto memory_offset = program.pio_memory_offset;
+
+    /* Let the tail of the previous bit finish before the
+       clock divider is changed */
+    wait_until_sm_idle();
 
     /* Switch to slow timing for reset */
-    set_timing(70);
-    set_fifo_thresh(1);
+    set_timing(get_timing_profile(current_speed).reset_tick_us);
 
     // onewire_do_reset(pio, sm, offset);
     pio_sm_exec(pio, state_machine, pio_encode_jmp(memory_offset + onewire_offset_reset));
-    while (pio_sm_get_rx_fifo_level(pio, state_machine) == 0)
-    {} /* wait */;
-    int ret = ((pio_sm_get(pio, state_machine) & 0x80000000) == 0);
 
-    /* when rx fifo has filled we still need to wait for
-       the remaineder of the reset to execute before we
-       can manipulate the clkdiv.
-       Just wait until we reach the waiting state */
+    /* The presence bit is not auto-pushed, as that would
+       require switching the FIFO threshold to 1 bit and
+       restarting the state machine on every reset.
+       Instead wait until the reset branch has completed and
+       push the sampled bit (in 31 of the ISR) manually.
+       With a threshold of 1 bit (after triplets) the bit
+       has already been auto-pushed, pushing again would leave
+       a stale word in the RX FIFO. */
     wait_until_sm_idle();
+    if (pio_sm_is_rx_fifo_empty(pio, state_machine))
+    {
+        pio_sm_exec(pio, state_machine, pio_encode_push(false, false));
+    }
+    int ret = ((pio_sm_get(pio, state_machine) & 0x80000000) == 0);
 
     /* Restore normal timing */
-    set_timing(3);
+    set_timing(get_timing_profile(current_speed).slot_tick_us);
 
     return ret;// 1=detected, 0=not
 }
 
-void onewire::set_timing(uint usecs) const
+void onewire::set_timing(float usecs) const
 {
-    auto pio = program.instructions.pio;
+    auto pio = program.pio;
     auto state_machine = program.state_machine_id;
 
-    uint div = clock_get_hz(clk_sys) / 1e6 * usecs;
-    pio_sm_set_clkdiv_int_frac(pio, state_machine, div, 0);
+    /* Overdrive ticks are not a whole number of microseconds,
+       so use the fractional divider */
+    float div = float(clock_get_hz(clk_sys) / 1e6) * usecs;
+    pio_sm_set_clkdiv(pio, state_machine, div);
     pio_sm_clkdiv_restart(pio, state_machine);
 }
 
+/* The rx/tx-branch counts y down between release and sample of a
+   read slot, bit 0 drives pinctlz low */
+void onewire::set_y_register(bool strong_pullup) const
+{
+    uint value = get_timing_profile(current_speed).sample_delay;
+    if (strong_pullup)
+    {
+        value |= onewire_timing::STRONG_PULLUP;
+    }
+    pio_sm_exec(program.pio, program.state_machine_id, pio_encode_set(pio_y, value));
+}
+
+void onewire::set_speed(speed bus_speed) const
+{
+    if (bus_speed == current_speed)
+    {
+        return;
+    }
+    /* Let the tail of the previous bit finish */
+    wait_until_sm_idle();
+    current_speed = bus_speed;
+    set_timing(get_timing_profile(current_speed).slot_tick_us);
+    set_y_register(false);
+}
+
+void onewire::clock_changed() const
+{
+    wait_until_sm_idle();
+    set_timing(get_timing_profile(current_speed).slot_tick_us);
+}
+
 /* Wait for idle state to be reached. This is only
    useful when you know that all but the last bit
    have been processed (after having checked fifos) */
 void onewire::wait_until_sm_idle() const
 {
-    auto pio = program.instructions.pio;
+    wait_until_sm_idle(program.pio_memory_offset + onewire_offset_waiting);
+}
+
+void onewire::wait_until_sm_idle(uint waiting_addr) const
+{
+    TRACE_SCOPE(onewire_wait_idle, pin);
+    auto pio = program.pio;
     auto state_machine = program.state_machine_id;
-    auto memory_offset = program.instructions.pio_memory_offset;
 
-    uint8_t waiting_addr = memory_offset + onewire_offset_waiting;
     auto retries = TIMEOUT_RETRIES;
     while (pio_sm_get_pc(pio, state_machine) != waiting_addr)
     {
         sleep_us(1);
         if (retries-- < 0)
         {
-            /* FIXME: do something clever in case of
-               timeout */
+            abort_transfer("1-Wire state machine did not become idle");
+        }
+    }
+}
+
+void onewire::wait_for_rx() const
+{
+    auto pio = program.pio;
+    auto state_machine = program.state_machine_id;
+
+    const uint32_t start = time_us_32();
+    while (pio_sm_get_rx_fifo_level(pio, state_machine) == 0)
+    {
+        if (time_us_32() - start > RX_TIMEOUT_US)
+        {
+            abort_transfer("1-Wire receive timed out");
         }
     }
 }
 
+/* Restart the 1-Wire program in its idle state at standard speed with
+   the strong pullup off, the next reset resynchronizes the devices */
+void onewire::abort_transfer(const char* reason) const
+{
+    auto pio = program.pio;
+    auto state_machine = program.state_machine_id;
+    auto memory_offset = program.pio_memory_offset;
+
+    pio_sm_set_enabled(pio, state_machine, false);
+    pio_sm_init(pio, state_machine, memory_offset + onewire_offset_start, &config);
+    current_speed = speed::standard;
+    set_timing(onewire_timing::STANDARD.slot_tick_us);
+    set_y_register(false);
+    pio_sm_exec(pio, state_machine, pio_encode_set(pio_pins, 1));
+    pio_sm_set_enabled(pio, state_machine, true);
+    printf("1-Wire on pin %u: %s\n", pin, reason);
+    throw std::runtime_error(reason);
+}
+
 uint8_t onewire::transmit_or_receive_bits(const uint8_t bits, const uint8_t data) const
 {
-    auto pio = program.instructions.pio;
+    auto pio = program.pio;
     auto state_machine = program.state_machine_id;
 
     set_fifo_thresh(bits);
     pio->txf[state_machine] = data;
-    while (pio_sm_get_rx_fifo_level(pio, state_machine) == 0)
-    {} /* wait */;
+    wait_for_rx();
     /* Returned byte is in 31..24 of RX fifo! */
     return (pio_sm_get(pio, state_machine) >> (32-bits)) & 0xff;
 }
 
 void onewire::transmit(uint8_t byte) const
 {
+    TRACE_SCOPE(onewire_transmit, pin);
     transmit_or_receive_bits(8, byte);
 }
 
 uint8_t onewire::receive() const
 {
+    TRACE_SCOPE(onewire_receive, pin);
     return transmit_or_receive_bits();
 }
 
 void onewire::transmit_then_pull_up(uint8_t byte) const
 {
-    auto pio = program.instructions.pio;
+    auto pio = program.pio;
     auto state_machine = program.state_machine_id;
 
     transmit_or_receive_bits(7, byte);
 
     set_fifo_thresh(1);
-    pio_sm_exec(pio, state_machine, pio_encode_set(pio_y, 0));
+    set_y_register(true);
     pio->txf[state_machine] = byte >> 7;
-    while (pio_sm_get_rx_fifo_level(pio, state_machine) == 0)
-    {} /* wait */;
+    wait_for_rx();
     pio_sm_get(pio, state_machine); /* read to drain RX fifo */
 }
 
 void onewire::disable_pull_up() const
 {
-    auto pio = program.instructions.pio;
+    auto pio = program.pio;
     auto state_machine = program.state_machine_id;
 
     /* Preset y register so no SPU during next bit */
-    pio_sm_exec(pio, state_machine, pio_encode_set(pio_y, 1));
+    set_y_register(false);
     /* Set pinctlz pin to high ! */
     pio_sm_exec(pio, state_machine, pio_encode_set(pio_pins, 1));
 }
 
-std::optional<onewire::search_state> onewire::incremental_search(const onewire::search_state& state) const
+onewire::triplet_result onewire::triplet(bool direction_on_discrepancy) const
 {
-
-    const auto [last_device_id, most_significant_discrepancy] = state;
-
-    if(!reset())
+    /* All three bits are transferred with a FIFO threshold
+       of 1 bit, so consecutive triplets never have to restart
+       the state machine. */
+    bool id_bit = transmit_or_receive_bits(1, 0b1);
+    bool complement_bit = transmit_or_receive_bits(1, 0b1);
+
+    bool direction = id_bit; // all remaining devices agree on the id bit
+    if (id_bit == complement_bit) // discrepancy (or no devices at all)
     {
-        return {};
+        direction = direction_on_discrepancy;
     }
+    transmit_or_receive_bits(1, direction);
 
-    transmit(ONEWIRE_SEARCH_COMMAND);
-
-    uint8_t search_direction = 0;
-
-    uint64_t device_id = 0;
-    int8_t discrepancy = 64;
-    for (int8_t bit_id = 0; bit_id < 64; bit_id++)
-    {
-        // get 2 bits
-        uint8_t id_bits = transmit_or_receive_bits(2, 0b11); // [complementary id bit, id bit]
-        search_direction = id_bits & 0b1; // we initially go down the direction of the last id bit
-        switch (id_bits)
-        {
-        case 0b00: // discrepancy
-        {
-            bool last_discrepancy_reached = bit_id == most_significant_discrepancy; // we hit the last discrepancy, go down the other way
-            bool bit_in_last_device_id_is_one = // before the most significant discrepancy, follow the path of the last device id
-                (bit_id < most_significant_discrepancy) && ((last_device_id >> bit_id) & 0b1);
-            if(last_discrepancy_reached || bit_in_last_device_id_is_one)
-            {
-                search_direction = 1;
-                break;
-            }
-            else
-            {
-                discrepancy = bit_id; // we hit a discrepancy and are going down the 0-direction, *insert NOTED-meme*
-            }
-            break;
-        }
-        case 0b11: // no devices left
-            return {};
-        default:
-            // either 0b01 (all device ids are 1 at the current bit) or 0b10 (all 0)
-            // all remaining devices agree on the last bit, continue in the set search_direction
-            break;
-        }
-
-        transmit_or_receive_bits(1, search_direction);
+    return {id_bit, complement_bit, direction};
+}
 
-        device_id += uint64_t(search_direction) << bit_id;
-    }
-    return {search_state{device_id, discrepancy}};
+onewire::search_bits onewire::run_search(uint64_t directions) const
+{
+    return search_program_loaded ? run_search_program(directions) : bus_master::run_search(directions);
 }
 
-std::vector<uint64_t> onewire::search() const
+onewire::search_bits onewire::run_search_program(uint64_t directions) const
 {
-    std::vector<uint64_t> device_ids;
+    auto pio = program.pio;
+    auto state_machine = program.state_machine_id;
+    auto memory_offset = program.pio_memory_offset;
+    auto search_offset = get_onewire_search_instructions().offset(program.pio_index);
+
+    /* Switch the state machine over to the search program once
+       the search command has been sent */
+    wait_until_sm_idle();
+    pio_sm_init(pio, state_machine, search_offset + onewire_search_offset_start, &search_config);
+    set_timing(onewire_timing::SEARCH_TICK_US);
+    pio_sm_put(pio, state_machine, uint32_t(directions));
+    pio_sm_put(pio, state_machine, uint32_t(directions >> 32));
+    pio_sm_set_enabled(pio, state_machine, true);
 
-    int8_t most_significant_discrepancy = -1;
-    uint64_t last_device_id = 0;
-    int checksum_fails = 0;
-    while (most_significant_discrepancy != 64)
+    /* 16 triplets per RX word: bit 2n is the id bit,
+       bit 2n+1 the complement bit of triplet n */
+    search_bits bits{0, 0};
+    for (uint word = 0; word < 4; word++)
     {
-        auto search_result = incremental_search({last_device_id, most_significant_discrepancy});
-        if(!search_result.has_value())
+        wait_for_rx();
+        uint32_t triplets = pio_sm_get(pio, state_machine);
+        for (uint i = 0; i < 16; i++)
         {
-            return device_ids;
+            uint bit_id = word * 16 + i;
+            bits.id |= uint64_t((triplets >> (2 * i)) & 0b1) << bit_id;
+            bits.complement |= uint64_t((triplets >> (2 * i + 1)) & 0b1) << bit_id;
         }
-        auto [device_id, discrepancy] = search_result.value();
-        if(calc_crc8((uint8_t*)&device_id, sizeof(decltype(device_id))))
-        {
-            // checksum is invalid, something went wrong, try again
-            printf("checksum of device %llu invalid\n", device_id);
-            checksum_fails++;
-            if(checksum_fails > CHECKSUM_RETRIES)
-            {
-                throw std::runtime_error("Max checksum fails exceeded.");
-            }
-            continue;
-        }
-        last_device_id = device_id;
-        most_significant_discrepancy = discrepancy;
-        device_ids.push_back(device_id);
     }
 
-    return device_ids;
+    /* Wait for the last write slot to finish and switch back */
+    wait_until_sm_idle(search_offset + onewire_search_offset_start);
+    pio_sm_init(pio, state_machine, memory_offset + onewire_offset_start, &config);
+    set_timing(get_timing_profile(current_speed).slot_tick_us);
+    set_y_register(false);
+    pio_sm_set_enabled(pio, state_machine, true);
+
+    return bits;
 }
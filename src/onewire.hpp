@@ -1,29 +1,38 @@
 #pragma once
 
+#include <bus_master.hpp>
 #include <picopp.hpp>
 
 #include <hardware/pio.h>
 #include <pico/stdlib.h>
 
 #include <cstdint>
-#include <optional>
-#include <tuple>
-#include <vector>
 
-uint8_t calc_crc8(const uint8_t* data, const size_t size);
-
-class onewire
+class onewire : public bus_master
 {
   public:
     onewire(uint8_t pin, uint8_t pinctlz);
+    ~onewire() override;
+
+    /* Reset at the current speed. Only overdrive capable devices
+       which have been switched to overdrive respond to a reset
+       at overdrive speed */
+    int reset() const override;
+
+    /* Switch the timing of the master, devices are switched by
+       select and skip_rom */
+    void set_speed(speed bus_speed) const override;
+    speed get_speed() const override { return current_speed; }
 
-    int reset() const;
+    /* Recompute the clock divider after clk_sys has changed.
+       Call while no transfer is in progress. */
+    void clock_changed() const override;
 
     /* Transmit a byte */
-    void transmit(uint8_t byte) const;
+    void transmit(uint8_t byte) const override;
 
     /* Receive a byte */
-    uint8_t receive() const;
+    uint8_t receive() const override;
 
     /*  Transmit a byte and activate strong pullup after
         last bit has been sent.
@@ -33,44 +42,44 @@ class onewire
         activated.
         Either consider this when controlling the strong
         pullup time or wait for idle before taking time. */
-    void transmit_then_pull_up(uint8_t byte) const;
+    void transmit_then_pull_up(uint8_t byte) const override;
 
     /* Reset the strong pullup (set pinctlz to high) */
-    void disable_pull_up() const;
-
-    using search_state = std::tuple<uint64_t, int8_t>;
-    /**
-     * @brief Incrementally search new devices by passing the last discrepancy
-     * point to the next iteration. This does not work with hot-swapping devices.
-     * When a new device is connected, a new search has to be started, i.e.,
-     * last_discrepancy has to be 0. When this function returns no values, the
-     * search has to be started from scratch, too.
-     *
-     * @param last_discrepancy The last discrepancy of the previous iteration.
-     *     Initialize with 0.
-     * @return new device id, new last discrepancy
-     */
-    std::optional<search_state> incremental_search(const search_state& state) const;
-
-    //--------------------------------------------------------------------------
-    // Do a general search. Continues from the previous search state.
-    // The search state can be reset by using the 'OWFirst' function.
-    //
-    // Returns:   TRUE (1) : when a 1-Wire device was found and its
-    //                       Serial Number placed in the global ROM
-    //            FALSE (0): when no new device was found.  Either the
-    //                       last search was the last device or there
-    //                       are no devices on the 1-Wire Net.
-    //
-    std::vector<uint64_t> search() const;
+    void disable_pull_up() const override;
+
+    triplet_result triplet(bool direction_on_discrepancy) const override;
+
+    const char* search_method() const override
+    {
+        return search_program_loaded ? "PIO search" : "ARM triplets";
+    }
+
+    uint16_t trace_id() const override { return pin; }
+
+    /* Whether the ROM search runs in the onewire_search PIO program
+       instead of triplets driven by the ARM */
+    bool has_search_program() const { return search_program_loaded; }
+
+  protected:
+    search_bits run_search(uint64_t directions) const override;
 
   private:
+    search_bits run_search_program(uint64_t directions) const;
+
     void set_fifo_thresh(uint thresh) const;
-    void set_timing(uint usecs) const;
+    void set_timing(float usecs) const;
+    void set_y_register(bool strong_pullup) const;
     void wait_until_sm_idle() const;
+    void wait_until_sm_idle(uint waiting_addr) const;
+    void wait_for_rx() const;
+    [[noreturn]] void abort_transfer(const char* reason) const;
     uint8_t transmit_or_receive_bits(const uint8_t bits = 8, const uint8_t data = 0xff) const;
 
     pico::Program program;
+    pio_sm_config config;
+    pio_sm_config search_config;
+    bool search_program_loaded;
+    mutable speed current_speed = speed::standard;
     uint8_t pin; /* Pin number for 1-Wire data signal */
     uint8_t pinctlz; /* Pin number for external FET strong pullup */
 };
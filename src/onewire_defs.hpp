@@ -1,6 +1,11 @@
 #pragma once
 
-constexpr const uint ONEWIRE_SKIP_ROM_COMMAND  = 0xcc;
-constexpr const uint ONEWIRE_READ_ROM_COMMAND  = 0x33;
-constexpr const uint ONEWIRE_SEARCH_COMMAND    = 0xf0;
-constexpr const uint ONEWIRE_MATCH_ROM_COMMAND = 0x55;
+#include <cstdint>
+
+constexpr const uint8_t ONEWIRE_SKIP_ROM_COMMAND            = 0xcc;
+constexpr const uint8_t ONEWIRE_READ_ROM_COMMAND            = 0x33;
+constexpr const uint8_t ONEWIRE_SEARCH_COMMAND              = 0xf0;
+constexpr const uint8_t ONEWIRE_ALARM_SEARCH_COMMAND        = 0xec;
+constexpr const uint8_t ONEWIRE_MATCH_ROM_COMMAND           = 0x55;
+constexpr const uint8_t ONEWIRE_OVERDRIVE_SKIP_ROM_COMMAND  = 0x3c;
+constexpr const uint8_t ONEWIRE_OVERDRIVE_MATCH_ROM_COMMAND = 0x69;
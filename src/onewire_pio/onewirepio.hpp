@@ -4,6 +4,7 @@
 extern "C" {
 #endif
 #include <onewire.pio.h>
+#include <onewire_search.pio.h>
 #ifdef __cplusplus
 }
 #endif
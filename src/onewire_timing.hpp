@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+
+// Instruction timings of the onewire PIO programs per 1-Wire speed.
+// Also used by the host-side PIO model in tools/pio_trace to check the
+// resulting waveforms against the 1-Wire timing requirements.
+namespace onewire_timing
+{
+struct profile
+{
+    float slot_tick_us;  // instruction timing of the rx/tx-branch
+    float reset_tick_us; // instruction timing of the reset-branch
+    uint8_t sample_delay;  // y-register of the rx/tx-branch, see onewire.pio
+};
+
+/* Standard speed, see onewire.pio: 5us low, sample at 15us */
+constexpr const profile STANDARD{ 2.5f, 70.0f, 2 };
+
+/* Overdrive: 0.5us ticks give 1us low to start a slot, sample the
+   bus 2us into the slot and make 12us read slots (12.5us low for a
+   0-bit). 9.5us reset ticks give 66.5us reset low and sample the
+   presence pulse 9.5us after release. */
+constexpr const profile OVERDRIVE{ 0.5f, 9.5f, 0 };
+
+/* The search program runs at standard speed with 3us ticks, see
+   onewire_search.pio */
+constexpr const float SEARCH_TICK_US = 3.0f;
+
+/* Bit 0 of the y-register switches the strong pullup on */
+constexpr const uint8_t STRONG_PULLUP = 0x1;
+}// namespace onewire_timing
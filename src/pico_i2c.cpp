@@ -0,0 +1,52 @@
+#include <pico_i2c.hpp>
+
+#include <hardware/gpio.h>
+
+namespace
+{
+/* Bounds a transfer if a target holds SCL low, generously above the
+   9 clocks per byte at the configured baud rate */
+constexpr const uint32_t TRANSFER_TIMEOUT_BASE_US = 500;
+constexpr const uint32_t TRANSFER_TIMEOUT_BYTE_CLOCKS = 20;
+
+uint32_t transfer_timeout_us(size_t length, uint32_t baudrate)
+{
+    return TRANSFER_TIMEOUT_BASE_US + uint32_t((length + 1) * TRANSFER_TIMEOUT_BYTE_CLOCKS * 1000000ull / baudrate);
+}
+}// namespace
+
+pico_i2c::pico_i2c(i2c_inst_t *instance_in, uint8_t sda_pin, uint8_t scl_pin, uint32_t baudrate_in):
+    instance(instance_in), baudrate(baudrate_in)
+{
+    i2c_init(instance, baudrate);
+    gpio_set_function(sda_pin, GPIO_FUNC_I2C);
+    gpio_set_function(scl_pin, GPIO_FUNC_I2C);
+    /* The bridge boards carry their own pull-ups, the internal ones
+       only keep the lines defined without a board attached */
+    gpio_pull_up(sda_pin);
+    gpio_pull_up(scl_pin);
+}
+
+pico_i2c::~pico_i2c()
+{
+    i2c_deinit(instance);
+}
+
+bool pico_i2c::write(uint8_t address, std::span<const uint8_t> data)
+{
+    int written = i2c_write_timeout_us(instance, address, data.data(), data.size(), false,
+        transfer_timeout_us(data.size(), baudrate));
+    return written == int(data.size());
+}
+
+bool pico_i2c::read(uint8_t address, std::span<uint8_t> data)
+{
+    int received = i2c_read_timeout_us(instance, address, data.data(), data.size(), false,
+        transfer_timeout_us(data.size(), baudrate));
+    return received == int(data.size());
+}
+
+void pico_i2c::clock_changed()
+{
+    i2c_set_baudrate(instance, baudrate);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <i2c_transport.hpp>
+
+#include <hardware/i2c.h>
+
+#include <cstdint>
+
+/* I2C controller on one of the RP2040 I2C blocks */
+class pico_i2c : public i2c_transport
+{
+  public:
+    pico_i2c(i2c_inst_t *instance, uint8_t sda_pin, uint8_t scl_pin, uint32_t baudrate);
+    ~pico_i2c() override;
+
+    pico_i2c(const pico_i2c &) = delete;
+    pico_i2c &operator=(const pico_i2c &) = delete;
+
+    bool write(uint8_t address, std::span<const uint8_t> data) override;
+    bool read(uint8_t address, std::span<uint8_t> data) override;
+
+    void clock_changed() override;
+
+  private:
+    i2c_inst_t *instance;
+    uint32_t baudrate;
+};
@@ -1,36 +1,142 @@
 #include <picopp.hpp>
 
+#include <cstdio>
 #include <stdexcept>
-#include <array>
+
+namespace
+{
+static_assert(NUM_PIOS == 2, "");
+const std::array<pio_hw_t *, NUM_PIOS> pio_instances{ pio0, pio1 };// try PIO 0 first, as CYW43 prefers PIO 1
+
+constexpr const uint PIO_STATE_MACHINES = 4;
+}// namespace
+
+uint pico::free_state_machines(PIO pio)
+{
+    uint free = 0;
+    for (uint state_machine = 0; state_machine < PIO_STATE_MACHINES; state_machine++)
+    {
+        if (!pio_sm_is_claimed(pio, state_machine))
+        {
+            free++;
+        }
+    }
+    return free;
+}
+
+uint pico::free_instruction_slots(PIO pio)
+{
+    // The SDK does not expose its instruction memory bookkeeping, so probe
+    // every offset with a single instruction program.
+    static const uint16_t probe_instruction = pio_encode_nop();
+    const pio_program_t probe_program{ &probe_instruction, 1, -1 };
+
+    uint free = 0;
+    for (uint offset = 0; offset < PIO_INSTRUCTION_COUNT; offset++)
+    {
+        if (pio_can_add_program_at_offset(pio, &probe_program, offset))
+        {
+            free++;
+        }
+    }
+    return free;
+}
+
+void pico::print_pio_budget()
+{
+    for (uint i = 0; i < NUM_PIOS; i++)
+    {
+        printf("PIO %u: %u free state machines, %u free instruction slots\n",
+            i,
+            free_state_machines(pio_instances[i]),
+            free_instruction_slots(pio_instances[i]));
+    }
+}
 
 pico::ProgramInstructions::ProgramInstructions(const pio_program_t *program_in):
     program(program_in)
+{}
+
+pico::ProgramInstructions::~ProgramInstructions()
 {
-    static_assert(NUM_PIOS == 2, "");
-    const std::array<pio_hw_t *, 2> pio_instances{ pio0, pio1 };// try PIO 0 first, as CYW43 prefers PIO 1
+    for (uint i = 0; i < NUM_PIOS; i++)
+    {
+        if (users[i] > 0)
+        {
+            pio_remove_program(pio_instances[i], program, pio_memory_offsets[i]);
+        }
+    }
+}
 
-    for (auto possible_pio : pio_instances)
+bool pico::ProgramInstructions::acquire(uint pio_index)
+{
+    if (users[pio_index] == 0)
     {
-        if (pio_can_add_program(possible_pio, program))
+        auto pio = pio_instances[pio_index];
+        if (!pio_can_add_program(pio, program))
         {
-            pio = possible_pio;
-            pio_memory_offset = pio_add_program(possible_pio, program);
+            return false;
         }
+        pio_memory_offsets[pio_index] = pio_add_program(pio, program);
     }
-    if (!pio)
+    users[pio_index]++;
+    return true;
+}
+
+void pico::ProgramInstructions::release(uint pio_index)
+{
+    if (users[pio_index] == 0)
+    {
+        return;
+    }
+    users[pio_index]--;
+    if (users[pio_index] == 0)
+    {
+        pio_remove_program(pio_instances[pio_index], program, pio_memory_offsets[pio_index]);
+    }
+}
+
+uint pico::ProgramInstructions::claim_state_machine(uint &state_machine_id)
+{
+    // Prefer PIOs which already hold the program, so instruction memory is
+    // only spent once the state machines of those PIOs are used up.
+    for (bool loaded_only : { true, false })
     {
-        throw std::runtime_error("Could not load PIO program.");
+        for (uint i = 0; i < NUM_PIOS; i++)
+        {
+            auto pio = pio_instances[i];
+            if (is_loaded(i) != loaded_only || free_state_machines(pio) == 0)
+            {
+                continue;
+            }
+            if (!acquire(i))
+            {
+                continue;
+            }
+            int claimed = pio_claim_unused_sm(pio, false);
+            if (claimed < 0)
+            {
+                release(i);
+                continue;
+            }
+            state_machine_id = uint(claimed);
+            return i;
+        }
     }
+    throw std::runtime_error("Could not load PIO program.");
 }
 
-pico::Program::Program(const ProgramInstructions &instructions_in):
+pico::Program::Program(ProgramInstructions &instructions_in):
     instructions(instructions_in)
 {
-    state_machine_id = (int8_t)pio_claim_unused_sm(instructions.pio, true);
+    pio_index = instructions.claim_state_machine(state_machine_id);
+    pio = pio_instances[pio_index];
+    pio_memory_offset = instructions.offset(pio_index);
 }
 
 pico::Program::~Program()
 {
-    pio_sm_set_enabled(instructions.pio, state_machine_id, false);
-    pio_sm_unclaim(instructions.pio, state_machine_id);
+    pio_sm_set_enabled(pio, state_machine_id, false);
+    pio_sm_unclaim(pio, state_machine_id);
+    instructions.release(pio_index);
 }
@@ -3,29 +3,65 @@
 #include <hardware/structs/pio.h>
 #include <hardware/pio.h>
 
+#include <array>
+
 namespace pico
 {
-// Associates a pio_program_t with a PIO
+// Number of free (unclaimed) state machines of a PIO.
+uint free_state_machines(PIO pio);
+
+// Number of free instruction memory slots of a PIO.
+uint free_instruction_slots(PIO pio);
+
+// Prints the state machine and instruction memory budget of all PIOs.
+void print_pio_budget();
+
+// Manages a pio_program_t across all PIOs. The program is loaded into a PIO's
+// instruction memory on demand, i.e., only when the first state machine on
+// that PIO needs it, and removed again when the last user is gone.
 struct ProgramInstructions
 {
     ProgramInstructions(const pio_program_t *program);
+    ~ProgramInstructions();
+
+    ProgramInstructions(const ProgramInstructions &) = delete;
+    ProgramInstructions &operator=(const ProgramInstructions &) = delete;
+
+    // Claims a state machine on the first PIO (PIO 0 first, as CYW43 prefers
+    // PIO 1) that either already has the program loaded or has room for it.
+    // Returns the PIO index.
+    uint claim_state_machine(uint &state_machine_id);
+
+    // Loads the program into the given PIO, if not already loaded, without
+    // claiming a state machine. Returns false if it does not fit.
+    bool acquire(uint pio_index);
 
-    ~ProgramInstructions()
-    {
-        pio_remove_program(pio, program, pio_memory_offset);
-    }
+    // Drops one user of the program on the given PIO.
+    void release(uint pio_index);
+
+    bool is_loaded(uint pio_index) const { return users[pio_index] > 0; }
+    uint offset(uint pio_index) const { return pio_memory_offsets[pio_index]; }
 
     const pio_program_t* program;
-    PIO pio = nullptr;
-    uint pio_memory_offset;
+
+  private:
+    std::array<uint, NUM_PIOS> pio_memory_offsets{};
+    std::array<uint, NUM_PIOS> users{};
 };
 
 // Loads a program on a state machine.
 struct Program
 {
-    Program(const ProgramInstructions &instructions);
+    Program(ProgramInstructions &instructions);
     ~Program();
-    const ProgramInstructions& instructions;
+
+    Program(const Program &) = delete;
+    Program &operator=(const Program &) = delete;
+
+    ProgramInstructions& instructions;
+    PIO pio;
+    uint pio_index;
+    uint pio_memory_offset;
     uint state_machine_id;
 };
 }// namespace pico
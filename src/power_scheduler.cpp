@@ -0,0 +1,107 @@
+#include <power_scheduler.hpp>
+
+#include <mqtt_client.hpp>
+#include <trace.hpp>
+
+#include <hardware/clocks.h>
+#include <hardware/uart.h>
+#include <pico/cyw43_arch.h>
+
+#include <stdexcept>
+
+namespace
+{
+/* Lowest clock reachable by the system PLL that still keeps the
+   cyw43 SPI and lwIP timers serviced without backlog */
+constexpr const uint32_t IDLE_CLOCK_KHZ = 48000;
+}
+
+power_scheduler::power_scheduler(std::span<const bus_master* const> wires_in):
+    wires(wires_in), full_clock_khz(clock_get_hz(clk_sys) / 1000)
+{}
+
+void power_scheduler::start_sweep()
+{
+    sweep_start_us = time_us_64();
+    sweep_start_reduced_us = plan.reduced_clock_us();
+}
+
+void power_scheduler::idle_until(absolute_time_t deadline)
+{
+    const auto action = plan.plan(time_us_64(), to_us_since_boot(deadline));
+    if (action == idle_plan::action::none)
+    {
+        return;
+    }
+    TRACE_SCOPE(idle);
+    if (!radio_power_save)
+    {
+        set_wifi_power_save(true);
+        radio_power_save = true;
+    }
+
+    if (action == idle_plan::action::reduce_clock)
+    {
+        auto switch_start = time_us_64();
+        set_clock(IDLE_CLOCK_KHZ);
+        auto switch_end = time_us_64();
+        plan.clock_reduced_at(switch_end, uint32_t(switch_end - switch_start));
+    }
+    sleep_until(deadline);
+}
+
+void power_scheduler::restore_clock()
+{
+    if (!plan.clock_reduced())
+    {
+        return;
+    }
+    auto switch_start = time_us_64();
+    set_clock(full_clock_khz);
+
+    /* The PIO and I2C clock dividers are derived from clk_sys. A wire
+       that got stuck has been restarted with the dividers of the new
+       clock when it throws, the others still need theirs. */
+    for (const auto* wire: wires)
+    {
+        try
+        {
+            wire->clock_changed();
+        } catch (std::runtime_error&)
+        {
+        }
+    }
+    auto switch_end = time_us_64();
+    plan.clock_restored_at(switch_end, uint32_t(switch_end - switch_start));
+}
+
+void power_scheduler::wake_radio()
+{
+    if (radio_power_save)
+    {
+        set_wifi_power_save(false);
+        radio_power_save = false;
+    }
+}
+
+power_scheduler::sweep_activity power_scheduler::end_sweep()
+{
+    auto sweep_us = time_us_64() - sweep_start_us;
+    return {sweep_us - (plan.reduced_clock_us() - sweep_start_reduced_us), sweep_us};
+}
+
+void power_scheduler::set_clock(uint32_t khz)
+{
+#if LIB_PICO_STDIO_UART
+    uart_default_tx_wait_blocking();
+#endif
+    /* Keep the cyw43 driver from talking to the radio while
+       clk_sys (and with it the SPI clock) changes */
+    cyw43_arch_lwip_begin();
+    set_sys_clock_khz(khz, true);
+    cyw43_arch_lwip_end();
+#if LIB_PICO_STDIO_UART
+    /* clk_peri follows clk_sys */
+    uart_set_baudrate(uart_default, PICO_DEFAULT_UART_BAUD_RATE);
+#endif
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <bus_master.hpp>
+#include <idle_plan.hpp>
+
+#include <pico/stdlib.h>
+
+#include <cstdint>
+#include <span>
+
+/* Runs the CPU at full clk_sys and the radio in performance mode only
+   while a sweep is busy. Conversions and the time between sweeps are
+   spent asleep at a reduced clk_sys with the radio in power-save mode,
+   see idle_plan.
+
+   Dormant mode is not used: it stops the clocks the cyw43 driver and
+   the lwIP timers need to stay associated and connected. */
+class power_scheduler
+{
+  public:
+    struct sweep_activity
+    {
+        uint64_t active_us; // time at full clock since start_sweep
+        uint64_t sweep_us;  // time since start_sweep
+    };
+
+    explicit power_scheduler(std::span<const bus_master* const> wires);
+
+    void start_sweep();
+
+    /* Sleep until deadline with the radio in power-save mode, at
+       reduced clock unless the step is too short. Returns at once if
+       the deadline has passed. Leaves the clock reduced for the next
+       step, call restore_clock before work starts. */
+    void idle_until(absolute_time_t deadline);
+
+    /* Return to full clock and recompute the clock dividers of the
+       wires, if the clock is reduced */
+    void restore_clock();
+
+    /* Switch the radio to performance mode before publishing */
+    void wake_radio();
+
+    sweep_activity end_sweep();
+
+  private:
+    void set_clock(uint32_t khz);
+
+    std::span<const bus_master* const> wires;
+    uint32_t full_clock_khz;
+    bool radio_power_save = false;
+    idle_plan plan;
+    uint64_t sweep_start_us = 0;
+    uint64_t sweep_start_reduced_us = 0;
+};
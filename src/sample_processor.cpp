@@ -0,0 +1,117 @@
+#include <sample_processor.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+/* Division rounding to nearest, halves away from zero */
+int16_t divide_rounded(int32_t dividend, int32_t divisor)
+{
+    return dividend >= 0 ? (dividend + divisor / 2) / divisor : (dividend - divisor / 2) / divisor;
+}
+
+bool outside_deadband(int16_t value, int16_t reference, int16_t deadband)
+{
+    return value > reference + deadband || value < reference - deadband;
+}
+}
+
+sample_processor::sample_processor():
+    sample_processor(config{})
+{}
+
+sample_processor::sample_processor(const config& cfg_in)
+{
+    configure(cfg_in);
+}
+
+void sample_processor::configure(const config& cfg_in)
+{
+    if (cfg_in.filter_type == filter::median
+        && (cfg_in.median_window == 0 || cfg_in.median_window > MAX_MEDIAN_WINDOW || cfg_in.median_window % 2 == 0))
+    {
+        throw std::invalid_argument("Median window must be odd and at most 7 samples.");
+    }
+    if (cfg_in.window == 0 || cfg_in.ema_shift > 8 || cfg_in.deadband < 0)
+    {
+        throw std::invalid_argument("Invalid sample processing configuration.");
+    }
+    cfg = cfg_in;
+    history_count = 0;
+    history_next = 0;
+    ema_valid = false;
+    start_window();
+}
+
+void sample_processor::start_window()
+{
+    samples = 0;
+    window_sum = 0;
+}
+
+int16_t sample_processor::apply_filter(int16_t raw)
+{
+    switch (cfg.filter_type)
+    {
+    case filter::median:
+    {
+        history[history_next] = raw;
+        history_next = (history_next + 1) % cfg.median_window;
+        history_count = std::min<uint8_t>(history_count + 1, cfg.median_window);
+        std::array<int16_t, MAX_MEDIAN_WINDOW> sorted;
+        std::copy_n(history.begin(), history_count, sorted.begin());
+        std::sort(sorted.begin(), sorted.begin() + history_count);
+        return sorted[history_count / 2];
+    }
+    case filter::ema:
+        if (!ema_valid)
+        {
+            ema_q8 = int32_t(raw) * 256;
+            ema_valid = true;
+        }
+        else
+        {
+            ema_q8 += (int32_t(raw) * 256 - ema_q8) >> cfg.ema_shift;
+        }
+        return divide_rounded(ema_q8, 256);
+    case filter::none:
+    default:
+        return raw;
+    }
+}
+
+std::optional<sample_processor::report> sample_processor::add(int16_t raw)
+{
+    const int16_t value = apply_filter(raw);
+
+    if (samples == 0)
+    {
+        window_min = raw;
+        window_max = raw;
+    }
+    window_min = std::min(window_min, raw);
+    window_max = std::max(window_max, raw);
+    window_sum += raw;
+    samples++;
+    if (samples < cfg.window)
+    {
+        return {};
+    }
+
+    report rep{value, window_min, window_max, divide_rounded(window_sum, samples)};
+    start_window();
+
+    bool changed = !last_reported.has_value()
+        || outside_deadband(rep.value, *last_reported, cfg.deadband)
+        || outside_deadband(rep.min, *last_reported, cfg.deadband)
+        || outside_deadband(rep.max, *last_reported, cfg.deadband);
+    silent_windows++;
+    if (!changed && (cfg.heartbeat == 0 || silent_windows < cfg.heartbeat))
+    {
+        return {};
+    }
+    last_reported = rep.value;
+    silent_windows = 0;
+    return rep;
+}
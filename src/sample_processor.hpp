@@ -0,0 +1,68 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+
+/* Per-device processing of raw DS18B20 readings (1/16 degC):
+   a median or EMA filter, min/max/mean over a window of samples and
+   report-by-exception with a deadband. Fixed-point only, the state
+   has a fixed size. */
+class sample_processor
+{
+  public:
+    static constexpr const uint8_t MAX_MEDIAN_WINDOW = 7;
+
+    enum class filter
+    {
+        none,
+        median,
+        ema
+    };
+
+    struct config
+    {
+        filter filter_type = filter::none;
+        uint8_t median_window = 3;   // odd, at most MAX_MEDIAN_WINDOW
+        uint8_t ema_shift = 2;       // weight of a new sample is 1/2^ema_shift
+        uint8_t window = 1;          // samples aggregated into one report
+        int16_t deadband = 2;        // change of the filtered value, min or max that is reported
+        uint16_t heartbeat = 15;     // windows after which an unchanged value is reported anyway, 0 = never
+    };
+
+    struct report
+    {
+        int16_t value; // filtered value at the end of the window
+        int16_t min;   // of the raw samples
+        int16_t max;
+        int16_t mean;
+    };
+
+    sample_processor();
+    explicit sample_processor(const config& cfg);
+
+    void configure(const config& cfg);
+
+    /* Returns a report at the end of a window if it is to be published */
+    std::optional<report> add(int16_t raw);
+
+  private:
+    int16_t apply_filter(int16_t raw);
+    void start_window();
+
+    config cfg;
+
+    std::array<int16_t, MAX_MEDIAN_WINDOW> history{};
+    uint8_t history_count = 0;
+    uint8_t history_next = 0;
+    int32_t ema_q8 = 0; // Q23.8
+    bool ema_valid = false;
+
+    uint8_t samples = 0;
+    int16_t window_min = 0;
+    int16_t window_max = 0;
+    int32_t window_sum = 0;
+
+    std::optional<int16_t> last_reported;
+    uint16_t silent_windows = 0;
+};
@@ -0,0 +1,231 @@
+#include <sweep_encoder.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+namespace
+{
+/* Entry header, value, three window fields and the time */
+constexpr const size_t MAX_ENTRY_SIZE = 6 * sweep_format::MAX_VARINT_SIZE;
+}
+
+sweep_encoder::sweep_encoder(output_function output_in):
+    output(std::move(output_in))
+{}
+
+void sweep_encoder::set_devices(std::vector<uint64_t> identifiers_in)
+{
+    std::sort(identifiers_in.begin(), identifiers_in.end());
+    identifiers_in.erase(std::unique(identifiers_in.begin(), identifiers_in.end()), identifiers_in.end());
+    if (identifiers_in == identifiers)
+    {
+        return;
+    }
+
+    /* Devices keep their last value across table changes */
+    std::vector<int16_t> new_previous(identifiers_in.size());
+    std::vector<bool> new_known(identifiers_in.size());
+    for (size_t i = 0; i < identifiers_in.size(); i++)
+    {
+        auto old = std::lower_bound(identifiers.begin(), identifiers.end(), identifiers_in[i]);
+        if (old != identifiers.end() && *old == identifiers_in[i])
+        {
+            new_previous[i] = previous[old - identifiers.begin()];
+            new_known[i] = known[old - identifiers.begin()];
+        }
+    }
+    identifiers = std::move(identifiers_in);
+    previous = std::move(new_previous);
+    known = std::move(new_known);
+
+    uint16_t crc = 0xffff;
+    for (auto identifier : identifiers)
+    {
+        uint8_t bytes[8];
+        std::memcpy(bytes, &identifier, sizeof(bytes)); // little endian
+        crc = sweep_format::crc16(bytes, crc);
+    }
+    table = crc;
+    key_frame_due = true;
+}
+
+void sweep_encoder::request_key_frame()
+{
+    key_frame_due = true;
+}
+
+void sweep_encoder::begin_message(sweep_format::message_type type)
+{
+    current_type = type;
+    length = 0;
+    buffer[length++] = sweep_format::VERSION;
+    buffer[length++] = uint8_t(type);
+    put_varint(sequence);
+    put_varint(part);
+    put_varint(table);
+}
+
+void sweep_encoder::end_message(bool last_part)
+{
+    if (last_part)
+    {
+        buffer[1] |= sweep_format::LAST_PART;
+    }
+    const uint16_t crc = sweep_format::crc16({buffer.data(), length});
+    buffer[length++] = uint8_t(crc);
+    buffer[length++] = uint8_t(crc >> 8);
+    output({buffer.data(), length});
+    part++;
+}
+
+void sweep_encoder::put_varint(uint64_t value)
+{
+    length += sweep_format::put_varint(buffer.data() + length, value);
+}
+
+void sweep_encoder::put_entry(size_t gap, uint8_t flags, int16_t value, int16_t previous_value, const sample *reading,
+    int32_t time_offset_ms)
+{
+    put_varint((uint64_t(gap) << sweep_format::ENTRY_FLAG_BITS) | flags);
+    put_varint(sweep_format::zigzag_encode(int32_t(value) - previous_value));
+    if (flags & sweep_format::ENTRY_WINDOW)
+    {
+        put_varint(sweep_format::zigzag_encode(int32_t(reading->min) - value));
+        put_varint(sweep_format::zigzag_encode(int32_t(reading->max) - value));
+        put_varint(sweep_format::zigzag_encode(int32_t(reading->mean) - value));
+    }
+    if (flags & sweep_format::ENTRY_TIME)
+    {
+        put_varint(sweep_format::zigzag_encode(time_offset_ms));
+    }
+}
+
+void sweep_encoder::encode_table()
+{
+    size_t first = 0;
+    do
+    {
+        begin_message(sweep_format::message_type::table);
+        put_varint(identifiers.size());
+        put_varint(first);
+        const size_t space = (MAX_MESSAGE_SIZE - length - 2 * sweep_format::MAX_VARINT_SIZE - sweep_format::CRC_SIZE) / sizeof(uint64_t);
+        const size_t count = std::min(space, identifiers.size() - first);
+        put_varint(count);
+        for (size_t i = first; i < first + count; i++)
+        {
+            std::memcpy(buffer.data() + length, &identifiers[i], sizeof(uint64_t)); // little endian
+            length += sizeof(uint64_t);
+        }
+        first += count;
+        end_message(false);
+    } while (first < identifiers.size());
+}
+
+void sweep_encoder::encode(uint32_t sequence_in, uint64_t timestamp_ms_in, std::span<const sample> samples)
+{
+    sequence = sequence_in;
+    timestamp_ms = timestamp_ms_in;
+    part = 0;
+
+    std::vector<indexed_sample> reports;
+    reports.reserve(samples.size());
+    for (const auto &reading : samples)
+    {
+        auto found = std::lower_bound(identifiers.begin(), identifiers.end(), reading.identifier);
+        if (found != identifiers.end() && *found == reading.identifier)
+        {
+            reports.push_back({size_t(found - identifiers.begin()), &reading});
+        }
+    }
+    std::sort(reports.begin(), reports.end(), [](const indexed_sample &a, const indexed_sample &b) {
+        return a.index < b.index;
+    });
+
+    const bool key_frame = key_frame_due || sweeps_since_key_frame + 1 >= KEY_FRAME_INTERVAL;
+    if (key_frame)
+    {
+        encode_table();
+        key_frame_due = false;
+        sweeps_since_key_frame = 0;
+    }
+    else
+    {
+        sweeps_since_key_frame++;
+    }
+
+    const auto type = key_frame ? sweep_format::message_type::key_frame : sweep_format::message_type::delta_frame;
+    auto begin_frame = [&]()
+    {
+        begin_message(type);
+        put_varint(timestamp_ms);
+    };
+    begin_frame();
+
+    /* Key frames visit every device, delta frames only the reports */
+    size_t next_index = 0;
+    auto report = reports.begin();
+    auto encode_device = [&](size_t index, const sample *reading)
+    {
+        if (!reading && !known[index])
+        {
+            return;
+        }
+        if (length + MAX_ENTRY_SIZE + sweep_format::CRC_SIZE > MAX_MESSAGE_SIZE)
+        {
+            end_message(false);
+            begin_frame();
+            next_index = 0;
+        }
+        uint8_t flags = 0;
+        int16_t value = previous[index];
+        int32_t time_offset_ms = 0;
+        if (reading)
+        {
+            value = reading->value;
+            flags |= sweep_format::ENTRY_REPORT;
+            if (reading->min != value || reading->max != value || reading->mean != value)
+            {
+                flags |= sweep_format::ENTRY_WINDOW;
+            }
+            /* Without a synchronized clock there is no offset */
+            if (reading->timestamp_ms != 0 && timestamp_ms != 0)
+            {
+                time_offset_ms = int32_t(std::clamp<int64_t>(int64_t(reading->timestamp_ms - timestamp_ms),
+                    std::numeric_limits<int32_t>::min(), std::numeric_limits<int32_t>::max()));
+            }
+            if (time_offset_ms != 0)
+            {
+                flags |= sweep_format::ENTRY_TIME;
+            }
+        }
+        const int16_t base = key_frame || !known[index] ? 0 : previous[index];
+        put_entry(index - next_index, flags, value, base, reading, time_offset_ms);
+        next_index = index + 1;
+        previous[index] = value;
+        known[index] = true;
+    };
+
+    if (key_frame)
+    {
+        for (size_t index = 0; index < identifiers.size(); index++)
+        {
+            const sample *reading = nullptr;
+            if (report != reports.end() && report->index == index)
+            {
+                reading = report->reading;
+                ++report;
+            }
+            encode_device(index, reading);
+        }
+    }
+    else
+    {
+        for (const auto &entry : reports)
+        {
+            encode_device(entry.index, entry.reading);
+        }
+    }
+    end_message(true);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <sweep_format.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <vector>
+
+/* Encodes sweeps in the binary sweep format (sweep_format.hpp). A
+   sweep is split into messages of at most MAX_MESSAGE_SIZE bytes,
+   which are passed to the output function in order. */
+class sweep_encoder
+{
+  public:
+    /* A publish has to fit into MQTT_OUTPUT_RINGBUF_SIZE with its topic */
+    static constexpr const size_t MAX_MESSAGE_SIZE = 768;
+    static constexpr const uint32_t KEY_FRAME_INTERVAL = 60;
+
+    /* Temperatures in 1/16 degC */
+    struct sample
+    {
+        uint64_t identifier;
+        int16_t value;
+        int16_t min;
+        int16_t max;
+        int16_t mean;
+        uint64_t timestamp_ms = 0; // conversion start of the bus in UNIX ms, 0 for that of the sweep
+    };
+
+    using output_function = std::function<void(std::span<const uint8_t>)>;
+
+    explicit sweep_encoder(output_function output);
+
+    /* A changed device table is sent with the next sweep, which is
+       a key frame */
+    void set_devices(std::vector<uint64_t> identifiers);
+    uint16_t table_id() const { return table; }
+
+    /* Send the device table and a key frame with the next sweep, e.g.
+       for a consumer that just subscribed */
+    void request_key_frame();
+
+    /* Samples of devices not in the table are skipped */
+    void encode(uint32_t sequence, uint64_t timestamp_ms, std::span<const sample> samples);
+
+  private:
+    struct indexed_sample
+    {
+        size_t index;
+        const sample *reading;
+    };
+
+    void begin_message(sweep_format::message_type type);
+    void end_message(bool last_part);
+    void put_varint(uint64_t value);
+    void put_entry(size_t gap, uint8_t flags, int16_t value, int16_t previous_value, const sample *reading, int32_t time_offset_ms);
+    void encode_table();
+
+    output_function output;
+    std::vector<uint64_t> identifiers;
+    /* Last value of each device, valid if known */
+    std::vector<int16_t> previous;
+    std::vector<bool> known;
+    uint16_t table = 0;
+    bool key_frame_due = true;
+    uint32_t sweeps_since_key_frame = 0;
+
+    std::array<uint8_t, MAX_MESSAGE_SIZE> buffer;
+    size_t length = 0;
+    uint32_t sequence = 0;
+    uint64_t timestamp_ms = 0;
+    uint32_t part = 0;
+    sweep_format::message_type current_type = sweep_format::message_type::table;
+};
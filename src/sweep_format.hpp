@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+
+/* Binary sweep format, shared by the encoder of the firmware and the
+   host decoder.
+
+   Every message is self-contained and ends with a CRC:
+     uint8        version
+     uint8        bits 0..1 message type, bit 7 set on the last part
+     varint       sequence number of the sweep
+     varint       part number within the sweep
+     varint       device table id
+     ... body of the message type ...
+     uint16       CRC-16/CCITT-FALSE of all preceding bytes, little endian
+
+   table body:   varint total device count, varint index of the first
+                 identifier, varint n, n * uint64 identifier (little endian)
+   sample body:  varint conversion start in UNIX ms (0 if not synchronized),
+                 then entries up to the CRC:
+                   varint  (index gap << 3) | (has time << 2) | (has window << 1) | is report
+                   zigzag  value - previous value of the device
+                   if has window: zigzag min - value, max - value, mean - value
+                   if has time: zigzag conversion start of the bus of the
+                                device - conversion start above, in ms
+
+   The device table lists the identifiers in ascending order, samples
+   refer to a device by its index. The table id is the CRC of the
+   identifiers. The index gap is relative to the previous entry of the
+   message + 1. The buses start converting one after the other, an
+   entry without time has the conversion start of the message.
+   Key frames encode the values against 0 and carry an entry for every
+   device with a known value; entries that are not reports only set the
+   baseline of a device. Delta frames encode values against the
+   previous entry of the same device, a decoder that misses a message
+   waits for the next key frame. */
+namespace sweep_format
+{
+constexpr const uint8_t VERSION = 2;
+constexpr const uint8_t LAST_PART = 0x80;
+
+enum class message_type : uint8_t
+{
+    table = 0,
+    key_frame = 1,
+    delta_frame = 2
+};
+
+constexpr const uint8_t ENTRY_REPORT = 0x1;
+constexpr const uint8_t ENTRY_WINDOW = 0x2;
+constexpr const uint8_t ENTRY_TIME = 0x4;
+constexpr const uint8_t ENTRY_FLAG_BITS = 3;
+
+/* Largest varint of a 64 bit value */
+constexpr const size_t MAX_VARINT_SIZE = 10;
+constexpr const size_t CRC_SIZE = 2;
+
+constexpr uint32_t zigzag_encode(int32_t value)
+{
+    return (uint32_t(value) << 1) ^ uint32_t(value >> 31);
+}
+
+constexpr int32_t zigzag_decode(uint32_t value)
+{
+    return int32_t(value >> 1) ^ -int32_t(value & 1);
+}
+
+/* Writes value at buf, returns the number of bytes written */
+inline size_t put_varint(uint8_t *buf, uint64_t value)
+{
+    size_t length = 0;
+    while (value >= 0x80)
+    {
+        buf[length++] = uint8_t(value) | 0x80;
+        value >>= 7;
+    }
+    buf[length++] = uint8_t(value);
+    return length;
+}
+
+/* Reads a varint from the front of data and advances data past it */
+inline std::optional<uint64_t> get_varint(std::span<const uint8_t> &data)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < data.size() && i < MAX_VARINT_SIZE; i++)
+    {
+        value |= uint64_t(data[i] & 0x7f) << (7 * i);
+        if (!(data[i] & 0x80))
+        {
+            data = data.subspan(i + 1);
+            return value;
+        }
+    }
+    return {};
+}
+
+inline uint16_t crc16(std::span<const uint8_t> data, uint16_t crc = 0xffff)
+{
+    for (auto byte : data)
+    {
+        crc ^= uint16_t(byte) << 8;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+}// namespace sweep_format
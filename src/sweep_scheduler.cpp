@@ -0,0 +1,94 @@
+#include <sweep_scheduler.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+uint8_t sweep_scheduler::add_group(uint64_t interval_us, uint64_t now_us)
+{
+    if (count == MAX_GROUPS)
+    {
+        throw std::runtime_error("Too many sampling groups.");
+    }
+    if (interval_us == 0)
+    {
+        throw std::invalid_argument("Sampling interval must not be 0.");
+    }
+    groups[count] = {interval_us, now_us, 0, {}};
+    return count++;
+}
+
+const sweep_scheduler::group& sweep_scheduler::get(uint8_t id) const
+{
+    if (id >= count)
+    {
+        throw std::out_of_range("No such sampling group.");
+    }
+    return groups[id];
+}
+
+void sweep_scheduler::set_interval(uint8_t id, uint64_t interval_us)
+{
+    get(id);
+    if (interval_us == 0)
+    {
+        throw std::invalid_argument("Sampling interval must not be 0.");
+    }
+    /* The next deadline keeps its place, the new interval
+       applies from there on */
+    groups[id].interval_us = interval_us;
+}
+
+uint64_t sweep_scheduler::interval(uint8_t id) const
+{
+    return get(id).interval_us;
+}
+
+uint64_t sweep_scheduler::next_deadline() const
+{
+    uint64_t deadline = std::numeric_limits<uint64_t>::max();
+    for (size_t id = 0; id < count; id++)
+    {
+        deadline = std::min(deadline, groups[id].deadline_us);
+    }
+    return deadline;
+}
+
+sweep_scheduler::group_mask sweep_scheduler::collect_due(uint64_t now_us)
+{
+    group_mask due;
+    for (size_t id = 0; id < count; id++)
+    {
+        auto& grp = groups[id];
+        if (grp.deadline_us > now_us)
+        {
+            continue;
+        }
+        due.set(id);
+
+        auto lateness = now_us - grp.deadline_us;
+        auto missed = lateness / grp.interval_us;
+        lateness %= grp.interval_us;
+
+        auto& stats = grp.stats;
+        if (stats.runs > 0)
+        {
+            auto jitter = lateness > grp.last_lateness_us ? lateness - grp.last_lateness_us : grp.last_lateness_us - lateness;
+            stats.max_jitter_us = std::max(stats.max_jitter_us, jitter);
+        }
+        stats.runs++;
+        stats.missed_deadlines += missed;
+        stats.max_lateness_us = std::max(stats.max_lateness_us, lateness);
+        stats.total_lateness_us += lateness;
+        grp.last_lateness_us = lateness;
+
+        /* Skip missed deadlines but keep the phase */
+        grp.deadline_us += (missed + 1) * grp.interval_us;
+    }
+    return due;
+}
+
+const sweep_scheduler::group_statistics& sweep_scheduler::statistics(uint8_t id) const
+{
+    return get(id).stats;
+}
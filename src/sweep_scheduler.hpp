@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+
+/* Absolute-deadline scheduler for sampling groups with individual
+   intervals. Deadlines advance by whole intervals, so the time spent
+   converting, reading and publishing does not accumulate as drift.
+   All times are microseconds since boot (time_us_64), passed in by
+   the caller. */
+class sweep_scheduler
+{
+  public:
+    static constexpr const size_t MAX_GROUPS = 8;
+    using group_mask = std::bitset<MAX_GROUPS>;
+
+    struct group_statistics
+    {
+        uint32_t runs = 0;
+        uint32_t missed_deadlines = 0; // deadlines skipped because a run was late by a full interval
+        uint64_t max_lateness_us = 0;  // start of a run after its deadline
+        uint64_t total_lateness_us = 0;
+        uint64_t max_jitter_us = 0;    // deviation of the period between two runs from the interval
+    };
+
+    /* Adds a group whose first deadline is now_us. Returns its id. */
+    uint8_t add_group(uint64_t interval_us, uint64_t now_us);
+    void set_interval(uint8_t group, uint64_t interval_us);
+    uint64_t interval(uint8_t group) const;
+    size_t group_count() const { return count; }
+
+    /* Earliest deadline of all groups */
+    uint64_t next_deadline() const;
+
+    /* Returns the groups due at now_us and advances their deadlines */
+    group_mask collect_due(uint64_t now_us);
+
+    const group_statistics& statistics(uint8_t group) const;
+
+  private:
+    struct group
+    {
+        uint64_t interval_us;
+        uint64_t deadline_us;
+        uint64_t last_lateness_us;
+        group_statistics stats;
+    };
+
+    const group& get(uint8_t id) const;
+
+    std::array<group, MAX_GROUPS> groups{};
+    size_t count = 0;
+};
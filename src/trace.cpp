@@ -0,0 +1,118 @@
+#include <trace.hpp>
+
+#include <array>
+
+#if TRACE_ENABLED
+#include <hardware/sync.h>
+#include <hardware/timer.h>
+
+#include <cstdio>
+#endif
+
+namespace
+{
+constexpr const std::array<const char*, size_t(trace::event_id::count)> EVENT_NAMES
+{{
+    "sweep",
+    "idle",
+    "onewire_reset",
+    "onewire_transmit",
+    "onewire_receive",
+    "onewire_wait_idle",
+    "onewire_search",
+    "ds18b20_convert",
+    "ds18b20_read_scratchpad",
+    "ds18b20_write_scratchpad",
+    "ds18b20_check_alarms",
+    "mqtt_dns",
+    "mqtt_connect",
+    "mqtt_subscribe",
+    "mqtt_publish"
+}};
+}
+
+const char* trace::name(event_id id)
+{
+    return size_t(id) < EVENT_NAMES.size() ? EVENT_NAMES[size_t(id)] : "unknown";
+}
+
+#if TRACE_ENABLED
+namespace
+{
+static_assert((trace::CAPACITY & (trace::CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+
+struct event
+{
+    uint32_t timestamp_us;
+    trace::event_id id;
+    trace::phase event_phase;
+    uint16_t argument;
+};
+
+std::array<event, trace::CAPACITY> ring;
+/* Events recorded since start, the ring holds the last CAPACITY */
+volatile uint32_t head = 0;
+volatile bool recording = true;
+/* End of the events of the current dump */
+uint32_t dump_end = 0;
+
+constexpr const char PHASES[] = {'B', 'E', 'I'};
+}
+
+void trace::record(event_id id, phase event_phase, uint16_t argument)
+{
+    if (!recording)
+    {
+        return;
+    }
+    const uint32_t timestamp_us = time_us_32();
+    const uint32_t interrupts = save_and_disable_interrupts();
+    const uint32_t index = head;
+    head = index + 1;
+    restore_interrupts(interrupts);
+    ring[index & (CAPACITY - 1)] = {timestamp_us, id, event_phase, argument};
+}
+
+void trace::set_recording(bool on)
+{
+    recording = on;
+}
+
+size_t trace::format(size_t &cursor, char* buf, size_t size)
+{
+    size_t length = 0;
+    /* cursor is 0 before the header, then 1 + the events written */
+    if (cursor == 0)
+    {
+        dump_end = head;
+        const uint32_t lost = dump_end > CAPACITY ? dump_end - CAPACITY : 0;
+        int written = snprintf(buf, size, "# trace v1 events %lu lost %lu\n",
+            (unsigned long)(dump_end - lost),
+            (unsigned long)lost);
+        if (written < 0 || size_t(written) >= size)
+        {
+            return 0;
+        }
+        length = written;
+        cursor = 1;
+    }
+
+    const uint32_t dump_first = dump_end > CAPACITY ? dump_end - CAPACITY : 0;
+    for (uint32_t index = dump_first + cursor - 1; index < dump_end; index++)
+    {
+        const auto& ev = ring[index & (CAPACITY - 1)];
+        int written = snprintf(buf + length, size - length, "%lu %c %s %u\n",
+            (unsigned long)ev.timestamp_us,
+            PHASES[size_t(ev.event_phase)],
+            name(ev.id),
+            unsigned(ev.argument));
+        if (written < 0 || size_t(written) >= size - length)
+        {
+            break;
+        }
+        length += written;
+        cursor++;
+    }
+    return length;
+}
+#endif
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/* Hot-path tracing: begin/end events stamped with time_us_32 in a
+   fixed ring that overwrites the oldest events.
+
+   Recording reserves a ring entry with interrupts masked for a few
+   cycles (the Cortex-M0+ has no exclusive loads/stores), then writes
+   it. Recording is safe from interrupt handlers.
+
+   Without TRACE_ENABLED (CMake option ENABLE_TRACE) TRACE_SCOPE and
+   TRACE_EVENT expand to nothing and no ring is allocated.
+
+   Dump format, one line per event, converted to Chrome trace JSON by
+   tools/trace_to_chrome:
+     # trace v1 events <n> lost <n>
+     <time_us_32> <B|E|I> <name> <argument> */
+namespace trace
+{
+enum class event_id : uint8_t
+{
+    sweep,
+    idle,
+    onewire_reset,
+    onewire_transmit,
+    onewire_receive,
+    onewire_wait_idle,
+    onewire_search,
+    ds18b20_convert,
+    ds18b20_read_scratchpad,
+    ds18b20_write_scratchpad,
+    ds18b20_check_alarms,
+    mqtt_dns,
+    mqtt_connect,
+    mqtt_subscribe,
+    mqtt_publish,
+    count
+};
+
+enum class phase : uint8_t
+{
+    begin,
+    end,
+    instant
+};
+
+const char* name(event_id id);
+
+#if TRACE_ENABLED
+constexpr const bool enabled = true;
+
+/* Power of two */
+constexpr const size_t CAPACITY = 1024;
+
+void record(event_id id, phase event_phase, uint16_t argument);
+
+/* Pause recording, e.g. while dumping */
+void set_recording(bool on);
+
+/* Writes the events recorded before the first call as lines into buf,
+   continuing at cursor (0 for the first call). Returns the number of
+   characters written, 0 when done. Only complete lines are written.
+   Pause recording while dumping, new events overwrite old ones. */
+size_t format(size_t &cursor, char* buf, size_t size);
+
+class scope
+{
+  public:
+    scope(event_id id_in, uint16_t argument_in = 0):
+        id(id_in), argument(argument_in)
+    {
+        record(id, phase::begin, argument);
+    }
+    ~scope()
+    {
+        record(id, phase::end, argument);
+    }
+    scope(const scope&) = delete;
+    scope& operator=(const scope&) = delete;
+
+  private:
+    event_id id;
+    uint16_t argument;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+/* Traces the enclosing scope */
+#define TRACE_SCOPE(id, ...) ::trace::scope TRACE_CONCAT(trace_scope_, __LINE__)(::trace::event_id::id __VA_OPT__(,) __VA_ARGS__)
+#define TRACE_EVENT(id, argument) ::trace::record(::trace::event_id::id, ::trace::phase::instant, argument)
+#else
+constexpr const bool enabled = false;
+
+inline void set_recording(bool) {}
+inline size_t format(size_t &, char*, size_t) { return 0; }
+
+#define TRACE_SCOPE(id, ...) static_cast<void>(0)
+#define TRACE_EVENT(id, argument) static_cast<void>(0)
+#endif
+}// namespace trace
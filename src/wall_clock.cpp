@@ -0,0 +1,54 @@
+#include <wall_clock.hpp>
+
+#include <clock_sync.hpp>
+
+#include <lwip/apps/sntp.h>
+#include <pico/cyw43_arch.h>
+#include <pico/stdlib.h>
+
+#include <stdio.h>
+
+namespace
+{
+/* Written in the lwIP context, read with the lwIP lock held */
+clock_sync::synchronization sync_point;
+}
+
+extern "C" void wall_clock_set_time_us(uint32_t sec, uint32_t us)
+{
+    clock_sync::update(sync_point, time_us_64(), uint64_t(sec) * 1000000 + us);
+}
+
+void wall_clock::start(const char* server)
+{
+    cyw43_arch_lwip_begin();
+    sntp_setoperatingmode(SNTP_OPMODE_POLL);
+    sntp_setservername(0, server);
+    sntp_init();
+    cyw43_arch_lwip_end();
+    printf("SNTP started with %s\n", server);
+}
+
+bool wall_clock::is_synchronized()
+{
+    cyw43_arch_lwip_begin();
+    bool valid = sync_point.valid;
+    cyw43_arch_lwip_end();
+    return valid;
+}
+
+uint64_t wall_clock::to_unix_us(uint64_t local_us)
+{
+    cyw43_arch_lwip_begin();
+    clock_sync::synchronization sync = sync_point;
+    cyw43_arch_lwip_end();
+    return sync.valid ? clock_sync::extrapolate(sync, local_us) : 0;
+}
+
+int32_t wall_clock::drift_ppb()
+{
+    cyw43_arch_lwip_begin();
+    int32_t drift = sync_point.drift_ppb;
+    cyw43_arch_lwip_end();
+    return drift;
+}
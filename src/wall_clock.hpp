@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+/* Wall clock (UNIX time) from lwIP's SNTP client. Between updates the
+   time is extrapolated from time_us_64, corrected by the drift of the
+   local clock measured between the last two updates. */
+namespace wall_clock
+{
+/* Start polling server every SNTP_UPDATE_DELAY */
+void start(const char* server);
+
+bool is_synchronized();
+
+/* UNIX time in us of a time_us_64 value, 0 if not synchronized */
+uint64_t to_unix_us(uint64_t local_us);
+
+/* Measured drift of the local clock in parts per billion */
+int32_t drift_ppb();
+}
@@ -0,0 +1,281 @@
+#include <warm_state.hpp>
+
+#include <sweep_format.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+constexpr const size_t HEADER_SIZE = 12;
+constexpr const size_t LENGTH_OFFSET = 8;
+constexpr const size_t CRC_SIZE = 4;
+constexpr const size_t DEVICE_SIZE = 11;
+
+size_t varint_size(uint64_t value)
+{
+    size_t size = 1;
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+/* Writes the payload behind the header, stops writing once the region
+   is full and keeps room for the CRC */
+class writer
+{
+  public:
+    explicit writer(std::span<uint8_t> region_in): region(region_in) {}
+
+    bool full() const { return overflow; }
+    size_t room() const { return overflow ? 0 : region.size() - CRC_SIZE - position; }
+
+    void put_varint(uint64_t value)
+    {
+        if (reserve(varint_size(value)))
+        {
+            position += sweep_format::put_varint(region.data() + position, value);
+        }
+    }
+
+    template<typename T>
+    void put(T value)
+    {
+        // the RP2040 is little endian, as the image
+        if (reserve(sizeof(T)))
+        {
+            std::memcpy(region.data() + position, &value, sizeof(T));
+            position += sizeof(T);
+        }
+    }
+
+    void put_bytes(std::span<const uint8_t> bytes)
+    {
+        if (reserve(bytes.size()))
+        {
+            std::memcpy(region.data() + position, bytes.data(), bytes.size());
+            position += bytes.size();
+        }
+    }
+
+    /* Completes the header and appends the CRC, returns the image size */
+    size_t finish()
+    {
+        const uint32_t payload_length = position - HEADER_SIZE;
+        const uint16_t reserved = 0;
+        std::memcpy(region.data(), &warm_state::MAGIC, sizeof(uint32_t));
+        std::memcpy(region.data() + 4, &warm_state::VERSION, sizeof(uint16_t));
+        std::memcpy(region.data() + 6, &reserved, sizeof(uint16_t));
+        std::memcpy(region.data() + LENGTH_OFFSET, &payload_length, sizeof(uint32_t));
+        const uint32_t crc = warm_state::crc32(region.first(position));
+        std::memcpy(region.data() + position, &crc, sizeof(uint32_t));
+        return position + CRC_SIZE;
+    }
+
+  private:
+    bool reserve(size_t size)
+    {
+        overflow = overflow || size > room();
+        return !overflow;
+    }
+
+    std::span<uint8_t> region;
+    size_t position = HEADER_SIZE;
+    bool overflow = false;
+};
+
+class reader
+{
+  public:
+    explicit reader(std::span<const uint8_t> payload_in): payload(payload_in) {}
+
+    bool failed() const { return error; }
+    size_t remaining() const { return payload.size(); }
+
+    uint64_t get_varint()
+    {
+        auto value = sweep_format::get_varint(payload);
+        error = error || !value;
+        return value.value_or(0);
+    }
+
+    template<typename T>
+    T get()
+    {
+        T value{};
+        if (payload.size() < sizeof(T))
+        {
+            error = true;
+            return value;
+        }
+        std::memcpy(&value, payload.data(), sizeof(T));
+        payload = payload.subspan(sizeof(T));
+        return value;
+    }
+
+    std::span<const uint8_t> get_bytes(size_t size)
+    {
+        if (payload.size() < size)
+        {
+            error = true;
+            return {};
+        }
+        auto bytes = payload.first(size);
+        payload = payload.subspan(size);
+        return bytes;
+    }
+
+  private:
+    std::span<const uint8_t> payload;
+    bool error = false;
+};
+}// namespace
+
+namespace warm_state
+{
+size_t save(const state &saved, std::span<uint8_t> region)
+{
+    if (region.size() < HEADER_SIZE + CRC_SIZE)
+    {
+        return 0;
+    }
+    writer out(region);
+    out.put_varint(saved.restarts);
+    out.put_varint(saved.sequence);
+    out.put<uint8_t>(saved.resolution);
+    out.put<uint32_t>(saved.broker_address);
+    out.put_varint(saved.buses.size());
+    for (const auto &bus : saved.buses)
+    {
+        out.put_varint(bus.size());
+        for (const auto &dev : bus)
+        {
+            out.put<uint64_t>(dev.identifier);
+            out.put<uint8_t>(dev.overdrive ? DEVICE_OVERDRIVE : 0);
+            out.put<int8_t>(dev.alarm_low);
+            out.put<int8_t>(dev.alarm_high);
+        }
+    }
+    if (out.full() || out.room() < varint_size(saved.unsent.size()))
+    {
+        invalidate(region);
+        return 0;
+    }
+
+    /* The newest messages that fit */
+    size_t room = out.room() - varint_size(saved.unsent.size());
+    size_t first = saved.unsent.size();
+    while (first > 0)
+    {
+        const auto &message = saved.unsent[first - 1];
+        const size_t size = varint_size(message.size()) + message.size();
+        if (size > room)
+        {
+            break;
+        }
+        room -= size;
+        first--;
+    }
+    out.put_varint(saved.unsent.size() - first);
+    for (size_t i = first; i < saved.unsent.size(); i++)
+    {
+        out.put_varint(saved.unsent[i].size());
+        out.put_bytes(saved.unsent[i]);
+    }
+    return out.finish();
+}
+
+std::optional<state> load(std::span<const uint8_t> region)
+{
+    if (region.size() < HEADER_SIZE + CRC_SIZE)
+    {
+        return {};
+    }
+    uint32_t magic;
+    uint16_t version;
+    uint32_t payload_length;
+    std::memcpy(&magic, region.data(), sizeof(uint32_t));
+    std::memcpy(&version, region.data() + 4, sizeof(uint16_t));
+    std::memcpy(&payload_length, region.data() + LENGTH_OFFSET, sizeof(uint32_t));
+    if (magic != MAGIC || version != VERSION || payload_length > region.size() - HEADER_SIZE - CRC_SIZE)
+    {
+        return {};
+    }
+    uint32_t crc;
+    std::memcpy(&crc, region.data() + HEADER_SIZE + payload_length, sizeof(uint32_t));
+    if (crc32(region.first(HEADER_SIZE + payload_length)) != crc)
+    {
+        return {};
+    }
+
+    reader in(region.subspan(HEADER_SIZE, payload_length));
+    state loaded;
+    loaded.restarts = uint32_t(in.get_varint());
+    loaded.sequence = uint32_t(in.get_varint());
+    loaded.resolution = in.get<uint8_t>();
+    loaded.broker_address = in.get<uint32_t>();
+    /* The counts are checked against the remaining bytes before any
+       allocation */
+    const uint64_t bus_count = in.get_varint();
+    if (bus_count > in.remaining())
+    {
+        return {};
+    }
+    loaded.buses.resize(bus_count);
+    for (auto &bus : loaded.buses)
+    {
+        const uint64_t device_count = in.get_varint();
+        if (device_count > in.remaining() / DEVICE_SIZE)
+        {
+            return {};
+        }
+        bus.resize(device_count);
+        for (auto &dev : bus)
+        {
+            dev.identifier = in.get<uint64_t>();
+            dev.overdrive = in.get<uint8_t>() & DEVICE_OVERDRIVE;
+            dev.alarm_low = in.get<int8_t>();
+            dev.alarm_high = in.get<int8_t>();
+        }
+    }
+    const uint64_t message_count = in.get_varint();
+    if (message_count > in.remaining())
+    {
+        return {};
+    }
+    for (uint64_t i = 0; i < message_count && !in.failed(); i++)
+    {
+        const auto message = in.get_bytes(in.get_varint());
+        loaded.unsent.emplace_back(message.begin(), message.end());
+    }
+    if (in.failed() || in.remaining() != 0)
+    {
+        return {};
+    }
+    return loaded;
+}
+
+void invalidate(std::span<uint8_t> region)
+{
+    std::memset(region.data(), 0, std::min<size_t>(region.size(), HEADER_SIZE));
+}
+
+/* CRC-32 (IEEE 802.3), bitwise: the image is small and saved once
+   per sweep */
+uint32_t crc32(std::span<const uint8_t> data, uint32_t crc)
+{
+    crc = ~crc;
+    for (auto byte : data)
+    {
+        crc ^= byte;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = crc & 1 ? (crc >> 1) ^ 0xedb88320 : crc >> 1;
+        }
+    }
+    return ~crc;
+}
+}// namespace warm_state
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <span>
+#include <vector>
+
+/* State kept across a watchdog reset in RAM the runtime does not
+   initialize (.uninitialized_data). A warm restart takes the device
+   tables and the broker address from it instead of searching the buses
+   and resolving the hostname, and publishes the sweep messages the
+   broker has not received.
+
+   Image, little endian:
+     uint32       magic "OWS1"
+     uint16       version
+     uint16       reserved, 0
+     uint32       payload length
+     payload:
+       varint     warm restarts since the last published sweep
+       varint     sweep sequence number
+       uint8      resolution
+       uint32     broker IPv4 address as stored by lwIP, 0 if unknown
+       varint     bus count, per bus:
+         varint   device count, per device:
+           uint64 identifier
+           uint8  flags, bit 0: overdrive
+           int8   alarm low, int8 alarm high
+       varint     unsent message count, per message, oldest first:
+         varint   length, then the message
+     uint32       CRC-32 of all preceding bytes
+
+   The codec does not depend on the SDK and is checked on the host by
+   tools/warm_state_check. */
+namespace warm_state
+{
+constexpr const uint32_t MAGIC = 0x3153574f;
+constexpr const uint16_t VERSION = 1;
+constexpr const uint8_t DEVICE_OVERDRIVE = 0x1;
+
+struct device
+{
+    uint64_t identifier;
+    bool overdrive;
+    int8_t alarm_low;
+    int8_t alarm_high;
+
+    bool operator==(const device &) const = default;
+};
+
+struct state
+{
+    uint32_t restarts = 0;
+    uint32_t sequence = 0;
+    uint8_t resolution = 12;
+    uint32_t broker_address = 0;
+    std::vector<std::vector<device>> buses;
+    std::deque<std::vector<uint8_t>> unsent;
+
+    bool operator==(const state &) const = default;
+};
+
+/* Writes the image into region. Unsent messages that do not fit are
+   left out, the oldest first. Returns the size of the image, 0 if the
+   device tables do not fit; the region is invalid then. */
+size_t save(const state &saved, std::span<uint8_t> region);
+
+/* The state of a valid image, nothing if the magic, version, lengths
+   or CRC do not match, e.g. after power-up */
+std::optional<state> load(std::span<const uint8_t> region);
+
+void invalidate(std::span<uint8_t> region);
+
+uint32_t crc32(std::span<const uint8_t> data, uint32_t crc = 0);
+}// namespace warm_state
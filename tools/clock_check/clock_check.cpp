@@ -0,0 +1,219 @@
+// Runs the firmware's wall clock (src/wall_clock.cpp, src/clock_sync.cpp)
+// against an SNTP stand-in and a local clock that runs fast or slow: the
+// drift measured between updates, the error of the extrapolation between
+// them, updates too close together and time steps on the server.
+//
+// Usage: clock_check
+
+#include <clock_sync.hpp>
+#include <wall_clock.hpp>
+
+#include <lwip/apps/sntp.h>
+#include <pico/cyw43_arch.h>
+#include <pico/stdlib.h>
+
+#include <check.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+
+namespace
+{
+constexpr const uint64_t SECOND_US = 1000000;
+// SNTP_UPDATE_DELAY of lwipopts.h
+constexpr const uint64_t UPDATE_INTERVAL_US = 15 * 60 * SECOND_US;
+// 2026-10-19 00:00:00 UTC
+constexpr const uint64_t BOOT_UNIX_US = 1792368000 * SECOND_US;
+
+// A device with a local clock off by skew_ppb and a time server that
+// answers after a network delay. lwIP does not compensate the round
+// trip, the time arrives late by the delay.
+struct simulation
+{
+    int64_t skew_ppb;
+    uint64_t true_us = 0;// since boot
+
+    uint64_t local_us() const
+    {
+        return true_us + int64_t(true_us) * skew_ppb / 1000000000;
+    }
+
+    void advance(uint64_t us)
+    {
+        true_us += us;
+        mock_clock::set(local_us());
+    }
+
+    void server_update(uint64_t delay_us)
+    {
+        const uint64_t unix_us = BOOT_UNIX_US + true_us;
+        advance(delay_us);
+        wall_clock_set_time_us(uint32_t(unix_us / SECOND_US), uint32_t(unix_us % SECOND_US));
+    }
+
+    // Error of the wall clock now
+    int64_t error_us() const
+    {
+        return int64_t(wall_clock::to_unix_us(local_us()) - (BOOT_UNIX_US + true_us));
+    }
+
+    // The largest error of the wall clock in one update interval, sampled
+    // every 10 s, then the server update
+    int64_t run_interval(uint64_t delay_us)
+    {
+        int64_t max_error = 0;
+        for (uint64_t elapsed = 0; elapsed < UPDATE_INTERVAL_US; elapsed += 10 * SECOND_US)
+        {
+            advance(10 * SECOND_US);
+            max_error = std::max(max_error, std::abs(error_us()));
+        }
+        server_update(delay_us);
+        return max_error;
+    }
+};
+
+int64_t drift_error(const clock_sync::synchronization &sync, int64_t skew_ppb)
+{
+    return std::abs(sync.drift_ppb - skew_ppb);
+}
+
+bool check(const char *name, const std::function<bool()> &scenario)
+{
+    return host_check::check(name, [&] { return scenario() && mock_lwip::lock_depth() == 0; });
+}
+}// namespace
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        fprintf(stderr, "usage: %s\n", argv[0]);
+        return 2;
+    }
+
+    bool ok = true;
+
+    // one device through the checks of this section, in order
+    printf("== wall clock against an SNTP stand-in, clock 37 ppm fast ==\n");
+    simulation device{ 37000 };
+    std::mt19937_64 random(1);
+    auto lan_delay = [&] { return 1000 + random() % 4000; };
+
+    ok = check("no time before the first update", [&] {
+        device.advance(3 * SECOND_US);
+        wall_clock::start("pool.ntp.org");
+        const char *server = mock_sntp::polled_server();
+        return server && strcmp(server, "pool.ntp.org") == 0 && !wall_clock::is_synchronized()
+            && wall_clock::to_unix_us(device.local_us()) == 0 && wall_clock::drift_ppb() == 0;
+    }) && ok;
+
+    ok = check("the first update sets the time", [&] {
+        device.server_update(0);
+        return wall_clock::is_synchronized() && device.error_us() == 0 && wall_clock::drift_ppb() == 0;
+    }) && ok;
+
+    ok = check("without a drift the error grows with the skew", [&] {
+        const int64_t max_error = device.run_interval(0);
+        // 37 ppm of 15 min, 33.3 ms
+        return max_error >= 33300 && max_error <= 33310;
+    }) && ok;
+
+    ok = check("the first interval measures the drift", [&] {
+        return std::abs(wall_clock::drift_ppb() - device.skew_ppb) < 10;
+    }) && ok;
+
+    ok = check("a day with network delays stays within 10 ms", [&] {
+        int64_t max_error = 0;
+        int32_t min_drift = INT32_MAX;
+        int32_t max_drift = INT32_MIN;
+        for (int update = 0; update < 96; update++)
+        {
+            max_error = std::max(max_error, device.run_interval(lan_delay()));
+            min_drift = std::min(min_drift, wall_clock::drift_ppb());
+            max_drift = std::max(max_drift, wall_clock::drift_ppb());
+        }
+        printf("  error max %.1f ms, drift %d to %d ppb\n", max_error / 1000.0, min_drift, max_drift);
+        // up to 5 ms of delay, and up to 4.4 ppm of drift error from the
+        // change of the delay over an interval
+        return max_error < 10000 && min_drift > device.skew_ppb - 6000 && max_drift < device.skew_ppb + 6000;
+    }) && ok;
+
+    ok = check("a time step on the server is not drift", [&] {
+        device.advance(UPDATE_INTERVAL_US);
+        const int32_t drift = wall_clock::drift_ppb();
+        // the server is corrected by 2 s
+        const uint64_t unix_us = BOOT_UNIX_US + device.true_us + 2 * SECOND_US;
+        wall_clock_set_time_us(uint32_t(unix_us / SECOND_US), uint32_t(unix_us % SECOND_US));
+        return wall_clock::drift_ppb() == drift && std::abs(device.error_us() - 2 * int64_t(SECOND_US)) < 10000;
+    }) && ok;
+    printf("\n");
+
+    printf("== drift correction ==\n");
+
+    ok = check("a slow clock is corrected the other way", [] {
+        clock_sync::synchronization sync;
+        simulation slow{ -25000 };
+        clock_sync::update(sync, slow.local_us(), BOOT_UNIX_US);
+        slow.advance(UPDATE_INTERVAL_US);
+        clock_sync::update(sync, slow.local_us(), BOOT_UNIX_US + slow.true_us);
+        slow.advance(UPDATE_INTERVAL_US);
+        const int64_t error = int64_t(clock_sync::extrapolate(sync, slow.local_us()) - (BOOT_UNIX_US + slow.true_us));
+        return drift_error(sync, slow.skew_ppb) < 10 && std::abs(error) < 10;
+    }) && ok;
+
+    ok = check("updates closer than a minute keep the drift", [] {
+        clock_sync::synchronization sync;
+        simulation fast{ 200000 };
+        clock_sync::update(sync, fast.local_us(), BOOT_UNIX_US);
+        fast.advance(clock_sync::MIN_DRIFT_INTERVAL_US - 20 * SECOND_US);
+        clock_sync::update(sync, fast.local_us(), BOOT_UNIX_US + fast.true_us);
+        const bool kept = sync.drift_ppb == 0 && sync.unix_us == BOOT_UNIX_US + fast.true_us;
+        fast.advance(clock_sync::MIN_DRIFT_INTERVAL_US);
+        clock_sync::update(sync, fast.local_us(), BOOT_UNIX_US + fast.true_us);
+        return kept && drift_error(sync, fast.skew_ppb) < 100;
+    }) && ok;
+
+    ok = check("drift beyond 500 ppm is rejected", [] {
+        clock_sync::synchronization sync;
+        simulation broken{ int64_t(clock_sync::MAX_DRIFT_PPB) + 1000 };
+        clock_sync::update(sync, broken.local_us(), BOOT_UNIX_US);
+        broken.advance(UPDATE_INTERVAL_US);
+        clock_sync::update(sync, broken.local_us(), BOOT_UNIX_US + broken.true_us);
+        return sync.drift_ppb == 0 && clock_sync::extrapolate(sync, sync.local_us) == BOOT_UNIX_US + broken.true_us;
+    }) && ok;
+
+    ok = check("a local time before the last update", [] {
+        // a conversion started just before the update
+        clock_sync::synchronization sync;
+        simulation fast{ 37000 };
+        clock_sync::update(sync, fast.local_us(), BOOT_UNIX_US);
+        fast.advance(UPDATE_INTERVAL_US);
+        const uint64_t conversion_local_us = fast.local_us();
+        const uint64_t conversion_unix_us = BOOT_UNIX_US + fast.true_us;
+        fast.advance(SECOND_US);
+        clock_sync::update(sync, fast.local_us(), BOOT_UNIX_US + fast.true_us);
+        // within the rounding of the correction
+        return std::abs(int64_t(clock_sync::extrapolate(sync, conversion_local_us) - conversion_unix_us)) <= 2;
+    }) && ok;
+
+    ok = check("a week without updates", [] {
+        clock_sync::synchronization sync;
+        simulation fast{ 37000 };
+        clock_sync::update(sync, fast.local_us(), BOOT_UNIX_US);
+        fast.advance(UPDATE_INTERVAL_US);
+        clock_sync::update(sync, fast.local_us(), BOOT_UNIX_US + fast.true_us);
+        fast.advance(7 * 24 * 3600 * SECOND_US);
+        const int64_t error = int64_t(clock_sync::extrapolate(sync, fast.local_us()) - (BOOT_UNIX_US + fast.true_us));
+        printf("  error after a week %.1f ms, %.1f s uncorrected\n", error / 1000.0, 7 * 24 * 3600 * 37e-6);
+        // the resolution of the drift, 1 ppb
+        return std::abs(error) < 7 * 24 * 3600 * 2;
+    }) && ok;
+    printf("\n");
+
+    return host_check::finish(ok);
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+
+#define SNTP_OPMODE_POLL 0
+
+void sntp_setoperatingmode(uint8_t operating_mode);
+void sntp_setservername(uint8_t idx, const char *server);
+void sntp_init();
+
+/* SNTP_SET_SYSTEM_TIME_US of the firmware's lwipopts.h */
+extern "C" void wall_clock_set_time_us(uint32_t sec, uint32_t us);
+
+namespace mock_sntp
+{
+/* The server the firmware polls, nullptr before sntp_init */
+const char *polled_server();
+}
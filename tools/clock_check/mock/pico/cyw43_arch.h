@@ -0,0 +1,10 @@
+#pragma once
+
+void cyw43_arch_lwip_begin();
+void cyw43_arch_lwip_end();
+
+namespace mock_lwip
+{
+/* Nesting depth of the lwIP lock, 0 outside of it */
+int lock_depth();
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint>
+
+uint64_t time_us_64();
+
+namespace mock_clock
+{
+/* Sets the value time_us_64 returns */
+void set(uint64_t local_us);
+}
@@ -0,0 +1,62 @@
+#include <lwip/apps/sntp.h>
+#include <pico/cyw43_arch.h>
+#include <pico/stdlib.h>
+
+#include <string>
+
+namespace
+{
+uint64_t local_time_us = 0;
+int lwip_lock_depth = 0;
+bool polling = false;
+std::string server_name;
+bool started = false;
+}// namespace
+
+uint64_t time_us_64()
+{
+    return local_time_us;
+}
+
+void mock_clock::set(uint64_t local_us)
+{
+    local_time_us = local_us;
+}
+
+void cyw43_arch_lwip_begin()
+{
+    lwip_lock_depth++;
+}
+
+void cyw43_arch_lwip_end()
+{
+    lwip_lock_depth--;
+}
+
+int mock_lwip::lock_depth()
+{
+    return lwip_lock_depth;
+}
+
+void sntp_setoperatingmode(uint8_t operating_mode)
+{
+    polling = operating_mode == SNTP_OPMODE_POLL;
+}
+
+void sntp_setservername(uint8_t idx, const char *server)
+{
+    if (idx == 0)
+    {
+        server_name = server;
+    }
+}
+
+void sntp_init()
+{
+    started = polling && lwip_lock_depth > 0;
+}
+
+const char *mock_sntp::polled_server()
+{
+    return started ? server_name.c_str() : nullptr;
+}
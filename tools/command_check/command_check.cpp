@@ -0,0 +1,387 @@
+// Checks the handling of commands received over MQTT: the parser of the
+// firmware (src/commands.cpp) with valid, malformed, out-of-range and
+// over-long payloads, the inbox the lwIP callbacks fill
+// (src/message_inbox.cpp) with fragmented, over-long and too many messages,
+// and the whole path from a PUBLISH of a broker stand-in through the MQTT
+// client (src/mqtt_client.cpp) and the command handler
+// (src/command_handler.cpp) to the answer on the result topic, across a
+// lost connection.
+//
+// Usage: command_check
+
+#include <command_handler.hpp>
+#include <commands.hpp>
+#include <message_inbox.hpp>
+#include <mqtt_client.hpp>
+#include <sweep_scheduler.hpp>
+
+#include <lwip/apps/mqtt.h>
+#include <pico/cyw43_arch.h>
+
+#include <check.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <optional>
+#include <string>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+constexpr const char *COMMAND_TOPIC = "sensors/pico/command";
+constexpr const char *RESULT_TOPIC = "sensors/pico/command/result";
+constexpr const uint64_t SECOND_US = 1000000;
+const ip_addr_t BROKER_ADDRESS{ 0x010200c0 };
+
+std::optional<command> parse(std::string_view payload)
+{
+    return parse_command(payload.data(), payload.size());
+}
+
+bool rejected(std::initializer_list<std::string_view> payloads)
+{
+    for (auto payload : payloads)
+    {
+        if (parse(payload))
+        {
+            printf("  accepted \"%.*s\"\n", int(payload.size()), payload.data());
+            return false;
+        }
+    }
+    return true;
+}
+
+// A message as lwIP delivers it: the publish callback, then the payload in
+// fragments of at most fragment_length bytes
+void deliver(message_inbox &inbox, const char *topic, std::string_view payload, size_t fragment_length = 1500)
+{
+    inbox.begin(topic, uint32_t(payload.size()));
+    for (;;)
+    {
+        const size_t length = std::min(fragment_length, payload.size());
+        const bool last = length == payload.size();
+        inbox.append(reinterpret_cast<const uint8_t *>(payload.data()), uint16_t(length), last);
+        if (last)
+        {
+            return;
+        }
+        payload.remove_prefix(length);
+    }
+}
+
+std::string payload_of(const mqtt_message &message)
+{
+    return std::string(message.payload.data(), message.payload_length);
+}
+
+using host_check::check;
+using host_check::throws;
+
+// The probe side of the command path: a client subscribed to the command
+// topic and a handler that applies the interval command to a scheduler
+// as the firmware does. A rescan fails as on a stuck bus.
+struct probe
+{
+    mqtt_client client{ "broker.local", 1883, "probe", nullptr, nullptr, nullptr, &BROKER_ADDRESS };
+    sweep_scheduler scheduler;
+    command_handler handler{ client, RESULT_TOPIC, [this](const command &cmd) { return apply(cmd); } };
+
+    probe()
+    {
+        scheduler.add_group(60 * SECOND_US, 0);
+        scheduler.add_group(60 * SECOND_US, 0);
+        client.subscribe(COMMAND_TOPIC);
+    }
+
+    const char *apply(const command &cmd)
+    {
+        switch (cmd.command_type)
+        {
+        case command::type::set_interval:
+            if (cmd.group >= scheduler.group_count())
+            {
+                return "error no such group";
+            }
+            scheduler.set_interval(cmd.group, uint64_t(cmd.value) * 1000);
+            return "ok interval";
+        case command::type::rescan:
+            throw std::runtime_error("1-Wire state machine did not become idle");
+        default:
+            return "error unknown command";
+        }
+    }
+
+    // The main loop: it wakes for a message in the inbox and handles it
+    bool wake_and_handle()
+    {
+        return client.has_messages() && handler.handle_received();
+    }
+};
+
+std::vector<mock_broker::message> results(std::initializer_list<const char *> payloads)
+{
+    std::vector<mock_broker::message> messages;
+    for (const char *payload : payloads)
+    {
+        messages.push_back({ RESULT_TOPIC, payload });
+    }
+    return messages;
+}
+
+bool check_over_mqtt(const char *name, const std::function<bool()> &scenario)
+{
+    return check(name, [&] {
+        mock_broker::reset();
+        return scenario() && mock_broker::errors() == 0 && mock_lwip::lock_depth() == 0;
+    });
+}
+}// namespace
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        fprintf(stderr, "usage: %s\n", argv[0]);
+        return 2;
+    }
+
+    bool ok = true;
+    printf("== command parser ==\n");
+
+    ok = check("commands without arguments", [] {
+        const auto rescan = parse("rescan");
+        const auto stats = parse("stats");
+        const auto sample = parse("sample");
+        const auto trace = parse("trace");
+        return rescan && rescan->command_type == command::type::rescan && stats
+            && stats->command_type == command::type::fetch_stats && sample
+            && sample->command_type == command::type::sample_now && trace
+            && trace->command_type == command::type::dump_trace;
+    }) && ok;
+
+    ok = check("interval", [] {
+        const auto cmd = parse("interval 2 60000");
+        const auto largest = parse("interval 255 4294967295");
+        return cmd && cmd->command_type == command::type::set_interval && cmd->group == 2 && cmd->value == 60000
+            && largest && largest->group == 255 && largest->value == 4294967295u;
+    }) && ok;
+
+    ok = check("resolution", [] {
+        const auto low = parse("resolution 9");
+        const auto high = parse("resolution 12");
+        return low && low->command_type == command::type::set_resolution && low->value == 9 && high
+            && high->value == 12;
+    }) && ok;
+
+    ok = check("burst", [] {
+        const auto cmd = parse("burst 10 200 30 5");
+        const auto longest = parse("burst 9 0 600 255");
+        return cmd && cmd->command_type == command::type::burst && cmd->burst.resolution == 10
+            && cmd->burst.period_ms == 200 && cmd->burst.duration_s == 30 && cmd->burst.bus_mask == 5
+            && longest && longest->burst.duration_s == command::burst_parameters::MAX_DURATION_S;
+    }) && ok;
+
+    ok = check("whitespace around and between tokens", [] {
+        const auto cmd = parse("  interval\t1   1000\r\n");
+        return cmd && cmd->group == 1 && cmd->value == 1000 && parse("stats\n");
+    }) && ok;
+
+    ok = check("a payload is not null-terminated", [] {
+        // the inbox hands over the payload and its length
+        const char payload[] = { 'r', 'e', 's', 'o', 'l', 'u', 't', 'i', 'o', 'n', ' ', '1', '1', '2' };
+        const auto cmd = parse_command(payload, 13);
+        return cmd && cmd->value == 11;
+    }) && ok;
+
+    ok = check("empty and unknown commands", [] {
+        return rejected({ "", " ", "\r\n", "reboot", "Stats", "stats!", "rescan now", "sample 1" });
+    }) && ok;
+
+    ok = check("missing and extra arguments", [] {
+        return rejected({ "interval", "interval 1", "interval 1 1000 2", "resolution", "resolution 10 11",
+            "burst 10 200 30", "burst 10 200 30 5 1", "trace 1" });
+    }) && ok;
+
+    ok = check("malformed numbers", [] {
+        return rejected({ "interval x 1000", "interval 1 10s", "interval 1 -5", "interval 1 +5",
+            "interval 1 0x10", "resolution 1.5", "resolution ten", "burst 10 200 30 0b1",
+            "interval 1 1,000" });
+    }) && ok;
+
+    ok = check("out-of-range values", [] {
+        return rejected({ "interval 256 1000", "interval 1 4294967296", "interval 1 0", "resolution 8",
+            "resolution 13", "resolution 4294967305", "burst 8 200 30 1", "burst 13 200 30 1",
+            "burst 10 65536 30 1", "burst 10 200 0 1", "burst 10 200 601 1", "burst 10 200 65535 1",
+            "burst 10 200 65536 1", "burst 10 200 30 256" });
+    }) && ok;
+
+    ok = check("over-long payloads", [] {
+        const std::string many_tokens = "burst 10 200 30 5 1 2 3 4 5 6 7 8 9 10";
+        const std::string long_name(mqtt_message::MAX_PAYLOAD_LENGTH, 'x');
+        const std::string long_number = "interval 1 " + std::string(mqtt_message::MAX_PAYLOAD_LENGTH - 15, '9');
+        // leading zeros do not overflow
+        const auto padded = parse("interval 1 " + std::string(40, '0') + "1000");
+        return rejected({ many_tokens, long_name, long_number }) && padded && padded->value == 1000;
+    }) && ok;
+    printf("\n");
+
+    printf("== inbox ==\n");
+
+    ok = check("messages are delivered in order", [] {
+        message_inbox inbox;
+        deliver(inbox, COMMAND_TOPIC, "stats");
+        deliver(inbox, "other/topic", "rescan");
+        mqtt_message first;
+        mqtt_message second;
+        mqtt_message none;
+        return inbox.pop(first) && inbox.pop(second) && !inbox.pop(none) && inbox.empty()
+            && strcmp(first.topic.data(), COMMAND_TOPIC) == 0 && payload_of(first) == "stats"
+            && strcmp(second.topic.data(), "other/topic") == 0 && payload_of(second) == "rescan"
+            && inbox.dropped() == 0;
+    }) && ok;
+
+    ok = check("fragments are assembled", [] {
+        message_inbox inbox;
+        deliver(inbox, COMMAND_TOPIC, "burst 10 200 30 5", 4);
+        mqtt_message message;
+        return inbox.pop(message) && payload_of(message) == "burst 10 200 30 5" && !inbox.pop(message);
+    }) && ok;
+
+    ok = check("a full inbox drops new messages", [] {
+        message_inbox inbox;
+        for (size_t i = 0; i < message_inbox::SIZE + 3; i++)
+        {
+            deliver(inbox, COMMAND_TOPIC, "interval 0 " + std::to_string(1000 + i));
+        }
+        bool oldest_kept = true;
+        mqtt_message message;
+        for (size_t i = 0; i < message_inbox::SIZE; i++)
+        {
+            oldest_kept = oldest_kept && inbox.pop(message) && payload_of(message) == "interval 0 " + std::to_string(1000 + i);
+        }
+        return oldest_kept && inbox.empty() && inbox.dropped() == 3;
+    }) && ok;
+
+    ok = check("the inbox wraps around", [] {
+        message_inbox inbox;
+        mqtt_message message;
+        bool in_order = true;
+        for (size_t i = 0; i < 5 * message_inbox::SIZE; i++)
+        {
+            deliver(inbox, COMMAND_TOPIC, std::to_string(i));
+            deliver(inbox, COMMAND_TOPIC, std::to_string(i) + "b");
+            in_order = in_order && inbox.pop(message) && payload_of(message) == std::to_string(i);
+            in_order = in_order && inbox.pop(message) && payload_of(message) == std::to_string(i) + "b";
+        }
+        return in_order && inbox.empty() && inbox.dropped() == 0;
+    }) && ok;
+
+    ok = check("an over-long payload is dropped whole", [] {
+        message_inbox inbox;
+        const std::string longest(mqtt_message::MAX_PAYLOAD_LENGTH, 'a');
+        deliver(inbox, COMMAND_TOPIC, longest + "b", 16);
+        deliver(inbox, COMMAND_TOPIC, longest, 16);
+        mqtt_message message;
+        return inbox.pop(message) && payload_of(message) == longest && !inbox.pop(message) && inbox.dropped() == 1;
+    }) && ok;
+
+    ok = check("an over-long topic is dropped", [] {
+        message_inbox inbox;
+        const std::string longest(mqtt_message::MAX_TOPIC_LENGTH, 't');
+        deliver(inbox, (longest + "t").c_str(), "stats");
+        deliver(inbox, longest.c_str(), "stats");
+        mqtt_message message;
+        return inbox.pop(message) && message.topic.data() == longest && !inbox.pop(message) && inbox.dropped() == 1;
+    }) && ok;
+
+    ok = check("a dropped message leaves the next one intact", [] {
+        message_inbox inbox;
+        deliver(inbox, COMMAND_TOPIC, std::string(200, 'x'), 50);
+        deliver(inbox, COMMAND_TOPIC, "sample", 2);
+        mqtt_message message;
+        return inbox.pop(message) && payload_of(message) == "sample" && inbox.dropped() == 1;
+    }) && ok;
+
+    ok = check("an empty payload is queued", [] {
+        message_inbox inbox;
+        deliver(inbox, COMMAND_TOPIC, "");
+        mqtt_message message;
+        return inbox.pop(message) && message.payload_length == 0
+            && !parse_command(message.payload.data(), message.payload_length);
+    }) && ok;
+    printf("\n");
+
+    printf("== over MQTT against a broker stand-in ==\n");
+
+    ok = check_over_mqtt("a command is applied and answered", [] {
+        probe device;
+        const bool sent = mock_broker::publish(COMMAND_TOPIC, "interval 1 30000");
+        mock_broker::run();
+        return sent && device.wake_and_handle() && device.scheduler.interval(1) == 30 * SECOND_US
+            && device.scheduler.interval(0) == 60 * SECOND_US && mock_broker::received() == results({ "ok interval" })
+            && !device.client.has_messages();
+    }) && ok;
+
+    ok = check_over_mqtt("each command is answered, in order", [] {
+        probe device;
+        for (const char *payload : { "interval 0 1000", "interval 7 1000", "reboot", "rescan" })
+        {
+            mock_broker::publish(COMMAND_TOPIC, payload);
+        }
+        mock_broker::run();
+        return device.wake_and_handle() && device.scheduler.interval(0) == SECOND_US
+            && mock_broker::received()
+            == results({ "ok interval", "error no such group", "error malformed command", "error bus failed" });
+    }) && ok;
+
+    ok = check_over_mqtt("a fragmented PUBLISH is assembled", [] {
+        probe device;
+        mock_broker::publish(COMMAND_TOPIC, "interval 1 45000", 3);
+        mock_broker::run();
+        return device.wake_and_handle() && device.scheduler.interval(1) == 45 * SECOND_US
+            && mock_broker::received() == results({ "ok interval" });
+    }) && ok;
+
+    ok = check_over_mqtt("nothing is answered without a command", [] {
+        probe device;
+        mock_broker::run();
+        return !device.handler.handle_received() && mock_broker::received().empty();
+    }) && ok;
+
+    ok = check_over_mqtt("the subscription is restored on reconnect", [] {
+        probe device;
+        mock_broker::drop_connection();
+        // the broker keeps no session: a command is not delivered
+        const bool lost = !device.client.is_connected() && !mock_broker::publish(COMMAND_TOPIC, "interval 1 5000");
+        device.client.reconnect();
+        const bool restored = mock_broker::subscriptions() == std::vector<std::string>{ COMMAND_TOPIC };
+        mock_broker::publish(COMMAND_TOPIC, "interval 1 5000");
+        mock_broker::run();
+        return lost && restored && device.wake_and_handle() && device.scheduler.interval(1) == 5 * SECOND_US
+            && mock_broker::received() == results({ "ok interval" }) && device.client.statistics().connects == 2;
+    }) && ok;
+
+    ok = check_over_mqtt("a command is applied while the answer is lost", [] {
+        probe device;
+        mock_broker::publish(COMMAND_TOPIC, "interval 0 2000");
+        mock_broker::run();
+        mock_broker::drop_connection();
+        return device.wake_and_handle() && device.scheduler.interval(0) == 2 * SECOND_US
+            && mock_broker::received().empty();
+    }) && ok;
+
+    ok = check_over_mqtt("an unacknowledged subscription times out", [] {
+        mqtt_client client("broker.local", 1883, "probe", nullptr, nullptr, nullptr, &BROKER_ADDRESS);
+        mock_broker::set_answering(false);
+        const bool timed_out = throws<std::runtime_error>([&] { client.subscribe(COMMAND_TOPIC); });
+        return timed_out && !client.is_connected() && mock_broker::subscriptions().empty();
+    }) && ok;
+    printf("\n");
+
+    return host_check::finish(ok);
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <lwip/ip_addr.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// The MQTT client API of lwIP in front of a broker stand-in. Requests
+// are answered, and messages published to the client are delivered,
+// when the background runs: in sleep_ms or mock_broker::run.
+
+typedef struct mqtt_client_s mqtt_client_t;
+
+typedef enum
+{
+    MQTT_CONNECT_ACCEPTED = 0,
+    MQTT_CONNECT_REFUSED_PROTOCOL_VERSION = 1,
+    MQTT_CONNECT_REFUSED_IDENTIFIER = 2,
+    MQTT_CONNECT_REFUSED_SERVER = 3,
+    MQTT_CONNECT_REFUSED_USERNAME_PASS = 4,
+    MQTT_CONNECT_REFUSED_NOT_AUTHORIZED_ = 5,
+    MQTT_CONNECT_DISCONNECTED = 256,
+    MQTT_CONNECT_TIMEOUT = 257
+} mqtt_connection_status_t;
+
+enum
+{
+    MQTT_DATA_FLAG_LAST = 1
+};
+
+typedef void (*mqtt_connection_cb_t)(mqtt_client_t *client, void *arg, mqtt_connection_status_t status);
+typedef void (*mqtt_incoming_publish_cb_t)(void *arg, const char *topic, u32_t tot_len);
+typedef void (*mqtt_incoming_data_cb_t)(void *arg, const u8_t *data, u16_t len, u8_t flags);
+typedef void (*mqtt_request_cb_t)(void *arg, err_t err);
+
+struct mqtt_connect_client_info_t
+{
+    const char *client_id;
+    const char *client_user;
+    const char *client_pass;
+    u16_t keep_alive;
+    const char *will_topic;
+    const char *will_msg;
+    u8_t will_qos;
+    u8_t will_retain;
+};
+
+mqtt_client_t *mqtt_client_new();
+err_t mqtt_client_connect(mqtt_client_t *client, const ip_addr_t *ipaddr, u16_t port, mqtt_connection_cb_t cb, void *arg,
+    const struct mqtt_connect_client_info_t *client_info);
+void mqtt_disconnect(mqtt_client_t *client);
+u8_t mqtt_client_is_connected(mqtt_client_t *client);
+void mqtt_set_inpub_callback(mqtt_client_t *client, mqtt_incoming_publish_cb_t pub_cb, mqtt_incoming_data_cb_t data_cb, void *arg);
+err_t mqtt_subscribe(mqtt_client_t *client, const char *topic, u8_t qos, mqtt_request_cb_t cb, void *arg);
+err_t mqtt_publish(mqtt_client_t *client, const char *topic, const void *payload, u16_t payload_length, u8_t qos, u8_t retain,
+    mqtt_request_cb_t cb, void *arg);
+
+namespace mock_broker
+{
+struct message
+{
+    std::string topic;
+    std::string payload;
+
+    bool operator==(const message &) const = default;
+};
+
+// Forgets the clients, the subscriptions and the messages
+void reset();
+// Uses of the API lwIP does not allow, e.g. without the lwIP lock
+int errors();
+
+// Whether the broker answers CONNECT, SUBSCRIBE and PUBLISH
+void set_answering(bool answering);
+
+// Runs the background: answers the pending requests and delivers the
+// pending messages
+void run();
+
+// Publishes to the client if it subscribed to the topic, in fragments
+// as lwIP delivers a long PUBLISH. Returns whether the client will
+// receive it.
+bool publish(const std::string &topic, const std::string &payload, size_t fragment_length = 1024);
+
+// The connection is lost: the pending requests are dropped, the
+// subscriptions too, as the client always starts a clean session
+void drop_connection();
+
+const std::vector<message> &received();
+const std::vector<std::string> &subscriptions();
+}// namespace mock_broker
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+
+typedef uint8_t u8_t;
+typedef uint16_t u16_t;
+typedef uint32_t u32_t;
+typedef int8_t err_t;
+
+#define ERR_OK 0
+#define ERR_MEM -1
+#define ERR_TIMEOUT -3
+#define ERR_INPROGRESS -5
+#define ERR_ISCONN -10
+#define ERR_CONN -11
+#define ERR_ARG -16
+
+typedef struct ip_addr
+{
+    uint32_t addr;
+} ip_addr_t;
+
+const char *ip4addr_ntoa(const ip_addr_t *addr);
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <lwip/ip_addr.h>
+
+#include <cstdint>
+
+#define CYW43_AUTH_WPA2_AES_PSK 0x00400004
+#define CYW43_ITF_STA 0
+#define CYW43_LINK_DOWN 0
+#define CYW43_LINK_UP 3
+#define CYW43_LINK_BADAUTH -3
+#define CYW43_PERFORMANCE_PM 0xa11140
+#define CYW43_AGGRESSIVE_PM 0xa11c82
+
+typedef struct cyw43_t
+{
+} cyw43_t;
+
+extern cyw43_t cyw43_state;
+
+int cyw43_arch_init_with_country(uint32_t country);
+void cyw43_arch_enable_sta_mode();
+int cyw43_arch_wifi_connect_async(const char *ssid, const char *pw, uint32_t auth);
+int cyw43_tcpip_link_status(cyw43_t *self, int itf);
+int cyw43_wifi_pm(cyw43_t *self, uint32_t pm);
+
+void cyw43_arch_lwip_begin();
+void cyw43_arch_lwip_end();
+
+namespace mock_lwip
+{
+/* Nesting depth of the lwIP lock, 0 outside of it */
+int lock_depth();
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+typedef uint64_t absolute_time_t;
+
+/* A simulated clock: sleeping advances it and lets the broker stand-in
+   deliver what it has queued, as lwIP does in the background */
+uint64_t time_us_64();
+absolute_time_t make_timeout_time_ms(uint32_t ms);
+bool time_reached(absolute_time_t t);
+void sleep_ms(uint32_t ms);
@@ -0,0 +1,219 @@
+#include <lwip/apps/mqtt.h>
+#include <pico/cyw43_arch.h>
+
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <memory>
+
+// The state of a client as lwIP keeps it: the connection and the
+// callbacks, and the requests and messages the background has yet to
+// handle
+struct mqtt_client_s
+{
+    bool connected = false;
+    mqtt_connection_cb_t connection_cb = nullptr;
+    void *connection_arg = nullptr;
+    mqtt_incoming_publish_cb_t publish_cb = nullptr;
+    mqtt_incoming_data_cb_t data_cb = nullptr;
+    void *inpub_arg = nullptr;
+    std::deque<std::function<void()>> pending;
+};
+
+namespace
+{
+std::vector<std::unique_ptr<mqtt_client_s>> clients;
+std::vector<std::string> subscribed;
+std::vector<mock_broker::message> received_messages;
+bool broker_answering = true;
+int error_count = 0;
+
+// The API is called with the lwIP lock held, the background runs
+// outside of it
+void require_lock()
+{
+    if (mock_lwip::lock_depth() == 0)
+    {
+        error_count++;
+    }
+}
+
+mqtt_client_s *client()
+{
+    return clients.empty() ? nullptr : clients.back().get();
+}
+}// namespace
+
+mqtt_client_t *mqtt_client_new()
+{
+    clients.push_back(std::make_unique<mqtt_client_s>());
+    return client();
+}
+
+err_t mqtt_client_connect(mqtt_client_t *client, const ip_addr_t *, u16_t, mqtt_connection_cb_t cb, void *arg,
+    const struct mqtt_connect_client_info_t *)
+{
+    require_lock();
+    if (client->connected)
+    {
+        return ERR_ISCONN;
+    }
+    client->connection_cb = cb;
+    client->connection_arg = arg;
+    client->publish_cb = nullptr;
+    client->data_cb = nullptr;
+    client->inpub_arg = nullptr;
+    client->pending.clear();
+    if (broker_answering)
+    {
+        client->pending.push_back([client] {
+            client->connected = true;
+            client->connection_cb(client, client->connection_arg, MQTT_CONNECT_ACCEPTED);
+        });
+    }
+    return ERR_OK;
+}
+
+void mqtt_disconnect(mqtt_client_t *client)
+{
+    require_lock();
+    client->connected = false;
+    client->pending.clear();
+    subscribed.clear();
+}
+
+u8_t mqtt_client_is_connected(mqtt_client_t *client)
+{
+    require_lock();
+    return client->connected;
+}
+
+void mqtt_set_inpub_callback(mqtt_client_t *client, mqtt_incoming_publish_cb_t pub_cb, mqtt_incoming_data_cb_t data_cb, void *arg)
+{
+    require_lock();
+    client->publish_cb = pub_cb;
+    client->data_cb = data_cb;
+    client->inpub_arg = arg;
+}
+
+err_t mqtt_subscribe(mqtt_client_t *client, const char *topic, u8_t, mqtt_request_cb_t cb, void *arg)
+{
+    require_lock();
+    if (!client->connected)
+    {
+        return ERR_CONN;
+    }
+    if (broker_answering)
+    {
+        client->pending.push_back([cb, arg, subscription = std::string(topic)] {
+            subscribed.push_back(subscription);
+            cb(arg, ERR_OK);
+        });
+    }
+    return ERR_OK;
+}
+
+err_t mqtt_publish(mqtt_client_t *client, const char *topic, const void *payload, u16_t payload_length, u8_t, u8_t,
+    mqtt_request_cb_t cb, void *arg)
+{
+    require_lock();
+    if (!client->connected)
+    {
+        return ERR_CONN;
+    }
+    // lwIP copies the message into its output buffer
+    mock_broker::message message{ topic, std::string(static_cast<const char *>(payload), payload_length) };
+    if (broker_answering)
+    {
+        client->pending.push_back([cb, arg, message] {
+            received_messages.push_back(message);
+            cb(arg, ERR_OK);
+        });
+    }
+    return ERR_OK;
+}
+
+void mock_broker::reset()
+{
+    clients.clear();
+    subscribed.clear();
+    received_messages.clear();
+    broker_answering = true;
+    error_count = 0;
+}
+
+int mock_broker::errors()
+{
+    return error_count;
+}
+
+void mock_broker::set_answering(bool answering)
+{
+    broker_answering = answering;
+}
+
+void mock_broker::run()
+{
+    if (mock_lwip::lock_depth() != 0)
+    {
+        error_count++;
+        return;
+    }
+    auto *current = client();
+    while (current && !current->pending.empty())
+    {
+        auto event = std::move(current->pending.front());
+        current->pending.pop_front();
+        event();
+    }
+}
+
+bool mock_broker::publish(const std::string &topic, const std::string &payload, size_t fragment_length)
+{
+    auto *current = client();
+    if (!current || !current->connected || std::find(subscribed.begin(), subscribed.end(), topic) == subscribed.end())
+    {
+        return false;
+    }
+    current->pending.push_back([current, topic, payload, fragment_length] {
+        if (!current->publish_cb || !current->data_cb)
+        {
+            // lwIP drops a PUBLISH without callbacks
+            return;
+        }
+        current->publish_cb(current->inpub_arg, topic.c_str(), u32_t(payload.size()));
+        size_t offset = 0;
+        do
+        {
+            const size_t length = std::min(fragment_length, payload.size() - offset);
+            const bool last = offset + length == payload.size();
+            current->data_cb(current->inpub_arg, reinterpret_cast<const u8_t *>(payload.data() + offset), u16_t(length),
+                last ? MQTT_DATA_FLAG_LAST : 0);
+            offset += length;
+        } while (offset < payload.size());
+    });
+    return true;
+}
+
+void mock_broker::drop_connection()
+{
+    auto *current = client();
+    if (!current || !current->connected)
+    {
+        return;
+    }
+    current->connected = false;
+    current->pending.clear();
+    subscribed.clear();
+    current->connection_cb(current, current->connection_arg, MQTT_CONNECT_DISCONNECTED);
+}
+
+const std::vector<mock_broker::message> &mock_broker::received()
+{
+    return received_messages;
+}
+
+const std::vector<std::string> &mock_broker::subscriptions()
+{
+    return subscribed;
+}
@@ -0,0 +1,91 @@
+#include <hardware/watchdog.h>
+#include <lwip/apps/mqtt.h>
+#include <lwip/dns.h>
+#include <pico/cyw43_arch.h>
+#include <pico/stdlib.h>
+
+#include <cstdio>
+
+namespace
+{
+uint64_t now_us = 0;
+int lwip_lock_depth = 0;
+}// namespace
+
+cyw43_t cyw43_state;
+
+uint64_t time_us_64()
+{
+    return now_us;
+}
+
+absolute_time_t make_timeout_time_ms(uint32_t ms)
+{
+    return now_us + uint64_t(ms) * 1000;
+}
+
+bool time_reached(absolute_time_t t)
+{
+    return now_us >= t;
+}
+
+void sleep_ms(uint32_t ms)
+{
+    now_us += uint64_t(ms) * 1000;
+    mock_broker::run();
+}
+
+void watchdog_update()
+{}
+
+int cyw43_arch_init_with_country(uint32_t)
+{
+    return 0;
+}
+
+void cyw43_arch_enable_sta_mode()
+{}
+
+int cyw43_arch_wifi_connect_async(const char *, const char *, uint32_t)
+{
+    return 0;
+}
+
+int cyw43_tcpip_link_status(cyw43_t *, int)
+{
+    return CYW43_LINK_UP;
+}
+
+int cyw43_wifi_pm(cyw43_t *, uint32_t)
+{
+    return 0;
+}
+
+void cyw43_arch_lwip_begin()
+{
+    lwip_lock_depth++;
+}
+
+void cyw43_arch_lwip_end()
+{
+    lwip_lock_depth--;
+}
+
+int mock_lwip::lock_depth()
+{
+    return lwip_lock_depth;
+}
+
+err_t dns_gethostbyname(const char *, ip_addr_t *addr, dns_found_callback, void *)
+{
+    addr->addr = 0x010200c0;
+    return ERR_OK;
+}
+
+const char *ip4addr_ntoa(const ip_addr_t *addr)
+{
+    static char text[16];
+    snprintf(text, sizeof(text), "%u.%u.%u.%u", addr->addr & 0xff, (addr->addr >> 8) & 0xff, (addr->addr >> 16) & 0xff,
+        addr->addr >> 24);
+    return text;
+}
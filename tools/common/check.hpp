@@ -0,0 +1,50 @@
+#pragma once
+
+// Reporting shared by the host checks (tools/*_check): one line per
+// scenario under "== section ==" headers, and a summary that is the exit
+// code. A check that needs its mocks reset or verified around a scenario
+// wraps host_check::check.
+
+#include <cstdio>
+#include <exception>
+#include <functional>
+
+namespace host_check
+{
+// Runs a scenario and reports it. An exception escaping the scenario
+// fails it.
+inline bool check(const char *name, const std::function<bool()> &scenario)
+{
+    bool ok = false;
+    try
+    {
+        ok = scenario();
+    } catch (std::exception &err)
+    {
+        printf("  %s: unexpected exception: %s\n", name, err.what());
+    }
+    printf("  %-52s %s\n", name, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// True if the action throws the exception
+template <typename exception>
+bool throws(const std::function<void()> &action)
+{
+    try
+    {
+        action();
+    } catch (exception &)
+    {
+        return true;
+    }
+    return false;
+}
+
+// Prints the summary, returns the exit code of the check
+inline int finish(bool ok)
+{
+    printf("%s\n", ok ? "all checks passed" : "CHECKS FAILED");
+    return ok ? 0 : 1;
+}
+}// namespace host_check
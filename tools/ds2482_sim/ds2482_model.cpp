@@ -0,0 +1,316 @@
+#include <ds2482_model.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+
+namespace
+{
+constexpr const uint8_t DEVICE_RESET_COMMAND = 0xf0;
+constexpr const uint8_t SET_READ_POINTER_COMMAND = 0xe1;
+constexpr const uint8_t WRITE_CONFIGURATION_COMMAND = 0xd2;
+constexpr const uint8_t CHANNEL_SELECT_COMMAND = 0xc3;
+constexpr const uint8_t ONEWIRE_RESET_COMMAND = 0xb4;
+constexpr const uint8_t ONEWIRE_SINGLE_BIT_COMMAND = 0x87;
+constexpr const uint8_t ONEWIRE_WRITE_BYTE_COMMAND = 0xa5;
+constexpr const uint8_t ONEWIRE_READ_BYTE_COMMAND = 0x96;
+constexpr const uint8_t ONEWIRE_TRIPLET_COMMAND = 0x78;
+
+constexpr const uint8_t STATUS_POINTER = 0xf0;
+constexpr const uint8_t DATA_POINTER = 0xe1;
+constexpr const uint8_t CHANNEL_POINTER = 0xd2;
+constexpr const uint8_t CONFIGURATION_POINTER = 0xc3;
+
+constexpr const uint8_t STATUS_1WB = 0x01;
+constexpr const uint8_t STATUS_PPD = 0x02;
+constexpr const uint8_t STATUS_SD = 0x04;
+constexpr const uint8_t STATUS_RST = 0x10;
+constexpr const uint8_t STATUS_SBR = 0x20;
+constexpr const uint8_t STATUS_TSB = 0x40;
+constexpr const uint8_t STATUS_DIR = 0x80;
+
+constexpr const uint8_t CONFIGURATION_SPU = 0x04;
+constexpr const uint8_t CONFIGURATION_1WS = 0x08;
+
+constexpr const std::array<uint8_t, 8> CHANNEL_CODES{0xf0, 0xe1, 0xd2, 0xc3, 0xb4, 0xa5, 0x96, 0x87};
+constexpr const std::array<uint8_t, 8> CHANNEL_READBACK{0xb8, 0xb1, 0xaa, 0xa3, 0x9c, 0x95, 0x8e, 0x87};
+
+// Nominal 1-Wire timing of the bridge (all numbers are us)
+struct bridge_timing
+{
+    double reset_low; // tRSTL
+    double presence_sample; // tMSP after the release
+    double reset_high; // tRSTH
+    double write_1_low; // tW1L
+    double read_sample; // tMSR
+    double write_0_low; // tW0L
+    double slot; // tSLOT
+};
+
+constexpr const bridge_timing STANDARD_BRIDGE{ 560.0, 68.0, 584.0, 8.0, 14.0, 64.0, 70.0 };
+constexpr const bridge_timing OVERDRIVE_BRIDGE{ 70.0, 9.5, 74.0, 1.0, 2.0, 7.5, 10.5 };
+}// namespace
+
+ds2482_model::ds2482_model(uint8_t address, bool eight_channels_in, double i2c_baudrate):
+    i2c_address(address), eight_channels(eight_channels_in), byte_us(9e6 / i2c_baudrate),
+    buses(eight_channels_in ? 8 : 1)
+{
+    status = STATUS_RST;
+}
+
+void ds2482_model::violation(const char *what)
+{
+    printf("DS2482 model: %s\n", what);
+    protocol_violations++;
+}
+
+bool ds2482_model::write(uint8_t address, std::span<const uint8_t> data)
+{
+    // address byte, data bytes, START and STOP
+    now += (data.size() + 1) * byte_us + 2 * byte_us / 9;
+    if (address != i2c_address)
+    {
+        return false;
+    }
+    if (data.empty())
+    {
+        violation("empty write");
+        return true;
+    }
+    run_command(data);
+    return true;
+}
+
+bool ds2482_model::read(uint8_t address, std::span<uint8_t> data)
+{
+    now += (data.size() + 1) * byte_us + 2 * byte_us / 9;
+    if (address != i2c_address)
+    {
+        return false;
+    }
+    uint8_t value = 0;
+    switch (read_pointer)
+    {
+    case pointer::status:
+        if (busy())
+        {
+            busy_polls++;
+        }
+        value = busy() ? uint8_t(status | STATUS_1WB) : status;
+        break;
+    case pointer::data:
+        value = data_register;
+        break;
+    case pointer::channel:
+        value = CHANNEL_READBACK[selected_channel];
+        break;
+    case pointer::configuration:
+        value = configuration;
+        break;
+    default:
+        break;
+    }
+    // the register is read repeatedly until the STOP
+    for (auto &byte : data)
+    {
+        byte = value;
+    }
+    return true;
+}
+
+void ds2482_model::end_strong_pullup()
+{
+    strong_pullup = false;
+    configuration &= ~CONFIGURATION_SPU;
+}
+
+void ds2482_model::run_command(std::span<const uint8_t> data)
+{
+    const uint8_t command = data[0];
+    const bool has_parameter = data.size() >= 2;
+    const uint8_t parameter = has_parameter ? data[1] : 0;
+
+    switch (command)
+    {
+    case DEVICE_RESET_COMMAND:
+        end_strong_pullup();
+        configuration = 0;
+        selected_channel = 0;
+        busy_until = now;
+        status = STATUS_RST;
+        read_pointer = pointer::status;
+        return;
+    case SET_READ_POINTER_COMMAND:
+        switch (parameter)
+        {
+        case STATUS_POINTER:
+            read_pointer = pointer::status;
+            break;
+        case DATA_POINTER:
+            read_pointer = pointer::data;
+            break;
+        case CONFIGURATION_POINTER:
+            read_pointer = pointer::configuration;
+            break;
+        case CHANNEL_POINTER:
+            if (eight_channels)
+            {
+                read_pointer = pointer::channel;
+                break;
+            }
+            violation("invalid read pointer code");
+            break;
+        default:
+            violation("invalid read pointer code");
+            break;
+        }
+        return;
+    case WRITE_CONFIGURATION_COMMAND:
+    {
+        if (busy())
+        {
+            violation("configuration written while 1-Wire busy");
+            return;
+        }
+        const uint8_t low = parameter & 0x0f;
+        if (!has_parameter || (parameter >> 4) != (~low & 0x0f))
+        {
+            violation("configuration without complement");
+            return;
+        }
+        if (!(low & CONFIGURATION_SPU))
+        {
+            end_strong_pullup();
+        }
+        configuration = low;
+        status &= ~STATUS_RST;
+        read_pointer = pointer::configuration;
+        return;
+    }
+    case CHANNEL_SELECT_COMMAND:
+    {
+        if (!eight_channels)
+        {
+            violation("channel select on a DS2482-100");
+            return;
+        }
+        if (busy())
+        {
+            violation("channel selected while 1-Wire busy");
+            return;
+        }
+        size_t code = 0;
+        while (code < CHANNEL_CODES.size() && CHANNEL_CODES[code] != parameter)
+        {
+            code++;
+        }
+        if (code == CHANNEL_CODES.size())
+        {
+            violation("invalid channel code");
+            return;
+        }
+        selected_channel = uint8_t(code);
+        read_pointer = pointer::channel;
+        return;
+    }
+    default:
+        break;
+    }
+
+    // 1-Wire commands
+    if (busy())
+    {
+        violation("1-Wire command while 1-Wire busy");
+        return;
+    }
+    // a strong pullup lasts until the next command, which clears SPU
+    if (strong_pullup)
+    {
+        end_strong_pullup();
+    }
+    const bool pull_up_after = (configuration & CONFIGURATION_SPU) != 0;
+    status &= ~(STATUS_RST | STATUS_1WB);
+    read_pointer = pointer::status;
+    // the bus starts where the previous command ended
+    busy_until = std::max(now, busy_until);
+
+    switch (command)
+    {
+    case ONEWIRE_RESET_COMMAND:
+    {
+        bool short_detected = false;
+        bool presence = onewire_reset(short_detected);
+        status = (status & ~(STATUS_PPD | STATUS_SD)) | (presence ? STATUS_PPD : 0) | (short_detected ? STATUS_SD : 0);
+        return;
+    }
+    case ONEWIRE_SINGLE_BIT_COMMAND:
+    {
+        bool bit = onewire_bit(parameter & 0x80);
+        status = (status & ~STATUS_SBR) | (bit ? STATUS_SBR : 0);
+        break;
+    }
+    case ONEWIRE_WRITE_BYTE_COMMAND:
+        for (int i = 0; i < 8; i++)
+        {
+            onewire_bit((parameter >> i) & 1);
+        }
+        break;
+    case ONEWIRE_READ_BYTE_COMMAND:
+        data_register = 0;
+        for (int i = 0; i < 8; i++)
+        {
+            data_register |= uint8_t(onewire_bit(true)) << i;
+        }
+        break;
+    case ONEWIRE_TRIPLET_COMMAND:
+    {
+        bool id_bit = onewire_bit(true);
+        bool complement_bit = onewire_bit(true);
+        bool direction = id_bit != complement_bit ? id_bit : (id_bit || (parameter & 0x80));
+        onewire_bit(direction);
+        status = (status & ~(STATUS_SBR | STATUS_TSB | STATUS_DIR))
+            | (id_bit ? STATUS_SBR : 0) | (complement_bit ? STATUS_TSB : 0) | (direction ? STATUS_DIR : 0);
+        return;
+    }
+    default:
+        violation("unknown command");
+        return;
+    }
+    // the strong pullup follows the last bit of a byte or single bit
+    strong_pullup = pull_up_after;
+}
+
+bool ds2482_model::onewire_reset(bool &short_detected)
+{
+    const auto &timing = (configuration & CONFIGURATION_1WS) ? OVERDRIVE_BRIDGE : STANDARD_BRIDGE;
+    auto &bus = buses[selected_channel];
+    const double start = busy_until;
+    short_detected = !bus.level(start);
+    bus.set_master_low(true, start);
+    bus.set_master_low(false, start + timing.reset_low);
+    bool presence = !bus.level(start + timing.reset_low + timing.presence_sample);
+    busy_until = start + timing.reset_low + timing.reset_high;
+    return presence;
+}
+
+bool ds2482_model::onewire_bit(bool bit)
+{
+    const auto &timing = (configuration & CONFIGURATION_1WS) ? OVERDRIVE_BRIDGE : STANDARD_BRIDGE;
+    auto &bus = buses[selected_channel];
+    const double start = busy_until;
+    bool sampled;
+    bus.set_master_low(true, start);
+    if (bit)
+    {
+        bus.set_master_low(false, start + timing.write_1_low);
+        sampled = bus.level(start + timing.read_sample);
+    }
+    else
+    {
+        // the level is sampled while the master still holds the bus low
+        sampled = bus.level(start + timing.read_sample);
+        bus.set_master_low(false, start + timing.write_0_low);
+    }
+    busy_until = start + timing.slot;
+    return sampled;
+}
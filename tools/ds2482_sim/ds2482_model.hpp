@@ -0,0 +1,69 @@
+#pragma once
+
+#include <i2c_transport.hpp>
+#include <onewire_bus.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Model of a DS2482-100/800 I2C to 1-Wire bridge driving one model of a
+// 1-Wire bus per channel. It implements the I2C side as seen by the
+// driver: commands, read pointer, registers and the 1-Wire busy time.
+// Simulated time advances with each I2C transfer at the configured baud
+// rate, 1-Wire commands run on the bus models with the nominal timing of
+// the bridge and keep the busy bit set until they would have finished.
+//
+// Protocol violations (commands while busy, invalid codes, a config
+// write without the complement) are counted instead of being ignored
+// silently like the real bridge does.
+class ds2482_model : public i2c_transport
+{
+  public:
+    ds2482_model(uint8_t address, bool eight_channels, double i2c_baudrate = 400000.0);
+
+    bool write(uint8_t address, std::span<const uint8_t> data) override;
+    bool read(uint8_t address, std::span<uint8_t> data) override;
+
+    onewire_model::bus &channel_bus(uint8_t channel) { return buses[channel]; }
+
+    double now_us() const { return now; }
+    size_t violations() const { return protocol_violations; }
+    size_t status_polls() const { return busy_polls; }
+    bool strong_pullup_active() const { return strong_pullup; }
+
+  private:
+    enum class pointer
+    {
+        status,
+        data,
+        channel,
+        configuration
+    };
+
+    void run_command(std::span<const uint8_t> data);
+    void violation(const char *what);
+    bool busy() const { return now < busy_until; }
+    void end_strong_pullup();
+
+    // 1-Wire primitives on the selected channel, starting at the end
+    // of the previous one
+    bool onewire_reset(bool &short_detected);
+    bool onewire_bit(bool bit);
+
+    uint8_t i2c_address;
+    bool eight_channels;
+    double byte_us;
+    std::vector<onewire_model::bus> buses;
+    double now = 0;
+    double busy_until = 0; // end of the running 1-Wire command
+    pointer read_pointer = pointer::status;
+    uint8_t status = 0;
+    uint8_t data_register = 0;
+    uint8_t configuration = 0;
+    uint8_t selected_channel = 0;
+    bool strong_pullup = false;
+    size_t protocol_violations = 0;
+    size_t busy_polls = 0;
+};
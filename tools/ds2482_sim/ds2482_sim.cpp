@@ -0,0 +1,262 @@
+// Runs the firmware's DS2482 driver (src/ds2482.cpp) and the ROM functions
+// of its bus master (src/bus_master.cpp) against a model of the bridge that
+// drives the 1-Wire bus models of pio_trace. Checks the driver's use of the
+// bridge (busy polling, channel and configuration handling) and the results
+// of the 1-Wire transfers on the DS2482-100 and DS2482-800.
+//
+// Usage: ds2482_sim [--benchmark]
+
+#include <ds2482.hpp>
+#include <ds2482_model.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+constexpr const uint8_t READ_ROM_COMMAND = 0x33;
+constexpr const uint8_t CONVERT_T_COMMAND = 0x44;
+constexpr const uint8_t BRIDGE_ADDRESS = 0x18;
+constexpr const size_t SEARCH_DEVICES = 8;
+
+std::vector<uint64_t> make_roms(size_t count, uint64_t seed)
+{
+    std::mt19937_64 random(seed);
+    std::vector<uint64_t> roms;
+    while (roms.size() < count)
+    {
+        uint64_t rom = 0x28 | ((random() & 0xffffffffffffull) << 8); // DS18B20 family code
+        uint8_t bytes[7];
+        for (int i = 0; i < 7; i++)
+        {
+            bytes[i] = rom >> (8 * i);
+        }
+        rom |= uint64_t(calc_crc8(bytes, 7)) << 56;
+        if (std::find(roms.begin(), roms.end(), rom) == roms.end())
+        {
+            roms.push_back(rom);
+        }
+    }
+    return roms;
+}
+
+uint64_t read_rom(const bus_master &master)
+{
+    master.transmit(READ_ROM_COMMAND);
+    uint64_t rom = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        rom |= uint64_t(master.receive()) << (8 * i);
+    }
+    return rom;
+}
+
+bool same_devices(std::vector<uint64_t> found, std::vector<uint64_t> expected)
+{
+    std::sort(found.begin(), found.end());
+    std::sort(expected.begin(), expected.end());
+    return found == expected;
+}
+
+bool run_scenario(const char *name, bool eight_channels,
+    const std::function<bool(ds2482_model &, ds2482_bridge &)> &scenario)
+{
+    ds2482_model model(BRIDGE_ADDRESS, eight_channels);
+
+    printf("== %s ==\n", name);
+    bool functional = false;
+    try
+    {
+        ds2482_bridge bridge(model, BRIDGE_ADDRESS,
+            eight_channels ? ds2482_bridge::model::ds2482_800 : ds2482_bridge::model::ds2482_100);
+        functional = scenario(model, bridge);
+    } catch (std::exception &err)
+    {
+        printf("  driver failed: %s\n", err.what());
+    }
+    printf("  transfers %s, %.1f us simulated, %zu busy polls\n",
+        functional ? "ok" : "FAILED",
+        model.now_us(),
+        model.status_polls());
+    bool ok = functional && model.violations() == 0;
+    if (model.violations() > 0)
+    {
+        printf("  %zu protocol violations FAILED\n", model.violations());
+    }
+    printf("\n");
+    return ok;
+}
+
+void benchmark()
+{
+    printf("== search benchmark (simulated I2C and 1-Wire time) ==\n");
+    printf("  %8s %22s %22s %22s\n", "devices", "100 kHz [ms]", "400 kHz [ms]", "1 MHz [ms]");
+    for (size_t count : { 10, 50, 100 })
+    {
+        auto roms = make_roms(count, count);
+        printf("  %8zu", count);
+        for (double baudrate : { 100000.0, 400000.0, 1000000.0 })
+        {
+            ds2482_model model(BRIDGE_ADDRESS, false, baudrate);
+            for (auto rom : roms)
+            {
+                model.channel_bus(0).add_device(rom);
+            }
+            ds2482_bridge bridge(model, BRIDGE_ADDRESS, ds2482_bridge::model::ds2482_100);
+            ds2482_channel channel(bridge, 0);
+            const double start = model.now_us();
+            if (!same_devices(channel.search(), roms))
+            {
+                printf(" search FAILED");
+            }
+            const double elapsed = (model.now_us() - start) / 1000.0;
+            printf(" %10.1f (%5.2f/dev)", elapsed, elapsed / count);
+        }
+        printf("\n");
+    }
+    printf("\n");
+}
+}// namespace
+
+int main(int argc, char **argv)
+{
+    bool run_benchmark = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--benchmark") == 0)
+        {
+            run_benchmark = true;
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--benchmark]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    const auto roms = make_roms(SEARCH_DEVICES, 1);
+    bool ok = true;
+
+    ok = run_scenario("ds2482_100_read_rom", false, [&roms](ds2482_model &model, ds2482_bridge &bridge) {
+        model.channel_bus(0).add_device(roms[0]);
+        ds2482_channel channel(bridge, 0);
+        return channel.reset() == 1 && read_rom(channel) == roms[0];
+    }) && ok;
+
+    ok = run_scenario("ds2482_100_search", false, [&roms](ds2482_model &model, ds2482_bridge &bridge) {
+        for (auto rom : roms)
+        {
+            model.channel_bus(0).add_device(rom);
+        }
+        ds2482_channel channel(bridge, 0);
+        return same_devices(channel.search(), roms);
+    }) && ok;
+
+    ok = run_scenario("ds2482_800_channels", true, [&roms](ds2482_model &model, ds2482_bridge &bridge) {
+        // channel 0: three devices, 3: four devices, 7: one device, the others are empty
+        const std::vector<std::vector<uint64_t>> expected{
+            { roms[0], roms[1], roms[2] }, {}, {}, { roms[3], roms[4], roms[5], roms[6] }, {}, {}, {}, { roms[7] }
+        };
+        std::vector<ds2482_channel> channels;
+        for (uint8_t channel = 0; channel < bridge.channel_count(); channel++)
+        {
+            for (auto rom : expected[channel])
+            {
+                model.channel_bus(channel).add_device(rom);
+            }
+            channels.emplace_back(bridge, channel);
+        }
+        bool functional = true;
+        for (uint8_t channel = 0; channel < bridge.channel_count(); channel++)
+        {
+            functional = functional && channels[channel].reset() == (expected[channel].empty() ? 0 : 1);
+            functional = functional && same_devices(channels[channel].search(), expected[channel]);
+        }
+        // interleaved transfers switch the channel back and forth
+        functional = functional && channels[7].reset() && read_rom(channels[7]) == roms[7];
+        functional = functional && same_devices(channels[3].search(), expected[3]);
+        functional = functional && channels[7].reset() && read_rom(channels[7]) == roms[7];
+        functional = functional && same_devices(channels[0].search(), expected[0]);
+        return functional;
+    }) && ok;
+
+    ok = run_scenario("alarm_search", true, [&roms](ds2482_model &model, ds2482_bridge &bridge) {
+        auto &bus = model.channel_bus(2);
+        for (auto rom : roms)
+        {
+            bus.add_device(rom);
+        }
+        ds2482_channel channel(bridge, 2);
+        // devices crossing their thresholds between conversions
+        bool functional = channel.alarm_search().empty();
+        bus.set_alarm(roms[2], true);
+        bus.set_alarm(roms[5], true);
+        functional = functional && same_devices(channel.alarm_search(), { roms[2], roms[5] });
+        bus.set_alarm(roms[2], false);
+        functional = functional && same_devices(channel.alarm_search(), { roms[5] });
+        return functional;
+    }) && ok;
+
+    ok = run_scenario("overdrive", true, [&roms](ds2482_model &model, ds2482_bridge &bridge) {
+        // one overdrive capable device next to a standard speed device
+        model.channel_bus(1).add_device(roms[0], true);
+        model.channel_bus(1).add_device(roms[1]);
+        model.channel_bus(4).add_device(roms[2]);
+        ds2482_channel channel(bridge, 1);
+        ds2482_channel other(bridge, 4);
+        bool functional = channel.select(roms[0], bus_master::speed::overdrive)
+            && channel.get_speed() == bus_master::speed::overdrive;
+        // only the device switched to overdrive answers a reset at overdrive speed
+        functional = functional && channel.reset() == 1 && read_rom(channel) == roms[0];
+        // the other channel of the bridge runs at standard speed meanwhile
+        functional = functional && other.reset() == 1 && read_rom(other) == roms[2];
+        functional = functional && channel.skip_rom(bus_master::speed::overdrive) && channel.reset() == 1 && read_rom(channel) == roms[0];
+        // a search returns all devices to standard speed
+        functional = functional && same_devices(channel.search(), { roms[0], roms[1] });
+        return functional;
+    }) && ok;
+
+    ok = run_scenario("strong_pullup", false, [&roms](ds2482_model &model, ds2482_bridge &bridge) {
+        model.channel_bus(0).add_device(roms[0]);
+        ds2482_channel channel(bridge, 0);
+        bool functional = channel.skip_rom();
+        channel.transmit_then_pull_up(CONVERT_T_COMMAND);
+        functional = functional && model.strong_pullup_active();
+        channel.disable_pull_up();
+        functional = functional && !model.strong_pullup_active();
+        // the next command ends the strong pullup as well
+        functional = functional && channel.skip_rom();
+        channel.transmit_then_pull_up(CONVERT_T_COMMAND);
+        functional = functional && model.strong_pullup_active() && channel.reset() == 1 && !model.strong_pullup_active();
+        return functional;
+    }) && ok;
+
+    printf("== missing_bridge ==\n");
+    {
+        ds2482_model model(BRIDGE_ADDRESS, false);
+        bool thrown = false;
+        try
+        {
+            ds2482_bridge bridge(model, BRIDGE_ADDRESS + 1, ds2482_bridge::model::ds2482_100);
+        } catch (std::runtime_error &err)
+        {
+            thrown = true;
+            printf("  %s\n", err.what());
+        }
+        printf("  %s\n\n", thrown ? "ok" : "no error FAILED");
+        ok = thrown && ok;
+    }
+
+    if (run_benchmark)
+    {
+        benchmark();
+    }
+
+    printf("%s\n", ok ? "all checks passed" : "CHECKS FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,322 @@
+// Runs the firmware's metrics endpoint (src/http_server.cpp on top of
+// src/metrics_cache.cpp) against a mock of lwIP's raw TCP API whose
+// connections read the queued data only when it is acknowledged, as lwIP
+// does without TCP_WRITE_FLAG_COPY: responses in small send windows, slow
+// scrapes across sweeps, the connection pool, idle and reset connections
+// and malformed requests. The mock counts the use of closed connections and
+// copying writes.
+//
+// Usage: http_check
+
+#include <http_server.hpp>
+
+#include <lwip/tcp.h>
+#include <pico/cyw43_arch.h>
+
+#include <check.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace
+{
+constexpr const uint64_t TIMESTAMP_MS = 1792368000000;
+// as http_server.cpp
+constexpr const int MAX_IDLE_POLLS = 5;
+
+struct response
+{
+    int status = 0;
+    std::string content_type;
+    size_t content_length = 0;
+    std::string body;
+    bool complete = false;
+};
+
+response parse_response(const std::string &received)
+{
+    response result;
+    const auto header_end = received.find("\r\n\r\n");
+    if (header_end == std::string::npos || !received.starts_with("HTTP/1.0 "))
+    {
+        return result;
+    }
+    const std::string header = received.substr(0, header_end);
+    result.status = std::atoi(header.c_str() + 9);
+    auto field = [&](const std::string &name) {
+        const auto start = header.find("\r\n" + name + ": ");
+        if (start == std::string::npos)
+        {
+            return std::string();
+        }
+        const auto value = start + name.size() + 4;
+        return header.substr(value, header.find("\r\n", value) - value);
+    };
+    result.content_type = field("Content-Type");
+    result.content_length = std::strtoul(field("Content-Length").c_str(), nullptr, 10);
+    result.body = received.substr(header_end + 4);
+    result.complete = result.body.size() == result.content_length;
+    return result;
+}
+
+// A scrape that is acknowledged at once
+response scrape(const std::string &request, u16_t send_buffer = mock_tcp::SEND_BUFFER)
+{
+    tcp_pcb *pcb = mock_tcp::connect(send_buffer);
+    if (!pcb)
+    {
+        return {};
+    }
+    mock_tcp::send(pcb, request);
+    while (!pcb->queued.empty())
+    {
+        mock_tcp::acknowledge(pcb);
+    }
+    auto result = parse_response(pcb->received);
+    result.complete = result.complete && pcb->closed;
+    return result;
+}
+
+response get(const char *path)
+{
+    return scrape(std::string("GET ") + path + " HTTP/1.1\r\nHost: probe\r\nAccept: */*\r\n\r\n");
+}
+
+void fill(metrics_cache &cache, size_t devices, int16_t offset = 0)
+{
+    for (size_t i = 0; i < devices; i++)
+    {
+        const int16_t value = int16_t(320 + i + offset);
+        cache.set_reading({ 0x2800000000000028ull + (uint64_t(i) << 8), uint8_t(i % 2), value, int16_t(value - 3),
+            int16_t(value + 4), int16_t(value + 1), TIMESTAMP_MS + i });
+    }
+    cache.set_bus(0, { uint32_t((devices + 1) / 2), 10, 100, 1, 2 });
+    cache.set_bus(1, { uint32_t(devices / 2), 10, 100, 0, 0 });
+}
+
+bool has(const std::string &text, const std::string &part)
+{
+    return text.find(part) != std::string::npos;
+}
+
+bool check(const char *name, const std::function<bool(metrics_cache &, http_server &)> &scenario)
+{
+    return host_check::check(name, [&] {
+        mock_tcp::reset();
+        metrics_cache cache;
+        http_server server(cache);
+        server.start();
+        return mock_tcp::listener() && scenario(cache, server) && mock_tcp::errors() == 0
+            && mock_lwip::lock_depth() == 0;
+    });
+}
+}// namespace
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        fprintf(stderr, "usage: %s\n", argv[0]);
+        return 2;
+    }
+
+    bool ok = true;
+    printf("== metrics endpoint ==\n");
+
+    ok = check("503 before the first sweep", [](metrics_cache &, http_server &server) {
+        const auto result = get("/metrics");
+        return result.status == 503 && result.complete && server.served_requests() == 1;
+    }) && ok;
+
+    ok = check("Prometheus text of a sweep", [](metrics_cache &cache, http_server &server) {
+        cache.set_bus(0, { 1, 17, 34, 1, 2 });
+        cache.set_bus(1, { 1, 17, 34, 0, 0 });
+        cache.set_reading({ 0x2800000000000028ull, 0, 344, 340, 350, 345, TIMESTAMP_MS });
+        cache.set_reading({ 0x28000000000001a8ull, 1, -160, -161, -159, -160, TIMESTAMP_MS + 7 });
+        server.publish(5, 61500);
+        const auto result = get("/metrics");
+        return result.status == 200 && result.complete
+            && result.content_type == "text/plain; version=0.0.4; charset=utf-8"
+            && has(result.body, "probe_sweeps_total 5\n") && has(result.body, "probe_uptime_seconds 61.500\n")
+            && has(result.body, "onewire_crc_errors_total{bus=\"0\"} 2\n")
+            && has(result.body, "temperature_celsius{bus=\"0\",id=\"2800000000000028\"} 21.5000\n")
+            && has(result.body, "temperature_min_celsius{bus=\"1\",id=\"28000000000001a8\"} -10.0625\n")
+            && has(result.body, "temperature_timestamp_seconds{bus=\"1\",id=\"28000000000001a8\"} 1792368000.007\n");
+    }) && ok;
+
+    ok = check("JSON of a sweep", [](metrics_cache &cache, http_server &server) {
+        cache.set_bus(0, { 1, 17, 34, 1, 2 });
+        cache.set_reading({ 0x2800000000000028ull, 0, 344, 340, 350, 345, TIMESTAMP_MS });
+        server.publish(5, 61500);
+        const auto result = get("/metrics.json");
+        return result.status == 200 && result.complete && result.content_type == "application/json"
+            && result.body.starts_with("{\"sequence\":5,\"uptime_ms\":61500,\"buses\":[{\"bus\":0,")
+            && has(result.body, "{\"id\":\"2800000000000028\",\"bus\":0,\"value\":21.5000,")
+            && result.body.ends_with("]}");
+    }) && ok;
+
+    ok = check("a full cache fits the snapshot buffers", [](metrics_cache &cache, http_server &server) {
+        fill(cache, metrics_cache::MAX_DEVICES);
+        server.publish(1, 1000);
+        const auto prometheus = get("/metrics");
+        const auto json = get("/metrics.json");
+        printf("  %zu devices: %zu bytes Prometheus, %zu bytes JSON\n", metrics_cache::MAX_DEVICES,
+            prometheus.body.size(), json.body.size());
+        return prometheus.complete && json.complete && cache.truncated_renders() == 0 && json.body.ends_with("]}");
+    }) && ok;
+
+    ok = check("a small send window is refilled on acknowledgement", [](metrics_cache &cache, http_server &server) {
+        fill(cache, metrics_cache::MAX_DEVICES);
+        server.publish(1, 1000);
+        const auto whole = get("/metrics");
+        tcp_pcb *pcb = mock_tcp::connect(536);
+        mock_tcp::send(pcb, "GET /metrics HTTP/1.0\r\n\r\n");
+        size_t rounds = 0;
+        while (!pcb->queued.empty())
+        {
+            // one segment at a time
+            mock_tcp::acknowledge(pcb, 536);
+            rounds++;
+        }
+        const auto result = parse_response(pcb->received);
+        return result.complete && pcb->closed && result.body == whole.body && rounds > whole.body.size() / 536;
+    }) && ok;
+
+    ok = check("a slow scrape keeps its snapshot across sweeps", [](metrics_cache &cache, http_server &server) {
+        fill(cache, metrics_cache::MAX_DEVICES);
+        server.publish(1, 1000);
+        const auto first = get("/metrics");
+        tcp_pcb *slow = mock_tcp::connect(1460);
+        mock_tcp::send(slow, "GET /metrics HTTP/1.0\r\n\r\n");
+        mock_tcp::acknowledge(slow, 1460);
+        // the next sweep goes to the other slot, the one after is skipped
+        fill(cache, metrics_cache::MAX_DEVICES, 100);
+        server.publish(2, 2000);
+        const auto second = get("/metrics");
+        fill(cache, metrics_cache::MAX_DEVICES, 200);
+        server.publish(3, 3000);
+        const auto still_second = get("/metrics");
+        while (!slow->queued.empty())
+        {
+            mock_tcp::acknowledge(slow);
+        }
+        const auto result = parse_response(slow->received);
+        server.publish(4, 4000);
+        const auto fourth = get("/metrics");
+        return result.complete && result.body == first.body && has(second.body, "probe_sweeps_total 2\n")
+            && still_second.body == second.body && has(fourth.body, "probe_sweeps_total 4\n");
+    }) && ok;
+
+    ok = check("a request in several segments", [](metrics_cache &cache, http_server &server) {
+        fill(cache, 1);
+        server.publish(1, 1000);
+        tcp_pcb *pcb = mock_tcp::connect();
+        mock_tcp::send(pcb, "GET /met");
+        const bool waiting = pcb->queued.empty();
+        mock_tcp::send(pcb, "rics.json HTT");
+        mock_tcp::send(pcb, "P/1.0\r\n\r\n");
+        mock_tcp::acknowledge(pcb);
+        const auto result = parse_response(pcb->received);
+        return waiting && result.complete && result.content_type == "application/json";
+    }) && ok;
+
+    ok = check("the client closes its side after the request", [](metrics_cache &cache, http_server &server) {
+        fill(cache, metrics_cache::MAX_DEVICES);
+        server.publish(1, 1000);
+        tcp_pcb *pcb = mock_tcp::connect(1460);
+        mock_tcp::send(pcb, "GET /metrics HTTP/1.0\r\n\r\n");
+        mock_tcp::send_fin(pcb);
+        const bool open = !pcb->closed;
+        while (!pcb->queued.empty())
+        {
+            mock_tcp::acknowledge(pcb);
+        }
+        return open && parse_response(pcb->received).complete && pcb->closed;
+    }) && ok;
+
+    ok = check("unknown paths, methods and long request lines", [](metrics_cache &cache, http_server &server) {
+        fill(cache, 1);
+        server.publish(1, 1000);
+        const auto not_found = get("/");
+        const auto post = scrape("POST /metrics HTTP/1.0\r\n\r\n");
+        const auto too_long = scrape("GET /metrics?" + std::string(200, 'x') + " HTTP/1.0\r\n\r\n");
+        return not_found.status == 404 && not_found.complete && post.status == 405 && post.complete
+            && too_long.status == 414 && too_long.complete && server.served_requests() == 3;
+    }) && ok;
+    printf("\n");
+
+    printf("== connections ==\n");
+
+    ok = check("connections beyond the pool are refused", [](metrics_cache &, http_server &server) {
+        std::vector<tcp_pcb *> open;
+        for (size_t i = 0; i < http_server::MAX_CONNECTIONS; i++)
+        {
+            open.push_back(mock_tcp::connect());
+        }
+        const bool refused = mock_tcp::connect() == nullptr && server.refused_connections() == 1;
+        mock_tcp::send(open[0], "GET / HTTP/1.0\r\n\r\n");
+        mock_tcp::acknowledge(open[0]);
+        return refused && open[0]->closed && mock_tcp::connect() != nullptr;
+    }) && ok;
+
+    ok = check("idle connections are aborted", [](metrics_cache &, http_server &) {
+        std::vector<tcp_pcb *> idle;
+        for (size_t i = 0; i < http_server::MAX_CONNECTIONS; i++)
+        {
+            idle.push_back(mock_tcp::connect());
+        }
+        bool kept = true;
+        for (int poll = 0; poll < MAX_IDLE_POLLS; poll++)
+        {
+            kept = kept && !idle[0]->aborted;
+            for (auto *pcb : idle)
+            {
+                mock_tcp::poll(pcb);
+            }
+        }
+        bool aborted = true;
+        for (auto *pcb : idle)
+        {
+            aborted = aborted && pcb->aborted;
+        }
+        return kept && aborted && mock_tcp::connect() != nullptr;
+    }) && ok;
+
+    ok = check("an aborted scrape releases its snapshot", [](metrics_cache &cache, http_server &server) {
+        fill(cache, metrics_cache::MAX_DEVICES);
+        server.publish(1, 1000);
+        tcp_pcb *stalled = mock_tcp::connect(1460);
+        mock_tcp::send(stalled, "GET /metrics HTTP/1.0\r\n\r\n");
+        for (int poll = 0; poll < MAX_IDLE_POLLS; poll++)
+        {
+            mock_tcp::poll(stalled);
+        }
+        server.publish(2, 2000);
+        server.publish(3, 3000);
+        return stalled->aborted && has(get("/metrics").body, "probe_sweeps_total 3\n");
+    }) && ok;
+
+    ok = check("a reset scrape releases its snapshot", [](metrics_cache &cache, http_server &server) {
+        fill(cache, metrics_cache::MAX_DEVICES);
+        server.publish(1, 1000);
+        std::vector<tcp_pcb *> reset;
+        for (size_t i = 0; i < http_server::MAX_CONNECTIONS; i++)
+        {
+            reset.push_back(mock_tcp::connect(1460));
+            mock_tcp::send(reset.back(), "GET /metrics.json HTTP/1.0\r\n\r\n");
+        }
+        for (auto *pcb : reset)
+        {
+            mock_tcp::reset_by_peer(pcb);
+        }
+        server.publish(2, 2000);
+        server.publish(3, 3000);
+        return has(get("/metrics").body, "probe_sweeps_total 3\n");
+    }) && ok;
+    printf("\n");
+
+    return host_check::finish(ok);
+}
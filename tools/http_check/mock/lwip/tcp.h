@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+typedef uint8_t u8_t;
+typedef uint16_t u16_t;
+typedef int8_t err_t;
+
+#define ERR_OK 0
+#define ERR_MEM -1
+#define ERR_VAL -6
+#define ERR_ABRT -13
+#define ERR_RST -14
+
+typedef struct ip_addr
+{
+    uint32_t addr;
+} ip_addr_t;
+
+#define IPADDR_TYPE_ANY 46
+#define IP_ANY_TYPE ((const ip_addr_t *)nullptr)
+
+#define TCP_WRITE_FLAG_COPY 0x01
+#define TCP_WRITE_FLAG_MORE 0x02
+
+struct pbuf
+{
+    pbuf *next;
+    void *payload;
+    u16_t tot_len;
+    u16_t len;
+};
+
+struct tcp_pcb;
+typedef err_t (*tcp_accept_fn)(void *arg, tcp_pcb *newpcb, err_t err);
+typedef err_t (*tcp_recv_fn)(void *arg, tcp_pcb *tpcb, pbuf *p, err_t err);
+typedef err_t (*tcp_sent_fn)(void *arg, tcp_pcb *tpcb, u16_t len);
+typedef err_t (*tcp_poll_fn)(void *arg, tcp_pcb *tpcb);
+typedef void (*tcp_err_fn)(void *arg, err_t err);
+
+// A connection of the mock: the callbacks the server set and the data it
+// queued. Queued data is read when it is acknowledged, as lwIP does
+// without TCP_WRITE_FLAG_COPY.
+struct tcp_pcb
+{
+    void *arg = nullptr;
+    tcp_accept_fn accept = nullptr;
+    tcp_recv_fn recv = nullptr;
+    tcp_sent_fn sent = nullptr;
+    tcp_poll_fn poll = nullptr;
+    tcp_err_fn err = nullptr;
+
+    struct segment
+    {
+        const char *data;
+        u16_t length;
+    };
+    std::vector<segment> queued;
+    size_t unacknowledged = 0;
+    u16_t send_buffer;
+    std::string received; // by the client, in acknowledged order
+    bool closed = false;
+    bool aborted = false;
+};
+
+tcp_pcb *tcp_new_ip_type(u8_t type);
+err_t tcp_bind(tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port);
+tcp_pcb *tcp_listen_with_backlog(tcp_pcb *pcb, u8_t backlog);
+void tcp_arg(tcp_pcb *pcb, void *arg);
+void tcp_accept(tcp_pcb *pcb, tcp_accept_fn accept);
+void tcp_recv(tcp_pcb *pcb, tcp_recv_fn recv);
+void tcp_sent(tcp_pcb *pcb, tcp_sent_fn sent);
+void tcp_poll(tcp_pcb *pcb, tcp_poll_fn poll, u8_t interval);
+void tcp_err(tcp_pcb *pcb, tcp_err_fn err);
+err_t tcp_close(tcp_pcb *pcb);
+void tcp_abort(tcp_pcb *pcb);
+err_t tcp_write(tcp_pcb *pcb, const void *dataptr, u16_t len, u8_t apiflags);
+err_t tcp_output(tcp_pcb *pcb);
+void tcp_recved(tcp_pcb *pcb, u16_t len);
+u16_t tcp_sndbuf(const tcp_pcb *pcb);
+u16_t pbuf_copy_partial(const pbuf *p, void *dataptr, u16_t len, u16_t offset);
+u8_t pbuf_free(pbuf *p);
+
+namespace mock_tcp
+{
+// TCP_SND_BUF of the firmware's lwipopts.h
+constexpr const u16_t SEND_BUFFER = 8 * 1460;
+
+// Forgets all connections, pcbs handed out before are invalid
+void reset();
+// Misuse lwIP would assert on or that corrupts a response
+unsigned errors();
+
+// The pcb the server listens on, nullptr before start
+tcp_pcb *listener();
+// A client connects, nullptr if the server refused it
+tcp_pcb *connect(u16_t send_buffer = SEND_BUFFER);
+// The client sends data, in one segment
+void send(tcp_pcb *pcb, const std::string &data);
+// The client closes its side
+void send_fin(tcp_pcb *pcb);
+// Acknowledges the queued segments, at most bytes
+void acknowledge(tcp_pcb *pcb, size_t bytes = SIZE_MAX);
+// The coarse TCP timer fires for the connection
+void poll(tcp_pcb *pcb);
+// The connection is reset by the client
+void reset_by_peer(tcp_pcb *pcb);
+}// namespace mock_tcp
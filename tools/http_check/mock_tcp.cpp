@@ -0,0 +1,260 @@
+#include <lwip/tcp.h>
+#include <pico/cyw43_arch.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+namespace
+{
+std::vector<std::unique_ptr<tcp_pcb>> pcbs;
+tcp_pcb *listening = nullptr;
+unsigned error_count = 0;
+int lwip_lock_depth = 0;
+
+tcp_pcb *new_pcb(u16_t send_buffer)
+{
+    pcbs.push_back(std::make_unique<tcp_pcb>());
+    pcbs.back()->send_buffer = send_buffer;
+    return pcbs.back().get();
+}
+
+// lwIP frees closed and aborted pcbs, using them is undefined
+bool usable(const tcp_pcb *pcb)
+{
+    if (!pcb || pcb->closed || pcb->aborted)
+    {
+        error_count++;
+        return false;
+    }
+    return true;
+}
+
+// A callback returning ERR_ABRT has to have aborted the pcb
+void check_result(const tcp_pcb *pcb, err_t result)
+{
+    if ((result == ERR_ABRT) != pcb->aborted)
+    {
+        error_count++;
+    }
+}
+}// namespace
+
+void cyw43_arch_lwip_begin()
+{
+    lwip_lock_depth++;
+}
+
+void cyw43_arch_lwip_end()
+{
+    lwip_lock_depth--;
+}
+
+int mock_lwip::lock_depth()
+{
+    return lwip_lock_depth;
+}
+
+tcp_pcb *tcp_new_ip_type(u8_t)
+{
+    return new_pcb(mock_tcp::SEND_BUFFER);
+}
+
+err_t tcp_bind(tcp_pcb *pcb, const ip_addr_t *, u16_t)
+{
+    return usable(pcb) ? ERR_OK : ERR_VAL;
+}
+
+tcp_pcb *tcp_listen_with_backlog(tcp_pcb *pcb, u8_t)
+{
+    listening = usable(pcb) ? pcb : nullptr;
+    return listening;
+}
+
+void tcp_arg(tcp_pcb *pcb, void *arg)
+{
+    pcb->arg = arg;
+}
+
+void tcp_accept(tcp_pcb *pcb, tcp_accept_fn accept)
+{
+    pcb->accept = accept;
+}
+
+void tcp_recv(tcp_pcb *pcb, tcp_recv_fn recv)
+{
+    pcb->recv = recv;
+}
+
+void tcp_sent(tcp_pcb *pcb, tcp_sent_fn sent)
+{
+    pcb->sent = sent;
+}
+
+void tcp_poll(tcp_pcb *pcb, tcp_poll_fn poll, u8_t)
+{
+    pcb->poll = poll;
+}
+
+void tcp_err(tcp_pcb *pcb, tcp_err_fn err)
+{
+    pcb->err = err;
+}
+
+err_t tcp_close(tcp_pcb *pcb)
+{
+    if (usable(pcb))
+    {
+        pcb->closed = true;
+    }
+    return ERR_OK;
+}
+
+void tcp_abort(tcp_pcb *pcb)
+{
+    if (!usable(pcb))
+    {
+        return;
+    }
+    pcb->aborted = true;
+    pcb->queued.clear();
+    if (pcb->err)
+    {
+        pcb->err(pcb->arg, ERR_ABRT);
+    }
+}
+
+err_t tcp_write(tcp_pcb *pcb, const void *dataptr, u16_t len, u8_t apiflags)
+{
+    // the server sends its buffers without a copy
+    if (!usable(pcb) || (apiflags & TCP_WRITE_FLAG_COPY) || len == 0)
+    {
+        error_count++;
+        return ERR_VAL;
+    }
+    if (len > pcb->send_buffer)
+    {
+        error_count++;
+        return ERR_MEM;
+    }
+    pcb->queued.push_back({ static_cast<const char *>(dataptr), len });
+    pcb->send_buffer -= len;
+    pcb->unacknowledged += len;
+    return ERR_OK;
+}
+
+err_t tcp_output(tcp_pcb *pcb)
+{
+    return usable(pcb) ? ERR_OK : ERR_VAL;
+}
+
+void tcp_recved(tcp_pcb *pcb, u16_t)
+{
+    usable(pcb);
+}
+
+u16_t tcp_sndbuf(const tcp_pcb *pcb)
+{
+    return pcb->send_buffer;
+}
+
+u16_t pbuf_copy_partial(const pbuf *p, void *dataptr, u16_t len, u16_t offset)
+{
+    const u16_t length = std::min<u16_t>(len, p->tot_len - offset);
+    std::memcpy(dataptr, static_cast<const char *>(p->payload) + offset, length);
+    return length;
+}
+
+u8_t pbuf_free(pbuf *)
+{
+    return 1;
+}
+
+void mock_tcp::reset()
+{
+    pcbs.clear();
+    listening = nullptr;
+    error_count = 0;
+    lwip_lock_depth = 0;
+}
+
+unsigned mock_tcp::errors()
+{
+    return error_count + (lwip_lock_depth != 0 ? 1 : 0);
+}
+
+tcp_pcb *mock_tcp::listener()
+{
+    return listening;
+}
+
+tcp_pcb *mock_tcp::connect(u16_t send_buffer)
+{
+    tcp_pcb *pcb = new_pcb(send_buffer);
+    const err_t result = listening->accept(listening->arg, pcb, ERR_OK);
+    check_result(pcb, result);
+    return result == ERR_OK ? pcb : nullptr;
+}
+
+void mock_tcp::send(tcp_pcb *pcb, const std::string &data)
+{
+    if (!pcb->recv)
+    {
+        error_count++;
+        return;
+    }
+    pbuf segment{ nullptr, const_cast<char *>(data.data()), u16_t(data.size()), u16_t(data.size()) };
+    check_result(pcb, pcb->recv(pcb->arg, pcb, &segment, ERR_OK));
+}
+
+void mock_tcp::send_fin(tcp_pcb *pcb)
+{
+    if (!pcb->recv)
+    {
+        error_count++;
+        return;
+    }
+    check_result(pcb, pcb->recv(pcb->arg, pcb, nullptr, ERR_OK));
+}
+
+void mock_tcp::acknowledge(tcp_pcb *pcb, size_t bytes)
+{
+    // segments are acknowledged whole, lwIP reports them in one callback
+    size_t acknowledged = 0;
+    while (!pcb->queued.empty() && acknowledged + pcb->queued.front().length <= bytes)
+    {
+        const auto segment = pcb->queued.front();
+        pcb->queued.erase(pcb->queued.begin());
+        pcb->received.append(segment.data, segment.length);
+        acknowledged += segment.length;
+    }
+    if (acknowledged == 0)
+    {
+        return;
+    }
+    pcb->unacknowledged -= acknowledged;
+    pcb->send_buffer += u16_t(acknowledged);
+    if (pcb->sent)
+    {
+        check_result(pcb, pcb->sent(pcb->arg, pcb, u16_t(acknowledged)));
+    }
+}
+
+void mock_tcp::poll(tcp_pcb *pcb)
+{
+    if (pcb->poll && !pcb->closed && !pcb->aborted)
+    {
+        check_result(pcb, pcb->poll(pcb->arg, pcb));
+    }
+}
+
+void mock_tcp::reset_by_peer(tcp_pcb *pcb)
+{
+    // lwIP frees the pcb before calling the error callback
+    pcb->aborted = true;
+    pcb->queued.clear();
+    if (pcb->err)
+    {
+        pcb->err(pcb->arg, ERR_RST);
+    }
+}
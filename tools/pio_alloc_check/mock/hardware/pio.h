@@ -0,0 +1,43 @@
+#pragma once
+
+// The allocation functions of the Pico SDK's hardware/pio.h used by
+// src/picopp.cpp, implemented in mock_pio.cpp with the SDK's placement
+// rules. Misuse the SDK would catch with an assertion or a panic (adding
+// a program that does not fit, removing instructions that are not
+// loaded, unclaiming a free state machine) is counted instead.
+
+#include <hardware/structs/pio.h>
+
+#include <cstdint>
+
+struct pio_program_t
+{
+    const uint16_t *instructions;
+    uint8_t length;
+    int8_t origin;
+};
+
+uint16_t pio_encode_nop();
+
+bool pio_can_add_program(PIO pio, const pio_program_t *program);
+bool pio_can_add_program_at_offset(PIO pio, const pio_program_t *program, uint offset);
+uint pio_add_program(PIO pio, const pio_program_t *program);
+void pio_remove_program(PIO pio, const pio_program_t *program, uint loaded_offset);
+
+int pio_claim_unused_sm(PIO pio, bool required);
+void pio_sm_unclaim(PIO pio, uint sm);
+bool pio_sm_is_claimed(PIO pio, uint sm);
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled);
+
+namespace mock_pio
+{
+// Frees all state machines and instruction memory and clears the
+// error count
+void reset();
+
+// SDK assertions and panics since the last reset
+uint errors();
+
+uint used_instructions(PIO pio);
+uint claimed_state_machines(PIO pio);
+}// namespace mock_pio
@@ -0,0 +1,25 @@
+#pragma once
+
+// Stands in for the Pico SDK header in tools/pio_alloc_check: a PIO is
+// only the bookkeeping of its state machines and instruction memory.
+
+#include <cstdint>
+
+typedef unsigned int uint;
+
+#define NUM_PIOS 2
+#define PIO_INSTRUCTION_COUNT 32u
+
+struct pio_hw_t
+{
+    uint32_t used_instruction_space;
+    uint8_t claimed_state_machines;
+    uint8_t enabled_state_machines;
+};
+
+typedef pio_hw_t *PIO;
+
+extern pio_hw_t mock_pio_instances[NUM_PIOS];
+
+#define pio0 (&mock_pio_instances[0])
+#define pio1 (&mock_pio_instances[1])
@@ -0,0 +1,147 @@
+#include <hardware/pio.h>
+
+#include <bit>
+
+pio_hw_t mock_pio_instances[NUM_PIOS];
+
+namespace
+{
+constexpr const uint STATE_MACHINES = 4;
+
+uint error_count = 0;
+
+uint32_t program_mask(const pio_program_t *program)
+{
+    return program->length >= 32 ? 0xffffffffu : (1u << program->length) - 1;
+}
+
+// As the SDK: a relocatable program goes to the highest free offset
+int find_offset(PIO pio, const pio_program_t *program)
+{
+    if (program->origin >= 0)
+    {
+        return pio_can_add_program_at_offset(pio, program, uint(program->origin)) ? program->origin : -1;
+    }
+    for (int offset = int(PIO_INSTRUCTION_COUNT) - program->length; offset >= 0; offset--)
+    {
+        if (pio_can_add_program_at_offset(pio, program, uint(offset)))
+        {
+            return offset;
+        }
+    }
+    return -1;
+}
+}// namespace
+
+uint16_t pio_encode_nop()
+{
+    return 0xa042;// mov y, y
+}
+
+bool pio_can_add_program(PIO pio, const pio_program_t *program)
+{
+    return find_offset(pio, program) >= 0;
+}
+
+bool pio_can_add_program_at_offset(PIO pio, const pio_program_t *program, uint offset)
+{
+    if (program->origin >= 0 && uint(program->origin) != offset)
+    {
+        return false;
+    }
+    if (offset + program->length > PIO_INSTRUCTION_COUNT)
+    {
+        return false;
+    }
+    return !(pio->used_instruction_space & (program_mask(program) << offset));
+}
+
+uint pio_add_program(PIO pio, const pio_program_t *program)
+{
+    const int offset = find_offset(pio, program);
+    if (offset < 0)
+    {
+        // the SDK panics
+        error_count++;
+        return 0;
+    }
+    pio->used_instruction_space |= program_mask(program) << offset;
+    return uint(offset);
+}
+
+void pio_remove_program(PIO pio, const pio_program_t *program, uint loaded_offset)
+{
+    const uint32_t mask = program_mask(program) << loaded_offset;
+    if ((pio->used_instruction_space & mask) != mask)
+    {
+        error_count++;
+    }
+    pio->used_instruction_space &= ~mask;
+}
+
+int pio_claim_unused_sm(PIO pio, bool required)
+{
+    for (uint sm = 0; sm < STATE_MACHINES; sm++)
+    {
+        if (!pio_sm_is_claimed(pio, sm))
+        {
+            pio->claimed_state_machines |= uint8_t(1u << sm);
+            return int(sm);
+        }
+    }
+    if (required)
+    {
+        error_count++;
+    }
+    return -1;
+}
+
+void pio_sm_unclaim(PIO pio, uint sm)
+{
+    if (!pio_sm_is_claimed(pio, sm) || (pio->enabled_state_machines & (1u << sm)))
+    {
+        error_count++;
+    }
+    pio->claimed_state_machines &= uint8_t(~(1u << sm));
+}
+
+bool pio_sm_is_claimed(PIO pio, uint sm)
+{
+    return pio->claimed_state_machines & (1u << sm);
+}
+
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled)
+{
+    if (enabled)
+    {
+        pio->enabled_state_machines |= uint8_t(1u << sm);
+    }
+    else
+    {
+        pio->enabled_state_machines &= uint8_t(~(1u << sm));
+    }
+}
+
+void mock_pio::reset()
+{
+    for (auto &pio : mock_pio_instances)
+    {
+        pio = {};
+    }
+    error_count = 0;
+}
+
+uint mock_pio::errors()
+{
+    return error_count;
+}
+
+uint mock_pio::used_instructions(PIO pio)
+{
+    return uint(std::popcount(pio->used_instruction_space));
+}
+
+uint mock_pio::claimed_state_machines(PIO pio)
+{
+    return uint(std::popcount(pio->claimed_state_machines));
+}
@@ -0,0 +1,267 @@
+// Checks the PIO program and state machine allocation of the firmware
+// (src/picopp.cpp) against a mock of the SDK's PIO bookkeeping: sharing a
+// loaded program between the state machines of a PIO and across PIO 0 and
+// PIO 1, removing it with its last user and loading it again, and running
+// out of state machines or instruction memory while CYW43 holds its own.
+// The mock counts the misuse the SDK would assert or panic on.
+//
+// Usage: pio_alloc_check
+
+#include <picopp.hpp>
+
+#include <onewire.pio.h>
+#include <onewire_search.pio.h>
+
+#include <check.hpp>
+
+#include <cstdio>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+constexpr const uint STATE_MACHINES = 4;
+
+const pio_program_t onewire_program{
+    onewire_program_instructions, uint8_t(std::size(onewire_program_instructions)), -1
+};
+const pio_program_t onewire_search_program{
+    onewire_search_program_instructions, uint8_t(std::size(onewire_search_program_instructions)), -1
+};
+
+// What the CYW43 driver holds on PIO 1: a state machine and a short SPI
+// program of its own
+const uint16_t cyw43_instructions[10]{};
+const pio_program_t cyw43_program{ cyw43_instructions, uint8_t(std::size(cyw43_instructions)), -1 };
+
+void start_cyw43()
+{
+    pio_add_program(pio1, &cyw43_program);
+    pio_claim_unused_sm(pio1, true);
+}
+
+using programs = std::vector<std::unique_ptr<pico::Program>>;
+
+// Claims state machines until the allocator gives up
+size_t claim_all(pico::ProgramInstructions &instructions, programs &claimed)
+{
+    try
+    {
+        for (;;)
+        {
+            claimed.push_back(std::make_unique<pico::Program>(instructions));
+        }
+    } catch (std::runtime_error &)
+    {
+    }
+    return claimed.size();
+}
+
+bool check(const char *name, const std::function<bool()> &scenario)
+{
+    return host_check::check(name, [&] {
+        mock_pio::reset();
+        return scenario() && mock_pio::errors() == 0;
+    });
+}
+}// namespace
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        fprintf(stderr, "usage: %s\n", argv[0]);
+        return 2;
+    }
+
+    const uint onewire_length = onewire_program.length;
+    const uint search_length = onewire_search_program.length;
+    bool ok = true;
+    printf("== PIO program sharing (%u + %u instructions) ==\n", onewire_length, search_length);
+
+    ok = check("first state machine loads the program on PIO 0", [&] {
+        pico::ProgramInstructions instructions(&onewire_program);
+        pico::Program program(instructions);
+        return program.pio_index == 0 && program.pio == pio0 && instructions.is_loaded(0) && !instructions.is_loaded(1)
+            && program.pio_memory_offset == instructions.offset(0)
+            && mock_pio::used_instructions(pio0) == onewire_length && mock_pio::used_instructions(pio1) == 0;
+    }) && ok;
+
+    ok = check("state machines of a PIO share one copy", [&] {
+        pico::ProgramInstructions instructions(&onewire_program);
+        programs claimed;
+        for (uint i = 0; i < STATE_MACHINES; i++)
+        {
+            claimed.push_back(std::make_unique<pico::Program>(instructions));
+        }
+        bool shared = true;
+        for (const auto &program : claimed)
+        {
+            shared = shared && program->pio_index == 0 && program->pio_memory_offset == instructions.offset(0);
+        }
+        return shared && mock_pio::claimed_state_machines(pio0) == STATE_MACHINES
+            && mock_pio::used_instructions(pio0) == onewire_length && !instructions.is_loaded(1);
+    }) && ok;
+
+    ok = check("a full PIO 0 loads the program on PIO 1 once", [&] {
+        pico::ProgramInstructions instructions(&onewire_program);
+        programs claimed;
+        for (uint i = 0; i < STATE_MACHINES + 2; i++)
+        {
+            claimed.push_back(std::make_unique<pico::Program>(instructions));
+        }
+        return claimed[STATE_MACHINES]->pio_index == 1 && claimed[STATE_MACHINES + 1]->pio_index == 1
+            && claimed[STATE_MACHINES + 1]->pio_memory_offset == instructions.offset(1)
+            && mock_pio::used_instructions(pio0) == onewire_length
+            && mock_pio::used_instructions(pio1) == onewire_length;
+    }) && ok;
+
+    ok = check("a PIO holding the program is preferred", [&] {
+        pico::ProgramInstructions instructions(&onewire_program);
+        pico::ProgramInstructions search_instructions(&onewire_search_program);
+        programs others;
+        for (uint i = 0; i < STATE_MACHINES; i++)
+        {
+            others.push_back(std::make_unique<pico::Program>(search_instructions));
+        }
+        pico::Program first(instructions);
+        others.clear();
+        pico::Program second(instructions);
+        return first.pio_index == 1 && second.pio_index == 1 && !instructions.is_loaded(0)
+            && mock_pio::used_instructions(pio0) == 0;
+    }) && ok;
+
+    ok = check("the last user on a PIO removes the program", [&] {
+        pico::ProgramInstructions instructions(&onewire_program);
+        programs claimed;
+        for (uint i = 0; i < STATE_MACHINES + 2; i++)
+        {
+            claimed.push_back(std::make_unique<pico::Program>(instructions));
+        }
+        claimed.pop_back();
+        const bool kept = instructions.is_loaded(1) && mock_pio::used_instructions(pio1) == onewire_length;
+        claimed.pop_back();
+        const bool removed = !instructions.is_loaded(1) && mock_pio::used_instructions(pio1) == 0
+            && mock_pio::claimed_state_machines(pio1) == 0;
+        claimed.clear();
+        return kept && removed && !instructions.is_loaded(0) && mock_pio::used_instructions(pio0) == 0
+            && mock_pio::claimed_state_machines(pio0) == 0;
+    }) && ok;
+
+    ok = check("a released program is loaded again, at a new offset", [&] {
+        pico::ProgramInstructions instructions(&onewire_program);
+        pico::ProgramInstructions search_instructions(&onewire_search_program);
+        auto first = std::make_unique<pico::Program>(instructions);
+        const uint first_offset = first->pio_memory_offset;
+        first.reset();
+        // takes the top of the instruction memory the program had
+        pico::Program search(search_instructions);
+        pico::Program second(instructions);
+        return second.pio_index == 0 && second.pio_memory_offset == instructions.offset(0)
+            && second.pio_memory_offset != first_offset
+            && mock_pio::used_instructions(pio0) == onewire_length + search_length;
+    }) && ok;
+
+    ok = check("acquire and release without a state machine", [&] {
+        // as onewire.cpp does with the search program
+        pico::ProgramInstructions instructions(&onewire_program);
+        pico::ProgramInstructions search_instructions(&onewire_search_program);
+        pico::Program bus_a(instructions);
+        pico::Program bus_b(instructions);
+        const bool acquired = search_instructions.acquire(bus_a.pio_index) && search_instructions.acquire(bus_b.pio_index);
+        const bool shared = mock_pio::used_instructions(pio0) == onewire_length + search_length
+            && mock_pio::claimed_state_machines(pio0) == 2;
+        search_instructions.release(bus_a.pio_index);
+        const bool kept = search_instructions.is_loaded(0);
+        search_instructions.release(bus_b.pio_index);
+        search_instructions.release(bus_b.pio_index);// an extra release is ignored
+        return acquired && shared && kept && !search_instructions.is_loaded(0)
+            && mock_pio::used_instructions(pio0) == onewire_length;
+    }) && ok;
+
+    ok = check("a PIO without room for the program is skipped", [&] {
+        const uint16_t filler_instructions[PIO_INSTRUCTION_COUNT]{};
+        const pio_program_t filler{ filler_instructions, uint8_t(PIO_INSTRUCTION_COUNT - onewire_length + 1), -1 };
+        pio_add_program(pio0, &filler);
+        pico::ProgramInstructions instructions(&onewire_program);
+        pico::Program program(instructions);
+        return program.pio_index == 1 && !instructions.is_loaded(0)
+            && mock_pio::claimed_state_machines(pio0) == 0;
+    }) && ok;
+
+    ok = check("exhaustion with CYW43 on PIO 1", [&] {
+        start_cyw43();
+        pico::ProgramInstructions instructions(&onewire_program);
+        programs claimed;
+        const size_t count = claim_all(instructions, claimed);
+        const bool exhausted = count == 2 * STATE_MACHINES - 1
+            && mock_pio::claimed_state_machines(pio1) == STATE_MACHINES
+            && mock_pio::used_instructions(pio1) == onewire_length + cyw43_program.length;
+        claimed.clear();
+        return exhausted && mock_pio::claimed_state_machines(pio1) == 1
+            && mock_pio::used_instructions(pio1) == cyw43_program.length
+            && mock_pio::used_instructions(pio0) == 0;
+    }) && ok;
+
+    ok = check("a failed claim leaves nothing claimed or loaded", [&] {
+        start_cyw43();
+        const uint16_t filler_instructions[PIO_INSTRUCTION_COUNT]{};
+        const pio_program_t filler{ filler_instructions, uint8_t(PIO_INSTRUCTION_COUNT - cyw43_program.length - onewire_length + 1), -1 };
+        pio_add_program(pio1, &filler);
+        pico::ProgramInstructions instructions(&onewire_program);
+        programs claimed;
+        const size_t count = claim_all(instructions, claimed);
+        return count == STATE_MACHINES && !instructions.is_loaded(1)
+            && mock_pio::claimed_state_machines(pio1) == 1
+            && mock_pio::used_instructions(pio1) == cyw43_program.length + filler.length;
+    }) && ok;
+
+    ok = check("buses with the search program until exhaustion", [&] {
+        // the firmware's allocation per bus: a state machine running the
+        // 1-Wire program and the search program on the same PIO
+        start_cyw43();
+        pico::ProgramInstructions instructions(&onewire_program);
+        pico::ProgramInstructions search_instructions(&onewire_search_program);
+        programs claimed;
+        const size_t count = claim_all(instructions, claimed);
+        size_t with_search = 0;
+        for (const auto &bus : claimed)
+        {
+            with_search += search_instructions.acquire(bus->pio_index) ? 1 : 0;
+        }
+        const bool fits = onewire_length + search_length <= PIO_INSTRUCTION_COUNT;
+        const bool fits_beside_cyw43 = onewire_length + search_length + cyw43_program.length <= PIO_INSTRUCTION_COUNT;
+        const size_t expected = (fits ? STATE_MACHINES : 0) + (fits_beside_cyw43 ? STATE_MACHINES - 1 : 0);
+        printf("  %zu buses, %zu with the search program\n", count, with_search);
+        for (const auto &bus : claimed)
+        {
+            search_instructions.release(bus->pio_index);
+        }
+        return with_search == expected && !search_instructions.is_loaded(0) && !search_instructions.is_loaded(1);
+    }) && ok;
+
+    ok = check("the destructor removes programs still loaded", [&] {
+        {
+            pico::ProgramInstructions instructions(&onewire_program);
+            instructions.acquire(0);
+            instructions.acquire(1);
+        }
+        return mock_pio::used_instructions(pio0) == 0 && mock_pio::used_instructions(pio1) == 0;
+    }) && ok;
+
+    ok = check("budget reports agree with the PIO state", [&] {
+        start_cyw43();
+        pico::ProgramInstructions instructions(&onewire_program);
+        pico::Program program(instructions);
+        return pico::free_state_machines(pio0) == STATE_MACHINES - 1
+            && pico::free_state_machines(pio1) == STATE_MACHINES - 1
+            && pico::free_instruction_slots(pio0) == PIO_INSTRUCTION_COUNT - onewire_length
+            && pico::free_instruction_slots(pio1) == PIO_INSTRUCTION_COUNT - cyw43_program.length;
+    }) && ok;
+    printf("\n");
+
+    return host_check::finish(ok);
+}
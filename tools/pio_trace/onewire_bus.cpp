@@ -0,0 +1,260 @@
+#include <onewire_bus.hpp>
+
+#include <algorithm>
+
+namespace
+{
+constexpr const uint8_t SEARCH_ROM_COMMAND = 0xf0;
+constexpr const uint8_t ALARM_SEARCH_COMMAND = 0xec;
+constexpr const uint8_t READ_ROM_COMMAND = 0x33;
+constexpr const uint8_t MATCH_ROM_COMMAND = 0x55;
+constexpr const uint8_t SKIP_ROM_COMMAND = 0xcc;
+constexpr const uint8_t OVERDRIVE_SKIP_ROM_COMMAND = 0x3c;
+constexpr const uint8_t OVERDRIVE_MATCH_ROM_COMMAND = 0x69;
+
+constexpr const double EXPIRY_US = 1000.0;
+}// namespace
+
+void onewire_model::bus::add_device(uint64_t rom, bool overdrive_capable)
+{
+    device dev;
+    dev.rom = rom;
+    dev.overdrive_capable = overdrive_capable;
+    devices.push_back(dev);
+}
+
+void onewire_model::bus::set_alarm(uint64_t rom, bool alarm)
+{
+    for (auto &dev : devices)
+    {
+        if (dev.rom == rom)
+        {
+            dev.alarm = alarm;
+        }
+    }
+}
+
+const onewire_model::slave_timing &onewire_model::bus::timing_of(const device &dev) const
+{
+    return dev.device_speed == speed::overdrive ? OVERDRIVE_SLAVE : STANDARD_SLAVE;
+}
+
+void onewire_model::bus::set_master_low(bool low, double t)
+{
+    process_samples(t);
+    // pending samples lie at most one slot in the past, older intervals cannot matter anymore
+    std::erase_if(active_intervals, [t](const interval &low_interval) { return low_interval.until < t - EXPIRY_US; });
+    if (low == master_low)
+    {
+        return;
+    }
+    master_low = low;
+    if (low)
+    {
+        master_low_since = t;
+        slot_started(t);
+    }
+    else
+    {
+        master_intervals.push_back({ master_low_since, t });
+        reset_detected(t - master_low_since, t);
+    }
+}
+
+bool onewire_model::bus::level(double t)
+{
+    process_samples(t);
+    return !(master_low || slaves_low(t));
+}
+
+bool onewire_model::bus::slaves_low(double t) const
+{
+    return std::any_of(active_intervals.begin(), active_intervals.end(), [t](const interval &low) {
+        return low.from <= t && t < low.until;
+    });
+}
+
+void onewire_model::bus::pull_low(double from, double until)
+{
+    slave_intervals.push_back({ from, until });
+    active_intervals.push_back({ from, until });
+}
+
+void onewire_model::bus::slot_started(double t)
+{
+    for (size_t i = 0; i < devices.size(); i++)
+    {
+        auto &dev = devices[i];
+        const auto &timing = timing_of(dev);
+        switch (dev.device_state)
+        {
+        case state::idle:
+            break;
+        case state::rom_command:
+        case state::match_rom:
+        case state::function_command:
+            pending.push_back({ t + timing.sample, i });
+            break;
+        case state::search:
+        {
+            bool id_bit = (dev.rom >> dev.bit_index) & 1;
+            if (dev.search_phase == 2)
+            {
+                pending.push_back({ t + timing.sample, i });
+                break;
+            }
+            bool bit = dev.search_phase == 0 ? id_bit : !id_bit;
+            if (!bit)
+            {
+                pull_low(t, t + timing.hold_zero);
+            }
+            dev.search_phase++;
+            break;
+        }
+        case state::read_rom:
+        {
+            if (!((dev.rom >> dev.bit_index) & 1))
+            {
+                pull_low(t, t + timing.hold_zero);
+            }
+            dev.bit_index++;
+            if (dev.bit_index == 64)
+            {
+                dev.device_state = state::idle;
+            }
+            break;
+        }
+        }
+    }
+}
+
+void onewire_model::bus::reset_detected(double low_time, double t)
+{
+    for (size_t i = 0; i < devices.size(); i++)
+    {
+        auto &dev = devices[i];
+        if (low_time >= STANDARD_SLAVE.reset_detect)
+        {
+            // a reset at standard speed returns all devices to standard speed
+            dev.device_speed = speed::standard;
+        }
+        else if (dev.device_speed != speed::overdrive || low_time < OVERDRIVE_SLAVE.reset_detect)
+        {
+            continue;
+        }
+        const auto &timing = timing_of(dev);
+        dev.device_state = state::rom_command;
+        dev.bit_index = 0;
+        dev.received = 0;
+        pull_low(t + timing.presence_delay, t + timing.presence_delay + timing.presence);
+        // bits sampled during the reset pulse are void
+        std::erase_if(pending, [i](const pending_sample &sample) { return sample.device_index == i; });
+    }
+}
+
+void onewire_model::bus::process_samples(double t)
+{
+    std::sort(pending.begin(), pending.end(), [](const pending_sample &a, const pending_sample &b) {
+        return a.time < b.time;
+    });
+    size_t processed = 0;
+    for (; processed < pending.size() && pending[processed].time <= t; processed++)
+    {
+        const auto &sample = pending[processed];
+        bool bit = !(master_low || slaves_low(sample.time));
+        receive_bit(devices[sample.device_index], bit);
+    }
+    pending.erase(pending.begin(), pending.begin() + processed);
+}
+
+void onewire_model::bus::receive_bit(device &dev, bool bit)
+{
+    switch (dev.device_state)
+    {
+    case state::rom_command:
+    {
+        dev.received |= uint64_t(bit) << dev.bit_index;
+        dev.bit_index++;
+        if (dev.bit_index < 8)
+        {
+            break;
+        }
+        dev.command = dev.received & 0xff;
+        dev.bit_index = 0;
+        dev.received = 0;
+        dev.search_phase = 0;
+        switch (dev.command)
+        {
+        case SEARCH_ROM_COMMAND:
+            dev.device_state = state::search;
+            break;
+        case ALARM_SEARCH_COMMAND:
+            dev.device_state = dev.alarm ? state::search : state::idle;
+            break;
+        case READ_ROM_COMMAND:
+            dev.device_state = state::read_rom;
+            break;
+        case MATCH_ROM_COMMAND:
+            dev.device_state = state::match_rom;
+            break;
+        case SKIP_ROM_COMMAND:
+            dev.device_state = state::function_command;
+            break;
+        case OVERDRIVE_SKIP_ROM_COMMAND:
+        case OVERDRIVE_MATCH_ROM_COMMAND:
+            if (!dev.overdrive_capable)
+            {
+                dev.device_state = state::idle;
+                break;
+            }
+            dev.device_speed = speed::overdrive;
+            dev.device_state = dev.command == OVERDRIVE_SKIP_ROM_COMMAND ? state::function_command : state::match_rom;
+            break;
+        default:
+            dev.device_state = state::idle;
+            break;
+        }
+        break;
+    }
+    case state::search:
+    {
+        if (bit != ((dev.rom >> dev.bit_index) & 1))
+        {
+            dev.device_state = state::idle; // deselected, waits for the next reset
+            break;
+        }
+        dev.bit_index++;
+        dev.search_phase = 0;
+        if (dev.bit_index == 64)
+        {
+            dev.device_state = state::idle;
+        }
+        break;
+    }
+    case state::match_rom:
+    {
+        dev.received |= uint64_t(bit) << dev.bit_index;
+        dev.bit_index++;
+        if (dev.bit_index == 64)
+        {
+            dev.device_state = dev.received == dev.rom ? state::function_command : state::idle;
+            dev.bit_index = 0;
+            dev.received = 0;
+        }
+        break;
+    }
+    case state::function_command:
+    {
+        // function commands are not modelled, the device waits for the next reset
+        dev.bit_index++;
+        if (dev.bit_index == 8)
+        {
+            dev.device_state = state::idle;
+        }
+        break;
+    }
+    case state::idle:
+    case state::read_rom:
+        break;
+    }
+}
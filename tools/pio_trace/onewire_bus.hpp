@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Waveform level model of a 1-Wire bus with slave devices. The master
+// reports when it pulls the bus low, the slaves react to resets and time
+// slots like real devices: they answer resets with a presence pulse,
+// pull the bus low to send 0-bits and sample the bus to receive bits.
+// Supported ROM commands: SEARCH ROM, ALARM SEARCH, READ ROM, MATCH ROM,
+// SKIP ROM and their overdrive variants.
+namespace onewire_model
+{
+enum class speed
+{
+    standard,
+    overdrive
+};
+
+// Timing of the slaves (all numbers are us)
+struct slave_timing
+{
+    double reset_detect; // minimum low time detected as reset
+    double presence_delay; // release until presence pulse (tPDH)
+    double presence; // presence pulse length (tPDL)
+    double hold_zero; // how long a 0-bit is held after the falling edge
+    double sample; // sample point of written bits after the falling edge
+};
+
+constexpr const slave_timing STANDARD_SLAVE{ 440.0, 30.0, 120.0, 30.0, 30.0 };
+constexpr const slave_timing OVERDRIVE_SLAVE{ 45.0, 3.0, 12.0, 3.0, 3.5 };
+
+struct interval
+{
+    double from;
+    double until;
+};
+
+class bus
+{
+  public:
+    void add_device(uint64_t rom, bool overdrive_capable = false);
+    // Sets the alarm flag of a device, as a conversion crossing TH/TL would
+    void set_alarm(uint64_t rom, bool alarm);
+
+    // Master pulls the bus low (true) or releases it (false) at time t.
+    void set_master_low(bool low, double t);
+
+    // Bus level at time t, t must not decrease between calls.
+    bool level(double t);
+
+    const std::vector<interval> &master_low_intervals() const { return master_intervals; }
+    const std::vector<interval> &slave_low_intervals() const { return slave_intervals; }
+
+  private:
+    enum class state
+    {
+        idle, // waits for a reset
+        rom_command,
+        search,
+        read_rom,
+        match_rom,
+        function_command
+    };
+
+    struct device
+    {
+        uint64_t rom;
+        bool overdrive_capable;
+        bool alarm = false;
+        speed device_speed = speed::standard;
+        state device_state = state::idle;
+        uint8_t bit_index = 0;
+        uint8_t search_phase = 0; // 0: send id bit, 1: send complement, 2: receive direction
+        uint8_t command = 0;
+        uint64_t received = 0;
+    };
+
+    struct pending_sample
+    {
+        double time;
+        size_t device_index;
+    };
+
+    const slave_timing &timing_of(const device &dev) const;
+    void slot_started(double t);
+    void reset_detected(double low_time, double t);
+    void receive_bit(device &dev, bool bit);
+    void process_samples(double t);
+    bool slaves_low(double t) const;
+    void pull_low(double from, double until);
+
+    std::vector<device> devices;
+    std::vector<pending_sample> pending;
+    std::vector<interval> master_intervals;
+    std::vector<interval> slave_intervals;
+    std::vector<interval> active_intervals;
+    bool master_low = false;
+    double master_low_since = 0;
+};
+}// namespace onewire_model
@@ -0,0 +1,326 @@
+#include <onewire_master.hpp>
+
+#include <onewire.pio.h>
+#include <onewire_search.pio.h>
+
+#include <stdexcept>
+
+namespace
+{
+constexpr const uint8_t PIN = 15;
+constexpr const uint8_t PINCTLZ = 14;
+
+constexpr const uint8_t ONEWIRE_OFFSET = 0;
+constexpr const uint8_t SEARCH_OFFSET = sizeof(onewire_program_instructions) / sizeof(uint16_t);
+
+constexpr const int8_t NO_DISCREPANCY = 64;
+
+// bounds every wait, a stuck state machine is a failure of the program
+constexpr const long MAX_STEPS = 1000000;
+
+constexpr uint16_t encode_jmp(uint8_t addr) { return addr; }
+constexpr uint16_t encode_set_y(uint8_t value) { return 0xe040 | (value & 0x1f); }
+constexpr const uint16_t PUSH_NOBLOCK = 0x8000;
+
+// Copies a program into the instruction memory and relocates its jumps,
+// as pio_add_program_at_offset does
+template <size_t N>
+void load(std::array<uint16_t, 32> &memory, const uint16_t (&instructions)[N], uint8_t offset)
+{
+    for (size_t i = 0; i < N; i++)
+    {
+        uint16_t instruction = instructions[i];
+        if ((instruction >> 13) == 0) // JMP
+        {
+            instruction += offset;
+        }
+        memory[offset + i] = instruction;
+    }
+}
+
+uint64_t discrepancy_directions(uint64_t last_device_id, int8_t most_significant_discrepancy)
+{
+    if (most_significant_discrepancy < 0)
+    {
+        return 0;
+    }
+    uint64_t below_discrepancy = (uint64_t(1) << most_significant_discrepancy) - 1;
+    return (last_device_id & below_discrepancy) | (uint64_t(1) << most_significant_discrepancy);
+}
+
+pio_model::sm_config onewire_config()
+{
+    pio_model::sm_config config;
+    config.sideset_count = 1;
+    config.sideset_pindirs = true;
+    config.sideset_base = PIN;
+    config.in_base = PIN;
+    config.out_base = PINCTLZ;
+    config.out_count = 1;
+    config.set_base = PINCTLZ;
+    config.set_count = 1;
+    config.wrap_target = ONEWIRE_OFFSET + onewire_wrap_target;
+    config.wrap = ONEWIRE_OFFSET + onewire_wrap;
+    config.in_shift_right = true;
+    config.autopush = true;
+    config.push_threshold = 8;
+    config.out_shift_right = true;
+    config.autopull = true;
+    config.pull_threshold = 8;
+    return config;
+}
+
+pio_model::sm_config search_program_config()
+{
+    pio_model::sm_config config;
+    config.sideset_count = 1;
+    config.sideset_pindirs = true;
+    config.sideset_base = PIN;
+    config.in_base = PIN;
+    config.jmp_pin = PIN;
+    config.wrap_target = SEARCH_OFFSET + onewire_search_wrap_target;
+    config.wrap = SEARCH_OFFSET + onewire_search_wrap;
+    config.in_shift_right = true;
+    config.autopush = true;
+    config.push_threshold = 32;
+    config.out_shift_right = true;
+    config.autopull = false;
+    config.pull_threshold = 32;
+    return config;
+}
+}// namespace
+
+onewire_master::onewire_master(onewire_model::bus &bus_in, waveform &trace_in):
+    bus(bus_in),
+    trace(trace_in),
+    config(onewire_config()),
+    search_config(search_program_config()),
+    sm((load(instruction_memory, onewire_program_instructions, ONEWIRE_OFFSET),
+           load(instruction_memory, onewire_search_program_instructions, SEARCH_OFFSET),
+           instruction_memory.data()),
+        instruction_memory.size(),
+        config)
+{
+    static_assert(sizeof(onewire_program_instructions) + sizeof(onewire_search_program_instructions) <= 32 * sizeof(uint16_t),
+        "Both programs have to fit into one PIO");
+
+    sm.pins = 1u << PINCTLZ;
+    sm.pindirs = 1u << PINCTLZ;
+    sm.input = [this] {
+        update_bus();
+        return bus.level(now) ? 0xffffffffu : ~(1u << PIN);
+    };
+    sm.on_sample = [this] { trace.add_sample(now); };
+
+    sm.exec(encode_set_y(timing.sample_delay));
+    sm.init(ONEWIRE_OFFSET + onewire_offset_start, config);
+}
+
+void onewire_master::step()
+{
+    sm.step();
+    update_bus();
+    now += tick_us;
+}
+
+void onewire_master::update_bus()
+{
+    bool low = ((sm.pindirs >> PIN) & 1) && !((sm.pins >> PIN) & 1);
+    if (low != master_low)
+    {
+        master_low = low;
+        bus.set_master_low(low, now);
+    }
+}
+
+void onewire_master::wait_until_idle(uint8_t waiting_addr)
+{
+    for (long steps = 0; !(sm.pc() == waiting_addr && sm.is_stalled()); steps++)
+    {
+        if (steps > MAX_STEPS)
+        {
+            throw std::runtime_error("State machine did not reach its waiting state");
+        }
+        step();
+    }
+}
+
+void onewire_master::set_fifo_thresh(uint8_t thresh)
+{
+    if (thresh > 32)
+    {
+        thresh = 32;
+    }
+    if (config.push_threshold == thresh)
+    {
+        return;
+    }
+    wait_until_idle(ONEWIRE_OFFSET + onewire_offset_waiting);
+    config.push_threshold = thresh;
+    config.pull_threshold = thresh;
+    sm.restart(config);
+}
+
+void onewire_master::set_speed(onewire_model::speed bus_speed)
+{
+    if (bus_speed == current_speed)
+    {
+        return;
+    }
+    wait_until_idle(ONEWIRE_OFFSET + onewire_offset_waiting);
+    current_speed = bus_speed;
+    timing = bus_speed == onewire_model::speed::overdrive ? onewire_timing::OVERDRIVE : onewire_timing::STANDARD;
+    tick_us = timing.slot_tick_us;
+    sm.exec(encode_set_y(timing.sample_delay));
+}
+
+bool onewire_master::reset()
+{
+    wait_until_idle(ONEWIRE_OFFSET + onewire_offset_waiting);
+    tick_us = timing.reset_tick_us;
+    sm.exec(encode_jmp(ONEWIRE_OFFSET + onewire_offset_reset));
+    wait_until_idle(ONEWIRE_OFFSET + onewire_offset_waiting);
+    if (sm.rx_fifo.empty())
+    {
+        sm.exec(PUSH_NOBLOCK);
+    }
+    uint32_t presence = sm.rx_fifo.front();
+    sm.rx_fifo.pop_front();
+    tick_us = timing.slot_tick_us;
+    return (presence & 0x80000000) == 0;
+}
+
+uint8_t onewire_master::transmit_or_receive_bits(uint8_t bits, uint8_t data)
+{
+    set_fifo_thresh(bits);
+    sm.tx_fifo.push_back(data);
+    for (long steps = 0; sm.rx_fifo.empty(); steps++)
+    {
+        if (steps > MAX_STEPS)
+        {
+            throw std::runtime_error("State machine did not return any bits");
+        }
+        step();
+    }
+    uint32_t received = sm.rx_fifo.front();
+    sm.rx_fifo.pop_front();
+    return (received >> (32 - bits)) & 0xff;
+}
+
+void onewire_master::transmit(uint8_t byte)
+{
+    transmit_or_receive_bits(8, byte);
+}
+
+uint8_t onewire_master::receive()
+{
+    return transmit_or_receive_bits(8, 0xff);
+}
+
+onewire_master::search_bits onewire_master::run_triplets(uint64_t directions)
+{
+    search_bits bits{ 0, 0 };
+    for (uint8_t bit_id = 0; bit_id < 64; bit_id++)
+    {
+        bool id_bit = transmit_or_receive_bits(1, 0b1);
+        bool complement_bit = transmit_or_receive_bits(1, 0b1);
+        bool direction = id_bit == complement_bit ? (directions >> bit_id) & 0b1 : id_bit;
+        transmit_or_receive_bits(1, direction);
+        bits.id |= uint64_t(id_bit) << bit_id;
+        bits.complement |= uint64_t(complement_bit) << bit_id;
+    }
+    return bits;
+}
+
+onewire_master::search_bits onewire_master::run_search_program(uint64_t directions)
+{
+    wait_until_idle(ONEWIRE_OFFSET + onewire_offset_waiting);
+    sm.init(SEARCH_OFFSET + onewire_search_offset_start, search_config);
+    tick_us = onewire_timing::SEARCH_TICK_US;
+    sm.tx_fifo.push_back(uint32_t(directions));
+    sm.tx_fifo.push_back(uint32_t(directions >> 32));
+
+    search_bits bits{ 0, 0 };
+    for (uint8_t word = 0; word < 4; word++)
+    {
+        for (long steps = 0; sm.rx_fifo.empty(); steps++)
+        {
+            if (steps > MAX_STEPS)
+            {
+                throw std::runtime_error("Search program did not return any triplets");
+            }
+            step();
+        }
+        uint32_t triplets = sm.rx_fifo.front();
+        sm.rx_fifo.pop_front();
+        for (uint8_t i = 0; i < 16; i++)
+        {
+            uint8_t bit_id = word * 16 + i;
+            bits.id |= uint64_t((triplets >> (2 * i)) & 0b1) << bit_id;
+            bits.complement |= uint64_t((triplets >> (2 * i + 1)) & 0b1) << bit_id;
+        }
+    }
+
+    wait_until_idle(SEARCH_OFFSET + onewire_search_offset_start);
+    sm.init(ONEWIRE_OFFSET + onewire_offset_start, config);
+    tick_us = timing.slot_tick_us;
+    sm.exec(encode_set_y(timing.sample_delay));
+    return bits;
+}
+
+std::optional<std::tuple<uint64_t, int8_t>> onewire_master::incremental_search(uint64_t last_device_id,
+    int8_t most_significant_discrepancy,
+    bool use_search_program,
+    uint8_t search_command)
+{
+    if (!reset())
+    {
+        return {};
+    }
+    transmit(search_command);
+
+    const uint64_t directions = discrepancy_directions(last_device_id, most_significant_discrepancy);
+    const auto [id_bits, complement_bits] = use_search_program ? run_search_program(directions) : run_triplets(directions);
+
+    uint64_t device_id = 0;
+    int8_t discrepancy = NO_DISCREPANCY;
+    for (int8_t bit_id = 0; bit_id < 64; bit_id++)
+    {
+        bool id_bit = (id_bits >> bit_id) & 0b1;
+        bool complement_bit = (complement_bits >> bit_id) & 0b1;
+        if (id_bit && complement_bit)
+        {
+            return {};
+        }
+        bool search_direction = (id_bit != complement_bit) ? id_bit : ((directions >> bit_id) & 0b1);
+        if (!id_bit && !complement_bit && !search_direction)
+        {
+            discrepancy = bit_id;
+        }
+        device_id |= uint64_t(search_direction) << bit_id;
+    }
+    return std::make_tuple(device_id, discrepancy);
+}
+
+std::vector<uint64_t> onewire_master::search(bool use_search_program, uint8_t search_command)
+{
+    if (use_search_program && current_speed != onewire_model::speed::standard)
+    {
+        throw std::logic_error("The search program only runs at standard speed");
+    }
+
+    std::vector<uint64_t> device_ids;
+    int8_t most_significant_discrepancy = -1;
+    uint64_t last_device_id = 0;
+    while (most_significant_discrepancy != NO_DISCREPANCY)
+    {
+        auto result = incremental_search(last_device_id, most_significant_discrepancy, use_search_program, search_command);
+        if (!result.has_value())
+        {
+            break;
+        }
+        std::tie(last_device_id, most_significant_discrepancy) = result.value();
+        device_ids.push_back(last_device_id);
+    }
+    return device_ids;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <onewire_bus.hpp>
+#include <pio_model.hpp>
+#include <waveform.hpp>
+
+#include <onewire_timing.hpp>
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <tuple>
+#include <vector>
+
+// Drives the onewire PIO programs in the PIO model like src/onewire.cpp
+// drives them on the RP2040, against a model of the bus.
+class onewire_master
+{
+  public:
+    onewire_master(onewire_model::bus &bus, waveform &trace);
+
+    // Time on the bus in us.
+    double time() const { return now; }
+
+    void set_speed(onewire_model::speed bus_speed);
+    bool reset();
+    void transmit(uint8_t byte);
+    uint8_t receive();
+
+    // Search as in onewire::search, with the search program or with
+    // triplets of the onewire program. search_command is SEARCH ROM or
+    // ALARM SEARCH.
+    std::vector<uint64_t> search(bool use_search_program, uint8_t search_command = 0xf0);
+
+  private:
+    struct search_bits
+    {
+        uint64_t id;
+        uint64_t complement;
+    };
+
+    void step();
+    void update_bus();
+    void wait_until_idle(uint8_t waiting_addr);
+    void set_fifo_thresh(uint8_t thresh);
+    uint8_t transmit_or_receive_bits(uint8_t bits, uint8_t data);
+    std::optional<std::tuple<uint64_t, int8_t>> incremental_search(uint64_t last_device_id,
+        int8_t most_significant_discrepancy,
+        bool use_search_program,
+        uint8_t search_command);
+    search_bits run_triplets(uint64_t directions);
+    search_bits run_search_program(uint64_t directions);
+
+    onewire_model::bus &bus;
+    waveform &trace;
+
+    std::array<uint16_t, 32> instruction_memory{};
+    pio_model::sm_config config;
+    pio_model::sm_config search_config;
+    pio_model::state_machine sm;
+
+    onewire_timing::profile timing = onewire_timing::STANDARD;
+    onewire_model::speed current_speed = onewire_model::speed::standard;
+    double tick_us = onewire_timing::STANDARD.slot_tick_us;
+    double now = 0;
+    bool master_low = false;
+};
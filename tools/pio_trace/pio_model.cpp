@@ -0,0 +1,486 @@
+#include <pio_model.hpp>
+
+#include <stdexcept>
+
+namespace
+{
+enum opcode : uint8_t
+{
+    OP_JMP = 0,
+    OP_WAIT = 1,
+    OP_IN = 2,
+    OP_OUT = 3,
+    OP_PUSH_PULL = 4,
+    OP_MOV = 5,
+    OP_IRQ = 6,
+    OP_SET = 7
+};
+
+uint32_t mask_of(uint8_t bit_count)
+{
+    return bit_count >= 32 ? 0xffffffffu : (1u << bit_count) - 1;
+}
+
+uint8_t bit_count_of(uint16_t instruction)
+{
+    uint8_t bit_count = instruction & 0x1f;
+    return bit_count == 0 ? 32 : bit_count;
+}
+
+uint32_t reverse_bits(uint32_t value)
+{
+    uint32_t reversed = 0;
+    for (int i = 0; i < 32; i++)
+    {
+        reversed = (reversed << 1) | ((value >> i) & 1);
+    }
+    return reversed;
+}
+
+uint32_t rotate_right(uint32_t value, uint8_t amount)
+{
+    amount %= 32;
+    return amount == 0 ? value : (value >> amount) | (value << (32 - amount));
+}
+}// namespace
+
+pio_model::state_machine::state_machine(const uint16_t *instructions, size_t length, const sm_config &config_in):
+    program(instructions, instructions + length), config(config_in)
+{
+    if (length == 0 || length > 32)
+    {
+        throw std::invalid_argument("PIO programs have 1 to 32 instructions");
+    }
+}
+
+void pio_model::state_machine::init(uint8_t pc, const sm_config &config_in)
+{
+    config = config_in;
+    tx_fifo.clear();
+    rx_fifo.clear();
+    isr = 0;
+    isr_count = 0;
+    osr = 0;
+    osr_count = 32;
+    delay = 0;
+    stalled = false;
+    program_counter = pc;
+}
+
+void pio_model::state_machine::restart(const sm_config &config_in)
+{
+    config = config_in;
+    isr = 0;
+    isr_count = 0;
+    osr = 0;
+    osr_count = 32;
+    delay = 0;
+    stalled = false;
+}
+
+void pio_model::state_machine::exec(uint16_t instruction)
+{
+    // An executed instruction replaces a stalled one and does not advance the PC
+    apply_sideset(instruction);
+    jumped = false;
+    if (!execute(instruction))
+    {
+        throw std::logic_error("Executed instruction stalled");
+    }
+    stalled = false;
+    delay = 0;
+}
+
+void pio_model::state_machine::step()
+{
+    if (delay > 0)
+    {
+        delay--;
+        return;
+    }
+
+    const uint16_t instruction = program[program_counter];
+    // side-set takes effect when the instruction is issued, even if it stalls
+    apply_sideset(instruction);
+    jumped = false;
+    if (!execute(instruction))
+    {
+        stalled = true;
+        return;
+    }
+    stalled = false;
+    delay = delay_of(instruction);
+    if (!jumped)
+    {
+        program_counter = next_pc();
+    }
+}
+
+uint8_t pio_model::state_machine::next_pc() const
+{
+    return program_counter == config.wrap ? config.wrap_target : (program_counter + 1) % 32;
+}
+
+uint8_t pio_model::state_machine::delay_of(uint16_t instruction) const
+{
+    uint8_t delay_bits = 5 - config.sideset_count;
+    return (instruction >> 8) & mask_of(delay_bits);
+}
+
+void pio_model::state_machine::apply_sideset(uint16_t instruction)
+{
+    if (config.sideset_count == 0)
+    {
+        return;
+    }
+    uint8_t field = (instruction >> 8) & 0x1f;
+    if (config.sideset_optional && !(field & 0x10))
+    {
+        return;
+    }
+    uint8_t value_bits = config.sideset_count - (config.sideset_optional ? 1 : 0);
+    uint32_t value = (field >> (5 - config.sideset_count)) & mask_of(value_bits);
+    write_pins(config.sideset_pindirs ? pindirs : pins, value, config.sideset_base, value_bits);
+}
+
+uint32_t pio_model::state_machine::read_pins()
+{
+    on_sample();
+    return rotate_right(input(), config.in_base);
+}
+
+void pio_model::state_machine::write_pins(uint32_t &target, uint32_t value, uint8_t base, uint8_t count)
+{
+    for (uint8_t i = 0; i < count; i++)
+    {
+        uint32_t pin_mask = 1u << ((base + i) % 32);
+        target = ((value >> i) & 1) ? (target | pin_mask) : (target & ~pin_mask);
+    }
+}
+
+bool pio_model::state_machine::shift_in(uint32_t data, uint8_t bit_count)
+{
+    if (config.autopush && isr_count + bit_count >= config.push_threshold && rx_fifo.size() >= FIFO_DEPTH)
+    {
+        return false;
+    }
+
+    data &= mask_of(bit_count);
+    if (bit_count == 32)
+    {
+        isr = data;
+    }
+    else if (config.in_shift_right)
+    {
+        isr = (isr >> bit_count) | (data << (32 - bit_count));
+    }
+    else
+    {
+        isr = (isr << bit_count) | data;
+    }
+    isr_count = isr_count + bit_count > 32 ? 32 : isr_count + bit_count;
+
+    if (config.autopush && isr_count >= config.push_threshold)
+    {
+        rx_fifo.push_back(isr);
+        isr = 0;
+        isr_count = 0;
+    }
+    return true;
+}
+
+bool pio_model::state_machine::shift_out(uint32_t &data, uint8_t bit_count)
+{
+    if (config.autopull && osr_count >= config.pull_threshold)
+    {
+        if (tx_fifo.empty())
+        {
+            return false;
+        }
+        osr = tx_fifo.front();
+        tx_fifo.pop_front();
+        osr_count = 0;
+    }
+
+    if (bit_count == 32)
+    {
+        data = osr;
+        osr = 0;
+    }
+    else if (config.out_shift_right)
+    {
+        data = osr & mask_of(bit_count);
+        osr >>= bit_count;
+    }
+    else
+    {
+        data = osr >> (32 - bit_count);
+        osr <<= bit_count;
+    }
+    osr_count = osr_count + bit_count > 32 ? 32 : osr_count + bit_count;
+    return true;
+}
+
+bool pio_model::state_machine::execute(uint16_t instruction)
+{
+    const uint8_t op = instruction >> 13;
+    const uint8_t arg1 = (instruction >> 5) & 0x7;
+    const uint8_t arg2 = instruction & 0x1f;
+
+    switch (op)
+    {
+    case OP_JMP:
+    {
+        bool condition = false;
+        switch (arg1)
+        {
+        case 0:
+            condition = true;
+            break;
+        case 1:
+            condition = x == 0;
+            break;
+        case 2:
+            condition = x != 0;
+            x--;
+            break;
+        case 3:
+            condition = y == 0;
+            break;
+        case 4:
+            condition = y != 0;
+            y--;
+            break;
+        case 5:
+            condition = x != y;
+            break;
+        case 6:
+            on_sample();
+            condition = (input() >> config.jmp_pin) & 1;
+            break;
+        case 7:
+            condition = osr_count < config.pull_threshold;
+            break;
+        default:
+            break;
+        }
+        if (condition)
+        {
+            program_counter = arg2;
+            jumped = true;
+        }
+        return true;
+    }
+    case OP_WAIT:
+    {
+        const bool polarity = (instruction >> 7) & 1;
+        const uint8_t source = (instruction >> 5) & 0x3;
+        if (source == 0)
+        {
+            on_sample();
+            return ((input() >> arg2) & 1) == polarity;
+        }
+        if (source == 1)
+        {
+            return ((read_pins() >> arg2) & 1) == polarity;
+        }
+        return true; // IRQ waits are not modelled
+    }
+    case OP_IN:
+    {
+        const uint8_t bit_count = bit_count_of(instruction);
+        uint32_t data = 0;
+        switch (arg1)
+        {
+        case 0:
+            data = read_pins();
+            break;
+        case 1:
+            data = x;
+            break;
+        case 2:
+            data = y;
+            break;
+        case 6:
+            data = isr;
+            break;
+        case 7:
+            data = osr;
+            break;
+        default:
+            break;
+        }
+        return shift_in(data, bit_count);
+    }
+    case OP_OUT:
+    {
+        const uint8_t bit_count = bit_count_of(instruction);
+        uint32_t data = 0;
+        if (!shift_out(data, bit_count))
+        {
+            return false;
+        }
+        switch (arg1)
+        {
+        case 0:
+            write_pins(pins, data, config.out_base, bit_count);
+            break;
+        case 1:
+            x = data;
+            break;
+        case 2:
+            y = data;
+            break;
+        case 4:
+            write_pins(pindirs, data, config.out_base, bit_count);
+            break;
+        case 5:
+            program_counter = data & 0x1f;
+            jumped = true;
+            break;
+        case 6:
+            isr = data;
+            isr_count = bit_count;
+            break;
+        case 7:
+            throw std::logic_error("OUT EXEC is not modelled");
+        default:
+            break;
+        }
+        return true;
+    }
+    case OP_PUSH_PULL:
+    {
+        const bool is_pull = (instruction >> 7) & 1;
+        const bool if_full_or_empty = (instruction >> 6) & 1;
+        const bool block = (instruction >> 5) & 1;
+        if (is_pull)
+        {
+            if (if_full_or_empty && osr_count < config.pull_threshold)
+            {
+                return true;
+            }
+            if (tx_fifo.empty())
+            {
+                if (block)
+                {
+                    return false;
+                }
+                osr = x;
+            }
+            else
+            {
+                osr = tx_fifo.front();
+                tx_fifo.pop_front();
+            }
+            osr_count = 0;
+            return true;
+        }
+        if (if_full_or_empty && isr_count < config.push_threshold)
+        {
+            return true;
+        }
+        if (rx_fifo.size() >= FIFO_DEPTH)
+        {
+            if (block)
+            {
+                return false;
+            }
+        }
+        else
+        {
+            rx_fifo.push_back(isr);
+        }
+        isr = 0;
+        isr_count = 0;
+        return true;
+    }
+    case OP_MOV:
+    {
+        const uint8_t operation = (instruction >> 3) & 0x3;
+        uint32_t data = 0;
+        switch (instruction & 0x7)
+        {
+        case 0:
+            data = read_pins();
+            break;
+        case 1:
+            data = x;
+            break;
+        case 2:
+            data = y;
+            break;
+        case 6:
+            data = isr;
+            break;
+        case 7:
+            data = osr;
+            break;
+        default:
+            break;
+        }
+        if (operation == 1)
+        {
+            data = ~data;
+        }
+        else if (operation == 2)
+        {
+            data = reverse_bits(data);
+        }
+        switch (arg1)
+        {
+        case 0:
+            write_pins(pins, data, config.out_base, config.out_count);
+            break;
+        case 1:
+            x = data;
+            break;
+        case 2:
+            y = data;
+            break;
+        case 4:
+            throw std::logic_error("MOV EXEC is not modelled");
+        case 5:
+            program_counter = data & 0x1f;
+            jumped = true;
+            break;
+        case 6:
+            isr = data;
+            isr_count = 0;
+            break;
+        case 7:
+            osr = data;
+            osr_count = 0;
+            break;
+        default:
+            break;
+        }
+        return true;
+    }
+    case OP_IRQ:
+        return true;
+    case OP_SET:
+    {
+        switch (arg1)
+        {
+        case 0:
+            write_pins(pins, arg2, config.set_base, config.set_count);
+            break;
+        case 1:
+            x = arg2;
+            break;
+        case 2:
+            y = arg2;
+            break;
+        case 4:
+            write_pins(pindirs, arg2, config.set_base, config.set_count);
+            break;
+        default:
+            break;
+        }
+        return true;
+    }
+    default:
+        return true;
+    }
+}
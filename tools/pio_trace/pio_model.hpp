@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+// Cycle-accurate model of a single RP2040 PIO state machine. Covers the
+// subset of the PIO the onewire programs rely on: side-set (values and
+// pindirs, optional or not), delays, JMP, WAIT, IN, OUT, PUSH, PULL, MOV
+// and SET, autopush/autopull with thresholds and wrapping.
+// IRQ instructions are executed as NOPs.
+namespace pio_model
+{
+struct sm_config
+{
+    uint8_t sideset_count = 0; // number of side-set bits, including the enable bit
+    bool sideset_optional = false;
+    bool sideset_pindirs = false;
+    uint8_t sideset_base = 0;
+
+    uint8_t in_base = 0;
+    uint8_t out_base = 0;
+    uint8_t out_count = 32;
+    uint8_t set_base = 0;
+    uint8_t set_count = 5;
+    uint8_t jmp_pin = 0;
+
+    uint8_t wrap_target = 0;
+    uint8_t wrap = 31;
+
+    bool in_shift_right = true;
+    bool autopush = false;
+    uint8_t push_threshold = 32;
+    bool out_shift_right = true;
+    bool autopull = false;
+    uint8_t pull_threshold = 32;
+};
+
+class state_machine
+{
+  public:
+    static constexpr const size_t FIFO_DEPTH = 4;
+
+    // Returns the level of all 32 GPIOs as seen by the state machine.
+    using input_function = std::function<uint32_t()>;
+    // Called whenever the state machine samples pins (IN, MOV, JMP PIN, WAIT).
+    using sample_function = std::function<void()>;
+
+    state_machine(const uint16_t *instructions, size_t length, const sm_config &config);
+
+    // Equivalent of pio_sm_init: clears FIFOs and shift counters, jumps to pc.
+    void init(uint8_t pc, const sm_config &config);
+    // Equivalent of changing the configuration followed by pio_sm_restart:
+    // clears shift counters, delay and stall state, keeps the PC.
+    void restart(const sm_config &config);
+    // Equivalent of pio_sm_exec: executes an instruction immediately.
+    void exec(uint16_t instruction);
+
+    // Executes one clock cycle.
+    void step();
+
+    uint8_t pc() const { return program_counter; }
+    bool is_stalled() const { return stalled; }
+
+    std::deque<uint32_t> tx_fifo;
+    std::deque<uint32_t> rx_fifo;
+
+    uint32_t pins = 0;    // output values
+    uint32_t pindirs = 0; // output enables
+
+    input_function input = [] { return 0xffffffffu; };
+    sample_function on_sample = [] {};
+
+    uint32_t x = 0;
+    uint32_t y = 0;
+
+  private:
+    // Executes an instruction. Returns false if it stalls.
+    bool execute(uint16_t instruction);
+    void apply_sideset(uint16_t instruction);
+    uint32_t read_pins();
+    void write_pins(uint32_t &target, uint32_t value, uint8_t base, uint8_t count);
+    bool shift_in(uint32_t data, uint8_t bit_count);
+    bool shift_out(uint32_t &data, uint8_t bit_count);
+    uint8_t next_pc() const;
+    uint8_t delay_of(uint16_t instruction) const;
+
+    std::vector<uint16_t> program;
+    sm_config config;
+
+    uint8_t program_counter = 0;
+    uint32_t isr = 0;
+    uint32_t osr = 0;
+    uint8_t isr_count = 0;
+    uint8_t osr_count = 32;
+    uint8_t delay = 0;
+    bool stalled = false;
+    bool jumped = false;
+};
+}// namespace pio_model
@@ -0,0 +1,450 @@
+// Runs the onewire PIO programs in a cycle-accurate PIO model against a
+// model of a 1-Wire bus, checks the resulting waveforms against the
+// 1-Wire timing requirements (Maxim AN126 and the DS18B20/DS2431 data
+// sheets) and optionally writes them as VCD files.
+//
+// Usage: pio_trace [--vcd <directory>] [--benchmark]
+
+#include <onewire_bus.hpp>
+#include <onewire_master.hpp>
+#include <waveform.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+constexpr const double UNLIMITED = std::numeric_limits<double>::infinity();
+constexpr const uint8_t READ_ROM_COMMAND = 0x33;
+constexpr const uint8_t OVERDRIVE_SKIP_ROM_COMMAND = 0x3c;
+constexpr const uint8_t ALARM_SEARCH_COMMAND = 0xec;
+constexpr const uint8_t SKIP_ROM_COMMAND = 0xcc;
+constexpr const uint8_t MATCH_ROM_COMMAND = 0x55;
+constexpr const uint8_t OVERDRIVE_MATCH_ROM_COMMAND = 0x69;
+constexpr const uint8_t CONVERT_T_COMMAND = 0x44;
+constexpr const uint8_t READ_SCRATCHPAD_COMMAND = 0xbe;
+constexpr const size_t SEARCH_DEVICES = 8;
+
+enum parameter_id
+{
+    WRITE_1_LOW,
+    SAMPLE_POINT,
+    WRITE_0_LOW,
+    RECOVERY,
+    SLOT,
+    RESET_LOW,
+    PRESENCE_SAMPLE,
+    RESET_HIGH,
+    PARAMETER_COUNT
+};
+
+struct parameter
+{
+    const char *name;
+    double an126; // recommended value of AN126
+    double min;
+    double max;
+};
+
+using parameter_table = parameter[PARAMETER_COUNT];
+
+/* Standard speed: AN126 table 3 (A..J), limits of the DS18B20 and
+   DS2431 data sheets */
+const parameter_table STANDARD_LIMITS = {
+    { "A   write-1/read low", 6.0, 1.0, 15.0 },
+    { "A+E sample point", 15.0, 1.0, 15.0 },
+    { "C   write-0 low", 60.0, 60.0, 120.0 },
+    { "D   recovery", 10.0, 5.0, UNLIMITED },
+    { "    slot", 70.0, 60.0, 120.0 },
+    { "H   reset low", 480.0, 480.0, 640.0 },
+    { "I   presence sample", 70.0, 60.0, 75.0 },
+    { "I+J reset high", 480.0, 480.0, UNLIMITED },
+};
+
+const parameter_table OVERDRIVE_LIMITS = {
+    { "A   write-1/read low", 1.0, 1.0, 2.0 },
+    { "A+E sample point", 2.0, 1.0, 2.0 },
+    { "C   write-0 low", 7.5, 6.0, 16.0 },
+    { "D   recovery", 2.5, 2.0, UNLIMITED },
+    { "    slot", 10.0, 6.0, 16.0 },
+    { "H   reset low", 70.0, 48.0, 80.0 },
+    { "I   presence sample", 8.5, 8.0, 10.0 },
+    { "I+J reset high", 48.5, 48.0, UNLIMITED },
+};
+
+struct measurement
+{
+    double min = UNLIMITED;
+    double max = -UNLIMITED;
+
+    void add(double value)
+    {
+        min = std::min(min, value);
+        max = std::max(max, value);
+    }
+    bool empty() const { return min > max; }
+};
+
+uint8_t calc_crc8(const uint8_t *data, size_t size)
+{
+    // See Application Note 27
+    uint8_t crc8 = 0;
+    for (size_t j = 0; j < size; j++)
+    {
+        crc8 = crc8 ^ data[j];
+        for (int i = 0; i < 8; ++i)
+        {
+            crc8 = (crc8 & 1) ? (crc8 >> 1) ^ 0x8c : (crc8 >> 1);
+        }
+    }
+    return crc8;
+}
+
+std::vector<uint64_t> make_roms(size_t count, uint64_t seed)
+{
+    std::mt19937_64 random(seed);
+    std::vector<uint64_t> roms;
+    while (roms.size() < count)
+    {
+        uint64_t rom = 0x28 | ((random() & 0xffffffffffffull) << 8); // DS18B20 family code
+        uint8_t bytes[7];
+        for (int i = 0; i < 7; i++)
+        {
+            bytes[i] = rom >> (8 * i);
+        }
+        rom |= uint64_t(calc_crc8(bytes, 7)) << 56;
+        if (std::find(roms.begin(), roms.end(), rom) == roms.end())
+        {
+            roms.push_back(rom);
+        }
+    }
+    return roms;
+}
+
+/* Classifies the low pulses of the master in [from, until) into resets,
+   write-1/read and write-0 slots, measures them and compares them with
+   the limits. Returns false if any limit is violated. */
+bool check_timing(const char *title,
+    const parameter_table &limits,
+    const std::vector<onewire_model::interval> &master_low,
+    const std::vector<double> &samples,
+    double from,
+    double until)
+{
+    std::vector<onewire_model::interval> pulses;
+    std::copy_if(master_low.begin(), master_low.end(), std::back_inserter(pulses), [from, until](const auto &low) {
+        return low.from >= from && low.from < until;
+    });
+
+    measurement measured[PARAMETER_COUNT];
+    const double write_1_write_0_split = (limits[WRITE_1_LOW].max + limits[WRITE_0_LOW].min) / 2;
+    for (size_t i = 0; i < pulses.size(); i++)
+    {
+        const auto &pulse = pulses[i];
+        const double low = pulse.until - pulse.from;
+        const bool has_next = i + 1 < pulses.size();
+        const double next_fall = has_next ? pulses[i + 1].from : until;
+        auto first_sample_after_release = std::find_if(samples.begin(), samples.end(), [&pulse](double t) {
+            return t > pulse.until;
+        });
+        const bool sampled = first_sample_after_release != samples.end() && *first_sample_after_release < next_fall;
+
+        if (low > limits[WRITE_0_LOW].max)
+        {
+            measured[RESET_LOW].add(low);
+            if (sampled)
+            {
+                measured[PRESENCE_SAMPLE].add(*first_sample_after_release - pulse.until);
+            }
+            if (has_next)
+            {
+                measured[RESET_HIGH].add(next_fall - pulse.until);
+            }
+            continue;
+        }
+
+        if (low < write_1_write_0_split)
+        {
+            measured[WRITE_1_LOW].add(low);
+            if (sampled)
+            {
+                measured[SAMPLE_POINT].add(*first_sample_after_release - pulse.from);
+            }
+        }
+        else
+        {
+            measured[WRITE_0_LOW].add(low);
+        }
+        if (has_next)
+        {
+            measured[RECOVERY].add(next_fall - pulse.until);
+            measured[SLOT].add(next_fall - pulse.from);
+        }
+    }
+
+    bool ok = true;
+    printf("%s\n", title);
+    printf("  %-22s %8s %20s %20s\n", "parameter [us]", "AN126", "measured", "limits");
+    for (int id = 0; id < PARAMETER_COUNT; id++)
+    {
+        const auto &limit = limits[id];
+        const auto &value = measured[id];
+        char measured_text[32] = "-";
+        char limit_text[32];
+        if (!value.empty())
+        {
+            snprintf(measured_text, sizeof(measured_text), "%.1f .. %.1f", value.min, value.max);
+        }
+        if (limit.max == UNLIMITED)
+        {
+            snprintf(limit_text, sizeof(limit_text), ">= %.1f", limit.min);
+        }
+        else
+        {
+            snprintf(limit_text, sizeof(limit_text), "%.1f .. %.1f", limit.min, limit.max);
+        }
+        bool within = value.empty() || (value.min >= limit.min && value.max <= limit.max);
+        ok = ok && within;
+        printf("  %-22s %8.1f %20s %20s  %s\n", limit.name, limit.an126, measured_text, limit_text, within ? "ok" : "FAIL");
+    }
+    return ok;
+}
+
+struct scenario_result
+{
+    bool functional;
+    double speed_switch; // time of the switch to overdrive, if any
+};
+
+bool run_scenario(const char *name,
+    const std::function<scenario_result(onewire_model::bus &, onewire_master &)> &scenario,
+    const std::string &vcd_directory)
+{
+    onewire_model::bus bus;
+    waveform trace;
+    onewire_master master(bus, trace);
+
+    printf("== %s ==\n", name);
+    auto [functional, speed_switch] = scenario(bus, master);
+    const double end = master.time();
+    printf("  transfers %s, %.1f us on the bus\n", functional ? "ok" : "FAILED", end);
+
+    bool ok = functional;
+    ok = check_timing("  standard speed", STANDARD_LIMITS, bus.master_low_intervals(), trace.samples(), 0, speed_switch) && ok;
+    if (speed_switch < end)
+    {
+        ok = check_timing("  overdrive speed", OVERDRIVE_LIMITS, bus.master_low_intervals(), trace.samples(), speed_switch, end) && ok;
+    }
+
+    if (!vcd_directory.empty())
+    {
+        std::string path = vcd_directory + "/" + name + ".vcd";
+        trace.write_vcd(path, bus.master_low_intervals(), bus.slave_low_intervals());
+        printf("  wrote %s\n", path.c_str());
+    }
+    printf("\n");
+    return ok;
+}
+
+uint64_t read_rom(onewire_master &master)
+{
+    master.transmit(READ_ROM_COMMAND);
+    uint64_t rom = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        rom |= uint64_t(master.receive()) << (8 * i);
+    }
+    return rom;
+}
+
+bool same_devices(std::vector<uint64_t> found, std::vector<uint64_t> expected)
+{
+    std::sort(found.begin(), found.end());
+    std::sort(expected.begin(), expected.end());
+    return found == expected;
+}
+
+void benchmark()
+{
+    printf("== search benchmark (time on the bus, without ARM latency between triplets) ==\n");
+    printf("  %8s %22s %22s\n", "devices", "PIO search [ms]", "ARM triplets [ms]");
+    for (size_t count : { 10, 50, 100 })
+    {
+        auto roms = make_roms(count, count);
+        double elapsed[2];
+        for (int use_search_program = 0; use_search_program < 2; use_search_program++)
+        {
+            onewire_model::bus bus;
+            waveform trace;
+            onewire_master master(bus, trace);
+            for (auto rom : roms)
+            {
+                bus.add_device(rom);
+            }
+            auto found = master.search(use_search_program);
+            if (!same_devices(found, roms))
+            {
+                printf("  search of %zu devices FAILED\n", count);
+            }
+            elapsed[use_search_program] = master.time() / 1000.0;
+        }
+        printf("  %8zu %10.1f (%5.2f/dev) %10.1f (%5.2f/dev)\n",
+            count,
+            elapsed[1],
+            elapsed[1] / count,
+            elapsed[0],
+            elapsed[0] / count);
+    }
+}
+
+// One burst cycle as src/burst_capture.cpp runs it: SKIP ROM CONVERT T,
+// the conversion, then MATCH ROM READ SCRATCHPAD of every device.
+// Returns the time on the bus in us, without the conversion.
+double burst_cycle_bus_time(const std::vector<uint64_t> &roms, bool overdrive)
+{
+    onewire_model::bus bus;
+    waveform trace;
+    onewire_master master(bus, trace);
+    for (auto rom : roms)
+    {
+        bus.add_device(rom, overdrive);
+    }
+    master.reset();
+    master.transmit(SKIP_ROM_COMMAND);
+    master.transmit(CONVERT_T_COMMAND);
+    for (auto rom : roms)
+    {
+        master.set_speed(onewire_model::speed::standard);
+        master.reset();
+        if (overdrive)
+        {
+            master.transmit(OVERDRIVE_MATCH_ROM_COMMAND);
+            master.set_speed(onewire_model::speed::overdrive);
+        }
+        else
+        {
+            master.transmit(MATCH_ROM_COMMAND);
+        }
+        for (int i = 0; i < 8; i++)
+        {
+            master.transmit(uint8_t(rom >> (8 * i)));
+        }
+        master.transmit(READ_SCRATCHPAD_COMMAND);
+        for (int i = 0; i < 9; i++)
+        {
+            master.receive();
+        }
+    }
+    return master.time();
+}
+
+void burst_benchmark()
+{
+    // maximum conversion time at 9 bit plus the margin of burst_capture.cpp
+    constexpr const double CONVERSION_US = 93750.0 + 1000.0;
+    printf("== burst benchmark (9 bit, back to back, per bus, without ARM latency) ==\n");
+    printf("  %8s %28s %28s\n", "devices", "standard [ms/cycle, samples/s]", "overdrive [ms/cycle, samples/s]");
+    for (size_t count : { 1, 4, 8, 16, 32 })
+    {
+        auto roms = make_roms(count, count);
+        double cycle_us[2];
+        for (int overdrive = 0; overdrive < 2; overdrive++)
+        {
+            cycle_us[overdrive] = CONVERSION_US + burst_cycle_bus_time(roms, overdrive);
+        }
+        printf("  %8zu %14.2f %13.1f %14.2f %13.1f\n",
+            count,
+            cycle_us[0] / 1000.0,
+            count * 1e6 / cycle_us[0],
+            cycle_us[1] / 1000.0,
+            count * 1e6 / cycle_us[1]);
+    }
+}
+}// namespace
+
+int main(int argc, char **argv)
+{
+    std::string vcd_directory;
+    bool run_benchmark = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--vcd") == 0 && i + 1 < argc)
+        {
+            vcd_directory = argv[++i];
+        }
+        else if (strcmp(argv[i], "--benchmark") == 0)
+        {
+            run_benchmark = true;
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--vcd <directory>] [--benchmark]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    const auto roms = make_roms(SEARCH_DEVICES, 1);
+    bool ok = true;
+
+    ok = run_scenario("standard_read_rom", [&roms](onewire_model::bus &bus, onewire_master &master) {
+        bus.add_device(roms[0]);
+        bool functional = master.reset() && read_rom(master) == roms[0];
+        return scenario_result{ functional, UNLIMITED };
+    }, vcd_directory) && ok;
+
+    ok = run_scenario("overdrive_read_rom", [&roms](onewire_model::bus &bus, onewire_master &master) {
+        bus.add_device(roms[0], true);
+        bool functional = master.reset();
+        master.transmit(OVERDRIVE_SKIP_ROM_COMMAND);
+        master.set_speed(onewire_model::speed::overdrive);
+        double speed_switch = master.time();
+        functional = functional && master.reset() && read_rom(master) == roms[0];
+        return scenario_result{ functional, speed_switch };
+    }, vcd_directory) && ok;
+
+    ok = run_scenario("search_program", [&roms](onewire_model::bus &bus, onewire_master &master) {
+        for (auto rom : roms)
+        {
+            bus.add_device(rom);
+        }
+        return scenario_result{ same_devices(master.search(true), roms), UNLIMITED };
+    }, vcd_directory) && ok;
+
+    ok = run_scenario("search_triplets", [&roms](onewire_model::bus &bus, onewire_master &master) {
+        for (auto rom : roms)
+        {
+            bus.add_device(rom);
+        }
+        return scenario_result{ same_devices(master.search(false), roms), UNLIMITED };
+    }, vcd_directory) && ok;
+
+    ok = run_scenario("alarm_search", [&roms](onewire_model::bus &bus, onewire_master &master) {
+        for (auto rom : roms)
+        {
+            bus.add_device(rom);
+        }
+        // devices crossing their thresholds between conversions
+        bool functional = master.search(true, ALARM_SEARCH_COMMAND).empty();
+        bus.set_alarm(roms[2], true);
+        bus.set_alarm(roms[5], true);
+        functional = functional && same_devices(master.search(true, ALARM_SEARCH_COMMAND), { roms[2], roms[5] });
+        bus.set_alarm(roms[2], false);
+        functional = functional && same_devices(master.search(false, ALARM_SEARCH_COMMAND), { roms[5] });
+        return scenario_result{ functional, UNLIMITED };
+    }, vcd_directory) && ok;
+
+    if (run_benchmark)
+    {
+        benchmark();
+        burst_benchmark();
+    }
+
+    printf("%s\n", ok ? "all checks passed" : "CHECKS FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,95 @@
+#include <waveform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <tuple>
+
+namespace
+{
+constexpr const double SAMPLE_MARKER_US = 0.1;
+
+enum signal : uint8_t
+{
+    MASTER_LOW,
+    SLAVE_LOW,
+    SAMPLE,
+    SIGNAL_COUNT
+};
+
+int64_t to_timescale(double t)
+{
+    return std::llround(t * 100.0); // 10ns
+}
+}// namespace
+
+void waveform::write_vcd(const std::string &path,
+    const std::vector<onewire_model::interval> &master_low,
+    const std::vector<onewire_model::interval> &slave_low) const
+{
+    std::ofstream out(path);
+    if (!out)
+    {
+        throw std::runtime_error("Could not open " + path);
+    }
+
+    // (time, signal, +1/-1) for every interval
+    std::vector<std::tuple<int64_t, signal, int>> events;
+    auto add_intervals = [&events](const std::vector<onewire_model::interval> &intervals, signal sig) {
+        for (const auto &low : intervals)
+        {
+            events.emplace_back(to_timescale(low.from), sig, 1);
+            events.emplace_back(to_timescale(low.until), sig, -1);
+        }
+    };
+    add_intervals(master_low, MASTER_LOW);
+    add_intervals(slave_low, SLAVE_LOW);
+    for (auto t : sample_times)
+    {
+        events.emplace_back(to_timescale(t), SAMPLE, 1);
+        events.emplace_back(to_timescale(t + SAMPLE_MARKER_US), SAMPLE, -1);
+    }
+    std::sort(events.begin(), events.end());
+
+    out << "$timescale 10ns $end\n"
+        << "$scope module onewire $end\n"
+        << "$var wire 1 ! bus $end\n"
+        << "$var wire 1 \" master_low $end\n"
+        << "$var wire 1 # slave_low $end\n"
+        << "$var wire 1 $ sample $end\n"
+        << "$upscope $end\n"
+        << "$enddefinitions $end\n"
+        << "#0\n1!\n0\"\n0#\n0$\n";
+
+    int active[SIGNAL_COUNT] = { 0, 0, 0 };
+    bool written[SIGNAL_COUNT] = { false, false, false };
+    bool bus_written = true;
+    for (size_t i = 0; i < events.size();)
+    {
+        const int64_t t = std::get<0>(events[i]);
+        for (; i < events.size() && std::get<0>(events[i]) == t; i++)
+        {
+            active[std::get<1>(events[i])] += std::get<2>(events[i]);
+        }
+
+        out << '#' << t << '\n';
+        const char identifiers[SIGNAL_COUNT] = { '"', '#', '$' };
+        for (int sig = 0; sig < SIGNAL_COUNT; sig++)
+        {
+            bool value = active[sig] > 0;
+            if (value != written[sig])
+            {
+                out << (value ? '1' : '0') << identifiers[sig] << '\n';
+                written[sig] = value;
+            }
+        }
+        bool bus = !(written[MASTER_LOW] || written[SLAVE_LOW]);
+        if (bus != bus_written)
+        {
+            out << (bus ? '1' : '0') << "!\n";
+            bus_written = bus;
+        }
+    }
+}
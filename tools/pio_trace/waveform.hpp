@@ -0,0 +1,24 @@
+#pragma once
+
+#include <onewire_bus.hpp>
+
+#include <string>
+#include <vector>
+
+// Records the sample points of the state machine and writes the
+// waveform of a simulation as VCD (value change dump) file.
+class waveform
+{
+  public:
+    void add_sample(double t) { sample_times.push_back(t); }
+    const std::vector<double> &samples() const { return sample_times; }
+
+    // Writes the master and slave drive, the resulting bus level and the
+    // sample points. Times are in us, the VCD uses a 10ns timescale.
+    void write_vcd(const std::string &path,
+        const std::vector<onewire_model::interval> &master_low,
+        const std::vector<onewire_model::interval> &slave_low) const;
+
+  private:
+    std::vector<double> sample_times;
+};
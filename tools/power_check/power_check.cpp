@@ -0,0 +1,186 @@
+// Runs the clock decisions of the firmware's power scheduler
+// (src/idle_plan.cpp) against a simulated clock: the command polls between
+// two sweeps, the conversion wait, steps shorter than a clock switch, passed
+// deadlines, the measured switch cost and the time spent at reduced clock.
+//
+// Usage: power_check
+
+#include <idle_plan.hpp>
+
+#include <check.hpp>
+
+#include <algorithm>
+#include <cstdio>
+
+namespace
+{
+// as in main.cpp
+constexpr const uint64_t SWEEP_PERIOD_US = 60000000;
+constexpr const uint64_t COMMAND_POLL_US = 1000000;
+constexpr const uint64_t CONVERSION_US = 750000;
+
+struct simulation
+{
+    uint64_t now_us = 0;
+    uint32_t reduce_cost_us = 600;
+    uint32_t restore_cost_us = 900;
+    idle_plan plan;
+    unsigned reductions = 0;
+    unsigned restores = 0;
+    unsigned sleeps = 0;
+
+    // power_scheduler::idle_until
+    void idle_until(uint64_t deadline_us)
+    {
+        const auto action = plan.plan(now_us, deadline_us);
+        if (action == idle_plan::action::none)
+        {
+            return;
+        }
+        if (action == idle_plan::action::reduce_clock)
+        {
+            now_us += reduce_cost_us;
+            plan.clock_reduced_at(now_us, reduce_cost_us);
+            reductions++;
+        }
+        sleeps++;
+        now_us = std::max(now_us, deadline_us);
+    }
+
+    // power_scheduler::restore_clock
+    void restore_clock()
+    {
+        if (!plan.clock_reduced())
+        {
+            return;
+        }
+        now_us += restore_cost_us;
+        plan.clock_restored_at(now_us, restore_cost_us);
+        restores++;
+    }
+
+    // the idle loop of main.cpp until the next sweep
+    void wait_for_sweep(uint64_t deadline_us)
+    {
+        while (now_us < deadline_us)
+        {
+            idle_until(std::min(deadline_us, now_us + COMMAND_POLL_US));
+        }
+        restore_clock();
+    }
+};
+
+using host_check::check;
+}// namespace
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        fprintf(stderr, "usage: %s\n", argv[0]);
+        return 2;
+    }
+
+    bool ok = true;
+    printf("== idle and clock scheduling ==\n");
+
+    ok = check("one clock round trip per sweep period", [] {
+        simulation sim;
+        sim.wait_for_sweep(SWEEP_PERIOD_US);
+        return sim.sleeps == SWEEP_PERIOD_US / COMMAND_POLL_US && sim.reductions == 1 && sim.restores == 1
+            && !sim.plan.clock_reduced();
+    }) && ok;
+
+    ok = check("a sweep reduces the clock for the conversion", [] {
+        simulation sim;
+        sim.now_us = 40000;// the conversions have been started
+        sim.idle_until(sim.now_us + CONVERSION_US);
+        const bool reduced = sim.plan.clock_reduced();
+        sim.restore_clock();
+        return reduced && sim.reductions == 1 && sim.restores == 1 && sim.now_us == 40000 + CONVERSION_US + sim.restore_cost_us;
+    }) && ok;
+
+    ok = check("a passed deadline neither sleeps nor switches", [] {
+        simulation sim;
+        sim.now_us = 5000;
+        sim.idle_until(5000);
+        sim.idle_until(4000);
+        return sim.sleeps == 0 && sim.reductions == 0 && sim.now_us == 5000
+            && sim.plan.plan(5000, 5000) == idle_plan::action::none;
+    }) && ok;
+
+    ok = check("a passed deadline keeps a reduced clock", [] {
+        simulation sim;
+        sim.idle_until(COMMAND_POLL_US);
+        sim.idle_until(COMMAND_POLL_US);
+        return sim.plan.clock_reduced() && sim.reductions == 1 && sim.restores == 0;
+    }) && ok;
+
+    ok = check("a step shorter than a round trip stays at full clock", [] {
+        simulation sim;
+        const uint32_t cost = sim.plan.switch_cost_us();
+        sim.idle_until(cost - 1);
+        const bool stayed = sim.sleeps == 1 && sim.reductions == 0 && !sim.plan.clock_reduced();
+        sim.idle_until(sim.now_us + cost);
+        return stayed && sim.reductions == 1 && cost == idle_plan::INITIAL_SWITCH_COST_US;
+    }) && ok;
+
+    ok = check("the measured round trip replaces the estimate", [] {
+        simulation sim;
+        sim.reduce_cost_us = 4000;
+        sim.restore_cost_us = 6000;
+        sim.idle_until(COMMAND_POLL_US);
+        sim.restore_clock();
+        const bool slow = sim.plan.switch_cost_us() == 10000
+            && sim.plan.plan(sim.now_us, sim.now_us + 9999) == idle_plan::action::sleep
+            && sim.plan.plan(sim.now_us, sim.now_us + 10000) == idle_plan::action::reduce_clock;
+        sim.reduce_cost_us = 300;
+        sim.restore_cost_us = 500;
+        sim.idle_until(sim.now_us + COMMAND_POLL_US);
+        sim.restore_clock();
+        return slow && sim.plan.switch_cost_us() == 800
+            && sim.plan.plan(sim.now_us, sim.now_us + 800) == idle_plan::action::reduce_clock;
+    }) && ok;
+
+    ok = check("time at reduced clock excludes the switches", [] {
+        simulation sim;
+        sim.wait_for_sweep(SWEEP_PERIOD_US);
+        const uint64_t first = sim.plan.reduced_clock_us();
+        const uint64_t start = sim.now_us;
+        sim.idle_until(start + CONVERSION_US);
+        sim.restore_clock();
+        return first == SWEEP_PERIOD_US - sim.reduce_cost_us
+            && sim.plan.reduced_clock_us() - first == CONVERSION_US - sim.reduce_cost_us;
+    }) && ok;
+
+    ok = check("restoring a full clock does nothing", [] {
+        simulation sim;
+        sim.restore_clock();
+        sim.plan.clock_restored_at(1000, 100);
+        return sim.restores == 0 && sim.plan.reduced_clock_us() == 0 && sim.plan.switch_cost_us() == idle_plan::INITIAL_SWITCH_COST_US;
+    }) && ok;
+
+    ok = check("an hour of sweeps", [] {
+        simulation sim;
+        uint64_t next_sweep = SWEEP_PERIOD_US;
+        uint64_t active_us = 0;
+        for (int sweep = 0; sweep < 60; sweep++)
+        {
+            sim.wait_for_sweep(next_sweep);
+            const uint64_t sweep_start = sim.now_us;
+            const uint64_t reduced_start = sim.plan.reduced_clock_us();
+            sim.now_us += 40000;// start the conversions
+            sim.idle_until(sim.now_us + CONVERSION_US);
+            sim.restore_clock();
+            sim.now_us += 150000;// read and publish
+            active_us += sim.now_us - sweep_start - (sim.plan.reduced_clock_us() - reduced_start);
+            next_sweep += SWEEP_PERIOD_US;
+        }
+        printf("  %u clock switches in %u idle steps, %.1f ms active per sweep\n",
+            sim.reductions + sim.restores, sim.sleeps, active_us / 60 / 1000.0);
+        return sim.reductions == 120 && sim.restores == 120 && active_us == 60 * (40000 + 150000 + 600 + 900);
+    }) && ok;
+    printf("\n");
+
+    return host_check::finish(ok);
+}
@@ -0,0 +1,283 @@
+// Feeds recorded DS18B20 readings (1/16 degC) through the firmware's sample
+// processing (src/sample_processor.cpp): the median and Q8 EMA filters, the
+// min/max/mean window, deadband suppression and heartbeat reports.
+//
+// Usage: sample_check
+
+#include <sample_processor.hpp>
+
+#include <check.hpp>
+
+#include <cstdio>
+#include <initializer_list>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+constexpr const int16_t POWER_ON_RESET = 85 * 16;
+
+// The filtered value after each sample, for window 1 and no deadband
+std::vector<int16_t> filtered(const sample_processor::config &cfg, std::initializer_list<int16_t> raw)
+{
+    auto unfiltered = cfg;
+    unfiltered.window = 1;
+    unfiltered.deadband = 0;
+    unfiltered.heartbeat = 1;
+    sample_processor processor(unfiltered);
+    std::vector<int16_t> values;
+    for (int16_t sample : raw)
+    {
+        values.push_back(processor.add(sample)->value);
+    }
+    return values;
+}
+
+// The reports published for a sequence of samples
+std::vector<sample_processor::report> reports(sample_processor &processor, std::initializer_list<int16_t> raw)
+{
+    std::vector<sample_processor::report> published;
+    for (int16_t sample : raw)
+    {
+        if (auto rep = processor.add(sample))
+        {
+            published.push_back(*rep);
+        }
+    }
+    return published;
+}
+
+bool equal(const sample_processor::report &rep, int16_t value, int16_t min, int16_t max, int16_t mean)
+{
+    return rep.value == value && rep.min == min && rep.max == max && rep.mean == mean;
+}
+
+using host_check::check;
+
+bool rejected(const sample_processor::config &cfg)
+{
+    try
+    {
+        sample_processor processor(cfg);
+    } catch (std::invalid_argument &)
+    {
+        return true;
+    }
+    return false;
+}
+}// namespace
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        fprintf(stderr, "usage: %s\n", argv[0]);
+        return 2;
+    }
+
+    bool ok = true;
+    printf("== filters ==\n");
+
+    ok = check("median of 3 removes a single spike", [] {
+        sample_processor::config cfg;
+        cfg.filter_type = sample_processor::filter::median;
+        const auto values = filtered(cfg, { 344, 345, POWER_ON_RESET, 345, 346, -1, 346 });
+        return values == std::vector<int16_t>{ 344, 345, 345, 345, 346, 345, 346 };
+    }) && ok;
+
+    ok = check("median of 3 follows a step after one sample", [] {
+        sample_processor::config cfg;
+        cfg.filter_type = sample_processor::filter::median;
+        const auto values = filtered(cfg, { 320, 320, 320, 400, 400, 400 });
+        return values == std::vector<int16_t>{ 320, 320, 320, 320, 400, 400 };
+    }) && ok;
+
+    ok = check("median of 5 removes two spikes", [] {
+        sample_processor::config cfg;
+        cfg.filter_type = sample_processor::filter::median;
+        cfg.median_window = 5;
+        const auto values = filtered(cfg, { 100, 101, 102, 2000, 2000, 103, 104 });
+        return values.back() == 104 && values[4] == 102 && values[5] == 103;
+    }) && ok;
+
+    ok = check("EMA starts at the first sample", [] {
+        sample_processor::config cfg;
+        cfg.filter_type = sample_processor::filter::ema;
+        return filtered(cfg, { 320 }) == std::vector<int16_t>{ 320 };
+    }) && ok;
+
+    ok = check("EMA steps in Q8 with weight 1/4", [] {
+        sample_processor::config cfg;
+        cfg.filter_type = sample_processor::filter::ema;
+        // Q8: 0, 1024, 1792, 2368, 2800
+        const auto rising = filtered(cfg, { 0, 16, 16, 16, 16 });
+        // Q8: -40960, -41984, -42752
+        const auto falling = filtered(cfg, { -160, -176, -176 });
+        return rising == std::vector<int16_t>{ 0, 4, 7, 9, 11 } && falling == std::vector<int16_t>{ -160, -164, -167 };
+    }) && ok;
+
+    ok = check("EMA keeps fractions and rounds the output", [] {
+        sample_processor::config cfg;
+        cfg.filter_type = sample_processor::filter::ema;
+        // Q8: 0, 64, 112, 148, 175: a truncated value would stay 0 longer
+        return filtered(cfg, { 0, 1, 1, 1, 1 }) == std::vector<int16_t>{ 0, 0, 0, 1, 1 };
+    }) && ok;
+
+    ok = check("EMA settles on a constant input", [] {
+        sample_processor::config cfg;
+        cfg.filter_type = sample_processor::filter::ema;
+        cfg.ema_shift = 4;
+        sample_processor::config unfiltered = cfg;
+        unfiltered.deadband = 0;
+        unfiltered.heartbeat = 1;
+        sample_processor processor(unfiltered);
+        processor.add(0);
+        int16_t value = 0;
+        for (int i = 0; i < 200; i++)
+        {
+            value = processor.add(368)->value;
+        }
+        return value == 368;
+    }) && ok;
+    printf("\n");
+
+    printf("== windows and reporting ==\n");
+
+    ok = check("window min, max and mean of the raw samples", [] {
+        sample_processor::config cfg;
+        cfg.window = 4;
+        sample_processor processor(cfg);
+        const auto published = reports(processor, { 340, 350, 345, 341 });
+        return published.size() == 1 && equal(published[0], 341, 340, 350, 344);
+    }) && ok;
+
+    ok = check("the window mean rounds halves away from zero", [] {
+        sample_processor::config cfg;
+        cfg.window = 2;
+        cfg.deadband = 0;
+        sample_processor processor(cfg);
+        const auto published = reports(processor, { 340, 341, -3, -4 });
+        return published.size() == 2 && published[0].mean == 341 && published[1].mean == -4;
+    }) && ok;
+
+    ok = check("a spike shows in the max, not the median", [] {
+        sample_processor::config cfg;
+        cfg.filter_type = sample_processor::filter::median;
+        cfg.window = 3;
+        sample_processor processor(cfg);
+        const auto published = reports(processor, { 344, 344, 344, 345, POWER_ON_RESET, 344 });
+        return published.size() == 2 && equal(published[1], 345, 344, POWER_ON_RESET, 683);
+    }) && ok;
+
+    ok = check("changes within the deadband are suppressed", [] {
+        sample_processor::config cfg;
+        cfg.heartbeat = 0;
+        sample_processor processor(cfg);
+        const auto published = reports(processor, { 344, 346, 342, 347, 345, 349, 350 });
+        return published.size() == 3 && published[0].value == 344 && published[1].value == 347
+            && published[2].value == 350;
+    }) && ok;
+
+    ok = check("the deadband is relative to the last report", [] {
+        sample_processor::config cfg;
+        cfg.heartbeat = 0;
+        cfg.deadband = 4;
+        sample_processor processor(cfg);
+        // a slow drift is reported once it adds up
+        const auto published = reports(processor, { 300, 301, 302, 303, 304, 305, 306, 307, 308, 309 });
+        return published.size() == 2 && published[1].value == 305;
+    }) && ok;
+
+    ok = check("a window min or max outside the deadband is reported", [] {
+        sample_processor::config cfg;
+        cfg.window = 3;
+        cfg.heartbeat = 0;
+        sample_processor processor(cfg);
+        const auto published = reports(processor, { 344, 344, 344, 344, 341, 344, 344, 344, 344 });
+        return published.size() == 2 && equal(published[1], 344, 341, 344, 343);
+    }) && ok;
+
+    ok = check("an unchanged value is reported on the heartbeat", [] {
+        sample_processor::config cfg;
+        cfg.window = 2;
+        cfg.heartbeat = 3;
+        sample_processor processor(cfg);
+        std::vector<unsigned> reported_windows;
+        for (unsigned window = 0; window < 10; window++)
+        {
+            processor.add(344);
+            if (processor.add(345))
+            {
+                reported_windows.push_back(window);
+            }
+        }
+        return reported_windows == std::vector<unsigned>{ 0, 3, 6, 9 };
+    }) && ok;
+
+    ok = check("a change restarts the heartbeat", [] {
+        sample_processor::config cfg;
+        cfg.heartbeat = 3;
+        sample_processor processor(cfg);
+        const auto published = reports(processor, { 344, 344, 360, 360, 360, 360 });
+        return published.size() == 3 && published[1].value == 360 && published[2].value == 360;
+    }) && ok;
+
+    ok = check("heartbeat 0 reports changes only", [] {
+        sample_processor::config cfg;
+        cfg.heartbeat = 0;
+        sample_processor processor(cfg);
+        size_t count = 0;
+        for (int i = 0; i < 1000; i++)
+        {
+            count += processor.add(344).has_value();
+        }
+        return count == 1;
+    }) && ok;
+
+    ok = check("invalid configurations are rejected", [] {
+        sample_processor::config even;
+        even.filter_type = sample_processor::filter::median;
+        even.median_window = 4;
+        sample_processor::config too_long = even;
+        too_long.median_window = sample_processor::MAX_MEDIAN_WINDOW + 2;
+        sample_processor::config no_window;
+        no_window.window = 0;
+        sample_processor::config slow_ema;
+        slow_ema.ema_shift = 9;
+        sample_processor::config negative;
+        negative.deadband = -1;
+        // the median window does not matter without the median filter
+        sample_processor::config unused = even;
+        unused.filter_type = sample_processor::filter::ema;
+        return rejected(even) && rejected(too_long) && rejected(no_window) && rejected(slow_ema)
+            && rejected(negative) && !rejected(unused);
+    }) && ok;
+
+    ok = check("a recorded warm-up with a power-on reset", [] {
+        // one reading every 10 s while a room heats up, with an 85 degC
+        // reading after a brown-out of the sensor
+        sample_processor::config cfg;
+        cfg.filter_type = sample_processor::filter::median;
+        cfg.window = 6;
+        cfg.deadband = 2;
+        cfg.heartbeat = 15;
+        sample_processor processor(cfg);
+        const auto published = reports(processor, {
+            304, 305, 304, 304, 305, 305,
+            305, 306, 305, 306, 306, 306,
+            307, 308, 308, POWER_ON_RESET, 309, 309,
+            310, 311, 311, 312, 312, 313,
+            313, 314, 314, 315, 315, 316,
+            316, 316, 317, 316, 317, 317,
+        });
+        printf("  %zu reports for 6 windows\n", published.size());
+        // the second and the last window stay within the deadband
+        return published.size() == 4 && equal(published[0], 305, 304, 305, 305)
+            && equal(published[1], 309, 307, POWER_ON_RESET, 484)
+            && equal(published[2], 312, 310, 313, 312)
+            && equal(published[3], 315, 313, 316, 315);
+    }) && ok;
+    printf("\n");
+
+    return host_check::finish(ok);
+}
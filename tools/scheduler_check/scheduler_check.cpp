@@ -0,0 +1,187 @@
+// Drives the firmware's sweep scheduler (src/sweep_scheduler.cpp) with a
+// simulated clock: deadlines on a fixed grid despite the time a sweep takes,
+// missed deadlines skipped without losing the phase, several groups with
+// their own intervals, interval changes and the lateness and jitter
+// statistics.
+//
+// Usage: scheduler_check
+
+#include <sweep_scheduler.hpp>
+
+#include <check.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <stdexcept>
+
+namespace
+{
+constexpr const uint64_t SECOND_US = 1000000;
+
+using host_check::check;
+using host_check::throws;
+}// namespace
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        fprintf(stderr, "usage: %s\n", argv[0]);
+        return 2;
+    }
+
+    bool ok = true;
+    printf("== sweep scheduler ==\n");
+
+    ok = check("the first deadline is the time the group is added", [] {
+        sweep_scheduler scheduler;
+        scheduler.add_group(60 * SECOND_US, 5000);
+        return scheduler.next_deadline() == 5000 && scheduler.collect_due(4999).none()
+            && scheduler.collect_due(5000).test(0) && scheduler.next_deadline() == 5000 + 60 * SECOND_US;
+    }) && ok;
+
+    ok = check("sweep time does not accumulate as drift", [] {
+        sweep_scheduler scheduler;
+        const uint64_t start = 1234;
+        scheduler.add_group(60 * SECOND_US, start);
+        uint64_t now = start;
+        for (int sweep = 0; sweep < 1000; sweep++)
+        {
+            now = scheduler.next_deadline();
+            if (!scheduler.collect_due(now + 2000).test(0))
+            {
+                return false;
+            }
+            now += 2000 + 800000;// woken 2 ms late, the sweep takes 0.8 s
+        }
+        const auto &stats = scheduler.statistics(0);
+        return scheduler.next_deadline() == start + 1000 * 60 * SECOND_US && stats.runs == 1000
+            && stats.missed_deadlines == 0 && stats.max_lateness_us == 2000 && stats.max_jitter_us == 0;
+    }) && ok;
+
+    ok = check("missed deadlines are skipped, the phase is kept", [] {
+        sweep_scheduler scheduler;
+        scheduler.add_group(10 * SECOND_US, 0);
+        scheduler.collect_due(0);
+        // a burst blocks the loop for 35.5 s: the deadlines at 10 and 20 s
+        // are missed, the run at 35.5 s is 5.5 s late for the one at 30 s
+        const bool due = scheduler.collect_due(35500000).test(0);
+        const auto &stats = scheduler.statistics(0);
+        return due && stats.missed_deadlines == 2 && stats.max_lateness_us == 5500000
+            && scheduler.next_deadline() == 40 * SECOND_US;
+    }) && ok;
+
+    ok = check("a run exactly one interval late misses one deadline", [] {
+        sweep_scheduler scheduler;
+        scheduler.add_group(SECOND_US, 0);
+        scheduler.collect_due(SECOND_US);
+        const auto &stats = scheduler.statistics(0);
+        return stats.missed_deadlines == 1 && stats.max_lateness_us == 0 && scheduler.next_deadline() == 2 * SECOND_US;
+    }) && ok;
+
+    ok = check("lateness and jitter statistics", [] {
+        sweep_scheduler scheduler;
+        scheduler.add_group(SECOND_US, 0);
+        for (uint64_t lateness : { 100, 3100, 1100, 1100, 0 })
+        {
+            scheduler.collect_due(scheduler.next_deadline() + lateness);
+        }
+        const auto &stats = scheduler.statistics(0);
+        // jitter: |3100 - 100|, |1100 - 3100|, 0, |0 - 1100|
+        return stats.runs == 5 && stats.max_lateness_us == 3100 && stats.total_lateness_us == 5400
+            && stats.max_jitter_us == 3000 && stats.missed_deadlines == 0;
+    }) && ok;
+
+    ok = check("jitter counts the lateness left after skipping", [] {
+        sweep_scheduler scheduler;
+        scheduler.add_group(SECOND_US, 0);
+        scheduler.collect_due(200);
+        // the deadlines at 1 and 2 s are missed, 300 us late for 3 s
+        scheduler.collect_due(3 * SECOND_US + 300);
+        const auto &stats = scheduler.statistics(0);
+        return stats.missed_deadlines == 2 && stats.max_lateness_us == 300 && stats.max_jitter_us == 100;
+    }) && ok;
+
+    ok = check("groups with their own intervals", [] {
+        sweep_scheduler scheduler;
+        const uint8_t fast = scheduler.add_group(SECOND_US, 0);
+        const uint8_t slow = scheduler.add_group(300 * SECOND_US, 0);
+        unsigned fast_runs = 0;
+        unsigned slow_runs = 0;
+        unsigned both = 0;
+        for (uint64_t now = 0; now <= 900 * SECOND_US; now = scheduler.next_deadline())
+        {
+            const auto due = scheduler.collect_due(now);
+            fast_runs += due.test(fast);
+            slow_runs += due.test(slow);
+            both += due.test(fast) && due.test(slow);
+        }
+        return fast_runs == 901 && slow_runs == 4 && both == 4 && scheduler.group_count() == 2;
+    }) && ok;
+
+    ok = check("next deadline is the earliest of all groups", [] {
+        sweep_scheduler scheduler;
+        scheduler.add_group(7 * SECOND_US, 0);
+        scheduler.add_group(3 * SECOND_US, 1000);
+        scheduler.collect_due(1000);
+        const bool earliest = scheduler.next_deadline() == 3 * SECOND_US + 1000;
+        const auto due = scheduler.collect_due(3 * SECOND_US + 1000);
+        return earliest && due.to_ulong() == 0b10 && scheduler.next_deadline() == 6 * SECOND_US + 1000;
+    }) && ok;
+
+    ok = check("a new interval applies after the next deadline", [] {
+        sweep_scheduler scheduler;
+        scheduler.add_group(60 * SECOND_US, 0);
+        scheduler.collect_due(0);
+        scheduler.set_interval(0, 10 * SECOND_US);
+        const bool kept = scheduler.next_deadline() == 60 * SECOND_US && scheduler.interval(0) == 10 * SECOND_US;
+        scheduler.collect_due(60 * SECOND_US);
+        return kept && scheduler.next_deadline() == 70 * SECOND_US;
+    }) && ok;
+
+    ok = check("invalid groups and intervals are rejected", [] {
+        sweep_scheduler scheduler;
+        bool rejected = throws<std::invalid_argument>([&] { scheduler.add_group(0, 0); });
+        for (size_t i = 0; i < sweep_scheduler::MAX_GROUPS; i++)
+        {
+            scheduler.add_group(SECOND_US, 0);
+        }
+        rejected = rejected && throws<std::runtime_error>([&] { scheduler.add_group(SECOND_US, 0); });
+        rejected = rejected && throws<std::invalid_argument>([&] { scheduler.set_interval(0, 0); });
+        rejected = rejected && throws<std::out_of_range>([&] { scheduler.statistics(sweep_scheduler::MAX_GROUPS); });
+        return rejected && scheduler.interval(0) == SECOND_US;
+    }) && ok;
+
+    ok = check("random wake-up delays stay on the grid", [] {
+        std::mt19937_64 random(1);
+        sweep_scheduler scheduler;
+        const uint64_t interval = 5 * SECOND_US;
+        const uint64_t start = 777;
+        scheduler.add_group(interval, start);
+        uint64_t now = start;
+        uint32_t expected_missed = 0;
+        uint64_t max_lateness = 0;
+        for (int sweep = 0; sweep < 10000; sweep++)
+        {
+            // mostly a few ms late, sometimes blocked for several intervals
+            const uint64_t delay = random() % 64 == 0 ? random() % (4 * interval) : random() % 5000;
+            now = std::max(now, scheduler.next_deadline()) + delay;
+            const uint64_t deadline = scheduler.next_deadline();
+            expected_missed += (now - deadline) / interval;
+            max_lateness = std::max(max_lateness, (now - deadline) % interval);
+            scheduler.collect_due(now);
+            if ((scheduler.next_deadline() - start) % interval != 0 || scheduler.next_deadline() <= now)
+            {
+                return false;
+            }
+        }
+        const auto &stats = scheduler.statistics(0);
+        printf("  %u runs, %u missed deadlines, lateness max %llu us, jitter max %llu us\n",
+            stats.runs, stats.missed_deadlines, (unsigned long long)stats.max_lateness_us, (unsigned long long)stats.max_jitter_us);
+        return stats.runs == 10000 && stats.missed_deadlines == expected_missed && stats.max_lateness_us == max_lateness;
+    }) && ok;
+    printf("\n");
+
+    return host_check::finish(ok);
+}
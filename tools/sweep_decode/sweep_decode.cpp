@@ -0,0 +1,244 @@
+// Decodes the binary sweep messages of the firmware, one message per
+// line of hex digits on stdin, and prints the reports as CSV:
+//   sequence,timestamp_ms,identifier,value,min,max,mean
+// with the conversion start of the bus of the device as timestamp.
+//
+//   mosquitto_sub -h <broker> -t picoW/sweep -F %x | sweep_decode
+//
+// Usage: sweep_decode [--all] [--benchmark]
+//   --all        also print the last known value of devices without a
+//                report in key frames
+//   --benchmark  compare the bytes per sweep of the binary and the text
+//                format at 10, 100 and 500 devices
+
+#include <sweep_decoder.hpp>
+#include <sweep_encoder.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+constexpr const char *SWEEP_TOPIC = "picoW/sweep";
+constexpr const char *TEXT_TOPIC_PREFIX = "picoW/temperature/";
+constexpr const size_t BENCHMARK_SWEEPS = 600;
+constexpr const size_t BENCHMARK_BUSES = 4;
+// between the conversion starts of two buses
+constexpr const uint64_t BUS_START_MS = 9;
+
+std::vector<uint8_t> parse_hex(const std::string &line)
+{
+    std::vector<uint8_t> bytes;
+    for (size_t i = 0; i + 1 < line.size(); i += 2)
+    {
+        bytes.push_back(uint8_t(std::stoul(line.substr(i, 2), nullptr, 16)));
+    }
+    return bytes;
+}
+
+// Size of an MQTT 3.1.1 PUBLISH packet at QoS 1 or 2, without the
+// acknowledgement packets of the QoS flow
+size_t publish_packet_size(size_t topic_length, size_t payload_length)
+{
+    const size_t remaining = 2 + topic_length + 2 + payload_length;
+    size_t length_bytes = 1;
+    for (size_t r = remaining; r >= 128; r >>= 7)
+    {
+        length_bytes++;
+    }
+    return 1 + length_bytes + remaining;
+}
+
+struct format_size
+{
+    size_t messages = 0;
+    size_t payload = 0;
+    size_t packets = 0;
+
+    void add(size_t topic_length, size_t payload_length)
+    {
+        messages++;
+        payload += payload_length;
+        packets += publish_packet_size(topic_length, payload_length);
+    }
+};
+
+// Encodes BENCHMARK_SWEEPS sweeps in which every device reports a
+// random walk, as with a deadband of 0, in both formats. The devices are
+// spread over BENCHMARK_BUSES buses. Checks the round trip of the binary
+// format on the way.
+bool benchmark_devices(size_t device_count)
+{
+    std::mt19937_64 random(device_count);
+    std::map<uint64_t, int16_t> values;
+    while (values.size() < device_count)
+    {
+        values[(random() << 8) | 0x28] = int16_t(320 + random() % 64);
+    }
+
+    std::vector<std::vector<uint8_t>> messages;
+    sweep_encoder encoder([&messages](std::span<const uint8_t> message) {
+        messages.emplace_back(message.begin(), message.end());
+    });
+    std::vector<uint64_t> identifiers;
+    for (const auto &[identifier, value] : values)
+    {
+        identifiers.push_back(identifier);
+    }
+    encoder.set_devices(identifiers);
+    sweep_decoder decoder;
+
+    format_size text;
+    format_size binary;
+    bool ok = true;
+    uint64_t timestamp_ms = 1700000000000;
+    for (uint32_t sequence = 1; sequence <= BENCHMARK_SWEEPS; sequence++, timestamp_ms += 1000)
+    {
+        std::vector<sweep_encoder::sample> samples;
+        for (auto &[identifier, value] : values)
+        {
+            value = int16_t(value + int(random() % 5) - 2);
+            const uint64_t bus_timestamp_ms = timestamp_ms + samples.size() % BENCHMARK_BUSES * BUS_START_MS;
+            samples.push_back({identifier, value, value, value, value, bus_timestamp_ms});
+
+            // as src/main.cpp publishes readings without binary_sweeps
+            char payload[80];
+            int length = snprintf(payload, sizeof(payload), "%u,%llu,%.2f,%.2f,%.2f,%.2f",
+                sequence,
+                (unsigned long long)bus_timestamp_ms,
+                value * 0.0625,
+                value * 0.0625,
+                value * 0.0625,
+                value * 0.0625);
+            text.add(strlen(TEXT_TOPIC_PREFIX) + 16, length);
+        }
+
+        messages.clear();
+        encoder.encode(sequence, timestamp_ms, samples);
+        std::optional<sweep_decoder::sweep> decoded;
+        for (const auto &message : messages)
+        {
+            binary.add(strlen(SWEEP_TOPIC), message.size());
+            decoded = decoder.decode(message);
+        }
+
+        bool matches = decoded && decoded->sequence == sequence && decoded->timestamp_ms == timestamp_ms
+            && decoded->samples.size() == device_count;
+        for (size_t i = 0; matches && i < device_count; i++)
+        {
+            const auto &entry = decoded->samples[i];
+            matches = entry.is_report && entry.identifier == samples[i].identifier && entry.value == samples[i].value
+                && entry.timestamp_ms == samples[i].timestamp_ms;
+        }
+        if (!matches)
+        {
+            printf("  round trip of sweep %u with %zu devices FAILED\n", sequence, device_count);
+            ok = false;
+        }
+    }
+
+    printf("  %8zu %10.0f %10.0f %10.0f %10.1f %10.0f %10.0f %7.1fx\n",
+        device_count,
+        double(text.messages) / BENCHMARK_SWEEPS,
+        double(text.payload) / BENCHMARK_SWEEPS,
+        double(text.packets) / BENCHMARK_SWEEPS,
+        double(binary.messages) / BENCHMARK_SWEEPS,
+        double(binary.payload) / BENCHMARK_SWEEPS,
+        double(binary.packets) / BENCHMARK_SWEEPS,
+        double(text.packets) / binary.packets);
+    return ok;
+}
+
+bool benchmark()
+{
+    printf("== bytes per sweep, every device reporting, mean of %zu sweeps with a key frame every %u ==\n",
+        BENCHMARK_SWEEPS,
+        sweep_encoder::KEY_FRAME_INTERVAL);
+    printf("  %8s %32s %32s\n", "", "text", "binary");
+    printf("  %8s %10s %10s %10s %10s %10s %10s %8s\n",
+        "devices", "messages", "payload", "PUBLISH", "messages", "payload", "PUBLISH", "ratio");
+    bool ok = true;
+    for (size_t count : { 10, 100, 500 })
+    {
+        ok = benchmark_devices(count) && ok;
+    }
+    return ok;
+}
+
+int decode_stdin(bool all)
+{
+    sweep_decoder decoder;
+    std::string line;
+    while (std::getline(std::cin, line))
+    {
+        try
+        {
+            auto decoded = decoder.decode(parse_hex(line));
+            if (!decoded)
+            {
+                continue;
+            }
+            for (const auto &entry : decoded->samples)
+            {
+                if (!entry.is_report && !all)
+                {
+                    continue;
+                }
+                printf("%u,%llu,%llx,%.4f,%.4f,%.4f,%.4f\n",
+                    decoded->sequence,
+                    (unsigned long long)entry.timestamp_ms,
+                    (unsigned long long)entry.identifier,
+                    entry.value * 0.0625,
+                    entry.min * 0.0625,
+                    entry.max * 0.0625,
+                    entry.mean * 0.0625);
+            }
+            fflush(stdout);
+        }
+        catch (const std::exception &err)
+        {
+            fprintf(stderr, "dropped message: %s\n", err.what());
+        }
+    }
+    if (decoder.dropped_messages() > 0)
+    {
+        fprintf(stderr, "%u messages dropped while waiting for a key frame\n", decoder.dropped_messages());
+    }
+    return 0;
+}
+}// namespace
+
+int main(int argc, char **argv)
+{
+    bool all = false;
+    bool run_benchmark = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--all") == 0)
+        {
+            all = true;
+        }
+        else if (strcmp(argv[i], "--benchmark") == 0)
+        {
+            run_benchmark = true;
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--all] [--benchmark]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (run_benchmark)
+    {
+        bool ok = benchmark();
+        printf("%s\n", ok ? "all checks passed" : "CHECKS FAILED");
+        return ok ? 0 : 1;
+    }
+    return decode_stdin(all);
+}
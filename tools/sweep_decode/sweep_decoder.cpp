@@ -0,0 +1,165 @@
+#include <sweep_decoder.hpp>
+
+#include <sweep_format.hpp>
+
+#include <cstring>
+
+namespace
+{
+uint64_t get(std::span<const uint8_t> &data)
+{
+    auto value = sweep_format::get_varint(data);
+    if (!value)
+    {
+        throw sweep_decoder::decode_error("truncated varint");
+    }
+    return *value;
+}
+
+int16_t get_zigzag(std::span<const uint8_t> &data, int32_t base)
+{
+    return int16_t(base + sweep_format::zigzag_decode(uint32_t(get(data))));
+}
+}// namespace
+
+std::optional<sweep_decoder::sweep> sweep_decoder::decode(std::span<const uint8_t> message)
+{
+    if (message.size() < 2 + sweep_format::CRC_SIZE)
+    {
+        throw decode_error("message too short");
+    }
+    auto body = message.first(message.size() - sweep_format::CRC_SIZE);
+    const uint16_t crc = message[message.size() - 2] | (message[message.size() - 1] << 8);
+    if (sweep_format::crc16(body) != crc)
+    {
+        throw decode_error("CRC mismatch");
+    }
+    if (body[0] != sweep_format::VERSION)
+    {
+        throw decode_error("unsupported version");
+    }
+    const bool last_part = body[1] & sweep_format::LAST_PART;
+    const auto type = sweep_format::message_type(body[1] & 0x3);
+    body = body.subspan(2);
+    const uint32_t sequence = get(body);
+    const uint32_t part = get(body);
+    const uint16_t table_id = get(body);
+
+    // A synchronized decoder expects the next part, a sweep starting
+    // with a device table or key frame starts over
+    const bool continues = synchronized && sequence == expected_sequence && part == expected_part;
+    const bool starts_over = part == 0 && type != sweep_format::message_type::delta_frame;
+    if (!continues && !starts_over)
+    {
+        synchronized = false;
+        dropped++;
+        return {};
+    }
+    if (part == 0)
+    {
+        current = {sequence, 0, starts_over, {}};
+        if (starts_over)
+        {
+            // a key frame carries every known device
+            known.assign(identifiers.size(), false);
+        }
+    }
+
+    switch (type)
+    {
+    case sweep_format::message_type::table:
+        decode_table(body, table_id);
+        break;
+    case sweep_format::message_type::key_frame:
+    case sweep_format::message_type::delta_frame:
+        if (!table || *table != table_id)
+        {
+            // the device table was missed
+            synchronized = false;
+            dropped++;
+            return {};
+        }
+        decode_frame(body, type == sweep_format::message_type::key_frame);
+        break;
+    default:
+        throw decode_error("unknown message type");
+    }
+
+    synchronized = true;
+    expected_sequence = sequence;
+    expected_part = part + 1;
+    if (!last_part)
+    {
+        return {};
+    }
+    expected_sequence = sequence + 1;
+    expected_part = 0;
+    return std::move(current);
+}
+
+void sweep_decoder::decode_table(std::span<const uint8_t> body, uint16_t table_id)
+{
+    const size_t total = get(body);
+    const size_t first = get(body);
+    const size_t count = get(body);
+    if (first == 0)
+    {
+        pending_identifiers.assign(total, 0);
+        pending_count = 0;
+    }
+    if (total != pending_identifiers.size() || first + count > total || first != pending_count
+        || body.size() != count * sizeof(uint64_t))
+    {
+        throw decode_error("malformed device table");
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        std::memcpy(&pending_identifiers[first + i], body.data() + i * sizeof(uint64_t), sizeof(uint64_t));
+    }
+    pending_count += count;
+    if (pending_count < total)
+    {
+        return;
+    }
+
+    identifiers = std::move(pending_identifiers);
+    previous.assign(total, 0);
+    known.assign(total, false);
+    pending_identifiers.clear();
+    table = table_id;
+}
+
+void sweep_decoder::decode_frame(std::span<const uint8_t> body, bool key_frame)
+{
+    const uint64_t timestamp_ms = get(body);
+    current.timestamp_ms = timestamp_ms;
+
+    size_t index = 0;
+    while (!body.empty())
+    {
+        const uint64_t header = get(body);
+        index += header >> sweep_format::ENTRY_FLAG_BITS;
+        if (index >= identifiers.size())
+        {
+            throw decode_error("device index out of range");
+        }
+        const int32_t base = key_frame || !known[index] ? 0 : previous[index];
+        sample entry{identifiers[index], bool(header & sweep_format::ENTRY_REPORT), 0, 0, 0, 0, timestamp_ms};
+        entry.value = get_zigzag(body, base);
+        entry.min = entry.max = entry.mean = entry.value;
+        if (header & sweep_format::ENTRY_WINDOW)
+        {
+            entry.min = get_zigzag(body, entry.value);
+            entry.max = get_zigzag(body, entry.value);
+            entry.mean = get_zigzag(body, entry.value);
+        }
+        if (header & sweep_format::ENTRY_TIME)
+        {
+            entry.timestamp_ms += int64_t(sweep_format::zigzag_decode(uint32_t(get(body))));
+        }
+        previous[index] = entry.value;
+        known[index] = true;
+        current.samples.push_back(entry);
+        index++;
+    }
+}
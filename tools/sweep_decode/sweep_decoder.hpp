@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+// Decodes the messages of the binary sweep format (src/sweep_format.hpp)
+// in the order they were published.
+class sweep_decoder
+{
+  public:
+    // Temperatures in 1/16 degC. Entries that are not reports only carry
+    // the last known value of a device.
+    struct sample
+    {
+        uint64_t identifier;
+        bool is_report;
+        int16_t value;
+        int16_t min;
+        int16_t max;
+        int16_t mean;
+        uint64_t timestamp_ms; // conversion start of the bus of the device, UNIX ms
+    };
+
+    struct sweep
+    {
+        uint32_t sequence;
+        uint64_t timestamp_ms; // conversion start in UNIX ms, 0 if the device clock was not synchronized
+        bool key_frame;
+        std::vector<sample> samples;
+    };
+
+    // Thrown for messages that fail the CRC, have an unknown version or
+    // are malformed.
+    class decode_error : public std::runtime_error
+    {
+      public:
+        using std::runtime_error::runtime_error;
+    };
+
+    // Returns the sweep once its last message is decoded. Messages
+    // following a lost message are dropped until the next key frame.
+    std::optional<sweep> decode(std::span<const uint8_t> message);
+
+    bool is_synchronized() const { return synchronized; }
+    uint32_t dropped_messages() const { return dropped; }
+    const std::vector<uint64_t> &devices() const { return identifiers; }
+
+  private:
+    void decode_table(std::span<const uint8_t> body, uint16_t table_id);
+    void decode_frame(std::span<const uint8_t> body, bool key_frame);
+
+    // device table and the parts received of the table in transfer
+    std::vector<uint64_t> identifiers;
+    std::optional<uint16_t> table;
+    std::vector<uint64_t> pending_identifiers;
+    size_t pending_count = 0;
+
+    std::vector<int16_t> previous;
+    std::vector<bool> known;
+
+    bool synchronized = false;
+    uint32_t expected_sequence = 0;
+    uint32_t expected_part = 0;
+    uint32_t dropped = 0;
+    sweep current{};
+};
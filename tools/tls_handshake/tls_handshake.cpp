@@ -0,0 +1,347 @@
+// Measures the time from the TCP connect to the CONNACK of an MQTT
+// connection over TLS 1.2 with a full handshake and with the two ways the
+// firmware resumes a session (src/mqtt_client.cpp): a session ticket and a
+// session ID. The broker is a stand-in on the loopback interface that
+// answers every CONNECT with a CONNACK, using a self-signed P-256
+// certificate and ECDHE-ECDSA-AES128-GCM-SHA256 like a typical broker.
+//
+// The times are those of OpenSSL on the host, not of mbedTLS on the
+// RP2040; the ratio shows what resumption saves. A resumed handshake
+// skips the certificate verification and the ECDHE key exchange, the
+// elliptic curve operations that dominate the connect on the device.
+//
+// Usage: tls_handshake [--count N]
+
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+constexpr const char *BROKER_NAME = "localhost";
+constexpr const char *CIPHER = "ECDHE-ECDSA-AES128-GCM-SHA256";
+constexpr const int DEFAULT_COUNT = 200;
+
+// MQTT 3.1.1 CONNECT with clean session, keep alive 60 s and a client ID,
+// the packet lwIP sends
+const std::vector<uint8_t> CONNECT_PACKET{
+    0x10, 0x19, 0x00, 0x04, 'M', 'Q', 'T', 'T', 0x04, 0x02, 0x00, 0x3c,
+    0x00, 0x0d, 't', 'l', 's', '_', 'h', 'a', 'n', 'd', 's', 'h', 'a', 'k', 'e'
+};
+const std::array<uint8_t, 4> CONNACK_PACKET{ 0x20, 0x02, 0x00, 0x00 };
+
+enum class mode
+{
+    full,
+    ticket,
+    session_id,
+};
+
+const char *mode_name(mode m)
+{
+    switch (m)
+    {
+    case mode::full:
+        return "full handshake";
+    case mode::ticket:
+        return "resumed, session ticket";
+    case mode::session_id:
+        return "resumed, session ID";
+    default:
+        return "?";
+    }
+}
+
+struct sample
+{
+    double ms;
+    unsigned long bytes_sent;
+    unsigned long bytes_received;
+};
+
+[[noreturn]] void fail(const char *what)
+{
+    fprintf(stderr, "%s\n", what);
+    ERR_print_errors_fp(stderr);
+    exit(1);
+}
+
+struct credentials
+{
+    EVP_PKEY *key;
+    X509 *certificate;
+};
+
+credentials make_credentials()
+{
+    credentials result{ EVP_EC_gen("P-256"), X509_new() };
+    if (!result.key || !result.certificate)
+    {
+        fail("key generation failed");
+    }
+    X509_set_version(result.certificate, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(result.certificate), 1);
+    X509_gmtime_adj(X509_getm_notBefore(result.certificate), 0);
+    X509_gmtime_adj(X509_getm_notAfter(result.certificate), 24 * 3600);
+    X509_NAME *name = X509_get_subject_name(result.certificate);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+        reinterpret_cast<const unsigned char *>(BROKER_NAME), -1, -1, 0);
+    X509_set_issuer_name(result.certificate, name);
+    X509_set_pubkey(result.certificate, result.key);
+    if (!X509_sign(result.certificate, result.key, EVP_sha256()))
+    {
+        fail("certificate signing failed");
+    }
+    return result;
+}
+
+void set_no_delay(int socket)
+{
+    int one = 1;
+    setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+bool read_exactly(SSL *ssl, uint8_t *data, size_t size)
+{
+    size_t done = 0;
+    while (done < size)
+    {
+        int n = SSL_read(ssl, data + done, int(size - done));
+        if (n <= 0)
+        {
+            return false;
+        }
+        done += size_t(n);
+    }
+    return true;
+}
+
+// Reads one MQTT packet: the fixed header, the remaining length and the body
+bool read_packet(SSL *ssl, std::vector<uint8_t> &packet)
+{
+    packet.assign(1, 0);
+    if (!read_exactly(ssl, packet.data(), 1))
+    {
+        return false;
+    }
+    size_t remaining = 0;
+    for (int shift = 0; shift < 28; shift += 7)
+    {
+        uint8_t byte;
+        if (!read_exactly(ssl, &byte, 1))
+        {
+            return false;
+        }
+        packet.push_back(byte);
+        remaining |= size_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            break;
+        }
+    }
+    const size_t header = packet.size();
+    packet.resize(header + remaining);
+    return read_exactly(ssl, packet.data() + header, remaining);
+}
+
+// Accepts `connections` connections one after another and answers the
+// CONNECT of each with a CONNACK
+void run_broker(SSL_CTX *context, int listener, int connections)
+{
+    std::vector<uint8_t> packet;
+    for (int i = 0; i < connections; i++)
+    {
+        int socket = accept(listener, nullptr, nullptr);
+        if (socket < 0)
+        {
+            fail("accept failed");
+        }
+        set_no_delay(socket);
+        SSL *ssl = SSL_new(context);
+        SSL_set_fd(ssl, socket);
+        if (SSL_accept(ssl) == 1 && read_packet(ssl, packet) && packet[0] == CONNECT_PACKET[0])
+        {
+            SSL_write(ssl, CONNACK_PACKET.data(), int(CONNACK_PACKET.size()));
+            // wait for the client to close
+            read_packet(ssl, packet);
+        }
+        SSL_shutdown(ssl);
+        SSL_free(ssl);
+        close(socket);
+    }
+}
+
+SSL_CTX *make_broker_context(const credentials &broker)
+{
+    SSL_CTX *context = SSL_CTX_new(TLS_server_method());
+    SSL_CTX_set_min_proto_version(context, TLS1_2_VERSION);
+    SSL_CTX_set_max_proto_version(context, TLS1_2_VERSION);
+    SSL_CTX_set_cipher_list(context, CIPHER);
+    SSL_CTX_set_session_cache_mode(context, SSL_SESS_CACHE_SERVER);
+    if (SSL_CTX_use_certificate(context, broker.certificate) != 1
+        || SSL_CTX_use_PrivateKey(context, broker.key) != 1)
+    {
+        fail("broker credentials rejected");
+    }
+    return context;
+}
+
+SSL_CTX *make_client_context(const credentials &broker, bool tickets)
+{
+    SSL_CTX *context = SSL_CTX_new(TLS_client_method());
+    SSL_CTX_set_min_proto_version(context, TLS1_2_VERSION);
+    SSL_CTX_set_max_proto_version(context, TLS1_2_VERSION);
+    SSL_CTX_set_cipher_list(context, CIPHER);
+    if (!tickets)
+    {
+        SSL_CTX_set_options(context, SSL_OP_NO_TICKET);
+    }
+    // the firmware's mqtt_ca_certificate
+    X509_STORE_add_cert(SSL_CTX_get_cert_store(context), broker.certificate);
+    SSL_CTX_set_verify(context, SSL_VERIFY_PEER, nullptr);
+    return context;
+}
+
+// One connection: TCP connect, handshake, CONNECT, CONNACK. Returns the
+// session for the next connection.
+SSL_SESSION *connect_once(SSL_CTX *context, const sockaddr_in &address, SSL_SESSION *session, bool expect_resumed, sample &result)
+{
+    const auto start = std::chrono::steady_clock::now();
+    int socket = ::socket(AF_INET, SOCK_STREAM, 0);
+    set_no_delay(socket);
+    if (connect(socket, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0)
+    {
+        fail("connect failed");
+    }
+    SSL *ssl = SSL_new(context);
+    SSL_set_fd(ssl, socket);
+    SSL_set_tlsext_host_name(ssl, BROKER_NAME);
+    SSL_set1_host(ssl, BROKER_NAME);
+    if (session)
+    {
+        SSL_set_session(ssl, session);
+    }
+    if (SSL_connect(ssl) != 1)
+    {
+        fail("handshake failed");
+    }
+    SSL_write(ssl, CONNECT_PACKET.data(), int(CONNECT_PACKET.size()));
+    std::vector<uint8_t> connack;
+    if (!read_packet(ssl, connack) || !std::equal(connack.begin(), connack.end(), CONNACK_PACKET.begin(), CONNACK_PACKET.end()))
+    {
+        fail("no CONNACK");
+    }
+    result.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    result.bytes_sent = BIO_number_written(SSL_get_wbio(ssl));
+    result.bytes_received = BIO_number_read(SSL_get_rbio(ssl));
+    if (bool(SSL_session_reused(ssl)) != expect_resumed)
+    {
+        fail(expect_resumed ? "session was not resumed" : "unexpected resumption");
+    }
+    SSL_SESSION *next = SSL_get1_session(ssl);
+    SSL_shutdown(ssl);
+    SSL_free(ssl);
+    close(socket);
+    return next;
+}
+
+void report(mode m, std::vector<sample> &samples, double full_median)
+{
+    std::sort(samples.begin(), samples.end(), [](const sample &a, const sample &b) { return a.ms < b.ms; });
+    const sample &median = samples[samples.size() / 2];
+    printf("  %-26s %8.3f %8.3f %8.3f %10lu %10lu",
+        mode_name(m), samples.front().ms, median.ms, samples[samples.size() * 9 / 10].ms,
+        median.bytes_sent, median.bytes_received);
+    if (m != mode::full)
+    {
+        printf("  %5.1fx faster", full_median / median.ms);
+    }
+    printf("\n");
+}
+}// namespace
+
+int main(int argc, char **argv)
+{
+    int count = DEFAULT_COUNT;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--count") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0)
+        {
+            count = atoi(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--count N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    const credentials broker = make_credentials();
+    SSL_CTX *broker_context = make_broker_context(broker);
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (bind(listener, reinterpret_cast<sockaddr *>(&address), length) != 0
+        || listen(listener, 16) != 0
+        || getsockname(listener, reinterpret_cast<sockaddr *>(&address), &length) != 0)
+    {
+        fail("broker socket failed");
+    }
+
+    // per mode one warm-up connection that yields the session to resume
+    constexpr std::array<mode, 3> modes{ mode::full, mode::ticket, mode::session_id };
+    std::thread broker_thread(run_broker, broker_context, listener, int(modes.size()) * (count + 1));
+
+    printf("== MQTT connect over TLS 1.2, %s, %d connections each ==\n", CIPHER, count);
+    printf("  %-26s %8s %8s %8s %10s %10s\n", "", "min [ms]", "med [ms]", "p90 [ms]", "sent [B]", "recv [B]");
+    double full_median = 0.0;
+    for (mode m : modes)
+    {
+        SSL_CTX *context = make_client_context(broker, m != mode::session_id);
+        sample warm_up;
+        SSL_SESSION *session = connect_once(context, address, nullptr, false, warm_up);
+        std::vector<sample> samples(size_t(count), sample{});
+        for (auto &s : samples)
+        {
+            SSL_SESSION *next = connect_once(context, address, m == mode::full ? nullptr : session, m != mode::full, s);
+            SSL_SESSION_free(session);
+            session = next;
+        }
+        SSL_SESSION_free(session);
+        SSL_CTX_free(context);
+        if (m == mode::full)
+        {
+            std::sort(samples.begin(), samples.end(), [](const sample &a, const sample &b) { return a.ms < b.ms; });
+            full_median = samples[samples.size() / 2].ms;
+        }
+        report(m, samples, full_median);
+    }
+
+    broker_thread.join();
+    close(listener);
+    SSL_CTX_free(broker_context);
+    X509_free(broker.certificate);
+    EVP_PKEY_free(broker.key);
+    return 0;
+}
@@ -0,0 +1,124 @@
+// Converts trace dumps of the firmware (src/trace.hpp) to the Chrome
+// trace event format, viewable in chrome://tracing or Perfetto.
+// Lines that are not trace events, e.g. other stdio output, are skipped.
+//
+//   mosquitto_sub -h <broker> -t picoW/trace -N | trace_to_chrome > trace.json
+//
+// Usage: trace_to_chrome [<dump file>]
+//
+// Events go to one track per category (the name up to the first '_'),
+// onewire events to one track per bus, named by its GPIO.
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+
+namespace
+{
+struct track_key
+{
+    std::string category;
+    unsigned argument;
+
+    bool operator<(const track_key &other) const
+    {
+        return category < other.category || (category == other.category && argument < other.argument);
+    }
+};
+
+std::string track_name(const track_key &key)
+{
+    return key.category == "onewire" ? "onewire pin " + std::to_string(key.argument) : key.category;
+}
+
+int convert(std::istream &input)
+{
+    std::map<track_key, int> tracks;
+    uint64_t last_raw = 0;
+    uint64_t unwrapped = 0;
+    bool first_event = true;
+    size_t event_count = 0;
+
+    printf("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    std::string line;
+    while (std::getline(input, line))
+    {
+        if (line.rfind("# trace ", 0) == 0)
+        {
+            // a new dump, time_us_32 may have wrapped arbitrarily often since
+            first_event = true;
+            fprintf(stderr, "%s\n", line.c_str());
+            continue;
+        }
+
+        std::istringstream fields(line);
+        unsigned long timestamp_us;
+        char phase;
+        std::string name;
+        unsigned argument;
+        if (!(fields >> timestamp_us >> phase >> name >> argument) || !strchr("BEI", phase) || timestamp_us > 0xffffffffu)
+        {
+            continue;
+        }
+
+        // time_us_32 wraps after 71 minutes
+        if (first_event)
+        {
+            unwrapped = timestamp_us;
+            first_event = false;
+        }
+        else
+        {
+            unwrapped += uint32_t(timestamp_us - last_raw);
+        }
+        last_raw = timestamp_us;
+
+        track_key key{name.substr(0, name.find('_')), 0};
+        if (key.category == "onewire")
+        {
+            key.argument = argument;
+        }
+        auto [track, inserted] = tracks.emplace(key, int(tracks.size()) + 1);
+        if (inserted)
+        {
+            printf("%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}\n",
+                event_count++ ? "," : "",
+                track->second,
+                track_name(key).c_str());
+        }
+        printf("%s{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%llu,\"pid\":1,\"tid\":%d,\"args\":{\"argument\":%u}}\n",
+            event_count++ ? "," : "",
+            name.c_str(),
+            phase == 'I' ? "i\",\"s\":\"t" : phase == 'B' ? "B" : "E",
+            (unsigned long long)unwrapped,
+            track->second,
+            argument);
+    }
+    printf("]}\n");
+    return 0;
+}
+}// namespace
+
+int main(int argc, char **argv)
+{
+    if (argc > 2)
+    {
+        fprintf(stderr, "usage: %s [<dump file>]\n", argv[0]);
+        return 2;
+    }
+    if (argc == 2)
+    {
+        std::ifstream file(argv[1]);
+        if (!file)
+        {
+            fprintf(stderr, "cannot open %s\n", argv[1]);
+            return 1;
+        }
+        return convert(file);
+    }
+    return convert(std::cin);
+}
@@ -0,0 +1,215 @@
+// Checks the codec of the state the firmware keeps across a watchdog
+// reset (src/warm_state.cpp): round trips, the rejection of damaged or
+// foreign images and the dropping of unsent messages that do not fit.
+//
+// Usage: warm_state_check [--benchmark]
+
+#include <warm_state.hpp>
+
+#include <check.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <optional>
+#include <random>
+#include <vector>
+
+namespace
+{
+/* The region of the firmware, see main.cpp */
+constexpr const size_t REGION_SIZE = 16 * 1024;
+
+warm_state::state make_state(size_t buses, size_t devices_per_bus, size_t messages, size_t message_size, uint64_t seed)
+{
+    std::mt19937_64 random(seed);
+    warm_state::state result;
+    result.restarts = 1;
+    result.sequence = uint32_t(random());
+    result.resolution = 11;
+    result.broker_address = 0x0a01a8c0; // 192.168.1.10
+    result.buses.resize(buses);
+    for (auto &bus : result.buses)
+    {
+        for (size_t i = 0; i < devices_per_bus; i++)
+        {
+            bus.push_back({ 0x28 | (random() << 8), bool(random() & 1), int8_t(-10 - int(i % 40)), int8_t(30 + int(i % 90)) });
+        }
+    }
+    for (size_t m = 0; m < messages; m++)
+    {
+        std::vector<uint8_t> message(message_size - m % 7);
+        for (auto &byte : message)
+        {
+            byte = uint8_t(random());
+        }
+        result.unsent.push_back(std::move(message));
+    }
+    return result;
+}
+
+using host_check::check;
+
+void benchmark()
+{
+    printf("== save/load of a full region (host time) ==\n");
+    printf("  %8s %10s %12s %12s\n", "devices", "bytes", "save [us]", "load [us]");
+    std::vector<uint8_t> region(REGION_SIZE);
+    for (size_t devices : { 10, 100, 500 })
+    {
+        const auto saved = make_state(4, devices / 4, 32, 600, devices);
+        constexpr int rounds = 200;
+        size_t size = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < rounds; i++)
+        {
+            size = warm_state::save(saved, region);
+        }
+        const double save_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / rounds;
+        start = std::chrono::steady_clock::now();
+        bool ok = true;
+        for (int i = 0; i < rounds; i++)
+        {
+            ok = warm_state::load(region).has_value() && ok;
+        }
+        const double load_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / rounds;
+        printf("  %8zu %10zu %12.1f %12.1f%s\n", devices, size, save_us, load_us, ok ? "" : " load FAILED");
+    }
+    printf("\n");
+}
+}// namespace
+
+int main(int argc, char **argv)
+{
+    bool run_benchmark = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--benchmark") == 0)
+        {
+            run_benchmark = true;
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--benchmark]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    bool ok = true;
+    printf("== warm_state codec ==\n");
+
+    ok = check("crc32 check value", [] {
+        const char *text = "123456789";
+        return warm_state::crc32({ reinterpret_cast<const uint8_t *>(text), 9 }) == 0xcbf43926;
+    }) && ok;
+
+    ok = check("round trip", [] {
+        std::vector<uint8_t> region(REGION_SIZE);
+        const auto saved = make_state(3, 20, 5, 300, 1);
+        const size_t size = warm_state::save(saved, region);
+        const auto loaded = warm_state::load(region);
+        return size > 0 && loaded && *loaded == saved;
+    }) && ok;
+
+    ok = check("round trip, no buses and no messages", [] {
+        std::vector<uint8_t> region(REGION_SIZE);
+        const warm_state::state saved;
+        const auto loaded = warm_state::save(saved, region) > 0 ? warm_state::load(region) : std::nullopt;
+        return loaded && *loaded == saved;
+    }) && ok;
+
+    ok = check("round trip, empty buses and messages", [] {
+        std::vector<uint8_t> region(REGION_SIZE);
+        auto saved = make_state(4, 0, 0, 0, 2);
+        saved.unsent.emplace_back();
+        const auto loaded = warm_state::save(saved, region) > 0 ? warm_state::load(region) : std::nullopt;
+        return loaded && *loaded == saved;
+    }) && ok;
+
+    ok = check("uninitialized RAM is rejected", [] {
+        std::mt19937 random(3);
+        bool rejected = true;
+        std::vector<uint8_t> region(REGION_SIZE);
+        for (int round = 0; round < 100; round++)
+        {
+            for (auto &byte : region)
+            {
+                byte = uint8_t(random());
+            }
+            rejected = !warm_state::load(region) && rejected;
+        }
+        std::fill(region.begin(), region.end(), 0);
+        return rejected && !warm_state::load(region);
+    }) && ok;
+
+    ok = check("every single bit error is rejected", [] {
+        std::vector<uint8_t> region(REGION_SIZE);
+        const size_t size = warm_state::save(make_state(2, 8, 3, 40, 4), region);
+        bool rejected = size > 0;
+        for (size_t bit = 0; bit < size * 8; bit++)
+        {
+            region[bit / 8] ^= uint8_t(1 << (bit % 8));
+            rejected = !warm_state::load(region) && rejected;
+            region[bit / 8] ^= uint8_t(1 << (bit % 8));
+        }
+        return rejected && warm_state::load(region);
+    }) && ok;
+
+    ok = check("other version is rejected", [] {
+        std::vector<uint8_t> region(REGION_SIZE);
+        warm_state::save(make_state(1, 4, 1, 20, 5), region);
+        region[4] ^= 0x02;
+        return !warm_state::load(region);
+    }) && ok;
+
+    ok = check("image longer than the region is rejected", [] {
+        std::vector<uint8_t> region(REGION_SIZE);
+        const size_t size = warm_state::save(make_state(2, 10, 2, 100, 6), region);
+        return size > 0 && !warm_state::load(std::span<const uint8_t>(region).first(size - 1))
+            && warm_state::load(std::span<const uint8_t>(region).first(size));
+    }) && ok;
+
+    ok = check("invalidated region is rejected", [] {
+        std::vector<uint8_t> region(REGION_SIZE);
+        warm_state::save(make_state(1, 4, 1, 20, 7), region);
+        warm_state::invalidate(region);
+        return !warm_state::load(region);
+    }) && ok;
+
+    ok = check("oldest unsent messages are dropped", [] {
+        // room for the tables and some of the 40 messages of about 600 bytes
+        std::vector<uint8_t> region(8 * 1024);
+        const auto saved = make_state(2, 30, 40, 600, 8);
+        const auto loaded = warm_state::save(saved, region) > 0 ? warm_state::load(region) : std::nullopt;
+        if (!loaded || loaded->buses != saved.buses || loaded->unsent.empty() || loaded->unsent.size() >= saved.unsent.size())
+        {
+            return false;
+        }
+        const size_t dropped = saved.unsent.size() - loaded->unsent.size();
+        return std::equal(loaded->unsent.begin(), loaded->unsent.end(), saved.unsent.begin() + dropped);
+    }) && ok;
+
+    ok = check("a message larger than the region is dropped", [] {
+        std::vector<uint8_t> region(1024);
+        auto saved = make_state(1, 2, 0, 0, 9);
+        saved.unsent.emplace_back(2048, 0x55);
+        saved.unsent.emplace_back(16, 0xaa);
+        const auto loaded = warm_state::save(saved, region) > 0 ? warm_state::load(region) : std::nullopt;
+        return loaded && loaded->unsent.size() == 1 && loaded->unsent.front() == saved.unsent.back();
+    }) && ok;
+
+    ok = check("tables too large invalidate the region", [] {
+        std::vector<uint8_t> region(1024);
+        warm_state::save(make_state(1, 4, 0, 0, 10), region);
+        return warm_state::save(make_state(4, 50, 0, 0, 10), region) == 0 && !warm_state::load(region);
+    }) && ok;
+    printf("\n");
+
+    if (run_benchmark)
+    {
+        benchmark();
+    }
+
+    return host_check::finish(ok);
+}